@@ -0,0 +1,444 @@
+#include "../include/calculate.h"
+#include "../include/collector.h"
+#include "../include/config.h"
+#include "../include/filter.h"
+#include "../include/history.h"
+#include "../include/parser.h"
+#include "../include/recording.h"
+#include "../include/snapshot.h"
+#include "../include/timing.h"
+#include "../include/wire.h"
+#include "fixture.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DEFAULT_SIZES "100,1000,10000,100000"
+#define DEFAULT_CORES 64
+#define DEFAULT_TICKS 5
+#define DEFAULT_SORT_DEPTH 100
+#define MICRO_ITERATIONS 200000
+
+typedef struct {
+  const char *sizes;
+  int num_cores;
+  int ticks;
+  int threads;
+  int sort_depth;
+  int read_io;
+  int cold_interval;
+  int tree;
+} BenchOptions;
+
+static SnapshotExchange exchange;
+
+static double ms(unsigned long long ns) { return (double)ns / 1e6; }
+
+static char *read_fixture(const char *root, const char *name) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s", root, name);
+  return read_file_dynamically(path);
+}
+
+// The sscanf parser pidParser replaced, kept as a baseline for its timing.
+// Its format is one field off after the state column, as it always was.
+static int sscanf_pid_parser(const char *input, pidStats *stats) {
+  int read_count =
+      sscanf(input,
+             "%d (%255[^)]) %c %*s %*s %*s %*s %*s %*s %*s %*s %*s "
+             "%lu %lu %*s %*s %*s %*s %*s %*s %*s %ld %ld",
+             &stats->pid, stats->comm, &stats->state, &stats->utime,
+             &stats->stime, &stats->vsize, &stats->rss_kb);
+  return read_count == 7;
+}
+
+static void bench_parsers(const char *root) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%d/stat", root, fixture_pid(10));
+  char *pid_line = read_file_dynamically(path);
+  char *cpu_text = read_fixture(root, "stat");
+  char *mem_text = read_fixture(root, "meminfo");
+  char *net_text = read_fixture(root, "net/dev");
+  if (!pid_line || !cpu_text || !mem_text || !net_text) {
+    free(pid_line);
+    free(cpu_text);
+    free(mem_text);
+    free(net_text);
+    return;
+  }
+
+  size_t pid_len = strlen(pid_line);
+  size_t mem_len = strlen(mem_text) + 1;
+  char *scratch = malloc(mem_len);
+  int entries = cpuEntryCount(cpu_text);
+  cpuStats prev = {0}, curr = {0};
+  cpuStatsReserve(&prev, entries);
+  cpuStatsReserve(&curr, entries);
+  int padded = cpu_lanes_round(entries);
+  double *usage_block = calloc((size_t)padded * 5, sizeof(double));
+  CpuUsage usage = {usage_block, usage_block + padded,
+                    usage_block + 2 * padded, usage_block + 3 * padded,
+                    usage_block + 4 * padded};
+  int net_entries = netEntryCount(net_text);
+  netStat *nets = calloc(net_entries, sizeof(netStat));
+  pidStats stats;
+  memStats mem;
+  volatile unsigned long sink = 0;
+  unsigned long long started;
+  int iterations = MICRO_ITERATIONS;
+  int cpu_iterations = iterations / (entries > 0 ? entries : 1) + 1;
+
+  started = now_ns();
+  for (int i = 0; i < iterations; ++i) {
+    pidParser(pid_line, pid_len, &stats);
+    sink += stats.utime;
+  }
+  double parser_ns = (double)(now_ns() - started) / iterations;
+  printf("  pidParser   %9.1f ns/record\n", parser_ns);
+
+  started = now_ns();
+  for (int i = 0; i < iterations; ++i) {
+    sscanf_pid_parser(pid_line, &stats);
+    sink += stats.utime;
+  }
+  double sscanf_ns = (double)(now_ns() - started) / iterations;
+  printf("  sscanf      %9.1f ns/record (%.1fx pidParser)\n", sscanf_ns,
+         parser_ns > 0 ? sscanf_ns / parser_ns : 0.0);
+
+  started = now_ns();
+  for (int i = 0; i < cpu_iterations; ++i) {
+    cpuParser(cpu_text, &curr, entries);
+    sink += curr.field[CPU_USER][0];
+  }
+  printf("  cpuParser   %9.1f us/file (%d entries)\n",
+         (double)(now_ns() - started) / cpu_iterations / 1e3, entries);
+
+  // memParser tokenizes in place, so each run gets a fresh copy.
+  started = now_ns();
+  for (int i = 0; i < iterations / 10; ++i) {
+    memcpy(scratch, mem_text, mem_len);
+    memParser(scratch, &mem);
+    sink += mem.memTotal;
+  }
+  printf("  memParser   %9.1f ns/file\n",
+         (double)(now_ns() - started) / (iterations / 10));
+
+  int net_iterations = iterations / (net_entries > 0 ? net_entries : 1) + 1;
+  started = now_ns();
+  for (int i = 0; i < net_iterations; ++i) {
+    netParser(net_text, nets, net_entries);
+    sink += nets[0].rx_bytes;
+  }
+  printf("  netParser   %9.1f us/file (%d interfaces)\n",
+         (double)(now_ns() - started) / net_iterations / 1e3, net_entries);
+
+  updateCpuState(&prev, &curr, entries);
+  for (int i = 0; i < entries; ++i)
+    curr.field[CPU_USER][i] += 100;
+  started = now_ns();
+  for (int i = 0; i < cpu_iterations; ++i) {
+    cpuUsage(&prev, &curr, &usage, entries);
+    sink += (unsigned long)usage.usage[0];
+  }
+  printf("  cpuUsage    %9.1f ns/call (%d entries)\n",
+         (double)(now_ns() - started) / cpu_iterations, entries);
+
+  // Enough one-second ticks to wrap every tier, so the rollups are
+  // included.
+  History history;
+  if (history_init(&history, entries, 1000)) {
+    int history_iterations = 100000;
+    started = now_ns();
+    for (int i = 0; i < history_iterations; ++i)
+      history_record(&history, 1000ULL * (i + 1), usage.usage, entries, &mem);
+    printf("  history     %9.1f ns/tick (%d series)\n",
+           (double)(now_ns() - started) / history_iterations,
+           history.num_series);
+    history_destroy(&history);
+  }
+
+  free(nets);
+  free(net_text);
+  free(usage_block);
+  cpuStatsFree(&curr);
+  cpuStatsFree(&prev);
+  free(scratch);
+  free(pid_line);
+  free(cpu_text);
+  free(mem_text);
+}
+
+// Types queries one key at a time against the published rows, the way the
+// UI applies them. The fixture only has a dozen distinct names, so each row
+// gets a numbered one to give the index something to sift through.
+static void bench_filter(const ProcessInfo *published, int num_rows) {
+  ProcessInfo *rows = malloc(sizeof(ProcessInfo) * (num_rows + 1));
+  FilterIndex filter;
+  if (!rows || !filter_init(&filter)) {
+    free(rows);
+    return;
+  }
+  memcpy(rows, published, sizeof(ProcessInfo) * num_rows);
+  for (int i = 0; i < num_rows; ++i) {
+    char name[sizeof(rows[i].stats.comm)];
+    snprintf(name, sizeof(name), "%.200s-%d", rows[i].stats.comm, i % 5000);
+    memcpy(rows[i].stats.comm, name, sizeof(name));
+  }
+
+  unsigned long long started = now_ns();
+  filter_sync(&filter, rows, num_rows, 1);
+  unsigned long long first_sync = now_ns() - started;
+  started = now_ns();
+  filter_sync(&filter, rows, num_rows, 2);
+  unsigned long long sync = now_ns() - started;
+
+  static const char *queries[] = {"containerd-shim-42", "1234", "~jva"};
+  unsigned long long worst = 0, total = 0;
+  int keystrokes = 0, matches = 0;
+  for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); ++q) {
+    char typed[FILTER_QUERY_MAX] = {0};
+    filter_reset(&filter);
+    for (size_t k = 0; queries[q][k]; ++k) {
+      typed[k] = queries[q][k];
+      started = now_ns();
+      matches = filter_apply(&filter, typed);
+      unsigned long long elapsed = now_ns() - started;
+      total += elapsed;
+      if (elapsed > worst)
+        worst = elapsed;
+      keystrokes++;
+    }
+  }
+  printf("  filter      %9.1f us/keystroke (worst %.1f us, sync %.3f ms, "
+         "first %.3f ms, %d names, %d matches)\n",
+         (double)total / keystrokes / 1e3, (double)worst / 1e3, ms(sync),
+         ms(first_sync), filter.num_names, matches);
+  filter_destroy(&filter);
+  free(rows);
+}
+
+static int bench_size(const BenchOptions *options, int num_procs) {
+  char root[] = "/tmp/pulse-bench-XXXXXX";
+  if (!mkdtemp(root)) {
+    perror("mkdtemp");
+    return 0;
+  }
+
+  unsigned long long started = now_ns();
+  if (!fixture_write(root, num_procs, options->num_cores, 0)) {
+    perror("fixture_write");
+    fixture_remove(root);
+    return 0;
+  }
+  printf("\n%d processes, %d cores (fixture built in %.0f ms)\n", num_procs,
+         options->num_cores, ms(now_ns() - started));
+
+  PulseConfig config;
+  config_defaults(&config);
+  config.proc_root = root;
+  config.collector_threads = options->threads;
+  config.cold_interval = options->cold_interval;
+
+  Collector collector;
+  if (!collector_init(&collector, &config)) {
+    fprintf(stderr, "collector_init failed for %s\n", root);
+    fixture_remove(root);
+    return 0;
+  }
+
+  unsigned long long totals[STAGE_COUNT] = {0};
+  unsigned long long worst_tick = 0, all_ticks = 0;
+  int published = 0;
+  long long sampled = 0;
+  int last_sampled = 0;
+  // What an agent would send: a keyframe after the first tick, then deltas.
+  WireState wire[2];
+  wire_state_init(&wire[0]);
+  wire_state_init(&wire[1]);
+  OutBuf frame;
+  outbuf_init(&frame);
+  size_t keyframe_bytes = 0, delta_bytes = 0;
+  unsigned long long wire_ns = 0;
+  // And what --record adds to a tick, mapped file writes included.
+  char record_path[] = "/tmp/pulse-bench-rec-XXXXXX";
+  int record_fd = mkstemp(record_path);
+  Recorder recorder;
+  int recording = record_fd >= 0 && recorder_init(&recorder, record_path) &&
+                  recorder_start(&recorder);
+  if (record_fd >= 0)
+    close(record_fd);
+  unsigned long long record_ns = 0;
+  for (int tick = 1; tick <= options->ticks; ++tick) {
+    fixture_write(root, num_procs, options->num_cores, tick);
+    started = now_ns();
+    CollectorView view = {.sort_column = SORT_CPU,
+                          .sort_depth = options->sort_depth,
+                          .show_io = options->read_io,
+                          .show_tree = options->tree,
+                          .timed = 1};
+    Snapshot *back = snapshot_back(&exchange);
+    int ticked = collector_tick(&collector, back, &view);
+    unsigned long long elapsed = now_ns() - started;
+    if (ticked) {
+      started = now_ns();
+      WireState *curr = &wire[tick % 2];
+      outbuf_reset(&frame);
+      if (wire_capture(curr, back))
+        wire_encode(&frame, tick > 1 ? &wire[(tick + 1) % 2] : NULL, curr);
+      wire_ns += now_ns() - started;
+      if (recording) {
+        started = now_ns();
+        recorder_update(&recorder, back);
+        record_ns += now_ns() - started;
+      }
+      if (tick > 1)
+        delta_bytes += frame.len;
+      else
+        keyframe_bytes = frame.len;
+      started = now_ns();
+      collector_publish(&collector, &exchange);
+      published = snapshot_acquire(&exchange, NULL)->num_processes;
+      elapsed += now_ns() - started;
+    }
+    all_ticks += elapsed;
+    if (elapsed > worst_tick)
+      worst_tick = elapsed;
+    for (int s = 0; s < STAGE_COUNT; ++s)
+      totals[s] += collector.stage_ns[s];
+    last_sampled = collector.scanner.sampled;
+    sampled += last_sampled;
+  }
+
+  printf("  %-10s %10s %10s %10s\n", "stage", "ms/tick", "p50", "p99");
+  for (int s = 0; s < STAGE_COUNT; ++s) {
+    const LatencyHistogram *latency = &collector.self.stages[s];
+    printf("  %-10s %10.3f %10.3f %10.3f\n", collector_stage_names[s],
+           ms(totals[s]) / options->ticks, latency_percentile(latency, 0.5),
+           latency_percentile(latency, 0.99));
+  }
+  printf("  %-10s %10.3f (worst %.3f, %d processes published)\n", "tick",
+         ms(all_ticks) / options->ticks, ms(worst_tick), published);
+  printf("  %-10s %10.1f ns/process\n", "per-proc",
+         num_procs > 0 ? (double)all_ticks / options->ticks / num_procs : 0);
+  printf("  %-10s %10.1f stat reads/tick (last tick %d)\n", "sampled",
+         (double)sampled / options->ticks, last_sampled);
+  printf("  %-10s %10.3f ms/tick (keyframe %zu bytes, %.0f bytes/delta)\n",
+         "wire", ms(wire_ns) / options->ticks, keyframe_bytes,
+         options->ticks > 1 ? (double)delta_bytes / (options->ticks - 1) : 0);
+  if (recording) {
+    recorder_destroy(&recorder);
+    struct stat st;
+    printf("  %-10s %10.3f ms/tick (%.1f%% of a tick, %.0f bytes/tick)\n",
+           "record", ms(record_ns) / options->ticks,
+           all_ticks ? 100.0 * record_ns / all_ticks : 0,
+           stat(record_path, &st) == 0 ? (double)st.st_size / options->ticks
+                                       : 0);
+  }
+  if (record_fd >= 0)
+    unlink(record_path);
+  wire_state_destroy(&wire[0]);
+  wire_state_destroy(&wire[1]);
+  outbuf_free(&frame);
+
+  bench_parsers(root);
+  const Snapshot *snapshot = snapshot_acquire(&exchange, NULL);
+  bench_filter(snapshot->processed_list, snapshot->num_processes);
+
+  collector_destroy(&collector);
+  fixture_remove(root);
+  return 1;
+}
+
+static void print_usage(const char *prog) {
+  printf("Usage: %s [options]\n"
+         "  -s, --sizes LIST   comma separated process counts "
+         "(default: " DEFAULT_SIZES ")\n"
+         "  -c, --cores N      cores in the synthetic /proc/stat "
+         "(default: %d)\n"
+         "  -t, --ticks N      collector ticks per size (default: %d)\n"
+         "  -j, --threads N    collector threads (default: 1)\n"
+         "  -k, --top K        rows kept sorted, 0 for a full sort "
+         "(default: %d)\n"
+         "  -i, --io           also read /proc/<pid>/io every tick\n"
+         "  -C, --cold-interval N  re-read idle processes every N ticks "
+         "(default: 10)\n"
+         "  -T, --tree         lay processes out as a tree\n",
+         prog, DEFAULT_CORES, DEFAULT_TICKS, DEFAULT_SORT_DEPTH);
+}
+
+int main(int argc, char **argv) {
+  BenchOptions options = {DEFAULT_SIZES, DEFAULT_CORES, DEFAULT_TICKS, 1,
+                          DEFAULT_SORT_DEPTH, 0, 10, 0};
+  static const struct option long_options[] = {
+      {"sizes", required_argument, NULL, 's'},
+      {"cores", required_argument, NULL, 'c'},
+      {"ticks", required_argument, NULL, 't'},
+      {"threads", required_argument, NULL, 'j'},
+      {"top", required_argument, NULL, 'k'},
+      {"io", no_argument, NULL, 'i'},
+      {"cold-interval", required_argument, NULL, 'C'},
+      {"tree", no_argument, NULL, 'T'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "s:c:t:j:k:iC:Th", long_options,
+                            NULL)) != -1) {
+    switch (opt) {
+    case 's':
+      options.sizes = optarg;
+      break;
+    case 'c':
+      options.num_cores = atoi(optarg);
+      break;
+    case 't':
+      options.ticks = atoi(optarg);
+      break;
+    case 'j':
+      options.threads = atoi(optarg);
+      break;
+    case 'k':
+      options.sort_depth = atoi(optarg);
+      break;
+    case 'i':
+      options.read_io = 1;
+      break;
+    case 'C':
+      options.cold_interval = atoi(optarg);
+      break;
+    case 'T':
+      options.tree = 1;
+      break;
+    case 'h':
+      print_usage(argv[0]);
+      return 0;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (options.num_cores < 1 || options.ticks < 1 || options.threads < 1 ||
+      options.cold_interval < 1) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  snapshot_init(&exchange);
+  printf("Pulse collector benchmark: %d ticks per size, %d thread(s)\n",
+         options.ticks, options.threads);
+
+  char *sizes = strdup(options.sizes);
+  int status = 0;
+  for (char *save = NULL, *token = strtok_r(sizes, ",", &save); token;
+       token = strtok_r(NULL, ",", &save)) {
+    int num_procs = atoi(token);
+    if (num_procs > 0 && !bench_size(&options, num_procs))
+      status = 1;
+  }
+  free(sizes);
+  snapshot_destroy(&exchange);
+  return status;
+}
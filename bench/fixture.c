@@ -0,0 +1,217 @@
+#define _XOPEN_SOURCE 700
+#include "fixture.h"
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *const fixture_comms[] = {
+    "systemd", "kworker/3:1-events", "bash", "sshd", "cc1plus", "java",
+    "envoy", "python3", "Web Content", "tmux: server", "weird) (name",
+    "containerd-shim",
+};
+
+#define FIXTURE_NET_IFACES 300
+
+// PIDs are spread out the way a long-running host would leave them.
+int fixture_pid(int index) { return 1 + index * 3; }
+
+static int write_file(const char *path, const char *data, size_t len) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return 0;
+  int ok = write(fd, data, len) == (ssize_t)len;
+  close(fd);
+  return ok;
+}
+
+// Roughly one process in ten is busy; the rest never accumulate ticks. A
+// busy one gains 3 * busy ticks of utime and `busy` of stime per tick.
+static unsigned long pid_busy(int index) {
+  return (index % 10 == 0) ? (unsigned long)(index % 97) : 0;
+}
+
+// The user and system time is exactly what the processes' stat files add
+// up to, spread over the cores, as it would be on a host whose processes
+// all live as long as the run.
+static int write_cpu_stat(const char *root, int num_procs, int num_cores,
+                          unsigned int tick) {
+  char path[4096];
+  static char buffer[1 << 20];
+  size_t len = 0;
+  unsigned long long per_tick = 0;
+  for (int i = 0; i < num_procs; ++i)
+    per_tick += pid_busy(i);
+  unsigned long long user = per_tick * 3 * tick, system = per_tick * tick;
+  // Half of the time idle, and a VM whose host takes some steal time.
+  unsigned long long idle = 100000ULL * num_cores + user + system;
+  unsigned long long steal = (user + system) / 8;
+
+  len += snprintf(buffer + len, sizeof(buffer) - len,
+                  "cpu  %llu 0 %llu %llu 50 0 20 %llu 0 0\n", user, system,
+                  idle, steal);
+  for (int i = 0; i < num_cores && len < sizeof(buffer) - 128; ++i) {
+    // cpu0 takes the remainders so the cores add up to the aggregate.
+    int first = i == 0;
+    len += snprintf(
+        buffer + len, sizeof(buffer) - len,
+        "cpu%d %llu 0 %llu %llu 50 0 20 %llu 0 0\n", i,
+        user / num_cores + (first ? user % num_cores : 0),
+        system / num_cores + (first ? system % num_cores : 0),
+        idle / num_cores + (first ? idle % num_cores : 0),
+        steal / num_cores + (first ? steal % num_cores : 0));
+  }
+  len += snprintf(buffer + len, sizeof(buffer) - len,
+                  "intr 0\nctxt 0\nbtime 0\nprocesses %u\n"
+                  "procs_running 1\nprocs_blocked 0\n",
+                  tick);
+  snprintf(path, sizeof(path), "%s/stat", root);
+  return write_file(path, buffer, len);
+}
+
+static int write_meminfo(const char *root) {
+  static const char meminfo[] = "MemTotal:       65536000 kB\n"
+                                "MemFree:        12000000 kB\n"
+                                "MemAvailable:   40000000 kB\n"
+                                "Buffers:          500000 kB\n"
+                                "Cached:         20000000 kB\n"
+                                "SwapTotal:       8000000 kB\n"
+                                "SwapFree:        7500000 kB\n";
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/meminfo", root);
+  return write_file(path, meminfo, sizeof(meminfo) - 1);
+}
+
+static int write_pid_stat(const char *root, int index, int num_cores,
+                          unsigned int tick) {
+  char path[4096], line[512];
+  int pid = fixture_pid(index);
+  const char *comm =
+      fixture_comms[index % (sizeof(fixture_comms) / sizeof(*fixture_comms))];
+  unsigned long busy = pid_busy(index);
+  unsigned long utime = 100 + busy * tick * 3;
+  unsigned long stime = 50 + busy * tick;
+
+  int len = snprintf(
+      line, sizeof(line),
+      "%d (%s) S %d %d %d 0 -1 4194560 %lu 0 %d 0 %lu %lu 0 0 20 0 %d 0 "
+      "%d %lu %ld 18446744073709551615 94000000000000 94000000100000 "
+      "140700000000000 0 0 0 0 4096 17663 0 0 0 17 %d 0 0 0 0 0 "
+      "94000000200000 94000000210000 94000001000000 140700000001000 "
+      "140700000001100 140700000001100 140700000002000 0\n",
+      pid, comm, index > 0 ? fixture_pid(index / 8) : 0, pid, pid,
+      1000 + busy * tick, index % 5, utime, stime, 1 + index % 16,
+      1000 + index, 10000000UL + (unsigned long)index * 4096,
+      (long)(1000 + index % 50000), index % num_cores);
+
+  snprintf(path, sizeof(path), "%s/%d", root, pid);
+  if (tick == 0 && mkdir(path, 0755) != 0)
+    return 0;
+  snprintf(path, sizeof(path), "%s/%d/stat", root, pid);
+  if (!write_file(path, line, len))
+    return 0;
+
+  unsigned long long io = (unsigned long long)busy * tick * 4096;
+  len = snprintf(line, sizeof(line),
+                 "rchar: %llu\nwchar: %llu\nsyscr: %llu\nsyscw: %llu\n"
+                 "read_bytes: %llu\nwrite_bytes: %llu\n"
+                 "cancelled_write_bytes: 0\n",
+                 io * 2, io, io / 512, io / 1024, io, io / 2);
+  snprintf(path, sizeof(path), "%s/%d/io", root, pid);
+  return write_file(path, line, len);
+}
+
+static int write_diskstats(const char *root, unsigned int tick) {
+  char path[4096], buffer[1024];
+  unsigned long long t = tick;
+  int len = snprintf(
+      buffer, sizeof(buffer),
+      " 259       0 nvme0n1 %llu 10 %llu 400 %llu 20 %llu 800 0 %llu 1200 0 "
+      "0 0 0\n"
+      " 259       1 nvme0n1p1 %llu 10 %llu 400 %llu 20 %llu 800 0 %llu 1200 "
+      "0 0 0 0\n"
+      "   7       0 loop0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+      1000 + t * 50, 80000 + t * 4000, 2000 + t * 30, 160000 + t * 2000,
+      5000 + t * 100, 500 + t * 25, 40000 + t * 2000, 1000 + t * 15,
+      80000 + t * 1000, 2500 + t * 50);
+  snprintf(path, sizeof(path), "%s/diskstats", root);
+  return write_file(path, buffer, len);
+}
+
+// A container host: eth0, lo and a few hundred veths.
+static int write_net(const char *root, unsigned int tick) {
+  char path[4096];
+  static char buffer[1 << 16];
+  size_t len = 0;
+  unsigned long long t = tick;
+
+  if (tick == 0) {
+    snprintf(path, sizeof(path), "%s/net", root);
+    if (mkdir(path, 0755) != 0)
+      return 0;
+  }
+  len += snprintf(buffer + len, sizeof(buffer) - len,
+                  "Inter-|   Receive                                        "
+                  "        |  Transmit\n"
+                  " face |bytes    packets errs drop fifo frame compressed "
+                  "multicast|bytes    packets errs drop fifo colls carrier "
+                  "compressed\n");
+  for (int i = 0; i < FIXTURE_NET_IFACES && len < sizeof(buffer) - 256; ++i) {
+    char name[16];
+    if (i == 0)
+      snprintf(name, sizeof(name), "lo");
+    else if (i == 1)
+      snprintf(name, sizeof(name), "eth0");
+    else
+      snprintf(name, sizeof(name), "veth%05x", i * 2654435761u & 0xfffff);
+    unsigned long long busy = (i % 7 == 1) ? (unsigned long long)i : 0;
+    len += snprintf(buffer + len, sizeof(buffer) - len,
+                    "%6s: %llu %llu 0 %llu 0 0 0 0 %llu %llu 0 0 0 0 0 0\n",
+                    name, 100000 + busy * t * 15000, 100 + busy * t * 10,
+                    busy * t / 100, 50000 + busy * t * 9000,
+                    80 + busy * t * 8);
+  }
+  snprintf(path, sizeof(path), "%s/net/dev", root);
+  if (!write_file(path, buffer, len))
+    return 0;
+
+  len = snprintf(buffer, sizeof(buffer),
+                 "Tcp: RtoAlgorithm RtoMin RtoMax MaxConn ActiveOpens "
+                 "PassiveOpens AttemptFails EstabResets CurrEstab InSegs "
+                 "OutSegs RetransSegs InErrs OutRsts InCsumErrors\n"
+                 "Tcp: 1 200 120000 -1 100 200 3 4 12 %llu %llu %llu 0 7 0\n",
+                 1000 + t * 500, 900 + t * 450, 10 + t * 2);
+  snprintf(path, sizeof(path), "%s/net/snmp", root);
+  return write_file(path, buffer, len);
+}
+
+// Writes a procfs-shaped tree under `root`. Tick 0 creates it; later ticks
+// rewrite the counters in place so cached fds observe the new values.
+int fixture_write(const char *root, int num_procs, int num_cores,
+                  unsigned int tick) {
+  if (num_cores < 1)
+    num_cores = 1;
+  if (!write_cpu_stat(root, num_procs, num_cores, tick) ||
+      !write_meminfo(root) || !write_diskstats(root, tick) ||
+      !write_net(root, tick))
+    return 0;
+  for (int i = 0; i < num_procs; ++i) {
+    if (!write_pid_stat(root, i, num_cores, tick))
+      return 0;
+  }
+  return 1;
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int type,
+                        struct FTW *ftw) {
+  (void)sb;
+  (void)type;
+  (void)ftw;
+  return remove(path);
+}
+
+int fixture_remove(const char *root) {
+  return nftw(root, remove_entry, 64, FTW_DEPTH | FTW_PHYS) == 0;
+}
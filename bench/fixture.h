@@ -0,0 +1,11 @@
+#ifndef FIXTURE_H
+#define FIXTURE_H
+
+int fixture_pid(int index);
+
+int fixture_write(const char *root, int num_procs, int num_cores,
+                  unsigned int tick);
+
+int fixture_remove(const char *root);
+
+#endif
@@ -0,0 +1,25 @@
+#include "fixture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    fprintf(stderr, "Usage: %s DIR NUM_PROCS NUM_CORES [TICK]\n", argv[0]);
+    return 1;
+  }
+  const char *root = argv[1];
+  int num_procs = atoi(argv[2]);
+  int num_cores = atoi(argv[3]);
+  unsigned int tick = argc > 4 ? (unsigned int)atoi(argv[4]) : 0;
+
+  if (tick == 0 && mkdir(root, 0755) != 0) {
+    perror(root);
+    return 1;
+  }
+  if (!fixture_write(root, num_procs, num_cores, tick)) {
+    perror("fixture_write");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef AGENT_H
+#define AGENT_H
+
+#include "outbuf.h"
+#include "snapshot.h"
+#include "wire.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define AGENT_MAX_CLIENTS 64
+
+// A connected viewer. Frames queue up in `out` until the socket takes
+// them; `synced` is set once the client has been sent a keyframe and can
+// follow deltas.
+typedef struct {
+  int fd;
+  int synced;
+  OutBuf out;
+  size_t sent;
+} AgentClient;
+
+// Serves samples to viewers (pulse --connect) as wire frames. The collector
+// thread encodes each tick once, as a delta from the tick before and, when
+// a new viewer is waiting, as a keyframe; both are handed to the server
+// thread under `lock` and copied to every client from there. While nobody
+// is connected nothing is encoded at all.
+typedef struct {
+  int listen_fd;
+  int stop_fd;
+  int ready_fd;
+  char *unix_path;
+  char host[64];
+  pthread_t thread;
+  int thread_started;
+  // Collector thread: the last two samples and the frames being built.
+  WireState states[2];
+  int current;
+  int have_sample;
+  OutBuf staging_delta;
+  OutBuf staging_keyframe;
+  atomic_int want_keyframe;
+  // Written by the server thread, read by the collector.
+  atomic_int num_clients;
+  // Handed over under the lock; `sequence` counts hand-overs so the server
+  // can tell when it missed one.
+  pthread_mutex_t lock;
+  OutBuf delta;
+  OutBuf keyframe;
+  int has_delta;
+  int has_keyframe;
+  unsigned long sequence;
+  // Server thread only.
+  unsigned long delivered;
+  AgentClient clients[AGENT_MAX_CLIENTS];
+} Agent;
+
+int agent_init(Agent *agent, const char *address);
+
+int agent_start(Agent *agent);
+
+void agent_update(Agent *agent, const Snapshot *snapshot);
+
+void agent_destroy(Agent *agent);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct ArenaBlock ArenaBlock;
+
+// Bump allocator for data that lives for a single collector tick. When a
+// tick outgrows the main block the excess goes to overflow blocks, and the
+// next reset folds them into one block sized to the high-water mark, so a
+// steady-state tick performs no heap allocation at all.
+typedef struct {
+  char *base;
+  size_t size;
+  size_t used;
+  size_t requested;
+  ArenaBlock *overflow;
+  void *last;
+} Arena;
+
+int arena_init(Arena *arena, size_t initial_size);
+
+void *arena_alloc(Arena *arena, size_t size);
+
+void *arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+void arena_reset(Arena *arena);
+
+void arena_destroy(Arena *arena);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "config.h"
+#include "outbuf.h"
+#include "snapshot.h"
+
+typedef enum {
+  FIELD_PID,
+  FIELD_PPID,
+  FIELD_COMM,
+  FIELD_STATE,
+  FIELD_CPU,
+  FIELD_MEM,
+  FIELD_VIRT,
+  FIELD_RES,
+  FIELD_THREADS,
+  FIELD_PROCESSOR,
+  FIELD_MINFLT,
+  FIELD_MAJFLT,
+  FIELD_UTIME,
+  FIELD_STIME,
+  FIELD_STARTTIME,
+  FIELD_IO_READ,
+  FIELD_IO_WRITE,
+  FIELD_PSS,
+  FIELD_USS,
+  FIELD_SWAP,
+  FIELD_COUNT
+} BatchField;
+
+typedef struct {
+  OutputFormat format;
+  BatchField fields[FIELD_COUNT];
+  int num_fields;
+  int top_n;
+  int header_written;
+  OutBuf out;
+} BatchWriter;
+
+int batch_init(BatchWriter *writer, const PulseConfig *config);
+
+int batch_wants_io(const BatchWriter *writer);
+
+int batch_wants_memory(const BatchWriter *writer);
+
+void batch_format(BatchWriter *writer, const Snapshot *snapshot);
+
+int batch_emit(BatchWriter *writer, const Snapshot *snapshot, int fd);
+
+void batch_destroy(BatchWriter *writer);
+
+#endif
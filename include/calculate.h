@@ -2,11 +2,22 @@
 #define CALCULATE
 
 #include "parser.h"
+#include "ui.h"
 
-void updateCpuState(cpuStat *prevCpuStats, cpuStat *currentCpuStats,
+void updateCpuState(cpuStats *prevCpuStats, const cpuStats *currentCpuStats,
                     int num_entries);
 
-void cpuUsage(cpuStat *prevCpuStats, cpuStat *currentCpuStats, double *usage,
-              int num_entries);
+unsigned long long cpuTotal(const cpuStats *stats, int entry);
+
+void cpuUsage(const cpuStats *prevCpuStats, const cpuStats *currentCpuStats,
+              CpuUsage *usage, int num_entries);
+
+int diskUsage(const diskStat *prevDiskStats, int num_prev,
+              const diskStat *currentDiskStats, int num_current,
+              double elapsed_sec, DiskInfo *usage);
+
+int netUsage(const netStat *prevNetStats, int num_prev,
+             const netStat *currentNetStats, int num_current,
+             double elapsed_sec, NetInfo *usage);
 
 #endif
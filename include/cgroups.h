@@ -0,0 +1,55 @@
+#ifndef CGROUPS_H
+#define CGROUPS_H
+
+#include "arena.h"
+#include "ui.h"
+
+// A cgroup that held a process in the last scan, or an ancestor of one. Its
+// files are opened once and re-read with pread() every tick; fds are -1
+// where a controller is not enabled.
+typedef struct {
+  char *path;
+  int parent;
+  int depth;
+  unsigned int seen;
+  int num_procs;
+  int cpu_fd;
+  int memory_fd;
+  int pressure_fd;
+  int has_usage;
+  unsigned long long usage_usec;
+  unsigned long long usage_ns;
+} CgroupNode;
+
+// cgroup v2 groups by path. A node keeps its slot for as long as anything
+// in it is alive, so a process can remember the index of its group instead
+// of re-reading /proc/<pid>/cgroup. root_fd is -1 without a v2 hierarchy.
+typedef struct {
+  int root_fd;
+  int proc_fd;
+  CgroupNode *nodes;
+  int num_nodes;
+  int capacity;
+  int *index;
+  int index_capacity;
+  unsigned int generation;
+  char buffer[4096];
+} CgroupTable;
+
+int cgroups_init(CgroupTable *table, const char *proc_root,
+                 const char *cgroup_root);
+
+void cgroups_destroy(CgroupTable *table);
+
+int cgroups_lookup(CgroupTable *table, int pid);
+
+void cgroups_begin_tick(CgroupTable *table);
+
+void cgroups_add_process(CgroupTable *table, int node);
+
+int cgroups_sweep(CgroupTable *table);
+
+int cgroups_read(CgroupTable *table, Arena *arena, unsigned long long now,
+                 int num_cores, CgroupInfo *out, int max);
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef COLLECTOR_H
+#define COLLECTOR_H
+
+#include "arena.h"
+#include "cgroups.h"
+#include "config.h"
+#include "parser.h"
+#include "proctable.h"
+#include "proctree.h"
+#include "scanner.h"
+#include "smaps.h"
+#include "snapshot.h"
+#include "taskscan.h"
+
+typedef enum {
+  STAGE_READDIR,
+  STAGE_READ,
+  STAGE_PARSE,
+  STAGE_DELTA,
+  STAGE_SORT,
+  STAGE_PUBLISH,
+  STAGE_COUNT
+} CollectorStage;
+
+// What the collector samples, each at its own interval.
+// SUBSYSTEM_CPU covers disks and network too.
+typedef enum {
+  SUBSYSTEM_CPU,
+  SUBSYSTEM_MEMORY,
+  SUBSYSTEM_PROCESSES,
+  SUBSYSTEM_COUNT
+} Subsystem;
+
+typedef struct {
+  pidStats *items;
+  int count;
+} ProcessList;
+
+typedef enum { SORT_NONE, SORT_CPU, SORT_IO } SortColumn;
+
+// What the consumer of the snapshot needs from the next tick. sort_depth is
+// how many leading rows must be in order; zero or less asks for a full sort.
+// Per-process I/O is only collected while show_io is set or it is sorted on.
+// With show_threads set, the threads of selected_pid and of the busiest
+// processes follow their process in the list. Cgroups are only mapped and
+// read while show_cgroups is set. show_tree lists processes under their
+// parents instead, with subtree sums and no thread rows. With `timed` set,
+// parsing is timed apart from reading, at two clock reads per process.
+// While show_memory is set, PSS, USS and swap are looked up for the first
+// memory_rows processes of the list and for those in memory_pids (sorted
+// ascending); reads happen in the background, so a process shows them
+// from a tick or so after it is first asked for.
+typedef struct {
+  SortColumn sort_column;
+  int sort_depth;
+  int show_io;
+  int show_threads;
+  int selected_pid;
+  int show_cgroups;
+  int show_tree;
+  int show_memory;
+  int memory_rows;
+  const int *memory_pids;
+  int num_memory_pids;
+  int timed;
+} CollectorView;
+
+// Whether the device of a diskstats line is a whole disk worth showing.
+typedef struct {
+  char name[32];
+  int whole;
+} DiskKind;
+
+// A read buffer kept across ticks so each system file is read without
+// allocating once it has grown to fit.
+typedef struct {
+  char *data;
+  size_t size;
+} FileBuffer;
+
+typedef struct {
+  char *stat_path;
+  char *meminfo_path;
+  char *diskstats_path;
+  char *net_dev_path;
+  char *net_snmp_path;
+  FileBuffer stat_buffer;
+  FileBuffer meminfo_buffer;
+  FileBuffer diskstats_buffer;
+  FileBuffer net_dev_buffer;
+  FileBuffer net_snmp_buffer;
+  ProcScanner scanner;
+  // The scan of the previous tick stays readable in prev_arena so cold
+  // processes can republish their rows from it. Ticks without a scan
+  // allocate from light_arena and leave both alone.
+  Arena tick_arena;
+  Arena prev_arena;
+  Arena light_arena;
+  pidStats *prev_items;
+  int prev_count;
+  int cold_interval;
+  // /proc/stat's total and busy time at the last scan, the usual share of
+  // one CPU of it that no process read accounts for, and whether the last
+  // scan showed more than usual.
+  unsigned long long scan_total;
+  unsigned long long scan_busy;
+  double cold_gap;
+  int has_cold_gap;
+  int wake_cold;
+  unsigned int tick;
+  unsigned long long cpu_total;
+  ProcTable procs;
+  // Threads of the processes expanded in the thread view, keyed by tid.
+  TaskScanner tasks;
+  ProcTable threads;
+  CgroupTable cgroups;
+  ProcTree tree;
+  SmapsReader smaps;
+  // Milliseconds per tick. Each subsystem runs every `every` ticks; those
+  // not due republish what they put in the last snapshot published.
+  int interval_ms;
+  unsigned int every[SUBSYSTEM_COUNT];
+  unsigned int last_run[SUBSYSTEM_COUNT];
+  const Snapshot *published;
+  CollectorView last_view;
+  unsigned long long devices_ns;
+  int skipped;
+  cpuStats prevCpuStats;
+  cpuStats currCpuStats;
+  int num_cpu_entries;
+  diskStat *prevDiskStats;
+  int num_prev_disks;
+  int disk_capacity;
+  // /sys/block beside the proc root, or -1 without one.
+  int sys_block_fd;
+  DiskKind *disk_kinds;
+  int num_disk_kinds;
+  int disk_kind_capacity;
+  netStat *prevNetStats;
+  int num_prev_nets;
+  int net_capacity;
+  int has_tcp_retrans;
+  unsigned long long tcp_retrans;
+  unsigned long long last_tick_ns;
+  unsigned long long stage_ns[STAGE_COUNT];
+  // Histograms of stage_ns and of whole ticks, copied into every snapshot.
+  SelfStats self;
+  unsigned long long self_cpu_ns;
+} Collector;
+
+extern const char *const collector_stage_names[STAGE_COUNT];
+
+int collector_init(Collector *collector, const PulseConfig *config);
+
+int collector_tick(Collector *collector, Snapshot *snapshot,
+                   const CollectorView *view);
+
+void collector_skip(Collector *collector, int missed);
+
+void collector_publish(Collector *collector, SnapshotExchange *exchange);
+
+void collector_destroy(Collector *collector);
+
+char *read_file_buffered(const char *path, FileBuffer *buffer);
+
+char *read_file_dynamically(const char *path);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+typedef enum { OUTPUT_NDJSON, OUTPUT_CSV } OutputFormat;
+
+#define CONFIG_MAX_HOSTS 16
+
+typedef struct {
+  int collector_threads;
+  const char *proc_root;
+  int interval_ms;
+  // How often CPU (with disks and network), memory and processes are
+  // sampled; 0 follows interval_ms. Collector ticks run at the shortest.
+  int cpu_interval_ms;
+  int memory_interval_ms;
+  int process_interval_ms;
+  int batch;
+  OutputFormat batch_format;
+  int iterations;
+  int top_n;
+  const char *fields;
+  const char *serve_address;
+  // Serve samples to viewers on this address, headless.
+  const char *agent_address;
+  // View these agents instead of collecting locally.
+  const char *connect_addresses[CONFIG_MAX_HOSTS];
+  int num_connect;
+  // Append every sample to this recording.
+  const char *record_path;
+  // Play this recording back instead of collecting.
+  const char *replay_path;
+  int cold_interval;
+  // NULL finds the cgroup v2 mount under /sys/fs/cgroup.
+  const char *cgroup_root;
+  // Print Pulse's own stage timings to stderr on exit.
+  int timings;
+} PulseConfig;
+
+void config_defaults(PulseConfig *config);
+
+int config_load_file(PulseConfig *config, const char *path);
+
+int config_parse_args(PulseConfig *config, int argc, char **argv);
+
+int config_tick_ms(const PulseConfig *config);
+
+#endif
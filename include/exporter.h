@@ -0,0 +1,36 @@
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include "outbuf.h"
+#include "snapshot.h"
+#include "topk.h"
+#include <pthread.h>
+
+// OpenMetrics endpoint fed from the collector thread. Each tick renders the
+// whole response body into `staging`, then swaps it with `published` under
+// `lock`; the server thread copies `published` out per scrape, so scrapes
+// never touch a snapshot or /proc.
+typedef struct {
+  int listen_fd;
+  int stop_fd;
+  char *unix_path;
+  int top_n;
+  pthread_t thread;
+  int thread_started;
+  pthread_mutex_t lock;
+  OutBuf staging;
+  OutBuf published;
+  OutBuf response;
+  SortKey *keys;
+  int key_capacity;
+} Exporter;
+
+int exporter_init(Exporter *exporter, const char *address, int top_n);
+
+int exporter_start(Exporter *exporter);
+
+void exporter_update(Exporter *exporter, const Snapshot *snapshot);
+
+void exporter_destroy(Exporter *exporter);
+
+#endif
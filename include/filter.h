@@ -0,0 +1,76 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include "ui.h"
+
+#define FILTER_QUERY_MAX 64
+// Digits in the longest PID (INT_MAX).
+#define FILTER_PID_DIGITS 10
+
+// A process's interned name, remembered by pid until it exits.
+typedef struct {
+  int pid;
+  int name;
+  unsigned long long starttime;
+  unsigned long seen;
+} FilterProc;
+
+// Name ids sharing one lowercase trigram.
+typedef struct {
+  unsigned int trigram;
+  int count;
+  int capacity;
+  int *names;
+} FilterPosting;
+
+// Matches rows of a snapshot against a typed query. Command names are
+// interned once, lowercase, and indexed by trigram, so a keystroke only
+// looks at the names that can match; processes map to their name through a
+// pid table that only changes for new, renamed or exited processes. A query
+// that extends the previous one narrows its results instead of starting
+// over. Digits also match PID prefixes, and a leading '~' matches names
+// fuzzily (the query's letters in order, with gaps).
+typedef struct {
+  int *names;
+  char *text;
+  size_t text_used;
+  size_t text_capacity;
+  unsigned long long *name_chars;
+  int num_names;
+  int name_capacity;
+  int *name_index;
+  int name_index_capacity;
+  FilterPosting *postings;
+  int num_postings;
+  int posting_capacity;
+  FilterProc *procs;
+  int num_procs;
+  int proc_capacity;
+  unsigned long generation;
+  int *row_names;
+  int *row_pids;
+  unsigned char *row_digits;
+  int num_rows;
+  int row_capacity;
+  char query[FILTER_QUERY_MAX];
+  unsigned char *name_matches;
+  int *matched_names;
+  int num_matched_names;
+  int matched_upto;
+  int *matches;
+  int num_matches;
+  int *scratch;
+} FilterIndex;
+
+int filter_init(FilterIndex *filter);
+
+void filter_destroy(FilterIndex *filter);
+
+void filter_sync(FilterIndex *filter, const ProcessInfo *rows, int num_rows,
+                 unsigned long generation);
+
+void filter_reset(FilterIndex *filter);
+
+int filter_apply(FilterIndex *filter, const char *query);
+
+#endif
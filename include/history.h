@@ -0,0 +1,49 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "parser.h"
+
+// Three resolutions: one sample per second, per 10 seconds and per minute.
+// Samples are folded into seconds by their timestamps, whatever the tick.
+#define HISTORY_TIERS 3
+
+// Fixed-size rings of recent percentages, quantized to 16 bits, one series
+// per CPU entry plus memory and swap usage. All series advance in lockstep,
+// so each tier keeps a single head and count. Coarser tiers are fed from a
+// running sum of the finer one, so recording costs O(series) however much
+// history is kept. The first tier is fed the same way from the samples
+// recorded within each second; `span_ms` is how much time they cover.
+typedef struct {
+  int num_cpu_entries;
+  int num_series;
+  int interval_ms;
+  unsigned long long last_ms;
+  unsigned int span_ms;
+  int capacity[HISTORY_TIERS];
+  int head[HISTORY_TIERS];
+  int count[HISTORY_TIERS];
+  int pending[HISTORY_TIERS];
+  unsigned short *samples[HISTORY_TIERS];
+  unsigned int *sums[HISTORY_TIERS];
+} History;
+
+extern const char *const history_tier_names[HISTORY_TIERS];
+
+int history_init(History *history, int num_cpu_entries, int interval_ms);
+
+void history_destroy(History *history);
+
+void history_record(History *history, unsigned long long timestamp_ms,
+                    const double *cpu_usage, int num_cpu_entries,
+                    const memStats *mem_info);
+
+int history_cpu_series(const History *history, int cpu_index);
+
+int history_mem_series(const History *history);
+
+int history_swap_series(const History *history);
+
+int history_read(const History *history, int series, int tier,
+                 unsigned short *out, int max);
+
+#endif
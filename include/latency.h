@@ -0,0 +1,27 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdio.h>
+
+// Buckets of microseconds: one per value below 8, then four per power of
+// two, so a bucket is at most a quarter of its value wide. The last one
+// (from about 2.4 hours) takes everything longer.
+#define LATENCY_BUCKETS 128
+
+// A fixed-size latency histogram. Recording is a couple of shifts and an
+// increment, cheap enough to sit on every stage of every tick and frame;
+// percentiles are read back to within a bucket.
+typedef struct {
+  unsigned int counts[LATENCY_BUCKETS];
+  unsigned int total;
+  unsigned long long max_us;
+} LatencyHistogram;
+
+void latency_record(LatencyHistogram *histogram, unsigned long long ns);
+
+double latency_percentile(const LatencyHistogram *histogram, double fraction);
+
+void latency_print(FILE *out, const char *name,
+                   const LatencyHistogram *histogram);
+
+#endif
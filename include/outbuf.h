@@ -0,0 +1,41 @@
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stddef.h>
+
+// Append-only text buffer that keeps its allocation between uses, so
+// formatting a tick's worth of output allocates nothing in steady state.
+typedef struct {
+  char *data;
+  size_t len;
+  size_t capacity;
+  int failed;
+} OutBuf;
+
+void outbuf_init(OutBuf *buf);
+
+void outbuf_free(OutBuf *buf);
+
+void outbuf_reset(OutBuf *buf);
+
+int outbuf_reserve(OutBuf *buf, size_t extra);
+
+void outbuf_char(OutBuf *buf, char c);
+
+void outbuf_mem(OutBuf *buf, const char *data, size_t len);
+
+void outbuf_str(OutBuf *buf, const char *text);
+
+void outbuf_u64(OutBuf *buf, unsigned long long value);
+
+void outbuf_i64(OutBuf *buf, long long value);
+
+void outbuf_fixed(OutBuf *buf, double value, int decimals);
+
+void outbuf_json_string(OutBuf *buf, const char *text);
+
+void outbuf_csv_string(OutBuf *buf, const char *text);
+
+int outbuf_write_all(const OutBuf *buf, int fd);
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef PARSER
 #define PARSER
 
+#include <stddef.h>
+
 typedef struct {
   unsigned long memTotal;
   unsigned long memAvailable;
@@ -8,27 +10,113 @@ typedef struct {
   unsigned long swapFree;
 } memStats;
 
+// Columns of a "cpu" line in /proc/stat. guest and guest_nice are already
+// counted in user and nice.
+typedef enum {
+  CPU_USER,
+  CPU_NICE,
+  CPU_SYSTEM,
+  CPU_IDLE,
+  CPU_IOWAIT,
+  CPU_IRQ,
+  CPU_SOFTIRQ,
+  CPU_STEAL,
+  CPU_GUEST,
+  CPU_GUEST_NICE,
+  CPU_FIELDS
+} cpuField;
+
+// Per-CPU arrays are padded to a multiple of this many entries so that
+// loops over them can run in whole vector blocks.
+#define CPU_LANES 8
+
+static inline int cpu_lanes_round(int entries) {
+  return (entries + CPU_LANES - 1) & ~(CPU_LANES - 1);
+}
+
+// One array per column (entry 0 is the aggregate line, then each core), so
+// the usage kernel streams every counter for all cores in a single pass.
+// The arrays share one allocation of `capacity` entries each.
+typedef struct {
+  unsigned long long *field[CPU_FIELDS];
+  int capacity;
+} cpuStats;
+
+typedef struct {
+  char name[32];
+  unsigned long long reads, writes;
+  unsigned long long sectors_read, sectors_written;
+  unsigned long long io_ticks;
+} diskStat;
+
+typedef struct {
+  char name[32];
+  unsigned long long rx_bytes, rx_packets, rx_drops;
+  unsigned long long tx_bytes, tx_packets, tx_drops;
+} netStat;
+
+// Microseconds of CPU time from a cgroup's cpu.stat, whole subtree.
+typedef struct {
+  unsigned long long usage_usec, user_usec, system_usec;
+} cgroupCpuStat;
+
+// The avg10 figures of a PSI file: percent of the last ten seconds in which
+// some or all runnable tasks were stalled.
+typedef struct {
+  double some_avg10, full_avg10;
+} pressureStat;
+
+// Totals of /proc/<pid>/smaps_rollup, in kB. pss charges each shared page
+// to the processes mapping it in equal parts; uss is the private pages
+// only, what exiting would free.
 typedef struct {
-  unsigned long user;
-  unsigned long nice;
-  unsigned long system;
-  unsigned long idle;
-  unsigned long iowait;
-  unsigned long irq;
-  unsigned long softirq;
-} cpuStat;
+  unsigned long pss, uss, swap;
+} smapsStat;
 
+// vsize is in bytes and rss_kb in kB, whatever the page size.
 typedef struct {
-  int pid;
+  int pid, ppid;
   char comm[256], state;
+  unsigned long minflt, majflt;
   unsigned long utime, stime;
-  long vsize, rss;
+  long num_threads;
+  unsigned long long starttime;
+  long vsize, rss_kb;
+  int processor;
+  int has_io;
+  unsigned long long read_bytes, write_bytes;
 } pidStats;
 
 void memParser(char *input, memStats *stats);
 
-int cpuParser(char *input, cpuStat *stats, int max_entries);
+int cpuEntryCount(const char *input);
+
+int cpuStatsReserve(cpuStats *stats, int entries);
+
+void cpuStatsFree(cpuStats *stats);
+
+int cpuParser(const char *input, cpuStats *stats, int max_entries);
+
+int pidParser(const char *input, size_t len, pidStats *stats);
+
+int ioParser(const char *input, size_t len, pidStats *stats);
+
+int smapsParser(const char *input, size_t len, smapsStat *stats);
+
+int diskEntryCount(const char *input);
+
+int diskParser(char *input, diskStat *stats, int max_entries);
+
+int netEntryCount(const char *input);
+
+int netParser(const char *input, netStat *stats, int max_entries);
+
+int tcpRetransParser(const char *input, unsigned long long *retrans_segs);
+
+int cgroupPathParser(const char *input, char *path, size_t size);
+
+int cgroupCpuParser(const char *input, cgroupCpuStat *stats);
 
-int pidParser(char *input, pidStats *stats);
+int pressureParser(const char *input, pressureStat *stats);
 
 #endif
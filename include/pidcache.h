@@ -0,0 +1,36 @@
+#ifndef PIDCACHE_H
+#define PIDCACHE_H
+
+#include <stddef.h>
+
+typedef struct {
+  int pid;
+  int fd;
+  unsigned int seen;
+} PidFdEntry;
+
+typedef struct {
+  PidFdEntry *slots;
+  int capacity;
+  int count;
+  int max_open;
+  unsigned int generation;
+  int dir_fd;
+  const char *file;
+  char *buffer;
+  size_t buffer_size;
+} PidFdCache;
+
+int pidcache_init(PidFdCache *cache, const char *proc_root, const char *file);
+
+void pidcache_destroy(PidFdCache *cache);
+
+void pidcache_begin_tick(PidFdCache *cache);
+
+char *pidcache_read(PidFdCache *cache, int pid, size_t *len);
+
+void pidcache_touch(PidFdCache *cache, int pid);
+
+void pidcache_sweep(PidFdCache *cache);
+
+#endif
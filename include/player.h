@@ -0,0 +1,58 @@
+#ifndef PLAYER_H
+#define PLAYER_H
+
+#include "collector.h"
+#include "recording.h"
+#include "snapshot.h"
+#include "wire.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Speeds are powers of two from a quarter to 64 times real time.
+#define PLAYER_MIN_SPEED -2
+#define PLAYER_MAX_SPEED 6
+// Far enough to reach either end of any recording.
+#define PLAYER_SEEK_ALL (1LL << 40)
+
+// Plays a recording back through `exchange` in place of a collector, at the
+// pace it was recorded (scaled by `speed`) and sorted as the UI asks. Each
+// seek bumps the published `source`, so the UI starts its history over.
+typedef struct {
+  Recording recording;
+  SnapshotExchange *exchange;
+  int stop_fd;
+  int wake_fd;
+  pthread_t thread;
+  int thread_started;
+  // Player thread only.
+  WireState state;
+  WireState scratch;
+  WireOrder order;
+  char host[64];
+  size_t next;
+  int synced;
+  int source;
+  // Set from the UI thread.
+  atomic_int sort_column;
+  atomic_int sort_depth;
+  atomic_int paused;
+  atomic_int speed;
+  atomic_llong seek_ms;
+} Player;
+
+int player_init(Player *player, const char *path,
+                SnapshotExchange *exchange);
+
+int player_start(Player *player);
+
+void player_set_view(Player *player, SortColumn sort_column, int sort_depth);
+
+void player_toggle_pause(Player *player);
+
+void player_change_speed(Player *player, int step);
+
+void player_seek(Player *player, long long delta_ms);
+
+void player_destroy(Player *player);
+
+#endif
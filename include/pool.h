@@ -0,0 +1,31 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+
+typedef void (*pool_task_fn)(void *ctx, int worker);
+
+typedef struct WorkerSlot WorkerSlot;
+
+typedef struct {
+  WorkerSlot *slots;
+  int num_workers;
+  pthread_mutex_t lock;
+  pthread_cond_t start_cond;
+  pthread_cond_t done_cond;
+  unsigned long generation;
+  int pending;
+  int stopping;
+  pool_task_fn task;
+  void *ctx;
+} WorkerPool;
+
+int pool_default_workers(void);
+
+int pool_init(WorkerPool *pool, int num_workers);
+
+void pool_run(WorkerPool *pool, pool_task_fn task, void *ctx);
+
+void pool_destroy(WorkerPool *pool);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef PROCTABLE_H
+#define PROCTABLE_H
+
+#include "parser.h"
+
+// Per-process state that survives between ticks. A slot is located by pid
+// but only matches while starttime is unchanged, so a recycled PID starts
+// from a fresh entry instead of inheriting the old process's counters.
+//
+// Counters are those of the last tick the process was actually sampled
+// (sample_total is the system-wide CPU time and sample_ns the clock at that
+// point); cold processes are skipped for a few ticks and republish the
+// rates and list row (last_index) of their last sample.
+//
+// cgroup is one more than the process's CgroupTable node, 0 until it has
+// been looked up and -1 if it has none, so /proc/<pid>/cgroup is read once
+// per process lifetime. tree_node is likewise one more than the process's
+// ProcTree node, 0 until the tree view has seen it.
+//
+// smaps is the process's last smaps_rollup read, taken at smaps_ns (0 if it
+// has not been read, and has_smaps clear if it could not be), and
+// smaps_queued is set while a read is waiting on the SmapsReader.
+typedef struct {
+  int pid;
+  unsigned int seen;
+  unsigned long long starttime;
+  unsigned long long cpu_time;
+  int has_io;
+  unsigned long long read_bytes;
+  unsigned long long write_bytes;
+  int hot;
+  int idle_samples;
+  int last_index;
+  unsigned long long sample_total;
+  unsigned long long sample_ns;
+  double cpu_percent;
+  double read_rate;
+  double write_rate;
+  int cgroup;
+  int tree_node;
+  smapsStat smaps;
+  int has_smaps;
+  int smaps_queued;
+  unsigned long long smaps_ns;
+} ProcEntry;
+
+typedef struct {
+  ProcEntry *slots;
+  int capacity;
+  int count;
+  unsigned int generation;
+} ProcTable;
+
+int proctable_init(ProcTable *table, int capacity);
+
+void proctable_destroy(ProcTable *table);
+
+void proctable_begin_tick(ProcTable *table);
+
+const ProcEntry *proctable_find(const ProcTable *table, int pid);
+
+ProcEntry *proctable_get(ProcTable *table, int pid);
+
+ProcEntry *proctable_upsert(ProcTable *table, int pid,
+                            unsigned long long starttime, int *is_new);
+
+void proctable_sweep(ProcTable *table);
+
+#endif
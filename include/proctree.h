@@ -0,0 +1,72 @@
+#ifndef PROCTREE_H
+#define PROCTREE_H
+
+#include "arena.h"
+#include "parser.h"
+#include "proctable.h"
+
+// One process in the tree. Links are node indices, -1 for none; a node's
+// children are kept in no particular order. Free nodes have pid 0 and are
+// chained through next_sibling.
+typedef struct {
+  int pid;
+  int ppid;
+  int parent;
+  int first_child;
+  int next_sibling;
+  int prev_sibling;
+  int row;
+  int pending;
+  unsigned int seen;
+} TreeNode;
+
+// Parent/child links between processes, patched as processes appear, exit
+// or are re-parented rather than rebuilt every tick. A node keeps its index
+// for the life of its process, which ProcEntry.tree_node remembers. Nodes
+// whose parent is not known yet sit among the roots and stay in `pending`
+// until it turns up.
+typedef struct {
+  TreeNode *nodes;
+  int num_nodes;
+  int capacity;
+  int free_list;
+  int first_root;
+  int *pending;
+  int num_pending;
+  int pending_capacity;
+  unsigned int generation;
+} ProcTree;
+
+// What a row adds to its subtree's sums. `key` is summed as well and orders
+// siblings, largest subtree first; ties go to the lower pid.
+typedef struct {
+  double cpu;
+  long rss;
+  double key;
+} TreeSample;
+
+// A row of the flattened tree: its index in the scan, its depth, how many
+// rows below it belong to its subtree, and the subtree's sums.
+typedef struct {
+  int row;
+  int depth;
+  int descendants;
+  double cpu;
+  long rss;
+} TreeRow;
+
+int proctree_init(ProcTree *tree, int capacity);
+
+void proctree_destroy(ProcTree *tree);
+
+void proctree_begin_tick(ProcTree *tree);
+
+int proctree_update(ProcTree *tree, ProcEntry *entry, const pidStats *stats,
+                    int row);
+
+void proctree_sweep(ProcTree *tree, const ProcTable *procs);
+
+int proctree_layout(const ProcTree *tree, Arena *arena,
+                    const TreeSample *samples, TreeRow *out, int max);
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include "outbuf.h"
+#include "snapshot.h"
+#include "wire.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// A recording is a 16-byte header (RECORDING_MAGIC and the format version),
+// then wire frames exactly as an agent sends them: a hello and a keyframe
+// every RECORDING_KEYFRAME_INTERVAL samples, deltas in between. A clean
+// close appends an index of the keyframes (timestamp and offset of the
+// hello before each, 8 little-endian bytes apiece) as one more frame, and
+// a 16-byte trailer: the index frame's offset and RECORDING_INDEX_MAGIC.
+// Seeking is a binary search of the index and at most one interval of
+// deltas; a recording cut short has its index rebuilt from the frames.
+#define RECORDING_MAGIC "PULSEREC"
+#define RECORDING_INDEX_MAGIC "PULSEIDX"
+#define RECORDING_VERSION 3
+#define RECORDING_HEADER_SIZE 16
+#define RECORDING_TRAILER_SIZE 16
+#define RECORDING_MARK_SIZE 16
+#define RECORDING_INDEX 16
+#define RECORDING_KEYFRAME_INTERVAL 300
+
+// Appends samples to a recording. The collector thread only reduces each
+// snapshot to its wire form and hands it over; a writer thread encodes it
+// against the last one written and copies the frame into the file, which
+// grows a chunk at a time through a shared mapping, so what was written
+// survives the process dying. A writer that falls behind skips samples
+// rather than holding up the collector. `frames_end` is the end of the last
+// whole frame, `end` of what has been copied in.
+typedef struct {
+  int fd;
+  char *path;
+  char host[64];
+  unsigned char *map;
+  off_t map_offset;
+  size_t map_size;
+  off_t end;
+  off_t frames_end;
+  pthread_t thread;
+  int thread_started;
+  // Collector thread.
+  WireState captured;
+  // Handed over under the lock.
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  WireState pending;
+  int has_pending;
+  int stopping;
+  // Writer thread.
+  WireState written;
+  WireState encoding;
+  int have_sample;
+  int since_keyframe;
+  OutBuf frame;
+  OutBuf index;
+  unsigned long long last_mark_ms;
+  atomic_int error;
+} Recorder;
+
+// A recording mapped for reading. `index` is the on-disk index, or one
+// rebuilt from the frames into `owned_index`.
+typedef struct {
+  const unsigned char *data;
+  size_t size;
+  size_t frames_end;
+  const unsigned char *index;
+  unsigned char *owned_index;
+  int num_marks;
+} Recording;
+
+int recorder_init(Recorder *recorder, const char *path);
+
+int recorder_start(Recorder *recorder);
+
+void recorder_update(Recorder *recorder, const Snapshot *snapshot);
+
+void recorder_destroy(Recorder *recorder);
+
+int recording_open(Recording *recording, const char *path);
+
+void recording_close(Recording *recording);
+
+int recording_frame(const Recording *recording, size_t offset, int *type,
+                    const unsigned char **payload, size_t *len);
+
+unsigned long long recording_mark_time(const Recording *recording, int mark);
+
+size_t recording_mark_offset(const Recording *recording, int mark);
+
+int recording_find(const Recording *recording, unsigned long long time_ms);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include "arena.h"
+#include "parser.h"
+#include "pidcache.h"
+#include "pool.h"
+
+// Returns stats to republish for `pid` instead of reading /proc, or NULL to
+// read it. Called concurrently from every worker.
+typedef const pidStats *(*scan_reuse_fn)(void *ctx, int pid);
+
+typedef struct {
+  PidFdCache cache;
+  PidFdCache io_cache;
+  int start;
+  int count;
+  int produced;
+  int sampled;
+  unsigned long long read_ns;
+  unsigned long long parse_ns;
+} ScanShard;
+
+typedef struct {
+  WorkerPool pool;
+  ScanShard *shards;
+  int num_shards;
+  char *proc_root;
+  int *grouped_pids;
+  pidStats *output;
+  // With `timed` set, read and parse time are measured per process and
+  // summed over all workers; otherwise both are reported as read time.
+  int timed;
+  // /proc/<pid>/io is only read while something consumes it; it costs
+  // about as much as the stat read itself.
+  int read_io;
+  scan_reuse_fn reuse;
+  void *reuse_ctx;
+  int sampled;
+  unsigned long long readdir_ns;
+  unsigned long long read_ns;
+  unsigned long long parse_ns;
+} ProcScanner;
+
+int scanner_init(ProcScanner *scanner, const char *proc_root, int num_workers);
+
+int scanner_collect(ProcScanner *scanner, Arena *arena, pidStats **out);
+
+void scanner_destroy(ProcScanner *scanner);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+// Wakes the collector on a fixed grid of absolute CLOCK_MONOTONIC deadlines
+// (a periodic timerfd), so the time a tick takes does not push the next one
+// back. Periods that pass while a tick overruns are counted and dropped;
+// they are never made up with back-to-back ticks. stop_fd is an eventfd
+// that cuts a wait short when Pulse exits.
+typedef struct {
+  int timer_fd;
+  int stop_fd;
+  int interval_ms;
+} Scheduler;
+
+int scheduler_init(Scheduler *scheduler, int interval_ms);
+
+int scheduler_start(Scheduler *scheduler);
+
+int scheduler_wait(Scheduler *scheduler);
+
+void scheduler_stop(Scheduler *scheduler);
+
+void scheduler_destroy(Scheduler *scheduler);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef SMAPS_H
+#define SMAPS_H
+
+#include "parser.h"
+#include <pthread.h>
+
+// The most reads waiting at once; requests beyond it are refused and asked
+// again on a later tick.
+#define SMAPS_MAX_QUEUED 4096
+
+typedef struct {
+  int pid;
+  unsigned long long starttime;
+} SmapsRequest;
+
+// `ok` is clear when the file could not be read: the process is gone, is
+// not ours to inspect, or the kernel predates smaps_rollup.
+typedef struct {
+  int pid;
+  unsigned long long starttime;
+  int ok;
+  smapsStat stats;
+} SmapsResult;
+
+// Reads /proc/<pid>/smaps_rollup on a thread of its own. Each read walks
+// the process's page tables under its mmap lock, which can take
+// milliseconds for a large process, so the collector queues the processes
+// it wants and picks up whatever has been read by its next tick. Results
+// carry the starttime they were asked for so a recycled pid can be told
+// apart.
+typedef struct {
+  int dir_fd;
+  pthread_t thread;
+  int thread_started;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  int stopping;
+  // Handed over under the lock.
+  SmapsRequest *queue;
+  int num_queued;
+  int queue_capacity;
+  SmapsResult *results;
+  int num_results;
+  int result_capacity;
+  // Reader thread.
+  SmapsRequest *work;
+  int work_capacity;
+  char buffer[4096];
+  // Collector thread: what the last smaps_take() returned.
+  SmapsResult *taken;
+  int taken_capacity;
+} SmapsReader;
+
+int smaps_init(SmapsReader *reader, const char *proc_root);
+
+int smaps_request(SmapsReader *reader, int pid, unsigned long long starttime);
+
+int smaps_take(SmapsReader *reader, const SmapsResult **results);
+
+void smaps_destroy(SmapsReader *reader);
+
+#endif
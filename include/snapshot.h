@@ -0,0 +1,72 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "ui.h"
+#include <stdatomic.h>
+
+typedef struct {
+  CpuUsage cpu;
+  memStats mem_info;
+  ProcessInfo *processed_list;
+  DiskInfo *disks;
+  NetInfo *nets;
+  CgroupInfo *cgroups;
+  // Negative when /proc/net/snmp could not be read.
+  double tcp_retrans_rate;
+  SelfStats self;
+  int num_total_cpu_entries;
+  int num_processes;
+  int num_disks;
+  int num_nets;
+  int num_cgroups;
+  int sorted_count;
+  int cpu_capacity;
+  int process_capacity;
+  int disk_capacity;
+  int net_capacity;
+  int cgroup_capacity;
+  unsigned long generation;
+  unsigned long long timestamp_ms;
+  // Bit 1 << SUBSYSTEM_* for each subsystem read for this sample rather
+  // than carried over from the one before.
+  unsigned int sampled;
+  // Set by the viewer: which agent the sample came from, as an index into
+  // the --connect addresses, and the label to show for it.
+  int source;
+  char source_name[80];
+} Snapshot;
+
+// Triple buffer: the collector owns `back`, the reader owns `front` and the
+// two trade through `middle`, whose low bits hold a buffer index and whose
+// SNAPSHOT_FRESH bit marks a publish the reader has not picked up yet.
+// notify_fd is an eventfd signalled on every publish so the reader can
+// sleep in poll() instead of checking on a timer.
+typedef struct {
+  Snapshot buffers[3];
+  int back;
+  int front;
+  atomic_uint middle;
+  unsigned long generation;
+  int notify_fd;
+} SnapshotExchange;
+
+void snapshot_init(SnapshotExchange *exchange);
+
+void snapshot_destroy(SnapshotExchange *exchange);
+
+int snapshot_reserve(Snapshot *snapshot, int num_cpu_entries,
+                     int num_processes, int num_disks, int num_nets);
+
+int snapshot_reserve_cgroups(Snapshot *snapshot, int num_cgroups);
+
+Snapshot *snapshot_back(SnapshotExchange *exchange);
+
+void snapshot_publish(SnapshotExchange *exchange);
+
+void snapshot_wake(SnapshotExchange *exchange);
+
+void snapshot_drain_notify(SnapshotExchange *exchange);
+
+const Snapshot *snapshot_acquire(SnapshotExchange *exchange, int *changed);
+
+#endif
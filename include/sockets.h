@@ -0,0 +1,19 @@
+#ifndef SOCKETS_H
+#define SOCKETS_H
+
+// Addresses are "host:port", ":port" (all interfaces), "[v6addr]:port", or
+// a unix socket path: anything with a '/' in it or a "unix:" prefix.
+
+// Returns a listening socket, or -1 after reporting why. For a unix socket
+// `unix_path` is set to a copy of the path, to be unlinked on shutdown.
+int socket_listen(const char *address, char **unix_path);
+
+// Starts a non-blocking connect and returns the socket, which turns
+// writable once the connection is made or has failed (see socket_error).
+// Returns -1 if it could not even be started.
+int socket_connect(const char *address);
+
+// The pending error of a socket, 0 once a connect has succeeded.
+int socket_error(int fd);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef TASKSCAN_H
+#define TASKSCAN_H
+
+#include "parser.h"
+
+// Reads the per-thread stat files under <proc_root>/<pid>/task. Unlike the
+// process scan nothing is cached: only a few processes are expanded per tick
+// and their threads come and go far more often than processes do.
+typedef struct {
+  int dir_fd;
+  char buffer[1024];
+} TaskScanner;
+
+int taskscan_init(TaskScanner *scanner, const char *proc_root);
+
+int taskscan_collect(TaskScanner *scanner, int pid, pidStats *out, int max,
+                     unsigned long long deadline_ns);
+
+void taskscan_destroy(TaskScanner *scanner);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef TOPK_H
+#define TOPK_H
+
+typedef struct {
+  double value;
+  int pid;
+  int index;
+} SortKey;
+
+int topk_select(SortKey *keys, int count, int k);
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef UI_H
 #define UI_H
 
+#include "history.h"
+#include "latency.h"
 #include "parser.h"
 #include <ncurses.h>
 
@@ -8,16 +10,134 @@ typedef struct {
   pidStats stats;
   double cpu_percent;
   double mem_percent;
+  // Bytes per second; only meaningful when stats.has_io is set.
+  double read_rate;
+  double write_rate;
+  // The owning process of a thread row; zero for processes.
+  int thread_of;
+  // In the tree view: the row's depth, how many rows after it make up its
+  // subtree, and CPU and RSS (kB) summed over the subtree.
+  int depth;
+  int descendants;
+  double tree_cpu;
+  long tree_rss;
+  // PSS, USS and swap from smaps_rollup, only read for the rows the
+  // collector was asked about and only meaningful when has_smaps is set.
+  int has_smaps;
+  smapsStat smaps;
 } ProcessInfo;
 
+// Percent of each CPU entry's time over the last interval, one array per
+// mode; entry 0 is the aggregate. usage is everything but idle and iowait,
+// so it includes steal.
+typedef struct {
+  double *usage;
+  double *user;
+  double *system;
+  double *iowait;
+  double *steal;
+} CpuUsage;
+
+typedef struct {
+  char name[32];
+  double read_rate;
+  double write_rate;
+  double read_iops;
+  double write_iops;
+  double utilization;
+} DiskInfo;
+
+// Per-second rates for one interface.
+typedef struct {
+  char name[32];
+  double rx_rate, tx_rate;
+  double rx_packets, tx_packets;
+  double rx_drops, tx_drops;
+} NetInfo;
+
+// One cgroup v2 group, listed parents first. CPU and memory come from the
+// cgroup's own files and so cover its whole subtree; num_procs counts the
+// processes of the last scan in the subtree.
+typedef struct {
+  char path[256];
+  int depth;
+  int num_procs;
+  double cpu_percent;
+  int has_memory;
+  unsigned long long memory_bytes;
+  int has_pressure;
+  double pressure_some;
+  double pressure_full;
+} CgroupInfo;
+
+#define SELF_MAX_STAGES 8
+
+// Pulse's own cost as seen by the collector: how long each stage and each
+// whole tick took, how late each tick started against its deadline, how
+// many ticks were dropped after overruns, and the CPU (percent of one core)
+// and resident memory of the whole process.
+typedef struct {
+  const char *const *stage_names;
+  int num_stages;
+  LatencyHistogram stages[SELF_MAX_STAGES];
+  LatencyHistogram tick;
+  LatencyHistogram drift;
+  unsigned long long overruns;
+  double cpu_percent;
+  long rss_kb;
+} SelfStats;
+
+// The most process rows whose PSS, USS and swap are read at once.
+#define UI_MAX_VISIBLE_PIDS 256
+
 void ui_init(void);
 
 void ui_cleanup(void);
 
-void ui_handle_input(int ch, int num_processes);
+int ui_handle_input(int ch, int num_processes);
+
+int ui_filter_editing(void);
+
+int ui_sort_depth(void);
+
+int ui_io_visible(void);
+
+void ui_set_io_visible(int visible);
+
+int ui_memory_visible(void);
+
+void ui_set_memory_visible(int visible);
+
+int ui_visible_pids(int *pids, int max);
+
+int ui_cgroups_visible(void);
+
+void ui_set_cgroups_visible(int visible);
+
+int ui_threads_visible(void);
+
+void ui_set_threads_visible(int visible);
+
+int ui_stats_visible(void);
+
+const LatencyHistogram *ui_frame_latency(void);
+
+int ui_tree_visible(void);
+
+void ui_set_tree_visible(int visible);
+
+int ui_selected_pid(void);
+
+void ui_set_host(const char *name);
+
+void ui_set_replaying(int on);
 
-void ui_draw(const double *cpu_usage, const memStats *mem_info, int num_cores,
-             const ProcessInfo *processes, int num_processes);
+void ui_draw(const CpuUsage *cpu, const memStats *mem_info, int num_cores,
+             const History *history, const DiskInfo *disks, int num_disks,
+             const NetInfo *nets, int num_nets, double tcp_retrans_rate,
+             const CgroupInfo *cgroups, int num_cgroups,
+             const ProcessInfo *processes, int num_processes,
+             const SelfStats *self, unsigned long generation);
 void ui_resize(void);
 
 #endif
@@ -0,0 +1,54 @@
+#ifndef VIEWER_H
+#define VIEWER_H
+
+#include "collector.h"
+#include "snapshot.h"
+#include "wire.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+// One agent: its connection, the frame bytes read so far and the sample
+// they have built up. `name` is the agent's host name once it has said
+// hello.
+typedef struct {
+  const char *address;
+  char name[64];
+  int fd;
+  int connecting;
+  int synced;
+  WireState state;
+  unsigned char *in;
+  size_t in_len;
+  size_t in_capacity;
+  unsigned long long retry_at_ms;
+} ViewerHost;
+
+// Follows any number of agents from one thread and publishes the selected
+// one's samples through `exchange`, sorted as the UI asks, in place of a
+// local collector. Hosts that go away are retried in the background.
+typedef struct {
+  ViewerHost *hosts;
+  int num_hosts;
+  SnapshotExchange *exchange;
+  int stop_fd;
+  int wake_fd;
+  atomic_int selected;
+  atomic_int sort_column;
+  atomic_int sort_depth;
+  WireState scratch;
+  WireOrder order;
+  pthread_t thread;
+  int thread_started;
+} Viewer;
+
+int viewer_init(Viewer *viewer, const char *const *addresses,
+                int num_addresses, SnapshotExchange *exchange);
+
+int viewer_start(Viewer *viewer);
+
+void viewer_set_view(Viewer *viewer, int selected, SortColumn sort_column,
+                     int sort_depth);
+
+void viewer_destroy(Viewer *viewer);
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include "collector.h"
+#include "outbuf.h"
+#include "snapshot.h"
+#include "topk.h"
+
+// The agent/viewer protocol. A stream is a series of frames: a type byte,
+// the payload length as four little-endian bytes, then the payload. The
+// agent starts with a hello (protocol version and host name), sends a
+// keyframe once it has a sample, and from then on one delta per tick.
+#define WIRE_VERSION 3
+#define WIRE_HEADER_SIZE 5
+#define WIRE_FRAME_MAX (64u << 20)
+
+typedef enum {
+  WIRE_HELLO = 1,
+  WIRE_KEYFRAME = 2,
+  WIRE_DELTA = 3
+} WireFrameType;
+
+// Per-process values as sent: integers, so an idle process repeats the
+// same ones tick after tick and costs nothing in a delta. CPU and memory
+// are hundredths of a percent, vsize and rss in kB.
+typedef enum {
+  WIRE_PPID,
+  WIRE_STATE,
+  WIRE_PROCESSOR,
+  WIRE_VSIZE_KB,
+  WIRE_RSS_KB,
+  WIRE_CPU,
+  WIRE_MEM,
+  WIRE_READ_RATE,
+  WIRE_WRITE_RATE,
+  WIRE_HAS_IO,
+  WIRE_PROCESS_FIELDS
+} WireProcessField;
+
+// Disks use the first five (rates in bytes, hundredths of an IOPS and of a
+// percent of utilisation), interfaces all six (bytes, packets and drops
+// per second, the last two in hundredths).
+#define WIRE_DEVICE_FIELDS 6
+#define WIRE_CPU_MODES 5
+#define WIRE_MEM_FIELDS 4
+
+typedef struct {
+  int pid;
+  unsigned long long starttime;
+  long long fields[WIRE_PROCESS_FIELDS];
+  char comm[64];
+} WireProcess;
+
+typedef struct {
+  char name[32];
+  long long fields[WIRE_DEVICE_FIELDS];
+} WireDevice;
+
+// One sample reduced to what the viewer draws, with processes in pid order
+// so two samples are compared in a single merge. Thread rows, cgroups and
+// the tree are not sent. cpu holds num_cpu_entries values per mode (usage,
+// user, system, iowait, steal), in hundredths of a percent.
+typedef struct {
+  unsigned long long timestamp_ms;
+  unsigned int sampled;
+  long long *cpu;
+  int num_cpu_entries;
+  int cpu_capacity;
+  long long mem[WIRE_MEM_FIELDS];
+  long long tcp_retrans;
+  WireDevice *disks;
+  int num_disks;
+  int disk_capacity;
+  WireDevice *nets;
+  int num_nets;
+  int net_capacity;
+  WireProcess *procs;
+  int num_procs;
+  int proc_capacity;
+  // wire_capture's scratch for putting processes in pid order.
+  unsigned long long *keys;
+  int key_capacity;
+} WireState;
+
+// Scratch for putting a sample's processes in the order the UI asked for.
+typedef struct {
+  SortKey *keys;
+  int *indices;
+  int capacity;
+} WireOrder;
+
+void wire_state_init(WireState *state);
+
+void wire_state_destroy(WireState *state);
+
+void wire_state_clear(WireState *state);
+
+int wire_capture(WireState *state, const Snapshot *snapshot);
+
+void wire_encode_hello(OutBuf *out, const char *host);
+
+void wire_encode(OutBuf *out, const WireState *prev, const WireState *curr);
+
+int wire_decode_hello(const unsigned char *payload, size_t len, char *host,
+                      size_t host_size);
+
+int wire_decode(WireState *state, WireState *scratch, int type,
+                const unsigned char *payload, size_t len);
+
+int wire_frame_timestamp(const WireState *state, int type,
+                         const unsigned char *payload, size_t len,
+                         unsigned long long *timestamp_ms);
+
+int wire_order(WireOrder *order, const WireState *state, SortColumn column,
+               int depth);
+
+void wire_order_destroy(WireOrder *order);
+
+int wire_to_snapshot(const WireState *state, const int *order,
+                     Snapshot *snapshot);
+
+#endif
@@ -0,0 +1,266 @@
+#define _GNU_SOURCE
+#include "../include/agent.h"
+#include "../include/sockets.h"
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// A viewer that falls this far behind is dropped; it reconnects and starts
+// over from a keyframe rather than making the agent buffer without bound.
+#define AGENT_CLIENT_BACKLOG (8u << 20)
+#define AGENT_READ_BUFFER 512
+
+int agent_init(Agent *agent, const char *address) {
+  memset(agent, 0, sizeof(*agent));
+  agent->stop_fd = agent->ready_fd = -1;
+  wire_state_init(&agent->states[0]);
+  wire_state_init(&agent->states[1]);
+  outbuf_init(&agent->staging_delta);
+  outbuf_init(&agent->staging_keyframe);
+  outbuf_init(&agent->delta);
+  outbuf_init(&agent->keyframe);
+  atomic_init(&agent->want_keyframe, 0);
+  atomic_init(&agent->num_clients, 0);
+  pthread_mutex_init(&agent->lock, NULL);
+  if (gethostname(agent->host, sizeof(agent->host) - 1) != 0)
+    strcpy(agent->host, "unknown");
+
+  agent->listen_fd = socket_listen(address, &agent->unix_path);
+  agent->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  agent->ready_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (agent->listen_fd < 0 || agent->stop_fd < 0 || agent->ready_fd < 0) {
+    agent_destroy(agent);
+    return 0;
+  }
+  return 1;
+}
+
+// Called from the collector thread with the snapshot about to be published.
+void agent_update(Agent *agent, const Snapshot *snapshot) {
+  if (atomic_load(&agent->num_clients) == 0) {
+    agent->have_sample = 0;
+    return;
+  }
+  WireState *prev = &agent->states[agent->current];
+  WireState *curr = &agent->states[!agent->current];
+  int keyframe = atomic_exchange(&agent->want_keyframe, 0);
+  outbuf_reset(&agent->staging_delta);
+  outbuf_reset(&agent->staging_keyframe);
+
+  int captured = wire_capture(curr, snapshot);
+  int has_delta = captured && agent->have_sample;
+  if (has_delta)
+    wire_encode(&agent->staging_delta, prev, curr);
+  if (captured && keyframe)
+    wire_encode(&agent->staging_keyframe, NULL, curr);
+  has_delta = has_delta && !agent->staging_delta.failed;
+  int has_keyframe =
+      captured && keyframe && !agent->staging_keyframe.failed;
+  if (keyframe && !has_keyframe)
+    atomic_store(&agent->want_keyframe, 1);
+  agent->have_sample = captured;
+  if (captured)
+    agent->current = !agent->current;
+
+  pthread_mutex_lock(&agent->lock);
+  OutBuf previous = agent->delta;
+  agent->delta = agent->staging_delta;
+  agent->staging_delta = previous;
+  previous = agent->keyframe;
+  agent->keyframe = agent->staging_keyframe;
+  agent->staging_keyframe = previous;
+  agent->has_delta = has_delta;
+  agent->has_keyframe = has_keyframe;
+  agent->sequence++;
+  pthread_mutex_unlock(&agent->lock);
+
+  uint64_t one = 1;
+  ssize_t written = write(agent->ready_fd, &one, sizeof(one));
+  (void)written;
+}
+
+static void drop_client(Agent *agent, int i) {
+  int last = atomic_load(&agent->num_clients) - 1;
+  close(agent->clients[i].fd);
+  outbuf_free(&agent->clients[i].out);
+  agent->clients[i] = agent->clients[last];
+  atomic_store(&agent->num_clients, last);
+}
+
+// Queues this tick's frame for every client: a delta for those following
+// along, a keyframe for the rest. A client that missed a delta (the server
+// fell a hand-over behind, or the collector could not encode one) has to
+// wait for the next keyframe.
+static void distribute(Agent *agent) {
+  pthread_mutex_lock(&agent->lock);
+  int missed = agent->sequence != agent->delivered + 1 || !agent->has_delta;
+  agent->delivered = agent->sequence;
+  for (int i = 0; i < atomic_load(&agent->num_clients); ++i) {
+    AgentClient *client = &agent->clients[i];
+    if (missed)
+      client->synced = 0;
+    if (client->synced) {
+      outbuf_mem(&client->out, agent->delta.data, agent->delta.len);
+    } else if (agent->has_keyframe) {
+      outbuf_mem(&client->out, agent->keyframe.data, agent->keyframe.len);
+      client->synced = 1;
+    } else {
+      atomic_store(&agent->want_keyframe, 1);
+    }
+  }
+  pthread_mutex_unlock(&agent->lock);
+}
+
+// Writes what the socket takes. Returns 0 if the client is gone or too far
+// behind to keep.
+static int flush_client(AgentClient *client) {
+  while (client->sent < client->out.len) {
+    ssize_t n = send(client->fd, client->out.data + client->sent,
+                     client->out.len - client->sent, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        return 0;
+      break;
+    }
+    client->sent += n;
+  }
+  if (client->sent == client->out.len) {
+    outbuf_reset(&client->out);
+    client->sent = 0;
+  }
+  return !client->out.failed &&
+         client->out.len - client->sent <= AGENT_CLIENT_BACKLOG;
+}
+
+static void accept_client(Agent *agent) {
+  int fd = accept4(agent->listen_fd, NULL, NULL,
+                   SOCK_CLOEXEC | SOCK_NONBLOCK);
+  if (fd < 0)
+    return;
+  int n = atomic_load(&agent->num_clients);
+  if (n == AGENT_MAX_CLIENTS) {
+    close(fd);
+    return;
+  }
+  // Frames are written once per tick; don't hold them back. Fails
+  // harmlessly on a unix socket.
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  AgentClient *client = &agent->clients[n];
+  memset(client, 0, sizeof(*client));
+  client->fd = fd;
+  outbuf_init(&client->out);
+  wire_encode_hello(&client->out, agent->host);
+  atomic_store(&agent->want_keyframe, 1);
+  atomic_store(&agent->num_clients, n + 1);
+}
+
+static void *agent_thread(void *arg) {
+  Agent *agent = arg;
+  struct pollfd fds[3 + AGENT_MAX_CLIENTS];
+  while (1) {
+    int n = atomic_load(&agent->num_clients);
+    fds[0] = (struct pollfd){.fd = agent->stop_fd, .events = POLLIN};
+    fds[1] = (struct pollfd){.fd = agent->ready_fd, .events = POLLIN};
+    fds[2] = (struct pollfd){.fd = agent->listen_fd, .events = POLLIN};
+    for (int i = 0; i < n; ++i) {
+      const AgentClient *client = &agent->clients[i];
+      fds[3 + i] = (struct pollfd){
+          .fd = client->fd,
+          .events = POLLIN | (client->out.len > client->sent ? POLLOUT : 0)};
+    }
+    if (poll(fds, 3 + n, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (fds[0].revents & POLLIN)
+      break;
+
+    // Clients are removed by moving the last one into their slot, so walk
+    // backwards to keep fds[] lined up with the ones still to be visited.
+    for (int i = n - 1; i >= 0; --i) {
+      AgentClient *client = &agent->clients[i];
+      short revents = fds[3 + i].revents;
+      int alive = !(revents & (POLLERR | POLLNVAL));
+      if (alive && (revents & (POLLIN | POLLHUP))) {
+        // Viewers send nothing; reading only notices them leaving.
+        char discard[AGENT_READ_BUFFER];
+        ssize_t got = recv(client->fd, discard, sizeof(discard), 0);
+        alive = got > 0 || (got < 0 && (errno == EAGAIN || errno == EINTR));
+      }
+      if (alive && (revents & POLLOUT))
+        alive = flush_client(client);
+      if (!alive)
+        drop_client(agent, i);
+    }
+
+    if (fds[1].revents & POLLIN) {
+      uint64_t pending;
+      ssize_t drained = read(agent->ready_fd, &pending, sizeof(pending));
+      (void)drained;
+      distribute(agent);
+      for (int i = atomic_load(&agent->num_clients) - 1; i >= 0; --i) {
+        if (!flush_client(&agent->clients[i]))
+          drop_client(agent, i);
+      }
+    }
+    if (fds[2].revents & POLLIN) {
+      accept_client(agent);
+      int last = atomic_load(&agent->num_clients) - 1;
+      if (last >= 0 && !flush_client(&agent->clients[last]))
+        drop_client(agent, last);
+    }
+  }
+  return NULL;
+}
+
+int agent_start(Agent *agent) {
+  if (pthread_create(&agent->thread, NULL, agent_thread, agent) != 0)
+    return 0;
+  agent->thread_started = 1;
+  return 1;
+}
+
+void agent_destroy(Agent *agent) {
+  if (agent->thread_started) {
+    uint64_t one = 1;
+    if (write(agent->stop_fd, &one, sizeof(one)) < 0)
+      perror("pulse: agent stop");
+    pthread_join(agent->thread, NULL);
+  }
+  for (int i = 0; i < atomic_load(&agent->num_clients); ++i) {
+    close(agent->clients[i].fd);
+    outbuf_free(&agent->clients[i].out);
+  }
+  if (agent->listen_fd >= 0)
+    close(agent->listen_fd);
+  if (agent->stop_fd >= 0)
+    close(agent->stop_fd);
+  if (agent->ready_fd >= 0)
+    close(agent->ready_fd);
+  if (agent->unix_path) {
+    unlink(agent->unix_path);
+    free(agent->unix_path);
+  }
+  pthread_mutex_destroy(&agent->lock);
+  wire_state_destroy(&agent->states[0]);
+  wire_state_destroy(&agent->states[1]);
+  outbuf_free(&agent->staging_delta);
+  outbuf_free(&agent->staging_keyframe);
+  outbuf_free(&agent->delta);
+  outbuf_free(&agent->keyframe);
+  memset(agent, 0, sizeof(*agent));
+  agent->listen_fd = agent->stop_fd = agent->ready_fd = -1;
+}
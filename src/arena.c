@@ -0,0 +1,104 @@
+#include "../include/arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16
+
+struct ArenaBlock {
+  ArenaBlock *next;
+  size_t size;
+  size_t used;
+  // malloc's alignment carries over to data only if the header is padded
+  // to a whole multiple of ARENA_ALIGN.
+  _Alignas(ARENA_ALIGN) char data[];
+};
+
+static size_t align_up(size_t size) {
+  return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+int arena_init(Arena *arena, size_t initial_size) {
+  memset(arena, 0, sizeof(*arena));
+  arena->size = align_up(initial_size);
+  arena->base = malloc(arena->size);
+  return arena->base != NULL;
+}
+
+static void *overflow_alloc(Arena *arena, size_t size) {
+  ArenaBlock *block = arena->overflow;
+  if (!block || block->size - block->used < size) {
+    size_t block_size = size > arena->size ? size : arena->size;
+    block = malloc(sizeof(ArenaBlock) + block_size);
+    if (!block)
+      return NULL;
+    block->size = block_size;
+    block->used = 0;
+    block->next = arena->overflow;
+    arena->overflow = block;
+  }
+  void *ptr = block->data + block->used;
+  block->used += size;
+  return ptr;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+  size = align_up(size);
+  void *ptr;
+  if (arena->size - arena->used >= size && !arena->overflow) {
+    ptr = arena->base + arena->used;
+    arena->used += size;
+  } else {
+    ptr = overflow_alloc(arena, size);
+    if (!ptr)
+      return NULL;
+  }
+  arena->requested += size;
+  arena->last = ptr;
+  return ptr;
+}
+
+void *arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size) {
+  old_size = align_up(old_size);
+  new_size = align_up(new_size);
+  if (ptr && ptr == arena->last && !arena->overflow &&
+      (char *)ptr + new_size <= arena->base + arena->size) {
+    arena->used += new_size - old_size;
+    arena->requested += new_size - old_size;
+    return ptr;
+  }
+  if (ptr && ptr == arena->last && arena->overflow &&
+      (char *)ptr == arena->overflow->data + arena->overflow->used - old_size &&
+      arena->overflow->used - old_size + new_size <= arena->overflow->size) {
+    arena->overflow->used += new_size - old_size;
+    arena->requested += new_size - old_size;
+    return ptr;
+  }
+  void *moved = arena_alloc(arena, new_size);
+  if (moved && ptr)
+    memcpy(moved, ptr, old_size);
+  return moved;
+}
+
+void arena_reset(Arena *arena) {
+  if (arena->overflow) {
+    while (arena->overflow) {
+      ArenaBlock *next = arena->overflow->next;
+      free(arena->overflow);
+      arena->overflow = next;
+    }
+    char *bigger = realloc(arena->base, arena->requested);
+    if (bigger) {
+      arena->base = bigger;
+      arena->size = arena->requested;
+    }
+  }
+  arena->used = 0;
+  arena->requested = 0;
+  arena->last = NULL;
+}
+
+void arena_destroy(Arena *arena) {
+  arena_reset(arena);
+  free(arena->base);
+  memset(arena, 0, sizeof(*arena));
+}
@@ -0,0 +1,303 @@
+#include "../include/batch.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#define DEFAULT_FIELDS "pid,comm,state,cpu,mem,virt,res"
+
+static const char *const field_names[FIELD_COUNT] = {
+    "pid",      "ppid",     "comm",  "state",   "cpu",
+    "mem",      "virt",     "res",   "threads", "processor",
+    "minflt",   "majflt",   "utime", "stime",   "starttime",
+    "io_read",  "io_write", "pss",   "uss",     "swap",
+};
+
+static int parse_fields(BatchWriter *writer, const char *list) {
+  writer->num_fields = 0;
+  if (strcmp(list, "all") == 0) {
+    for (int f = 0; f < FIELD_COUNT; ++f)
+      writer->fields[writer->num_fields++] = (BatchField)f;
+    return 1;
+  }
+  const char *p = list;
+  while (*p) {
+    size_t len = strcspn(p, ",");
+    int found = -1;
+    for (int f = 0; f < FIELD_COUNT; ++f) {
+      if (strlen(field_names[f]) == len &&
+          strncasecmp(p, field_names[f], len) == 0)
+        found = f;
+    }
+    if (found < 0 || writer->num_fields == FIELD_COUNT) {
+      fprintf(stderr, "pulse: unknown batch field '%.*s' (valid: all", (int)len,
+              p);
+      for (int f = 0; f < FIELD_COUNT; ++f)
+        fprintf(stderr, ", %s", field_names[f]);
+      fprintf(stderr, ")\n");
+      return 0;
+    }
+    writer->fields[writer->num_fields++] = (BatchField)found;
+    p += len;
+    if (*p == ',')
+      p++;
+  }
+  return writer->num_fields > 0;
+}
+
+int batch_init(BatchWriter *writer, const PulseConfig *config) {
+  memset(writer, 0, sizeof(*writer));
+  writer->format = config->batch_format;
+  writer->top_n = config->top_n;
+  outbuf_init(&writer->out);
+  return parse_fields(writer, config->fields ? config->fields : DEFAULT_FIELDS);
+}
+
+void batch_destroy(BatchWriter *writer) { outbuf_free(&writer->out); }
+
+int batch_wants_io(const BatchWriter *writer) {
+  for (int f = 0; f < writer->num_fields; ++f) {
+    if (writer->fields[f] == FIELD_IO_READ ||
+        writer->fields[f] == FIELD_IO_WRITE)
+      return 1;
+  }
+  return 0;
+}
+
+int batch_wants_memory(const BatchWriter *writer) {
+  for (int f = 0; f < writer->num_fields; ++f) {
+    if (writer->fields[f] == FIELD_PSS || writer->fields[f] == FIELD_USS ||
+        writer->fields[f] == FIELD_SWAP)
+      return 1;
+  }
+  return 0;
+}
+
+// Rates are unknown (rather than zero) when /proc/<pid>/io is unreadable.
+static void emit_rate(BatchWriter *writer, const ProcessInfo *p, double rate) {
+  if (p->stats.has_io)
+    outbuf_fixed(&writer->out, rate, 0);
+  else if (writer->format == OUTPUT_NDJSON)
+    outbuf_str(&writer->out, "null");
+}
+
+// Likewise PSS, USS and swap until smaps_rollup has been read.
+static void emit_smaps(BatchWriter *writer, const ProcessInfo *p,
+                       unsigned long kb) {
+  if (p->has_smaps)
+    outbuf_u64(&writer->out, kb);
+  else if (writer->format == OUTPUT_NDJSON)
+    outbuf_str(&writer->out, "null");
+}
+
+static void emit_field(BatchWriter *writer, const ProcessInfo *p,
+                       BatchField field) {
+  OutBuf *out = &writer->out;
+  const pidStats *s = &p->stats;
+  switch (field) {
+  case FIELD_PID:
+    outbuf_i64(out, s->pid);
+    break;
+  case FIELD_PPID:
+    outbuf_i64(out, s->ppid);
+    break;
+  case FIELD_COMM:
+    if (writer->format == OUTPUT_CSV)
+      outbuf_csv_string(out, s->comm);
+    else
+      outbuf_json_string(out, s->comm);
+    break;
+  case FIELD_STATE: {
+    char state[2] = {s->state, '\0'};
+    if (writer->format == OUTPUT_CSV)
+      outbuf_csv_string(out, state);
+    else
+      outbuf_json_string(out, state);
+    break;
+  }
+  case FIELD_CPU:
+    outbuf_fixed(out, p->cpu_percent, 2);
+    break;
+  case FIELD_MEM:
+    outbuf_fixed(out, p->mem_percent, 2);
+    break;
+  case FIELD_VIRT:
+    outbuf_i64(out, s->vsize / 1024);
+    break;
+  case FIELD_RES:
+    outbuf_i64(out, s->rss_kb);
+    break;
+  case FIELD_THREADS:
+    outbuf_i64(out, s->num_threads);
+    break;
+  case FIELD_PROCESSOR:
+    outbuf_i64(out, s->processor);
+    break;
+  case FIELD_MINFLT:
+    outbuf_u64(out, s->minflt);
+    break;
+  case FIELD_MAJFLT:
+    outbuf_u64(out, s->majflt);
+    break;
+  case FIELD_UTIME:
+    outbuf_u64(out, s->utime);
+    break;
+  case FIELD_STIME:
+    outbuf_u64(out, s->stime);
+    break;
+  case FIELD_STARTTIME:
+    outbuf_u64(out, s->starttime);
+    break;
+  case FIELD_IO_READ:
+    emit_rate(writer, p, p->read_rate);
+    break;
+  case FIELD_IO_WRITE:
+    emit_rate(writer, p, p->write_rate);
+    break;
+  case FIELD_PSS:
+    emit_smaps(writer, p, p->smaps.pss);
+    break;
+  case FIELD_USS:
+    emit_smaps(writer, p, p->smaps.uss);
+    break;
+  case FIELD_SWAP:
+    emit_smaps(writer, p, p->smaps.swap);
+    break;
+  case FIELD_COUNT:
+    break;
+  }
+}
+
+static int rows_to_emit(const BatchWriter *writer, const Snapshot *snapshot) {
+  if (writer->top_n > 0 && writer->top_n < snapshot->num_processes)
+    return writer->top_n;
+  return snapshot->num_processes;
+}
+
+// One JSON object per tick: system totals followed by the process rows.
+static void format_ndjson(BatchWriter *writer, const Snapshot *snapshot) {
+  OutBuf *out = &writer->out;
+  const memStats *mem = &snapshot->mem_info;
+
+  outbuf_str(out, "{\"timestamp\":");
+  outbuf_u64(out, snapshot->timestamp_ms);
+  outbuf_str(out, ",\"cpu\":[");
+  for (int i = 0; i < snapshot->num_total_cpu_entries; ++i) {
+    if (i > 0)
+      outbuf_char(out, ',');
+    outbuf_fixed(out, snapshot->cpu.usage[i], 2);
+  }
+  outbuf_str(out, "],\"cpu_steal\":[");
+  for (int i = 0; i < snapshot->num_total_cpu_entries; ++i) {
+    if (i > 0)
+      outbuf_char(out, ',');
+    outbuf_fixed(out, snapshot->cpu.steal[i], 2);
+  }
+  outbuf_str(out, "],\"mem\":{\"total\":");
+  outbuf_u64(out, mem->memTotal);
+  outbuf_str(out, ",\"available\":");
+  outbuf_u64(out, mem->memAvailable);
+  outbuf_str(out, ",\"swap_total\":");
+  outbuf_u64(out, mem->swapTotal);
+  outbuf_str(out, ",\"swap_free\":");
+  outbuf_u64(out, mem->swapFree);
+  outbuf_str(out, "},\"disks\":[");
+  for (int i = 0; i < snapshot->num_disks; ++i) {
+    const DiskInfo *d = &snapshot->disks[i];
+    outbuf_str(out, i > 0 ? ",{\"name\":" : "{\"name\":");
+    outbuf_json_string(out, d->name);
+    outbuf_str(out, ",\"read_bps\":");
+    outbuf_fixed(out, d->read_rate, 0);
+    outbuf_str(out, ",\"write_bps\":");
+    outbuf_fixed(out, d->write_rate, 0);
+    outbuf_str(out, ",\"read_iops\":");
+    outbuf_fixed(out, d->read_iops, 1);
+    outbuf_str(out, ",\"write_iops\":");
+    outbuf_fixed(out, d->write_iops, 1);
+    outbuf_str(out, ",\"util\":");
+    outbuf_fixed(out, d->utilization, 1);
+    outbuf_char(out, '}');
+  }
+  outbuf_str(out, "],\"net\":[");
+  for (int i = 0; i < snapshot->num_nets; ++i) {
+    const NetInfo *n = &snapshot->nets[i];
+    outbuf_str(out, i > 0 ? ",{\"name\":" : "{\"name\":");
+    outbuf_json_string(out, n->name);
+    outbuf_str(out, ",\"rx_bps\":");
+    outbuf_fixed(out, n->rx_rate, 0);
+    outbuf_str(out, ",\"tx_bps\":");
+    outbuf_fixed(out, n->tx_rate, 0);
+    outbuf_str(out, ",\"rx_packets\":");
+    outbuf_fixed(out, n->rx_packets, 1);
+    outbuf_str(out, ",\"tx_packets\":");
+    outbuf_fixed(out, n->tx_packets, 1);
+    outbuf_str(out, ",\"rx_drops\":");
+    outbuf_fixed(out, n->rx_drops, 1);
+    outbuf_str(out, ",\"tx_drops\":");
+    outbuf_fixed(out, n->tx_drops, 1);
+    outbuf_char(out, '}');
+  }
+  outbuf_str(out, "],\"tcp_retrans\":");
+  if (snapshot->tcp_retrans_rate >= 0.0)
+    outbuf_fixed(out, snapshot->tcp_retrans_rate, 1);
+  else
+    outbuf_str(out, "null");
+  outbuf_str(out, ",\"processes\":[");
+
+  int rows = rows_to_emit(writer, snapshot);
+  for (int i = 0; i < rows; ++i) {
+    const ProcessInfo *p = &snapshot->processed_list[i];
+    outbuf_char(out, i > 0 ? ',' : '{');
+    if (i > 0)
+      outbuf_char(out, '{');
+    for (int f = 0; f < writer->num_fields; ++f) {
+      if (f > 0)
+        outbuf_char(out, ',');
+      outbuf_char(out, '"');
+      outbuf_str(out, field_names[writer->fields[f]]);
+      outbuf_str(out, "\":");
+      emit_field(writer, p, writer->fields[f]);
+    }
+    outbuf_char(out, '}');
+  }
+  outbuf_str(out, "]}\n");
+}
+
+// One row per process, prefixed with the tick's timestamp.
+static void format_csv(BatchWriter *writer, const Snapshot *snapshot) {
+  OutBuf *out = &writer->out;
+  if (!writer->header_written) {
+    outbuf_str(out, "timestamp");
+    for (int f = 0; f < writer->num_fields; ++f) {
+      outbuf_char(out, ',');
+      outbuf_str(out, field_names[writer->fields[f]]);
+    }
+    outbuf_char(out, '\n');
+    writer->header_written = 1;
+  }
+
+  int rows = rows_to_emit(writer, snapshot);
+  for (int i = 0; i < rows; ++i) {
+    const ProcessInfo *p = &snapshot->processed_list[i];
+    outbuf_u64(out, snapshot->timestamp_ms);
+    for (int f = 0; f < writer->num_fields; ++f) {
+      outbuf_char(out, ',');
+      emit_field(writer, p, writer->fields[f]);
+    }
+    outbuf_char(out, '\n');
+  }
+}
+
+void batch_format(BatchWriter *writer, const Snapshot *snapshot) {
+  outbuf_reset(&writer->out);
+  if (writer->format == OUTPUT_CSV)
+    format_csv(writer, snapshot);
+  else
+    format_ndjson(writer, snapshot);
+}
+
+int batch_emit(BatchWriter *writer, const Snapshot *snapshot, int fd) {
+  batch_format(writer, snapshot);
+  if (writer->out.failed)
+    return 0;
+  return outbuf_write_all(&writer->out, fd);
+}
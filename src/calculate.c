@@ -2,36 +2,160 @@
 #include "../include/parser.h"
 #include <string.h>
 
-void updateCpuState(cpuStat *prevCpuStats, cpuStat *currentCpuStats,
+void updateCpuState(cpuStats *prevCpuStats, const cpuStats *currentCpuStats,
                     int num_entries) {
-  memcpy(prevCpuStats, currentCpuStats, sizeof(cpuStat) * num_entries);
+  for (int f = 0; f < CPU_FIELDS; ++f)
+    memcpy(prevCpuStats->field[f], currentCpuStats->field[f],
+           sizeof(unsigned long long) * num_entries);
 }
 
-void cpuUsage(cpuStat *prevCpuStats, cpuStat *currentCpuStats, double *usage,
-              int num_entries) {
-  for (int i = 0; i < num_entries; i++) {
-    unsigned long long prevIdle = prevCpuStats[i].idle + prevCpuStats[i].iowait;
-    unsigned long long idle =
-        currentCpuStats[i].idle + currentCpuStats[i].iowait;
+// guest and guest_nice are left out since user and nice already count them.
+unsigned long long cpuTotal(const cpuStats *stats, int entry) {
+  unsigned long long total = 0;
+  for (int f = CPU_USER; f <= CPU_STEAL; ++f)
+    total += stats->field[f][entry];
+  return total;
+}
+
+// Exact for counters below 2^52 ticks: plants the value in the mantissa of
+// 2^52 and subtracts it again. Unlike a plain conversion from 64-bit
+// integers this has vector forms on every x86-64 and arm64.
+static inline double counter_value(unsigned long long ticks) {
+  unsigned long long bits = ticks | 0x4330000000000000ULL;
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value - 0x1p52;
+}
+
+// Counters only go backwards across CPU hotplug; treat that as no time.
+static inline double counter_delta(unsigned long long prev,
+                                   unsigned long long curr) {
+  double delta = counter_value(curr) - counter_value(prev);
+  return delta > 0.0 ? delta : 0.0;
+}
 
-    unsigned long long prevNonIdle =
-        prevCpuStats[i].user + prevCpuStats[i].nice + prevCpuStats[i].system +
-        prevCpuStats[i].irq + prevCpuStats[i].softirq;
-    unsigned long long nonIdle =
-        currentCpuStats[i].user + currentCpuStats[i].nice +
-        currentCpuStats[i].system + currentCpuStats[i].irq +
-        currentCpuStats[i].softirq;
+// One branch-free pass over one array per counter, rounded up to whole
+// CPU_LANES blocks (the arrays are padded to match) so that even -O2 turns
+// it into vector code with no scalar tail; each lane is one CPU entry. The
+// outputs are restrict parameters so no runtime alias checks are needed.
+static void usage_kernel(unsigned long long *const *prev,
+                         unsigned long long *const *curr, int padded,
+                         double *restrict busy_out, double *restrict user_out,
+                         double *restrict system_out,
+                         double *restrict iowait_out,
+                         double *restrict steal_out) {
+  for (int i = 0; i < padded; i++) {
+    double user = counter_delta(prev[CPU_USER][i], curr[CPU_USER][i]) +
+                  counter_delta(prev[CPU_NICE][i], curr[CPU_NICE][i]);
+    double system = counter_delta(prev[CPU_SYSTEM][i], curr[CPU_SYSTEM][i]) +
+                    counter_delta(prev[CPU_IRQ][i], curr[CPU_IRQ][i]) +
+                    counter_delta(prev[CPU_SOFTIRQ][i], curr[CPU_SOFTIRQ][i]);
+    double idle = counter_delta(prev[CPU_IDLE][i], curr[CPU_IDLE][i]);
+    double iowait = counter_delta(prev[CPU_IOWAIT][i], curr[CPU_IOWAIT][i]);
+    double steal = counter_delta(prev[CPU_STEAL][i], curr[CPU_STEAL][i]);
+    double total = user + system + idle + iowait + steal;
 
-    unsigned long long prevTotal = prevIdle + prevNonIdle;
-    unsigned long long total = idle + nonIdle;
+    // Divides unconditionally; an entry with no ticks has zero deltas anyway.
+    double scale = 100.0 / (total + (total == 0.0));
+    user_out[i] = user * scale;
+    system_out[i] = system * scale;
+    iowait_out[i] = iowait * scale;
+    steal_out[i] = steal * scale;
+    busy_out[i] = (user + system + steal) * scale;
+  }
+}
+
+void cpuUsage(const cpuStats *prevCpuStats, const cpuStats *currentCpuStats,
+              CpuUsage *usage, int num_entries) {
+  usage_kernel(prevCpuStats->field, currentCpuStats->field,
+               cpu_lanes_round(num_entries), usage->usage, usage->user,
+               usage->system, usage->iowait, usage->steal);
+}
 
-    unsigned long long totald = total - prevTotal;
-    unsigned long long idled = idle - prevIdle;
+#define SECTOR_SIZE 512
 
-    if (totald > 0) {
-      usage[i] = ((double)(totald - idled) / (double)totald) * 100.0;
+// Counters restart from zero when a device is re-added or a driver reloads;
+// treat that as no activity rather than a huge rate.
+static double delta_rate(unsigned long long prev, unsigned long long curr,
+                         double elapsed_sec) {
+  return curr >= prev ? (double)(curr - prev) / elapsed_sec : 0.0;
+}
+
+// Devices are matched by name, so one that appears or disappears between
+// ticks is simply skipped for that tick. /proc/diskstats keeps a stable
+// order, which makes the same index the usual hit.
+int diskUsage(const diskStat *prevDiskStats, int num_prev,
+              const diskStat *currentDiskStats, int num_current,
+              double elapsed_sec, DiskInfo *usage) {
+  int count = 0;
+  if (elapsed_sec <= 0.0)
+    return 0;
+  for (int i = 0; i < num_current; i++) {
+    const diskStat *curr = &currentDiskStats[i];
+    const diskStat *prev = NULL;
+    if (i < num_prev && strcmp(prevDiskStats[i].name, curr->name) == 0) {
+      prev = &prevDiskStats[i];
     } else {
-      usage[i] = 0.0;
+      for (int j = 0; j < num_prev && !prev; j++) {
+        if (strcmp(prevDiskStats[j].name, curr->name) == 0)
+          prev = &prevDiskStats[j];
+      }
+    }
+    if (!prev)
+      continue;
+
+    DiskInfo *info = &usage[count++];
+    memcpy(info->name, curr->name, sizeof(info->name));
+    info->read_rate =
+        delta_rate(prev->sectors_read, curr->sectors_read, elapsed_sec) *
+        SECTOR_SIZE;
+    info->write_rate =
+        delta_rate(prev->sectors_written, curr->sectors_written, elapsed_sec) *
+        SECTOR_SIZE;
+    info->read_iops = delta_rate(prev->reads, curr->reads, elapsed_sec);
+    info->write_iops = delta_rate(prev->writes, curr->writes, elapsed_sec);
+    info->utilization =
+        delta_rate(prev->io_ticks, curr->io_ticks, elapsed_sec) / 10.0;
+    if (info->utilization > 100.0)
+      info->utilization = 100.0;
+  }
+  return count;
+}
+
+// Interfaces come and go with containers, which shifts the rest of
+// /proc/net/dev up or down. Searching onward from the last match keeps the
+// common cases linear however many veths the host has.
+int netUsage(const netStat *prevNetStats, int num_prev,
+             const netStat *currentNetStats, int num_current,
+             double elapsed_sec, NetInfo *usage) {
+  int count = 0;
+  int hint = 0;
+  if (elapsed_sec <= 0.0 || num_prev == 0)
+    return 0;
+  for (int i = 0; i < num_current; i++) {
+    const netStat *curr = &currentNetStats[i];
+    const netStat *prev = NULL;
+    for (int n = 0; n < num_prev; n++) {
+      int j = (hint + n) % num_prev;
+      if (strcmp(prevNetStats[j].name, curr->name) == 0) {
+        prev = &prevNetStats[j];
+        hint = j + 1;
+        break;
+      }
     }
+    if (!prev)
+      continue;
+
+    NetInfo *info = &usage[count++];
+    memcpy(info->name, curr->name, sizeof(info->name));
+    info->rx_rate = delta_rate(prev->rx_bytes, curr->rx_bytes, elapsed_sec);
+    info->tx_rate = delta_rate(prev->tx_bytes, curr->tx_bytes, elapsed_sec);
+    info->rx_packets =
+        delta_rate(prev->rx_packets, curr->rx_packets, elapsed_sec);
+    info->tx_packets =
+        delta_rate(prev->tx_packets, curr->tx_packets, elapsed_sec);
+    info->rx_drops = delta_rate(prev->rx_drops, curr->rx_drops, elapsed_sec);
+    info->tx_drops = delta_rate(prev->tx_drops, curr->tx_drops, elapsed_sec);
   }
+  return count;
 }
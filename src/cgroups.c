@@ -0,0 +1,335 @@
+#include "../include/cgroups.h"
+#include "../include/parser.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CGROUPS_INITIAL_CAPACITY 64
+#define CGROUPS_DEFAULT_ROOT "/sys/fs/cgroup"
+// Where a hybrid (v1 + v2) host mounts the v2 hierarchy.
+#define CGROUPS_HYBRID_ROOT "/sys/fs/cgroup/unified"
+
+typedef struct {
+  int node;
+  int parent;
+  double cpu;
+  const char *path;
+} SiblingKey;
+
+static unsigned int hash_path(const char *path) {
+  unsigned int hash = 2166136261u;
+  for (; *path; ++path)
+    hash = (hash ^ (unsigned char)*path) * 16777619u;
+  return hash;
+}
+
+static int open_root(const char *path) {
+  int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd >= 0 && faccessat(fd, "cgroup.controllers", F_OK, 0) != 0) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+int cgroups_init(CgroupTable *table, const char *proc_root,
+                 const char *cgroup_root) {
+  memset(table, 0, sizeof(*table));
+  table->proc_fd = open(proc_root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (cgroup_root) {
+    table->root_fd = open_root(cgroup_root);
+  } else {
+    table->root_fd = open_root(CGROUPS_DEFAULT_ROOT);
+    if (table->root_fd < 0)
+      table->root_fd = open_root(CGROUPS_HYBRID_ROOT);
+  }
+  table->capacity = CGROUPS_INITIAL_CAPACITY;
+  table->nodes = calloc(table->capacity, sizeof(CgroupNode));
+  table->index_capacity = table->capacity * 2;
+  table->index = calloc(table->index_capacity, sizeof(int));
+  if (!table->nodes || !table->index) {
+    cgroups_destroy(table);
+    return 0;
+  }
+  return 1;
+}
+
+static void close_node(CgroupNode *node) {
+  if (node->cpu_fd >= 0)
+    close(node->cpu_fd);
+  if (node->memory_fd >= 0)
+    close(node->memory_fd);
+  if (node->pressure_fd >= 0)
+    close(node->pressure_fd);
+  free(node->path);
+  memset(node, 0, sizeof(*node));
+}
+
+void cgroups_destroy(CgroupTable *table) {
+  for (int i = 0; i < table->num_nodes; ++i) {
+    if (table->nodes[i].path)
+      close_node(&table->nodes[i]);
+  }
+  free(table->nodes);
+  free(table->index);
+  if (table->proc_fd >= 0)
+    close(table->proc_fd);
+  if (table->root_fd >= 0)
+    close(table->root_fd);
+  memset(table, 0, sizeof(*table));
+  table->proc_fd = table->root_fd = -1;
+}
+
+// Index slots hold a node index plus one; zero is empty.
+static int *index_slot(const CgroupTable *table, const char *path) {
+  unsigned int mask = (unsigned int)table->index_capacity - 1;
+  unsigned int i = hash_path(path) & mask;
+  while (table->index[i] != 0 &&
+         strcmp(table->nodes[table->index[i] - 1].path, path) != 0)
+    i = (i + 1) & mask;
+  return &table->index[i];
+}
+
+static int rebuild_index(CgroupTable *table, int index_capacity) {
+  int *index = calloc(index_capacity, sizeof(int));
+  if (!index)
+    return 0;
+  free(table->index);
+  table->index = index;
+  table->index_capacity = index_capacity;
+  for (int i = 0; i < table->num_nodes; ++i) {
+    if (table->nodes[i].path)
+      *index_slot(table, table->nodes[i].path) = i + 1;
+  }
+  return 1;
+}
+
+static int free_slot(CgroupTable *table) {
+  for (int i = 0; i < table->num_nodes; ++i) {
+    if (!table->nodes[i].path)
+      return i;
+  }
+  if (table->num_nodes == table->capacity) {
+    int capacity = table->capacity * 2;
+    CgroupNode *nodes = realloc(table->nodes, sizeof(CgroupNode) * capacity);
+    if (!nodes)
+      return -1;
+    table->nodes = nodes;
+    table->capacity = capacity;
+    if (!rebuild_index(table, capacity * 2))
+      return -1;
+  }
+  memset(&table->nodes[table->num_nodes], 0, sizeof(CgroupNode));
+  return table->num_nodes++;
+}
+
+static int open_node_file(const CgroupTable *table, const char *path,
+                          const char *file) {
+  char name[PATH_MAX];
+  // Paths are absolute within the hierarchy; "/" is the root itself.
+  if (snprintf(name, sizeof(name), "%s/%s", path[1] ? path + 1 : ".",
+               file) >= (int)sizeof(name))
+    return -1;
+  return openat(table->root_fd, name, O_RDONLY | O_CLOEXEC);
+}
+
+static int find_or_add(CgroupTable *table, const char *path) {
+  int *slot = index_slot(table, path);
+  if (*slot != 0)
+    return *slot - 1;
+
+  int parent = -1;
+  const char *last = strrchr(path, '/');
+  if (last && last != path) {
+    char parent_path[PATH_MAX];
+    size_t len = (size_t)(last - path);
+    if (len >= sizeof(parent_path))
+      return -1;
+    memcpy(parent_path, path, len);
+    parent_path[len] = '\0';
+    parent = find_or_add(table, parent_path);
+  } else if (path[1] != '\0') {
+    parent = find_or_add(table, "/");
+  }
+
+  int i = free_slot(table);
+  if (i < 0)
+    return -1;
+  CgroupNode *node = &table->nodes[i];
+  node->path = strdup(path);
+  if (!node->path)
+    return -1;
+  node->parent = parent;
+  node->depth = parent >= 0 ? table->nodes[parent].depth + 1 : 0;
+  node->seen = table->generation - 1;
+  node->cpu_fd = open_node_file(table, path, "cpu.stat");
+  node->memory_fd = open_node_file(table, path, "memory.current");
+  node->pressure_fd = open_node_file(table, path, "memory.pressure");
+  // Adding parents or growing may have moved the slot.
+  *index_slot(table, path) = i + 1;
+  return i;
+}
+
+// Reads /proc/<pid>/cgroup and returns the process's node, or -1 when it has
+// no v2 group (or there is no v2 hierarchy to read it from).
+int cgroups_lookup(CgroupTable *table, int pid) {
+  if (table->root_fd < 0 || table->proc_fd < 0)
+    return -1;
+  char name[32];
+  snprintf(name, sizeof(name), "%d/cgroup", pid);
+  int fd = openat(table->proc_fd, name, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  ssize_t len = read(fd, table->buffer, sizeof(table->buffer) - 1);
+  close(fd);
+  if (len <= 0)
+    return -1;
+  table->buffer[len] = '\0';
+  char path[PATH_MAX];
+  if (!cgroupPathParser(table->buffer, path, sizeof(path)) || path[0] != '/')
+    return -1;
+  return find_or_add(table, path);
+}
+
+void cgroups_begin_tick(CgroupTable *table) { table->generation++; }
+
+// Counts a live process against its group and every ancestor.
+void cgroups_add_process(CgroupTable *table, int node) {
+  for (int i = node; i >= 0 && i < table->num_nodes;
+       i = table->nodes[i].parent) {
+    CgroupNode *n = &table->nodes[i];
+    if (n->seen != table->generation) {
+      n->seen = table->generation;
+      n->num_procs = 0;
+    }
+    n->num_procs++;
+  }
+}
+
+// Drops groups nobody was counted in this tick and returns how many are
+// left. Children always go with their parents, since a process marks the
+// whole chain.
+int cgroups_sweep(CgroupTable *table) {
+  int live = 0, removed = 0;
+  for (int i = 0; i < table->num_nodes; ++i) {
+    CgroupNode *node = &table->nodes[i];
+    if (!node->path)
+      continue;
+    if (node->seen == table->generation) {
+      live++;
+    } else {
+      close_node(node);
+      removed = 1;
+    }
+  }
+  while (table->num_nodes > 0 && !table->nodes[table->num_nodes - 1].path)
+    table->num_nodes--;
+  if (removed)
+    rebuild_index(table, table->index_capacity);
+  return live;
+}
+
+static char *pread_text(CgroupTable *table, int fd) {
+  if (fd < 0)
+    return NULL;
+  ssize_t len = pread(fd, table->buffer, sizeof(table->buffer) - 1, 0);
+  if (len <= 0)
+    return NULL;
+  table->buffer[len] = '\0';
+  return table->buffer;
+}
+
+static void read_node(CgroupTable *table, CgroupNode *node,
+                      unsigned long long now, int num_cores,
+                      CgroupInfo *info) {
+  snprintf(info->path, sizeof(info->path), "%s", node->path);
+  info->depth = node->depth;
+  info->num_procs = node->num_procs;
+  info->cpu_percent = 0.0;
+  char *text = pread_text(table, node->cpu_fd);
+  cgroupCpuStat cpu;
+  if (text && cgroupCpuParser(text, &cpu)) {
+    // The view may have been off since the last read, so the rate spans
+    // back to it rather than over one interval.
+    double usec = (double)(now - node->usage_ns) / 1e3 * num_cores;
+    if (node->has_usage && cpu.usage_usec >= node->usage_usec && usec > 0.0)
+      info->cpu_percent =
+          100.0 * (double)(cpu.usage_usec - node->usage_usec) / usec;
+    node->has_usage = 1;
+    node->usage_usec = cpu.usage_usec;
+    node->usage_ns = now;
+  }
+  text = pread_text(table, node->memory_fd);
+  info->has_memory = text != NULL;
+  info->memory_bytes = text ? strtoull(text, NULL, 10) : 0;
+  pressureStat pressure;
+  text = pread_text(table, node->pressure_fd);
+  info->has_pressure = text && pressureParser(text, &pressure);
+  info->pressure_some = info->has_pressure ? pressure.some_avg10 : 0.0;
+  info->pressure_full = info->has_pressure ? pressure.full_avg10 : 0.0;
+}
+
+// Parents before children, busiest siblings first.
+static int compare_siblings(const void *a, const void *b) {
+  const SiblingKey *x = a, *y = b;
+  if (x->parent != y->parent)
+    return x->parent < y->parent ? -1 : 1;
+  if (x->cpu != y->cpu)
+    return x->cpu < y->cpu ? 1 : -1;
+  return strcmp(x->path, y->path);
+}
+
+// Reads every live group's files into `out` in tree order, with CPU time as
+// a share of the whole machine like the process rows. Returns the number of
+// rows written.
+int cgroups_read(CgroupTable *table, Arena *arena, unsigned long long now,
+                 int num_cores, CgroupInfo *out, int max) {
+  int n = table->num_nodes;
+  CgroupInfo *rows = arena_alloc(arena, sizeof(CgroupInfo) * (n + 1));
+  SiblingKey *keys = arena_alloc(arena, sizeof(SiblingKey) * (n + 1));
+  int *first_child = arena_alloc(arena, sizeof(int) * (n + 1));
+  int *num_children = arena_alloc(arena, sizeof(int) * (n + 1));
+  int *stack = arena_alloc(arena, sizeof(int) * (n + 1));
+  if (!rows || !keys || !first_child || !num_children || !stack)
+    return 0;
+  if (num_cores < 1)
+    num_cores = 1;
+
+  int live = 0;
+  for (int i = 0; i < n; ++i) {
+    CgroupNode *node = &table->nodes[i];
+    num_children[i] = 0;
+    if (!node->path || node->seen != table->generation)
+      continue;
+    read_node(table, node, now, num_cores, &rows[i]);
+    keys[live].node = i;
+    keys[live].parent = node->parent;
+    keys[live].cpu = rows[i].cpu_percent;
+    keys[live].path = node->path;
+    live++;
+  }
+  qsort(keys, live, sizeof(SiblingKey), compare_siblings);
+  int roots = 0;
+  for (int k = 0; k < live; ++k) {
+    int parent = keys[k].parent;
+    if (parent < 0) {
+      roots++;
+    } else if (num_children[parent]++ == 0) {
+      first_child[parent] = k;
+    }
+  }
+
+  int count = 0, depth = 0;
+  for (int k = roots - 1; k >= 0; --k)
+    stack[depth++] = keys[k].node;
+  while (depth > 0 && count < max) {
+    int node = stack[--depth];
+    out[count++] = rows[node];
+    for (int c = num_children[node] - 1; c >= 0; --c)
+      stack[depth++] = keys[first_child[node] + c].node;
+  }
+  return count;
+}
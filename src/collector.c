@@ -0,0 +1,1119 @@
+#include "../include/collector.h"
+#include "../include/calculate.h"
+#include "../include/timing.h"
+#include "../include/topk.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define INITIAL_BUFFER_SIZE 4096
+#define INITIAL_ARENA_SIZE (256 * 1024)
+#define INITIAL_TABLE_CAPACITY 1024
+// Sampled ticks without CPU time before a process is demoted to cold.
+#define HOT_IDLE_SAMPLES 3
+// Percent of one CPU by which the busy time in /proc/stat that the
+// processes read since the last scan do not account for may exceed its
+// usual level before all cold processes are read on the next one.
+#define COLD_WAKE_CPU 20.0
+// Weight of each scan in that usual level, a moving average.
+#define COLD_GAP_WEIGHT 0.125
+// Threads read per tick in the thread view, whatever the host runs.
+#define THREAD_SCAN_BUDGET 4096
+// Percent of one CPU a process must use before its threads are listed.
+#define THREAD_EXPAND_CPU 10.0
+// Threads a process may gain between its stat read and the task scan.
+#define THREAD_SLACK 16
+// How long a process's smaps_rollup read is shown before it is read again.
+#define SMAPS_TTL_NS 5000000000ULL
+
+typedef struct {
+  double cpu;
+  double read;
+  double write;
+} ProcRates;
+
+// The threads listed under the process in row `row` of the sorted keys,
+// in the order of `order`.
+typedef struct {
+  int row;
+  int count;
+  pidStats *items;
+  ProcRates *rates;
+  SortKey *order;
+} ThreadGroup;
+
+typedef struct {
+  ThreadGroup *groups;
+  int num_groups;
+  int count;
+} ThreadRows;
+
+const char *const collector_stage_names[STAGE_COUNT] = {
+    "readdir", "read", "parse", "delta", "sort", "publish",
+};
+
+// A counter that went backwards (a reset) reports no activity.
+static double counter_rate(unsigned long long prev, unsigned long long curr,
+                           double elapsed_sec) {
+  return curr >= prev ? (double)(curr - prev) / elapsed_sec : 0.0;
+}
+
+// Cold processes are read on a schedule staggered by pid, one tick in
+// cold_interval, and republish their last sample in between, unless
+// wake_cold asks for all of them. A PID recycled while cold goes unnoticed
+// until its next sample at most cold_interval ticks later, when the
+// starttime check resets the entry.
+static int skip_sample(const Collector *collector, const ProcEntry *entry) {
+  if (collector->cold_interval <= 1 || entry->hot || collector->wake_cold)
+    return 0;
+  if (entry->last_index < 0 || entry->last_index >= collector->prev_count ||
+      collector->prev_items[entry->last_index].pid != entry->pid)
+    return 0;
+  return (collector->tick + (unsigned int)entry->pid) %
+             (unsigned int)collector->cold_interval !=
+         0;
+}
+
+// A cold process that turns busy shows up as busy time in /proc/stat that
+// the processes read since the last scan do not account for; `sampled` is
+// their CPU time over that span. Some of that gap is always there, from
+// processes that exited in between and kernel work charged to no process,
+// so only a jump above its moving average counts. A scan that read every
+// process overcounts the cold ones and is left out of the average.
+static void check_cold(Collector *collector, unsigned long long sampled) {
+  if (collector->num_cpu_entries == 0 ||
+      collector->cpu_total == collector->scan_total)
+    return;
+  const cpuStats *curr = &collector->currCpuStats;
+  unsigned long long busy = curr->field[CPU_USER][0] +
+                            curr->field[CPU_NICE][0] +
+                            curr->field[CPU_SYSTEM][0];
+  unsigned long long total_delta = collector->cpu_total - collector->scan_total;
+  unsigned long long busy_delta = busy - collector->scan_busy;
+  int cores = collector->num_cpu_entries > 1 ? collector->num_cpu_entries - 1
+                                             : 1;
+  int valid = collector->scan_total > 0 && busy >= collector->scan_busy;
+  collector->scan_total = collector->cpu_total;
+  collector->scan_busy = busy;
+  int woken = collector->wake_cold;
+  collector->wake_cold = 0;
+  if (!valid || woken)
+    return;
+
+  double gap = busy_delta > sampled ? 100.0 * (double)(busy_delta - sampled) *
+                                          cores / (double)total_delta
+                                    : 0.0;
+  if (!collector->has_cold_gap) {
+    collector->cold_gap = gap;
+    collector->has_cold_gap = 1;
+    return;
+  }
+  collector->wake_cold = gap >= collector->cold_gap + COLD_WAKE_CPU;
+  collector->cold_gap += (gap - collector->cold_gap) * COLD_GAP_WEIGHT;
+}
+
+static const pidStats *reuse_cold(void *ctx, int pid) {
+  const Collector *collector = ctx;
+  const ProcEntry *entry = proctable_find(&collector->procs, pid);
+  if (!entry || !skip_sample(collector, entry))
+    return NULL;
+  return &collector->prev_items[entry->last_index];
+}
+
+static char *join_path(const char *root, const char *name) {
+  size_t len = strlen(root) + strlen(name) + 2;
+  char *path = malloc(len);
+  if (path)
+    snprintf(path, len, "%s/%s", root, name);
+  return path;
+}
+
+static int reserve_cpu_stats(Collector *collector, int needed) {
+  return cpuStatsReserve(&collector->prevCpuStats, needed) &&
+         cpuStatsReserve(&collector->currCpuStats, needed);
+}
+
+// The sysfs tree beside `proc_root`: /sys for /proc, /host/sys for
+// /host/proc.
+static int open_sys_block(const char *proc_root) {
+  char path[4096];
+  size_t len = strlen(proc_root);
+  while (len > 1 && proc_root[len - 1] == '/')
+    --len;
+  while (len > 0 && proc_root[len - 1] != '/')
+    --len;
+  while (len > 0 && proc_root[len - 1] == '/')
+    --len;
+  if (len > 0)
+    snprintf(path, sizeof(path), "%.*s/sys/block", (int)len, proc_root);
+  else
+    snprintf(path, sizeof(path), "%ssys/block", proc_root[0] == '/' ? "/" : "");
+  return open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+// Partitions, loop and ram devices would only repeat or pad out the figures
+// of the disks that matter, so only whole devices are kept. Without sysfs
+// every other device counts as one.
+static int whole_disk(int sys_block_fd, const char *name) {
+  if (strncmp(name, "loop", 4) == 0 || strncmp(name, "ram", 3) == 0)
+    return 0;
+  if (sys_block_fd < 0)
+    return 1;
+  char entry[32];
+  snprintf(entry, sizeof(entry), "%s", name);
+  for (char *p = entry; *p; ++p) {
+    if (*p == '/')
+      *p = '!';
+  }
+  return faccessat(sys_block_fd, entry, F_OK, 0) == 0;
+}
+
+// Asks sysfs about the devices in `disks` only when they differ from the
+// ones of the last read, which they rarely do. Returns 0 if the decisions
+// could not be stored.
+static int classify_disks(Collector *collector, const diskStat *disks,
+                          int count) {
+  if (count == collector->num_disk_kinds) {
+    int i = 0;
+    while (i < count &&
+           strcmp(collector->disk_kinds[i].name, disks[i].name) == 0)
+      ++i;
+    if (i == count)
+      return 1;
+  }
+  if (count > collector->disk_kind_capacity) {
+    DiskKind *grown =
+        realloc(collector->disk_kinds, sizeof(DiskKind) * count);
+    if (!grown) {
+      collector->num_disk_kinds = 0;
+      return 0;
+    }
+    collector->disk_kinds = grown;
+    collector->disk_kind_capacity = count;
+  }
+  for (int i = 0; i < count; ++i) {
+    DiskKind *kind = &collector->disk_kinds[i];
+    memcpy(kind->name, disks[i].name, sizeof(kind->name));
+    kind->whole = whole_disk(collector->sys_block_fd, disks[i].name);
+  }
+  collector->num_disk_kinds = count;
+  return 1;
+}
+
+// Keeps the whole devices that have seen any I/O.
+static int parse_disks(Collector *collector, char *data, Arena *arena,
+                       diskStat **out) {
+  int entries = diskEntryCount(data);
+  diskStat *disks = arena_alloc(arena, sizeof(diskStat) * (entries + 1));
+  *out = disks;
+  if (!disks)
+    return 0;
+  int parsed = diskParser(data, disks, entries);
+  int known = classify_disks(collector, disks, parsed);
+  int count = 0;
+  for (int i = 0; i < parsed; ++i) {
+    int whole = known ? collector->disk_kinds[i].whole
+                      : whole_disk(collector->sys_block_fd, disks[i].name);
+    if (whole && (disks[i].reads != 0 || disks[i].writes != 0))
+      disks[count++] = disks[i];
+  }
+  return count;
+}
+
+static int save_disks(Collector *collector, const diskStat *disks, int count) {
+  if (count > collector->disk_capacity) {
+    diskStat *grown =
+        realloc(collector->prevDiskStats, sizeof(diskStat) * count);
+    if (!grown)
+      return 0;
+    collector->prevDiskStats = grown;
+    collector->disk_capacity = count;
+  }
+  if (count > 0)
+    memcpy(collector->prevDiskStats, disks, sizeof(diskStat) * count);
+  collector->num_prev_disks = count;
+  return 1;
+}
+
+static int parse_nets(const char *data, Arena *arena, netStat **out) {
+  int entries = netEntryCount(data);
+  netStat *nets = arena_alloc(arena, sizeof(netStat) * (entries + 1));
+  *out = nets;
+  return nets ? netParser(data, nets, entries) : 0;
+}
+
+static int save_nets(Collector *collector, const netStat *nets, int count) {
+  if (count > collector->net_capacity) {
+    netStat *grown = realloc(collector->prevNetStats, sizeof(netStat) * count);
+    if (!grown)
+      return 0;
+    collector->prevNetStats = grown;
+    collector->net_capacity = count;
+  }
+  if (count > 0)
+    memcpy(collector->prevNetStats, nets, sizeof(netStat) * count);
+  collector->num_prev_nets = count;
+  return 1;
+}
+
+// Busiest interfaces first, so the panel shows the ones that matter when
+// there are more than it has rows for.
+static int compare_net_traffic(const void *a, const void *b) {
+  const NetInfo *x = a, *y = b;
+  double tx = x->rx_rate + x->tx_rate, ty = y->rx_rate + y->tx_rate;
+  if (tx != ty)
+    return tx < ty ? 1 : -1;
+  return strcmp(x->name, y->name);
+}
+
+// Rates since the entry's last sample, however many ticks ago, after which
+// this sample becomes the new baseline.
+static void sample_rates(const Collector *collector, ProcEntry *entry,
+                         const pidStats *stats, int is_new,
+                         unsigned long long now, ProcRates *rate) {
+  unsigned long long cpu_time = stats->utime + stats->stime;
+  unsigned long long total_delta = collector->cpu_total - entry->sample_total;
+  double sample_sec = (double)(now - entry->sample_ns) / 1e9;
+  rate->cpu = rate->read = rate->write = 0.0;
+  if (!is_new && total_delta > 0) {
+    rate->cpu =
+        100.0 * (double)(cpu_time - entry->cpu_time) / (double)total_delta;
+  }
+  if (stats->has_io && entry->has_io && !is_new && sample_sec > 0.0) {
+    rate->read = counter_rate(entry->read_bytes, stats->read_bytes, sample_sec);
+    rate->write =
+        counter_rate(entry->write_bytes, stats->write_bytes, sample_sec);
+  }
+  if (is_new || cpu_time != entry->cpu_time) {
+    entry->hot = 1;
+    entry->idle_samples = 0;
+  } else if (++entry->idle_samples >= HOT_IDLE_SAMPLES) {
+    entry->hot = 0;
+  }
+  entry->cpu_time = cpu_time;
+  entry->has_io = stats->has_io;
+  entry->read_bytes = stats->read_bytes;
+  entry->write_bytes = stats->write_bytes;
+  entry->sample_total = collector->cpu_total;
+  entry->sample_ns = now;
+  entry->cpu_percent = rate->cpu;
+  entry->read_rate = rate->read;
+  entry->write_rate = rate->write;
+}
+
+static int expand_candidate(const Collector *collector,
+                            const CollectorView *view, const pidStats *stats,
+                            const ProcRates *rate) {
+  if (stats->num_threads < 2)
+    return 0;
+  if (stats->pid == view->selected_pid)
+    return 1;
+  int cores = collector->num_cpu_entries > 1 ? collector->num_cpu_entries - 1
+                                             : 1;
+  return rate->cpu * cores >= THREAD_EXPAND_CPU;
+}
+
+static int read_thread_group(Collector *collector, Arena *arena,
+                             const pidStats *process, int budget,
+                             unsigned long long deadline,
+                             unsigned long long now, ThreadGroup *group) {
+  int max = (int)process->num_threads + THREAD_SLACK;
+  if (max > budget)
+    max = budget;
+  group->items = arena_alloc(arena, sizeof(pidStats) * max);
+  group->rates = arena_alloc(arena, sizeof(ProcRates) * max);
+  group->order = arena_alloc(arena, sizeof(SortKey) * max);
+  if (!group->items || !group->rates || !group->order)
+    return 0;
+  group->count = taskscan_collect(&collector->tasks, process->pid,
+                                  group->items, max, deadline);
+  for (int t = 0; t < group->count; ++t) {
+    const pidStats *stats = &group->items[t];
+    ProcRates *rate = &group->rates[t];
+    int is_new;
+    ProcEntry *entry = proctable_upsert(&collector->threads, stats->pid,
+                                        stats->starttime, &is_new);
+    if (entry)
+      sample_rates(collector, entry, stats, is_new, now, rate);
+    else
+      rate->cpu = rate->read = rate->write = 0.0;
+    group->order[t].value = rate->cpu;
+    group->order[t].pid = stats->pid;
+    group->order[t].index = t;
+  }
+  topk_select(group->order, group->count, 0);
+  return group->count;
+}
+
+static int compare_group_row(const void *a, const void *b) {
+  const ThreadGroup *x = a, *y = b;
+  return (x->row > y->row) - (x->row < y->row);
+}
+
+// Expands the selected process first, then every process busy enough to be
+// worth it, until THREAD_SCAN_BUDGET threads have been read or a quarter of
+// the interval has gone, so a host with 200k threads costs no more per tick
+// than one with a few thousand. Groups come back in row order.
+static void expand_threads(Collector *collector, const CollectorView *view,
+                           Arena *arena, const SortKey *keys,
+                           const ProcessList *procs, const ProcRates *rates,
+                           unsigned long long now, ThreadRows *rows) {
+  rows->num_groups = rows->count = 0;
+  rows->groups = arena_alloc(arena, sizeof(ThreadGroup) * (procs->count + 1));
+  if (!rows->groups)
+    return;
+  unsigned long long deadline =
+      now_ns() + (unsigned long long)collector->interval_ms * 250000ULL;
+  int selected_row = -1;
+  for (int i = 0; i < procs->count && view->selected_pid > 0; ++i) {
+    if (keys[i].pid == view->selected_pid) {
+      selected_row = i;
+      break;
+    }
+  }
+  for (int pass = selected_row >= 0 ? -1 : 0; pass < procs->count; ++pass) {
+    int i = pass < 0 ? selected_row : pass;
+    if (pass >= 0 && i == selected_row)
+      continue;
+    const pidStats *stats = &procs->items[keys[i].index];
+    if (!expand_candidate(collector, view, stats, &rates[keys[i].index]))
+      continue;
+    int budget = THREAD_SCAN_BUDGET - rows->count;
+    if (budget <= 0 || now_ns() > deadline)
+      break;
+    ThreadGroup *group = &rows->groups[rows->num_groups];
+    group->row = i;
+    if (read_thread_group(collector, arena, stats, budget, deadline, now,
+                          group) > 0) {
+      rows->count += group->count;
+      rows->num_groups++;
+    }
+  }
+  qsort(rows->groups, rows->num_groups, sizeof(ThreadGroup),
+        compare_group_row);
+}
+
+static void fill_row(ProcessInfo *info, const pidStats *stats,
+                     const ProcRates *rate, unsigned long mem_total,
+                     int thread_of) {
+  info->stats = *stats;
+  info->cpu_percent = rate->cpu;
+  info->read_rate = rate->read;
+  info->write_rate = rate->write;
+  info->thread_of = thread_of;
+  info->depth = info->descendants = 0;
+  info->tree_cpu = rate->cpu;
+  info->tree_rss = stats->rss_kb;
+  info->has_smaps = 0;
+  info->mem_percent = 0.0;
+  if (mem_total > 0)
+    info->mem_percent = 100.0 * (double)stats->rss_kb / (double)mem_total;
+}
+
+// Files what the smaps reader has read since the last scan with the
+// processes it was read for, unless their pid has been reused since.
+static void take_smaps(Collector *collector, unsigned long long now) {
+  const SmapsResult *results;
+  int count = smaps_take(&collector->smaps, &results);
+  for (int r = 0; r < count; ++r) {
+    ProcEntry *entry = proctable_get(&collector->procs, results[r].pid);
+    if (!entry || entry->starttime != results[r].starttime)
+      continue;
+    entry->smaps = results[r].stats;
+    entry->has_smaps = results[r].ok;
+    entry->smaps_queued = 0;
+    entry->smaps_ns = now;
+  }
+}
+
+static int compare_pid(const void *a, const void *b) {
+  int x = *(const int *)a, y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+// Gives the processes the view asks about their last smaps_rollup figures
+// and queues a fresh read for those with none or an expired one.
+static void attach_smaps(Collector *collector, const CollectorView *view,
+                         ProcessInfo *rows, int count,
+                         unsigned long long now) {
+  for (int i = 0, process_row = 0; i < count; ++i) {
+    ProcessInfo *info = &rows[i];
+    if (info->thread_of)
+      continue;
+    int pid = info->stats.pid;
+    if (process_row++ >= view->memory_rows &&
+        !(view->num_memory_pids > 0 &&
+          bsearch(&pid, view->memory_pids, view->num_memory_pids,
+                  sizeof(int), compare_pid)))
+      continue;
+    ProcEntry *entry = proctable_get(&collector->procs, pid);
+    if (!entry)
+      continue;
+    if (entry->smaps_ns > 0) {
+      info->has_smaps = entry->has_smaps;
+      info->smaps = entry->smaps;
+    }
+    if (!entry->smaps_queued &&
+        (entry->smaps_ns == 0 || now - entry->smaps_ns >= SMAPS_TTL_NS))
+      entry->smaps_queued =
+          smaps_request(&collector->smaps, pid, entry->starttime);
+  }
+}
+
+// Rows in tree order, each with the sums over its subtree.
+static int fill_tree_rows(ProcessInfo *out, const TreeRow *tree_rows,
+                          int count, const ProcessList *procs,
+                          const ProcRates *rates, unsigned long mem_total) {
+  for (int k = 0; k < count; ++k) {
+    const TreeRow *row = &tree_rows[k];
+    ProcessInfo *info = &out[k];
+    fill_row(info, &procs->items[row->row], &rates[row->row], mem_total, 0);
+    info->depth = row->depth;
+    info->descendants = row->descendants;
+    info->tree_cpu = row->cpu;
+    info->tree_rss = row->rss;
+  }
+  return count;
+}
+
+_Static_assert(STAGE_COUNT <= SELF_MAX_STAGES, "SelfStats has no room");
+
+static unsigned long long self_cpu_ns(void) {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+  return (unsigned long long)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+             1000000000ULL +
+         (unsigned long long)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) *
+             1000ULL;
+}
+
+// Pulse's own resident set, whatever --proc-root points at.
+static long self_rss_kb(void) {
+  char buf[128];
+  int fd = open("/proc/self/statm", O_RDONLY);
+  if (fd < 0)
+    return 0;
+  ssize_t n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (n <= 0)
+    return 0;
+  buf[n] = '\0';
+  unsigned long size, resident;
+  if (sscanf(buf, "%lu %lu", &size, &resident) != 2)
+    return 0;
+  return (long)(resident * (unsigned long)sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Feeds this tick's stage times into the histograms. Publishing comes
+// after the tick and is recorded by collector_publish(); parsing is only
+// known apart from reading when the scan was timed.
+static void record_self_stats(Collector *collector, unsigned long long started,
+                              unsigned long long elapsed_ns, int timed) {
+  SelfStats *self = &collector->self;
+  for (int s = 0; s < STAGE_COUNT; ++s) {
+    if (s != STAGE_PUBLISH && (s != STAGE_PARSE || timed))
+      latency_record(&self->stages[s], collector->stage_ns[s]);
+  }
+  unsigned long long now = now_ns();
+  latency_record(&self->tick, now - started);
+  if (collector->tick > 1) {
+    unsigned long long interval_ns =
+        (unsigned long long)collector->interval_ms * 1000000ULL *
+        (unsigned long long)(collector->skipped + 1);
+    latency_record(&self->drift, elapsed_ns > interval_ns
+                                     ? elapsed_ns - interval_ns
+                                     : interval_ns - elapsed_ns);
+  }
+  unsigned long long cpu_ns = self_cpu_ns();
+  if (elapsed_ns > 0 && cpu_ns >= collector->self_cpu_ns)
+    self->cpu_percent =
+        100.0 * (double)(cpu_ns - collector->self_cpu_ns) / elapsed_ns;
+  collector->self_cpu_ns = cpu_ns;
+  self->rss_kb = self_rss_kb();
+  collector->skipped = 0;
+}
+
+static void add_scanner_timings(Collector *collector) {
+  collector->stage_ns[STAGE_READDIR] += collector->scanner.readdir_ns;
+  collector->stage_ns[STAGE_READ] += collector->scanner.read_ns;
+  collector->stage_ns[STAGE_PARSE] += collector->scanner.parse_ns;
+}
+
+int collector_init(Collector *collector, const PulseConfig *config) {
+  memset(collector, 0, sizeof(*collector));
+  collector->tasks.dir_fd = -1;
+  collector->smaps.dir_fd = -1;
+  collector->cgroups.proc_fd = collector->cgroups.root_fd = -1;
+  collector->sys_block_fd = open_sys_block(config->proc_root);
+  collector->stat_path = join_path(config->proc_root, "stat");
+  collector->meminfo_path = join_path(config->proc_root, "meminfo");
+  collector->diskstats_path = join_path(config->proc_root, "diskstats");
+  collector->net_dev_path = join_path(config->proc_root, "net/dev");
+  collector->net_snmp_path = join_path(config->proc_root, "net/snmp");
+  if (!collector->stat_path || !collector->meminfo_path ||
+      !collector->diskstats_path || !collector->net_dev_path ||
+      !collector->net_snmp_path ||
+      !scanner_init(&collector->scanner, config->proc_root,
+                    config->collector_threads) ||
+      !arena_init(&collector->tick_arena, INITIAL_ARENA_SIZE) ||
+      !arena_init(&collector->prev_arena, INITIAL_ARENA_SIZE) ||
+      !arena_init(&collector->light_arena, INITIAL_ARENA_SIZE) ||
+      !proctable_init(&collector->procs, INITIAL_TABLE_CAPACITY) ||
+      !proctable_init(&collector->threads, INITIAL_TABLE_CAPACITY) ||
+      !proctree_init(&collector->tree, INITIAL_TABLE_CAPACITY) ||
+      !taskscan_init(&collector->tasks, config->proc_root) ||
+      !cgroups_init(&collector->cgroups, config->proc_root,
+                    config->cgroup_root) ||
+      !smaps_init(&collector->smaps, config->proc_root)) {
+    collector_destroy(collector);
+    return 0;
+  }
+
+  char *initial_cpu_data =
+      read_file_buffered(collector->stat_path, &collector->stat_buffer);
+  if (initial_cpu_data) {
+    int entries = cpuEntryCount(initial_cpu_data);
+    if (reserve_cpu_stats(collector, entries))
+      collector->num_cpu_entries =
+          cpuParser(initial_cpu_data, &collector->prevCpuStats, entries);
+    if (collector->num_cpu_entries > 0)
+      collector->cpu_total = cpuTotal(&collector->prevCpuStats, 0);
+  }
+  char *initial_disk_data =
+      read_file_buffered(collector->diskstats_path,
+                         &collector->diskstats_buffer);
+  if (initial_disk_data) {
+    diskStat *disks;
+    int count = parse_disks(collector, initial_disk_data,
+                            &collector->tick_arena, &disks);
+    save_disks(collector, disks, count);
+  }
+  char *initial_net_data =
+      read_file_buffered(collector->net_dev_path, &collector->net_dev_buffer);
+  if (initial_net_data) {
+    netStat *nets;
+    int count = parse_nets(initial_net_data, &collector->tick_arena, &nets);
+    save_nets(collector, nets, count);
+  }
+  char *initial_snmp_data =
+      read_file_buffered(collector->net_snmp_path, &collector->net_snmp_buffer);
+  if (initial_snmp_data)
+    collector->has_tcp_retrans =
+        tcpRetransParser(initial_snmp_data, &collector->tcp_retrans);
+  collector->self.stage_names = collector_stage_names;
+  collector->self.num_stages = STAGE_COUNT;
+  collector->self_cpu_ns = self_cpu_ns();
+  collector->last_tick_ns = now_ns();
+  ProcessList procs;
+  procs.count = scanner_collect(&collector->scanner, &collector->tick_arena,
+                                &procs.items);
+  proctable_begin_tick(&collector->procs);
+  for (int i = 0; i < procs.count; ++i) {
+    int is_new;
+    ProcEntry *entry = proctable_upsert(&collector->procs, procs.items[i].pid,
+                                        procs.items[i].starttime, &is_new);
+    if (entry) {
+      entry->cpu_time = procs.items[i].utime + procs.items[i].stime;
+      entry->hot = 1;
+      entry->last_index = i;
+      entry->sample_total = collector->cpu_total;
+      entry->sample_ns = collector->last_tick_ns;
+    }
+  }
+  collector->prev_items = procs.items;
+  collector->prev_count = procs.count;
+  collector->cold_interval = config->cold_interval;
+  collector->interval_ms = config_tick_ms(config);
+  const int intervals[SUBSYSTEM_COUNT] = {config->cpu_interval_ms,
+                                          config->memory_interval_ms,
+                                          config->process_interval_ms};
+  for (int s = 0; s < SUBSYSTEM_COUNT; ++s) {
+    int interval = intervals[s] > 0 ? intervals[s] : config->interval_ms;
+    int tick_ms = collector->interval_ms;
+    int every = (interval + tick_ms / 2) / tick_ms;
+    collector->every[s] = every > 1 ? (unsigned int)every : 1;
+  }
+  collector->devices_ns = collector->last_tick_ns;
+  collector->scanner.reuse = reuse_cold;
+  collector->scanner.reuse_ctx = collector;
+  return 1;
+}
+
+// Samples every process of this tick's scan and fills the snapshot's rows
+// (and cgroups) from them. Returns 0 if the rows could not be allocated.
+static int collect_processes(Collector *collector, Snapshot *snapshot,
+                             const CollectorView *view, Arena *arena,
+                             const ProcessList *curr_procs,
+                             unsigned long long tick_started) {
+  unsigned long long started = now_ns();
+  int num_cpu_entries = collector->num_cpu_entries;
+  int num_disks = snapshot->num_disks, num_nets = snapshot->num_nets;
+  SortKey *keys = arena_alloc(arena, sizeof(SortKey) * (curr_procs->count + 1));
+  ProcRates *rates =
+      arena_alloc(arena, sizeof(ProcRates) * (curr_procs->count + 1));
+  TreeSample *samples = NULL;
+  TreeRow *tree_rows = NULL;
+  if (view->show_tree) {
+    samples =
+        arena_alloc(arena, sizeof(TreeSample) * (curr_procs->count + 1));
+    tree_rows = arena_alloc(arena, sizeof(TreeRow) * (curr_procs->count + 1));
+  }
+  if (!keys || !rates || (view->show_tree && (!samples || !tree_rows)) ||
+      !snapshot_reserve(snapshot, num_cpu_entries, curr_procs->count,
+                        num_disks, num_nets))
+    return 0;
+
+  proctable_begin_tick(&collector->procs);
+  if (view->show_cgroups)
+    cgroups_begin_tick(&collector->cgroups);
+  if (view->show_tree)
+    proctree_begin_tick(&collector->tree);
+  unsigned long long sampled = 0;
+  for (int i = 0; i < curr_procs->count; ++i) {
+    const pidStats *stats = &curr_procs->items[i];
+    int is_new;
+    ProcRates *rate = &rates[i];
+    rate->cpu = rate->read = rate->write = 0.0;
+
+    ProcEntry *entry = proctable_upsert(&collector->procs, stats->pid,
+                                        stats->starttime, &is_new);
+    if (entry && !is_new && skip_sample(collector, entry)) {
+      rate->cpu = entry->cpu_percent;
+      rate->read = entry->read_rate;
+      rate->write = entry->write_rate;
+    } else if (entry) {
+      if (!is_new)
+        sampled += stats->utime + stats->stime - entry->cpu_time;
+      sample_rates(collector, entry, stats, is_new, tick_started, rate);
+    }
+    if (entry)
+      entry->last_index = i;
+    if (entry && view->show_cgroups) {
+      if (entry->cgroup == 0)
+        entry->cgroup = cgroups_lookup(&collector->cgroups, stats->pid) + 1;
+      if (entry->cgroup > 0)
+        cgroups_add_process(&collector->cgroups, entry->cgroup - 1);
+      else
+        entry->cgroup = -1;
+    }
+    keys[i].value =
+        view->sort_column == SORT_IO ? rate->read + rate->write : rate->cpu;
+    keys[i].pid = stats->pid;
+    keys[i].index = i;
+    if (view->show_tree) {
+      if (entry)
+        proctree_update(&collector->tree, entry, stats, i);
+      // Siblings go busiest subtree first, or by pid.
+      samples[i].cpu = rate->cpu;
+      samples[i].rss = stats->rss_kb;
+      samples[i].key = view->sort_column == SORT_NONE ? 0.0 : keys[i].value;
+    }
+  }
+  proctable_sweep(&collector->procs);
+  check_cold(collector, sampled);
+  if (view->show_tree)
+    proctree_sweep(&collector->tree, &collector->procs);
+  snapshot->num_cgroups = 0;
+  if (view->show_cgroups) {
+    int live = cgroups_sweep(&collector->cgroups);
+    if (snapshot_reserve_cgroups(snapshot, live))
+      snapshot->num_cgroups = cgroups_read(
+          &collector->cgroups, arena, now_ns(), num_cpu_entries - 1,
+          snapshot->cgroups, live);
+  }
+  collector->stage_ns[STAGE_DELTA] += now_ns() - started;
+
+  // Only the rows the UI can reach need to be in order; the rest of the list
+  // is published unsorted behind them.
+  started = now_ns();
+  snapshot->sorted_count = curr_procs->count;
+  int num_tree_rows = 0;
+  if (view->show_tree)
+    num_tree_rows = proctree_layout(&collector->tree, arena, samples,
+                                    tree_rows, curr_procs->count);
+  else if (view->sort_column != SORT_NONE)
+    snapshot->sorted_count =
+        topk_select(keys, curr_procs->count, view->sort_depth);
+  collector->stage_ns[STAGE_SORT] += now_ns() - started;
+
+  // Thread rows go straight after their process, and the sorted prefix
+  // grows by the threads inside it.
+  ThreadRows threads = {0};
+  proctable_begin_tick(&collector->threads);
+  if (view->show_threads && !view->show_tree) {
+    started = now_ns();
+    expand_threads(collector, view, arena, keys, curr_procs, rates,
+                   tick_started, &threads);
+    collector->stage_ns[STAGE_READ] += now_ns() - started;
+    if (!snapshot_reserve(snapshot, num_cpu_entries,
+                          curr_procs->count + threads.count, num_disks,
+                          num_nets))
+      threads.num_groups = 0;
+  }
+  proctable_sweep(&collector->threads);
+
+  started = now_ns();
+  unsigned long mem_total = snapshot->mem_info.memTotal;
+  int rows = 0, sorted_rows = 0;
+  if (view->show_tree) {
+    rows = sorted_rows =
+        fill_tree_rows(snapshot->processed_list, tree_rows, num_tree_rows,
+                       curr_procs, rates, mem_total);
+  }
+  for (int i = 0, g = 0; i < curr_procs->count && !view->show_tree; ++i) {
+    const pidStats *stats = &curr_procs->items[keys[i].index];
+    fill_row(&snapshot->processed_list[rows++], stats, &rates[keys[i].index],
+             mem_total, 0);
+    if (g < threads.num_groups && threads.groups[g].row == i) {
+      const ThreadGroup *group = &threads.groups[g++];
+      for (int t = 0; t < group->count; ++t) {
+        int k = group->order[t].index;
+        fill_row(&snapshot->processed_list[rows++], &group->items[k],
+                 &group->rates[k], mem_total, stats->pid);
+      }
+    }
+    if (i < snapshot->sorted_count)
+      sorted_rows = rows;
+  }
+  take_smaps(collector, tick_started);
+  if (view->show_memory)
+    attach_smaps(collector, view, snapshot->processed_list, rows,
+                 tick_started);
+  snapshot->sorted_count = sorted_rows;
+  snapshot->num_processes = rows;
+  collector->stage_ns[STAGE_DELTA] += now_ns() - started;
+  return 1;
+}
+
+// Republishes the rows of the last snapshot on ticks without a scan.
+static int carry_processes(Snapshot *snapshot, const Snapshot *published) {
+  if (!snapshot_reserve(snapshot, 0, published->num_processes, 0, 0) ||
+      !snapshot_reserve_cgroups(snapshot, published->num_cgroups))
+    return 0;
+  memcpy(snapshot->processed_list, published->processed_list,
+         sizeof(ProcessInfo) * published->num_processes);
+  memcpy(snapshot->cgroups, published->cgroups,
+         sizeof(CgroupInfo) * published->num_cgroups);
+  snapshot->num_processes = published->num_processes;
+  snapshot->sorted_count = published->sorted_count;
+  snapshot->num_cgroups = published->num_cgroups;
+  return 1;
+}
+
+static void carry_cpu(Snapshot *snapshot, const Snapshot *published) {
+  size_t size = sizeof(double) * published->num_total_cpu_entries;
+  memcpy(snapshot->cpu.usage, published->cpu.usage, size);
+  memcpy(snapshot->cpu.user, published->cpu.user, size);
+  memcpy(snapshot->cpu.system, published->cpu.system, size);
+  memcpy(snapshot->cpu.iowait, published->cpu.iowait, size);
+  memcpy(snapshot->cpu.steal, published->cpu.steal, size);
+}
+
+static void carry_devices(Snapshot *snapshot, const Snapshot *published) {
+  memcpy(snapshot->disks, published->disks,
+         sizeof(DiskInfo) * published->num_disks);
+  memcpy(snapshot->nets, published->nets,
+         sizeof(NetInfo) * published->num_nets);
+  snapshot->num_disks = published->num_disks;
+  snapshot->num_nets = published->num_nets;
+  snapshot->tcp_retrans_rate = published->tcp_retrans_rate;
+}
+
+static int same_view(const CollectorView *a, const CollectorView *b) {
+  return a->sort_column == b->sort_column && a->sort_depth == b->sort_depth &&
+         a->show_io == b->show_io && a->show_threads == b->show_threads &&
+         a->selected_pid == b->selected_pid &&
+         a->show_cgroups == b->show_cgroups && a->show_tree == b->show_tree &&
+         a->show_memory == b->show_memory &&
+         a->memory_rows == b->memory_rows;
+}
+
+// The subsystems whose interval is up. A changed view (sorting, selection,
+// a toggled table) is answered on the next tick rather than at the next
+// process sample, and everything runs until there is a snapshot to carry
+// results over from.
+static unsigned int due_subsystems(const Collector *collector,
+                                   const CollectorView *view) {
+  unsigned int due = 0;
+  for (int s = 0; s < SUBSYSTEM_COUNT; ++s) {
+    if (!collector->published ||
+        collector->tick - collector->last_run[s] >= collector->every[s])
+      due |= 1u << s;
+  }
+  if (!same_view(view, &collector->last_view))
+    due |= 1u << SUBSYSTEM_PROCESSES;
+  return due;
+}
+
+// A tick that can't be published still advances the CPU counters. Without
+// a scan the previous list is untouched; otherwise its arena is recycled
+// next tick.
+static int abandon_tick(Collector *collector, const char *cpu_data,
+                        int scanned) {
+  if (cpu_data)
+    updateCpuState(&collector->prevCpuStats, &collector->currCpuStats,
+                   collector->num_cpu_entries);
+  if (scanned) {
+    collector->prev_items = NULL;
+    collector->prev_count = 0;
+  }
+  return 0;
+}
+
+int collector_tick(Collector *collector, Snapshot *snapshot,
+                   const CollectorView *view) {
+  ProcessList curr_procs = {0};
+  unsigned long long started;
+
+  memset(collector->stage_ns, 0, sizeof(collector->stage_ns));
+  collector->tick++;
+  unsigned int due = due_subsystems(collector, view);
+  int scanned = (due & (1u << SUBSYSTEM_PROCESSES)) != 0;
+  int sample_cpu = (due & (1u << SUBSYSTEM_CPU)) != 0;
+  Arena *arena = &collector->light_arena;
+  if (scanned) {
+    // Last scan's list moves to prev_arena; the one before it is recycled.
+    Arena previous = collector->prev_arena;
+    collector->prev_arena = collector->tick_arena;
+    collector->tick_arena = previous;
+    arena = &collector->tick_arena;
+  }
+  arena_reset(arena);
+  unsigned long long tick_started = now_ns();
+  unsigned long long elapsed_ns = tick_started - collector->last_tick_ns;
+  collector->scanner.read_io =
+      view->show_io || view->sort_column == SORT_IO;
+  collector->scanner.timed = view->timed;
+
+  // Process CPU is a share of the jiffies in /proc/stat, so a scan reads it
+  // too.
+  started = now_ns();
+  char *cpu_data = sample_cpu || scanned
+                       ? read_file_buffered(collector->stat_path,
+                                            &collector->stat_buffer)
+                       : NULL;
+  char *mem_data = due & (1u << SUBSYSTEM_MEMORY)
+                       ? read_file_buffered(collector->meminfo_path,
+                                            &collector->meminfo_buffer)
+                       : NULL;
+  char *disk_data = NULL, *net_data = NULL, *snmp_data = NULL;
+  if (sample_cpu) {
+    disk_data = read_file_buffered(collector->diskstats_path,
+                                   &collector->diskstats_buffer);
+    net_data = read_file_buffered(collector->net_dev_path,
+                                  &collector->net_dev_buffer);
+    snmp_data = read_file_buffered(collector->net_snmp_path,
+                                   &collector->net_snmp_buffer);
+  }
+  collector->stage_ns[STAGE_READ] += now_ns() - started;
+  if (scanned) {
+    curr_procs.count =
+        scanner_collect(&collector->scanner, arena, &curr_procs.items);
+    add_scanner_timings(collector);
+  }
+
+  started = now_ns();
+  cpuStats *prevCpuStats = &collector->prevCpuStats;
+  cpuStats *currCpuStats = &collector->currCpuStats;
+  if (cpu_data) {
+    int entries = cpuEntryCount(cpu_data);
+    if (!reserve_cpu_stats(collector, entries)) {
+      cpu_data = NULL;
+    } else {
+      cpuParser(cpu_data, currCpuStats, entries);
+      // CPU hotplug changes the layout of /proc/stat; restart the deltas.
+      if (entries != collector->num_cpu_entries) {
+        updateCpuState(prevCpuStats, currCpuStats, entries);
+        collector->num_cpu_entries = entries;
+      }
+    }
+  }
+  diskStat *curr_disks = NULL;
+  int num_disks = 0;
+  if (disk_data)
+    num_disks = parse_disks(collector, disk_data, arena, &curr_disks);
+  netStat *curr_nets = NULL;
+  int num_nets = 0;
+  if (net_data)
+    num_nets = parse_nets(net_data, arena, &curr_nets);
+  unsigned long long tcp_retrans = 0;
+  int has_tcp_retrans = 0;
+  if (snmp_data)
+    has_tcp_retrans = tcpRetransParser(snmp_data, &tcp_retrans);
+  const Snapshot *published = collector->published;
+  if (!sample_cpu) {
+    num_disks = published->num_disks;
+    num_nets = published->num_nets;
+  }
+  int num_cpu_entries = collector->num_cpu_entries;
+  if (!snapshot_reserve(snapshot, num_cpu_entries, 0, num_disks, num_nets))
+    return abandon_tick(collector, cpu_data, scanned);
+  snapshot->num_total_cpu_entries = num_cpu_entries;
+  snapshot->timestamp_ms = realtime_ms();
+  snapshot->sampled = scanned ? 1u << SUBSYSTEM_PROCESSES : 0;
+  // Whatever wasn't due is carried over; what failed to read is left as is.
+  if (cpu_data) {
+    cpuUsage(prevCpuStats, currCpuStats, &snapshot->cpu, num_cpu_entries);
+    snapshot->sampled |= 1u << SUBSYSTEM_CPU;
+  } else if (!sample_cpu && !scanned) {
+    carry_cpu(snapshot, published);
+  }
+  if (mem_data) {
+    memParser(mem_data, &snapshot->mem_info);
+    snapshot->sampled |= 1u << SUBSYSTEM_MEMORY;
+  } else if (!(due & (1u << SUBSYSTEM_MEMORY))) {
+    snapshot->mem_info = published->mem_info;
+  }
+  if (sample_cpu) {
+    double elapsed_sec = (double)(tick_started - collector->devices_ns) / 1e9;
+    snapshot->num_disks =
+        diskUsage(collector->prevDiskStats, collector->num_prev_disks,
+                  curr_disks, num_disks, elapsed_sec, snapshot->disks);
+    save_disks(collector, curr_disks, num_disks);
+    snapshot->num_nets =
+        netUsage(collector->prevNetStats, collector->num_prev_nets,
+                 curr_nets, num_nets, elapsed_sec, snapshot->nets);
+    qsort(snapshot->nets, snapshot->num_nets, sizeof(NetInfo),
+          compare_net_traffic);
+    save_nets(collector, curr_nets, num_nets);
+    snapshot->tcp_retrans_rate = -1.0;
+    if (has_tcp_retrans && collector->has_tcp_retrans && elapsed_sec > 0.0)
+      snapshot->tcp_retrans_rate =
+          counter_rate(collector->tcp_retrans, tcp_retrans, elapsed_sec);
+    collector->has_tcp_retrans = has_tcp_retrans;
+    collector->tcp_retrans = tcp_retrans;
+    collector->devices_ns = tick_started;
+  } else {
+    carry_devices(snapshot, published);
+  }
+  collector->stage_ns[STAGE_PARSE] += now_ns() - started;
+
+  if (cpu_data && num_cpu_entries > 0)
+    collector->cpu_total = cpuTotal(currCpuStats, 0);
+  if (scanned ? !collect_processes(collector, snapshot, view, arena,
+                                   &curr_procs, tick_started)
+              : !carry_processes(snapshot, published))
+    return abandon_tick(collector, cpu_data, scanned);
+
+  if (cpu_data)
+    updateCpuState(prevCpuStats, currCpuStats, num_cpu_entries);
+  if (scanned) {
+    collector->prev_items = curr_procs.items;
+    collector->prev_count = curr_procs.count;
+  }
+  for (int s = 0; s < SUBSYSTEM_COUNT; ++s) {
+    if (due & (1u << s))
+      collector->last_run[s] = collector->tick;
+  }
+  collector->last_view = *view;
+  collector->last_tick_ns = tick_started;
+  record_self_stats(collector, tick_started, elapsed_ns, view->timed);
+  snapshot->self = collector->self;
+  return 1;
+}
+
+// Accounts for periods the scheduler dropped: subsystems fall due by the
+// clock, and the drift of the next tick is measured against its deadline.
+void collector_skip(Collector *collector, int missed) {
+  collector->tick += (unsigned int)missed;
+  collector->skipped += missed;
+  collector->self.overruns += (unsigned long long)missed;
+}
+
+void collector_publish(Collector *collector, SnapshotExchange *exchange) {
+  // Stays untouched until it comes back as the back buffer, after the next
+  // publish.
+  collector->published = snapshot_back(exchange);
+  unsigned long long started = now_ns();
+  snapshot_publish(exchange);
+  collector->stage_ns[STAGE_PUBLISH] = now_ns() - started;
+  latency_record(&collector->self.stages[STAGE_PUBLISH],
+                 collector->stage_ns[STAGE_PUBLISH]);
+}
+
+void collector_destroy(Collector *collector) {
+  arena_destroy(&collector->tick_arena);
+  arena_destroy(&collector->prev_arena);
+  arena_destroy(&collector->light_arena);
+  proctable_destroy(&collector->procs);
+  proctable_destroy(&collector->threads);
+  proctree_destroy(&collector->tree);
+  taskscan_destroy(&collector->tasks);
+  cgroups_destroy(&collector->cgroups);
+  smaps_destroy(&collector->smaps);
+  cpuStatsFree(&collector->prevCpuStats);
+  cpuStatsFree(&collector->currCpuStats);
+  free(collector->stat_path);
+  free(collector->meminfo_path);
+  free(collector->diskstats_path);
+  free(collector->net_dev_path);
+  free(collector->net_snmp_path);
+  free(collector->stat_buffer.data);
+  free(collector->meminfo_buffer.data);
+  free(collector->diskstats_buffer.data);
+  free(collector->net_dev_buffer.data);
+  free(collector->net_snmp_buffer.data);
+  free(collector->prevDiskStats);
+  free(collector->disk_kinds);
+  if (collector->sys_block_fd >= 0)
+    close(collector->sys_block_fd);
+  free(collector->prevNetStats);
+  scanner_destroy(&collector->scanner);
+  memset(collector, 0, sizeof(*collector));
+}
+
+// Reads all of `path` into `buffer`, growing it as needed and keeping it
+// for the next call. Returns the contents, or NULL if the read failed.
+char *read_file_buffered(const char *path, FileBuffer *buffer) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  if (!buffer->data) {
+    buffer->data = malloc(INITIAL_BUFFER_SIZE);
+    if (!buffer->data) {
+      close(fd);
+      return NULL;
+    }
+    buffer->size = INITIAL_BUFFER_SIZE;
+  }
+
+  size_t total_read = 0;
+  while (1) {
+    ssize_t bytes_read =
+        read(fd, buffer->data + total_read, buffer->size - total_read - 1);
+    if (bytes_read > 0) {
+      total_read += bytes_read;
+    } else if (bytes_read == 0) {
+      break;
+    } else {
+      close(fd);
+      return NULL;
+    }
+
+    if (total_read >= buffer->size - 1) {
+      char *new_buffer = realloc(buffer->data, buffer->size * 2);
+      if (!new_buffer) {
+        close(fd);
+        return NULL;
+      }
+      buffer->data = new_buffer;
+      buffer->size *= 2;
+    }
+  }
+  buffer->data[total_read] = '\0';
+  close(fd);
+  return buffer->data;
+}
+
+char *read_file_dynamically(const char *path) {
+  FileBuffer buffer = {NULL, 0};
+  char *data = read_file_buffered(path, &buffer);
+  if (!data)
+    free(buffer.data);
+  return data;
+}
@@ -0,0 +1,353 @@
+#include "../include/config.h"
+#include "../include/pool.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void config_defaults(PulseConfig *config) {
+  config->collector_threads = pool_default_workers();
+  config->proc_root = "/proc";
+  config->interval_ms = 1000;
+  config->cpu_interval_ms = 0;
+  config->memory_interval_ms = 0;
+  config->process_interval_ms = 0;
+  config->batch = 0;
+  config->batch_format = OUTPUT_NDJSON;
+  config->iterations = 0;
+  config->top_n = 0;
+  config->fields = NULL;
+  config->serve_address = NULL;
+  config->agent_address = NULL;
+  config->num_connect = 0;
+  config->record_path = NULL;
+  config->replay_path = NULL;
+  config->cold_interval = 10;
+  config->cgroup_root = NULL;
+  config->timings = 0;
+}
+
+static void print_usage(const char *prog) {
+  printf("Usage: %s [options]\n"
+         "  -j, --threads N        number of /proc collector threads "
+         "(default: online CPUs / 4)\n"
+         "      --proc-root DIR    read procfs from DIR instead of /proc\n"
+         "      --cgroup-root DIR  read cgroup v2 files from DIR (default: "
+         "found under\n"
+         "                         /sys/fs/cgroup)\n"
+         "  -d, --interval SECS    seconds between samples (default: 1)\n"
+         "      --cpu-interval SECS, --memory-interval SECS,\n"
+         "      --process-interval SECS\n"
+         "                         sample CPU (with disks and network), "
+         "memory or\n"
+         "                         processes at their own rate (default: "
+         "--interval)\n"
+         "  -b, --batch            write snapshots to stdout instead of the "
+         "UI\n"
+         "      --format FMT       batch output format: ndjson or csv "
+         "(default: ndjson)\n"
+         "  -n, --iterations N     exit after N batch snapshots "
+         "(default: run forever)\n"
+         "      --top N            limit batch and exporter output to the "
+         "top N\n"
+         "                         processes\n"
+         "      --fields LIST      comma-separated batch columns, or 'all' "
+         "(default:\n"
+         "                         pid,comm,state,cpu,mem,virt,res)\n"
+         "      --serve ADDR       serve OpenMetrics on ADDR ([host]:port or a "
+         "unix\n"
+         "                         socket path); without a terminal, runs "
+         "headless\n"
+         "      --agent ADDR       serve samples to viewers on ADDR, "
+         "headless\n"
+         "      --connect ADDR     view the agent at ADDR instead of this "
+         "machine; repeat\n"
+         "                         for more hosts, Tab switches between "
+         "them\n"
+         "      --record FILE      append every sample to FILE; without a "
+         "terminal,\n"
+         "                         runs headless\n"
+         "      --replay FILE      play FILE back instead of viewing this "
+         "machine\n"
+         "      --cold-interval N  re-read idle processes every N ticks "
+         "(default: 10,\n"
+         "                         1 reads every process every tick; all are "
+         "read\n"
+         "                         when /proc/stat shows unaccounted CPU "
+         "time)\n"
+         "      --timings          print Pulse's own stage timings to stderr "
+         "on exit\n"
+         "  -h, --help             show this help\n",
+         prog);
+}
+
+static int parse_int(const char *text, int min, int max, int *out) {
+  char *end;
+  long value = strtol(text, &end, 10);
+  if (*text == '\0' || *end != '\0' || value < min || value > max)
+    return 0;
+  *out = (int)value;
+  return 1;
+}
+
+static int parse_interval(const char *text, int *out_ms) {
+  char *end;
+  double seconds = strtod(text, &end);
+  if (*text == '\0' || *end != '\0' || !(seconds >= 0.1) || seconds > 86400)
+    return 0;
+  *out_ms = (int)(seconds * 1000.0 + 0.5);
+  return 1;
+}
+
+// Settings of the config file, named like the long options they stand for.
+static int apply_setting(PulseConfig *config, const char *key,
+                         const char *value) {
+  if (strcmp(key, "interval") == 0)
+    return parse_interval(value, &config->interval_ms);
+  if (strcmp(key, "cpu-interval") == 0)
+    return parse_interval(value, &config->cpu_interval_ms);
+  if (strcmp(key, "memory-interval") == 0)
+    return parse_interval(value, &config->memory_interval_ms);
+  if (strcmp(key, "process-interval") == 0)
+    return parse_interval(value, &config->process_interval_ms);
+  if (strcmp(key, "threads") == 0)
+    return parse_int(value, 1, 1024, &config->collector_threads);
+  if (strcmp(key, "cold-interval") == 0)
+    return parse_int(value, 1, 1000, &config->cold_interval);
+  return -1;
+}
+
+static char *trim(char *text) {
+  while (isspace((unsigned char)*text))
+    text++;
+  char *end = text + strlen(text);
+  while (end > text && isspace((unsigned char)end[-1]))
+    *--end = '\0';
+  return text;
+}
+
+// Reads `key = value` lines, with '#' starting a comment, from `path` or,
+// when it is NULL, from $PULSE_CONF or ~/.pulse.conf. Only a missing
+// default file is skipped quietly. Command line options are parsed after
+// and override the file. Returns 0 after reporting a bad file.
+int config_load_file(PulseConfig *config, const char *path) {
+  char default_path[4096];
+  int optional = 0;
+  if (!path)
+    path = getenv("PULSE_CONF");
+  if (!path) {
+    const char *home = getenv("HOME");
+    if (!home)
+      return 1;
+    snprintf(default_path, sizeof(default_path), "%s/.pulse.conf", home);
+    path = default_path;
+    optional = 1;
+  }
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    if (optional && errno == ENOENT)
+      return 1;
+    fprintf(stderr, "pulse: %s: %s\n", path, strerror(errno));
+    return 0;
+  }
+  char line[512];
+  int line_number = 0, ok = 1;
+  while (ok && fgets(line, sizeof(line), file)) {
+    line_number++;
+    char *comment = strchr(line, '#');
+    if (comment)
+      *comment = '\0';
+    char *key = trim(line);
+    if (*key == '\0')
+      continue;
+    char *equals = strchr(key, '=');
+    if (!equals) {
+      fprintf(stderr, "pulse: %s:%d: expected 'key = value'\n", path,
+              line_number);
+      ok = 0;
+      break;
+    }
+    *equals = '\0';
+    key = trim(key);
+    char *value = trim(equals + 1);
+    int applied = apply_setting(config, key, value);
+    if (applied < 0)
+      fprintf(stderr, "pulse: %s:%d: unknown setting '%s'\n", path,
+              line_number, key);
+    else if (applied == 0)
+      fprintf(stderr, "pulse: %s:%d: invalid %s '%s'\n", path, line_number,
+              key, value);
+    ok = applied > 0;
+  }
+  fclose(file);
+  return ok;
+}
+
+// The collector's tick: the shortest of the sampling intervals.
+int config_tick_ms(const PulseConfig *config) {
+  int tick = config->interval_ms;
+  const int intervals[3] = {config->cpu_interval_ms,
+                            config->memory_interval_ms,
+                            config->process_interval_ms};
+  for (int i = 0; i < 3; ++i) {
+    if (intervals[i] > 0 && intervals[i] < tick)
+      tick = intervals[i];
+  }
+  return tick;
+}
+
+// Returns 0 to continue, 1 if the program should exit successfully and -1 on
+// a usage error.
+int config_parse_args(PulseConfig *config, int argc, char **argv) {
+  static const struct option long_options[] = {
+      {"threads", required_argument, NULL, 'j'},
+      {"proc-root", required_argument, NULL, 'P'},
+      {"interval", required_argument, NULL, 'd'},
+      {"cpu-interval", required_argument, NULL, 'U'},
+      {"memory-interval", required_argument, NULL, 'M'},
+      {"process-interval", required_argument, NULL, 'R'},
+      {"batch", no_argument, NULL, 'b'},
+      {"format", required_argument, NULL, 'F'},
+      {"iterations", required_argument, NULL, 'n'},
+      {"top", required_argument, NULL, 'T'},
+      {"fields", required_argument, NULL, 'f'},
+      {"serve", required_argument, NULL, 'S'},
+      {"agent", required_argument, NULL, 'A'},
+      {"connect", required_argument, NULL, 'V'},
+      {"record", required_argument, NULL, 'w'},
+      {"replay", required_argument, NULL, 'r'},
+      {"cold-interval", required_argument, NULL, 'C'},
+      {"cgroup-root", required_argument, NULL, 'G'},
+      {"timings", no_argument, NULL, 'L'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "j:d:bn:h", long_options, NULL)) !=
+         -1) {
+    switch (opt) {
+    case 'j':
+      if (!parse_int(optarg, 1, 1024, &config->collector_threads)) {
+        fprintf(stderr, "%s: invalid thread count '%s'\n", argv[0], optarg);
+        return -1;
+      }
+      break;
+    case 'P':
+      config->proc_root = optarg;
+      break;
+    case 'G':
+      config->cgroup_root = optarg;
+      break;
+    case 'L':
+      config->timings = 1;
+      break;
+    case 'd':
+      if (!parse_interval(optarg, &config->interval_ms)) {
+        fprintf(stderr, "%s: invalid interval '%s' (minimum 0.1)\n", argv[0],
+                optarg);
+        return -1;
+      }
+      break;
+    case 'U':
+    case 'M':
+    case 'R': {
+      int *interval_ms = opt == 'U'   ? &config->cpu_interval_ms
+                         : opt == 'M' ? &config->memory_interval_ms
+                                      : &config->process_interval_ms;
+      if (!parse_interval(optarg, interval_ms)) {
+        fprintf(stderr, "%s: invalid interval '%s' (minimum 0.1)\n", argv[0],
+                optarg);
+        return -1;
+      }
+      break;
+    }
+    case 'b':
+      config->batch = 1;
+      break;
+    case 'F':
+      if (strcmp(optarg, "ndjson") == 0) {
+        config->batch_format = OUTPUT_NDJSON;
+      } else if (strcmp(optarg, "csv") == 0) {
+        config->batch_format = OUTPUT_CSV;
+      } else {
+        fprintf(stderr, "%s: unknown format '%s'\n", argv[0], optarg);
+        return -1;
+      }
+      break;
+    case 'n':
+      if (!parse_int(optarg, 1, 1 << 30, &config->iterations)) {
+        fprintf(stderr, "%s: invalid iteration count '%s'\n", argv[0],
+                optarg);
+        return -1;
+      }
+      break;
+    case 'T':
+      if (!parse_int(optarg, 1, 1 << 30, &config->top_n)) {
+        fprintf(stderr, "%s: invalid top count '%s'\n", argv[0], optarg);
+        return -1;
+      }
+      break;
+    case 'f':
+      config->fields = optarg;
+      break;
+    case 'S':
+      config->serve_address = optarg;
+      break;
+    case 'A':
+      config->agent_address = optarg;
+      break;
+    case 'V':
+      if (config->num_connect == CONFIG_MAX_HOSTS) {
+        fprintf(stderr, "%s: at most %d --connect hosts\n", argv[0],
+                CONFIG_MAX_HOSTS);
+        return -1;
+      }
+      config->connect_addresses[config->num_connect++] = optarg;
+      break;
+    case 'w':
+      config->record_path = optarg;
+      break;
+    case 'r':
+      config->replay_path = optarg;
+      break;
+    case 'C':
+      if (!parse_int(optarg, 1, 1000, &config->cold_interval)) {
+        fprintf(stderr, "%s: invalid cold interval '%s'\n", argv[0], optarg);
+        return -1;
+      }
+      break;
+    case 'h':
+      print_usage(argv[0]);
+      return 1;
+    default:
+      print_usage(argv[0]);
+      return -1;
+    }
+  }
+  // A viewer or a replay collects nothing, so it has nothing to write out
+  // or serve.
+  if ((config->num_connect > 0 || config->replay_path) &&
+      (config->batch || config->serve_address || config->agent_address ||
+       config->record_path ||
+       (config->num_connect > 0 && config->replay_path))) {
+    fprintf(stderr,
+            "%s: --connect and --replay cannot be combined with each other "
+            "or with --batch, --serve, --agent or --record\n",
+            argv[0]);
+    return -1;
+  }
+  if (config->num_connect == 0 && !config->replay_path) {
+    int fd = open(config->proc_root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+      fprintf(stderr, "%s: cannot open proc root '%s': %s\n", argv[0],
+              config->proc_root, strerror(errno));
+      return -1;
+    }
+    close(fd);
+  }
+  return 0;
+}
@@ -0,0 +1,368 @@
+#define _GNU_SOURCE
+#include "../include/exporter.h"
+#include "../include/sockets.h"
+#include "../include/timing.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define EXPORTER_REQUEST_MAX 8192
+// How long a client has to send its request and take the response, in
+// all: one that trickles bytes must not hold the only server thread.
+#define EXPORTER_IO_TIMEOUT_NS 2000000000ULL
+#define EXPORTER_DEFAULT_TOP 20
+
+#define CONTENT_TYPE                                                           \
+  "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+int exporter_init(Exporter *exporter, const char *address, int top_n) {
+  memset(exporter, 0, sizeof(*exporter));
+  exporter->stop_fd = -1;
+  exporter->top_n = top_n > 0 ? top_n : EXPORTER_DEFAULT_TOP;
+  outbuf_init(&exporter->staging);
+  outbuf_init(&exporter->published);
+  outbuf_init(&exporter->response);
+  pthread_mutex_init(&exporter->lock, NULL);
+
+  exporter->listen_fd = socket_listen(address, &exporter->unix_path);
+  exporter->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (exporter->listen_fd < 0 || exporter->stop_fd < 0) {
+    exporter_destroy(exporter);
+    return 0;
+  }
+  return 1;
+}
+
+// Label values only need backslash, quote and newline escaped.
+static void label_value(OutBuf *out, const char *text) {
+  outbuf_char(out, '"');
+  for (const char *p = text; *p; ++p) {
+    if (*p == '\\' || *p == '"') {
+      outbuf_char(out, '\\');
+      outbuf_char(out, *p);
+    } else if (*p == '\n') {
+      outbuf_str(out, "\\n");
+    } else {
+      outbuf_char(out, *p);
+    }
+  }
+  outbuf_char(out, '"');
+}
+
+static void metric_header(OutBuf *out, const char *name, const char *unit,
+                          const char *help) {
+  outbuf_str(out, "# TYPE ");
+  outbuf_str(out, name);
+  outbuf_str(out, " gauge\n");
+  if (unit) {
+    outbuf_str(out, "# UNIT ");
+    outbuf_str(out, name);
+    outbuf_char(out, ' ');
+    outbuf_str(out, unit);
+    outbuf_char(out, '\n');
+  }
+  outbuf_str(out, "# HELP ");
+  outbuf_str(out, name);
+  outbuf_char(out, ' ');
+  outbuf_str(out, help);
+  outbuf_char(out, '\n');
+}
+
+static void gauge_u64(OutBuf *out, const char *name, const char *unit,
+                      const char *help, unsigned long long value) {
+  metric_header(out, name, unit, help);
+  outbuf_str(out, name);
+  outbuf_char(out, ' ');
+  outbuf_u64(out, value);
+  outbuf_char(out, '\n');
+}
+
+static void process_sample(OutBuf *out, const char *name,
+                           const ProcessInfo *p) {
+  outbuf_str(out, name);
+  outbuf_str(out, "{pid=\"");
+  outbuf_i64(out, p->stats.pid);
+  outbuf_str(out, "\",comm=");
+  label_value(out, p->stats.comm);
+  outbuf_str(out, "} ");
+}
+
+// The snapshot may be sorted by something other than CPU (or only partially
+// sorted), so the exporter picks its own top N. Thread rows are left out;
+// `processes` is set to how many rows are processes.
+static int select_top(Exporter *exporter, const Snapshot *snapshot,
+                      int *processes) {
+  int count = snapshot->num_processes;
+  *processes = 0;
+  if (count > exporter->key_capacity) {
+    SortKey *keys = realloc(exporter->keys, count * sizeof(SortKey));
+    if (!keys)
+      return 0;
+    exporter->keys = keys;
+    exporter->key_capacity = count;
+  }
+  int n = 0;
+  for (int i = 0; i < count; ++i) {
+    const ProcessInfo *p = &snapshot->processed_list[i];
+    if (p->thread_of)
+      continue;
+    exporter->keys[n].value = p->cpu_percent;
+    exporter->keys[n].pid = p->stats.pid;
+    exporter->keys[n].index = i;
+    n++;
+  }
+  *processes = n;
+  return topk_select(exporter->keys, n, exporter->top_n);
+}
+
+static void cpu_gauge(OutBuf *out, const char *name, const char *help,
+                      const double *values, int num_entries) {
+  metric_header(out, name, NULL, help);
+  for (int i = 0; i < num_entries; ++i) {
+    outbuf_str(out, name);
+    outbuf_str(out, "{cpu=\"");
+    if (i == 0)
+      outbuf_str(out, "total");
+    else
+      outbuf_i64(out, i - 1);
+    outbuf_str(out, "\"} ");
+    outbuf_fixed(out, values[i], 2);
+    outbuf_char(out, '\n');
+  }
+}
+
+static void render(Exporter *exporter, const Snapshot *snapshot) {
+  OutBuf *out = &exporter->staging;
+  const memStats *mem = &snapshot->mem_info;
+
+  cpu_gauge(out, "pulse_cpu_usage_percent",
+            "CPU utilisation over the last sampling interval.",
+            snapshot->cpu.usage, snapshot->num_total_cpu_entries);
+  cpu_gauge(out, "pulse_cpu_steal_percent",
+            "CPU time taken by the hypervisor over the last interval.",
+            snapshot->cpu.steal, snapshot->num_total_cpu_entries);
+
+  gauge_u64(out, "pulse_memory_total_bytes", "bytes", "MemTotal.",
+            (unsigned long long)mem->memTotal * 1024);
+  gauge_u64(out, "pulse_memory_available_bytes", "bytes", "MemAvailable.",
+            (unsigned long long)mem->memAvailable * 1024);
+  gauge_u64(out, "pulse_swap_total_bytes", "bytes", "SwapTotal.",
+            (unsigned long long)mem->swapTotal * 1024);
+  gauge_u64(out, "pulse_swap_free_bytes", "bytes", "SwapFree.",
+            (unsigned long long)mem->swapFree * 1024);
+  int processes;
+  int rows = select_top(exporter, snapshot, &processes);
+  gauge_u64(out, "pulse_processes", NULL, "Processes seen in the last scan.",
+            processes);
+
+  if (rows > exporter->top_n)
+    rows = exporter->top_n;
+
+  metric_header(out, "pulse_process_cpu_percent", NULL,
+                "Per-process CPU share of the whole machine, top N by CPU.");
+  for (int i = 0; i < rows; ++i) {
+    const ProcessInfo *p = &snapshot->processed_list[exporter->keys[i].index];
+    process_sample(out, "pulse_process_cpu_percent", p);
+    outbuf_fixed(out, p->cpu_percent, 2);
+    outbuf_char(out, '\n');
+  }
+  metric_header(out, "pulse_process_resident_memory_bytes", "bytes",
+                "Per-process resident set size, top N by CPU.");
+  for (int i = 0; i < rows; ++i) {
+    const ProcessInfo *p = &snapshot->processed_list[exporter->keys[i].index];
+    process_sample(out, "pulse_process_resident_memory_bytes", p);
+    outbuf_i64(out, (long long)p->stats.rss_kb * 1024);
+    outbuf_char(out, '\n');
+  }
+  outbuf_str(out, "# EOF\n");
+}
+
+void exporter_update(Exporter *exporter, const Snapshot *snapshot) {
+  outbuf_reset(&exporter->staging);
+  render(exporter, snapshot);
+  if (exporter->staging.failed)
+    return;
+
+  pthread_mutex_lock(&exporter->lock);
+  OutBuf previous = exporter->published;
+  exporter->published = exporter->staging;
+  exporter->staging = previous;
+  pthread_mutex_unlock(&exporter->lock);
+}
+
+// Waits until `fd` is ready for `events`. Returns 0 once `deadline` has
+// passed or the exporter is stopping.
+static int wait_for(const Exporter *exporter, int fd, short events,
+                    unsigned long long deadline) {
+  struct pollfd fds[2] = {
+      {.fd = fd, .events = events},
+      {.fd = exporter->stop_fd, .events = POLLIN},
+  };
+  while (1) {
+    unsigned long long now = now_ns();
+    if (now >= deadline)
+      return 0;
+    int ready = poll(fds, 2, (int)((deadline - now + 999999) / 1000000));
+    if (ready < 0 && errno != EINTR)
+      return 0;
+    if (ready <= 0)
+      continue;
+    return !(fds[1].revents & POLLIN);
+  }
+}
+
+// Reads until the end of the request headers; only the request line matters.
+static int read_request(const Exporter *exporter, int fd, char *request,
+                        size_t size, unsigned long long deadline) {
+  size_t len = 0;
+  while (len < size - 1) {
+    if (!wait_for(exporter, fd, POLLIN, deadline))
+      return 0;
+    ssize_t n = read(fd, request + len, size - 1 - len);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+      continue;
+    if (n <= 0)
+      return 0;
+    len += n;
+    request[len] = '\0';
+    if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+      return 1;
+  }
+  return 0;
+}
+
+static int write_response(const Exporter *exporter, int fd,
+                          unsigned long long deadline) {
+  const OutBuf *out = &exporter->response;
+  size_t written = 0;
+  while (written < out->len) {
+    ssize_t n = write(fd, out->data + written, out->len - written);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN || !wait_for(exporter, fd, POLLOUT, deadline))
+        return 0;
+      continue;
+    }
+    written += (size_t)n;
+  }
+  return 1;
+}
+
+static void respond(Exporter *exporter, int fd, const char *status,
+                    const char *body, int use_published,
+                    unsigned long long deadline) {
+  OutBuf *out = &exporter->response;
+  outbuf_reset(out);
+  outbuf_str(out, "HTTP/1.1 ");
+  outbuf_str(out, status);
+  outbuf_str(out, "\r\nConnection: close\r\nContent-Type: ");
+  if (use_published) {
+    outbuf_str(out, CONTENT_TYPE "\r\nContent-Length: ");
+    pthread_mutex_lock(&exporter->lock);
+    outbuf_u64(out, exporter->published.len);
+    outbuf_str(out, "\r\n\r\n");
+    outbuf_mem(out, exporter->published.data, exporter->published.len);
+    pthread_mutex_unlock(&exporter->lock);
+  } else {
+    outbuf_str(out, "text/plain\r\nContent-Length: ");
+    outbuf_u64(out, strlen(body));
+    outbuf_str(out, "\r\n\r\n");
+    outbuf_str(out, body);
+  }
+  if (!out->failed)
+    write_response(exporter, fd, deadline);
+}
+
+// The client's socket is non-blocking, and reading the request and writing
+// the response share one deadline.
+static void serve_client(Exporter *exporter, int fd) {
+  char request[EXPORTER_REQUEST_MAX];
+  unsigned long long deadline = now_ns() + EXPORTER_IO_TIMEOUT_NS;
+  if (!read_request(exporter, fd, request, sizeof(request), deadline))
+    return;
+
+  if (strncmp(request, "GET ", 4) != 0) {
+    respond(exporter, fd, "405 Method Not Allowed", "method not allowed\n", 0,
+            deadline);
+    return;
+  }
+  const char *path = request + 4;
+  size_t path_len = strcspn(path, " ?\r\n");
+  if (path_len != 8 || strncmp(path, "/metrics", 8) != 0) {
+    respond(exporter, fd, "404 Not Found", "try /metrics\n", 0, deadline);
+    return;
+  }
+
+  pthread_mutex_lock(&exporter->lock);
+  int ready = exporter->published.len > 0;
+  pthread_mutex_unlock(&exporter->lock);
+  if (ready)
+    respond(exporter, fd, "200 OK", NULL, 1, deadline);
+  else
+    respond(exporter, fd, "503 Service Unavailable", "no sample yet\n", 0,
+            deadline);
+}
+
+static void *exporter_thread(void *arg) {
+  Exporter *exporter = arg;
+  struct pollfd fds[2] = {
+      {.fd = exporter->listen_fd, .events = POLLIN},
+      {.fd = exporter->stop_fd, .events = POLLIN},
+  };
+  while (1) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (fds[1].revents & POLLIN)
+      break;
+    if (!(fds[0].revents & POLLIN))
+      continue;
+    int client = accept4(exporter->listen_fd, NULL, NULL,
+                         SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (client < 0)
+      continue;
+    serve_client(exporter, client);
+    close(client);
+  }
+  return NULL;
+}
+
+int exporter_start(Exporter *exporter) {
+  if (pthread_create(&exporter->thread, NULL, exporter_thread, exporter) != 0)
+    return 0;
+  exporter->thread_started = 1;
+  return 1;
+}
+
+void exporter_destroy(Exporter *exporter) {
+  if (exporter->thread_started) {
+    uint64_t one = 1;
+    if (write(exporter->stop_fd, &one, sizeof(one)) < 0)
+      perror("pulse: exporter stop");
+    pthread_join(exporter->thread, NULL);
+  }
+  if (exporter->listen_fd >= 0)
+    close(exporter->listen_fd);
+  if (exporter->stop_fd >= 0)
+    close(exporter->stop_fd);
+  if (exporter->unix_path) {
+    unlink(exporter->unix_path);
+    free(exporter->unix_path);
+  }
+  pthread_mutex_destroy(&exporter->lock);
+  outbuf_free(&exporter->staging);
+  outbuf_free(&exporter->published);
+  outbuf_free(&exporter->response);
+  free(exporter->keys);
+  memset(exporter, 0, sizeof(*exporter));
+  exporter->listen_fd = -1;
+  exporter->stop_fd = -1;
+}
@@ -0,0 +1,496 @@
+#include "../include/filter.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FILTER_INITIAL_NAMES 256
+#define FILTER_INITIAL_PROCS 1024
+#define FILTER_INITIAL_TEXT 4096
+
+static unsigned int hash_name(const char *name) {
+  unsigned int hash = 2166136261u;
+  for (; *name; ++name)
+    hash = (hash ^ (unsigned char)*name) * 16777619u;
+  return hash;
+}
+
+static unsigned int hash_int(unsigned int key) { return key * 2654435761u; }
+
+static unsigned int trigram_at(const char *p) {
+  return (unsigned int)(unsigned char)p[0] << 16 |
+         (unsigned int)(unsigned char)p[1] << 8 | (unsigned char)p[2];
+}
+
+// One bit per character present, to rule names out without touching their
+// text. Letters and digits get a bit each; anything else shares the rest.
+static unsigned long long char_mask(const char *text) {
+  unsigned long long mask = 0;
+  for (; *text; ++text) {
+    unsigned char c = (unsigned char)*text;
+    int bit = c >= 'a' && c <= 'z'   ? c - 'a'
+              : c >= '0' && c <= '9' ? 26 + c - '0'
+                                     : 36 + c % 28;
+    mask |= 1ull << bit;
+  }
+  return mask;
+}
+
+static int exact_in_mask(const char *query) {
+  return query[0] && !query[1] &&
+         isalnum((unsigned char)query[0]);
+}
+
+static void lowercase(char *out, const char *in, size_t size) {
+  size_t i = 0;
+  for (; in[i] && i + 1 < size; ++i)
+    out[i] = (char)tolower((unsigned char)in[i]);
+  out[i] = '\0';
+}
+
+// Compares an interned (lowercase) name with a raw comm.
+static int same_name(const char *lower, const char *comm) {
+  for (; *lower && *comm; ++lower, ++comm) {
+    if (*lower != (char)tolower((unsigned char)*comm))
+      return 0;
+  }
+  return *lower == *comm;
+}
+
+int filter_init(FilterIndex *filter) {
+  memset(filter, 0, sizeof(*filter));
+  filter->name_capacity = FILTER_INITIAL_NAMES;
+  filter->names = malloc(sizeof(int) * filter->name_capacity);
+  filter->text_capacity = FILTER_INITIAL_TEXT;
+  filter->text = malloc(filter->text_capacity);
+  filter->name_chars =
+      malloc(sizeof(unsigned long long) * filter->name_capacity);
+  filter->name_matches = calloc(filter->name_capacity, 1);
+  filter->matched_names = malloc(sizeof(int) * filter->name_capacity);
+  filter->name_index_capacity = filter->name_capacity * 2;
+  filter->name_index = calloc(filter->name_index_capacity, sizeof(int));
+  filter->posting_capacity = FILTER_INITIAL_NAMES * 4;
+  filter->postings = calloc(filter->posting_capacity, sizeof(FilterPosting));
+  filter->proc_capacity = FILTER_INITIAL_PROCS * 2;
+  filter->procs = calloc(filter->proc_capacity, sizeof(FilterProc));
+  if (!filter->names || !filter->text || !filter->name_chars ||
+      !filter->name_matches || !filter->matched_names ||
+      !filter->name_index || !filter->postings || !filter->procs) {
+    filter_destroy(filter);
+    return 0;
+  }
+  return 1;
+}
+
+void filter_destroy(FilterIndex *filter) {
+  for (int i = 0; i < filter->posting_capacity && filter->postings; ++i)
+    free(filter->postings[i].names);
+  free(filter->names);
+  free(filter->text);
+  free(filter->name_chars);
+  free(filter->name_matches);
+  free(filter->matched_names);
+  free(filter->name_index);
+  free(filter->postings);
+  free(filter->procs);
+  free(filter->row_names);
+  free(filter->row_pids);
+  free(filter->row_digits);
+  free(filter->matches);
+  free(filter->scratch);
+  memset(filter, 0, sizeof(*filter));
+}
+
+static FilterPosting *find_posting(FilterPosting *postings, int capacity,
+                                   unsigned int trigram) {
+  unsigned int mask = (unsigned int)capacity - 1;
+  unsigned int i = hash_int(trigram) & mask;
+  while (postings[i].trigram != 0 && postings[i].trigram != trigram)
+    i = (i + 1) & mask;
+  return &postings[i];
+}
+
+static int grow_postings(FilterIndex *filter) {
+  int capacity = filter->posting_capacity * 2;
+  FilterPosting *postings = calloc(capacity, sizeof(FilterPosting));
+  if (!postings)
+    return 0;
+  for (int i = 0; i < filter->posting_capacity; ++i) {
+    if (filter->postings[i].trigram != 0)
+      *find_posting(postings, capacity, filter->postings[i].trigram) =
+          filter->postings[i];
+  }
+  free(filter->postings);
+  filter->postings = postings;
+  filter->posting_capacity = capacity;
+  return 1;
+}
+
+static int add_trigram(FilterIndex *filter, unsigned int trigram, int name) {
+  if ((filter->num_postings + 1) * 2 > filter->posting_capacity &&
+      !grow_postings(filter))
+    return 0;
+  FilterPosting *posting =
+      find_posting(filter->postings, filter->posting_capacity, trigram);
+  if (posting->trigram == 0) {
+    posting->trigram = trigram;
+    filter->num_postings++;
+  }
+  // A name repeating a trigram is listed once.
+  if (posting->count > 0 && posting->names[posting->count - 1] == name)
+    return 1;
+  if (posting->count == posting->capacity) {
+    int capacity = posting->capacity ? posting->capacity * 2 : 4;
+    int *names = realloc(posting->names, sizeof(int) * capacity);
+    if (!names)
+      return 0;
+    posting->names = names;
+    posting->capacity = capacity;
+  }
+  posting->names[posting->count++] = name;
+  return 1;
+}
+
+static const char *name_at(const FilterIndex *filter, int id) {
+  return filter->text + filter->names[id];
+}
+
+static int *name_slot(const FilterIndex *filter, const char *name) {
+  unsigned int mask = (unsigned int)filter->name_index_capacity - 1;
+  unsigned int i = hash_name(name) & mask;
+  while (filter->name_index[i] != 0 &&
+         strcmp(name_at(filter, filter->name_index[i] - 1), name) != 0)
+    i = (i + 1) & mask;
+  return &filter->name_index[i];
+}
+
+static int grow_names(FilterIndex *filter) {
+  int capacity = filter->name_capacity * 2;
+  int *names = realloc(filter->names, sizeof(int) * capacity);
+  if (!names)
+    return 0;
+  filter->names = names;
+  unsigned long long *name_chars =
+      realloc(filter->name_chars, sizeof(unsigned long long) * capacity);
+  if (!name_chars)
+    return 0;
+  filter->name_chars = name_chars;
+  unsigned char *name_matches = realloc(filter->name_matches, capacity);
+  if (!name_matches)
+    return 0;
+  memset(name_matches + filter->name_capacity, 0,
+         capacity - filter->name_capacity);
+  filter->name_matches = name_matches;
+  int *matched = realloc(filter->matched_names, sizeof(int) * capacity);
+  if (!matched)
+    return 0;
+  filter->matched_names = matched;
+  int *index = calloc((size_t)capacity * 2, sizeof(int));
+  if (!index)
+    return 0;
+  filter->name_capacity = capacity;
+  free(filter->name_index);
+  filter->name_index = index;
+  filter->name_index_capacity = capacity * 2;
+  for (int i = 0; i < filter->num_names; ++i)
+    *name_slot(filter, name_at(filter, i)) = i + 1;
+  return 1;
+}
+
+// Returns the id of a command name, adding it and its trigrams if new.
+// Names are never dropped: comm is at most 15 characters and even a busy
+// host only ever runs a few thousand distinct ones.
+static int intern(FilterIndex *filter, const char *comm) {
+  char lower[256];
+  lowercase(lower, comm, sizeof(lower));
+  int *slot = name_slot(filter, lower);
+  if (*slot != 0)
+    return *slot - 1;
+  if (filter->num_names == filter->name_capacity) {
+    if (!grow_names(filter))
+      return -1;
+    slot = name_slot(filter, lower);
+  }
+  // Kept back to back in one buffer, which a scan reads far faster than
+  // a pointer per name.
+  size_t len = strlen(lower);
+  if (filter->text_used + len + 1 > filter->text_capacity) {
+    size_t capacity = filter->text_capacity * 2 + len + 1;
+    char *text = realloc(filter->text, capacity);
+    if (!text)
+      return -1;
+    filter->text = text;
+    filter->text_capacity = capacity;
+  }
+  int id = filter->num_names;
+  filter->names[id] = (int)filter->text_used;
+  memcpy(filter->text + filter->text_used, lower, len + 1);
+  filter->text_used += len + 1;
+  filter->name_chars[id] = char_mask(lower);
+  filter->num_names++;
+  *slot = id + 1;
+  for (size_t i = 0; i + 3 <= len; ++i)
+    add_trigram(filter, trigram_at(lower + i), id);
+  return id;
+}
+
+static FilterProc *find_proc(FilterProc *procs, int capacity, int pid) {
+  unsigned int mask = (unsigned int)capacity - 1;
+  unsigned int i = hash_int((unsigned int)pid) & mask;
+  while (procs[i].pid != 0 && procs[i].pid != pid)
+    i = (i + 1) & mask;
+  return &procs[i];
+}
+
+static int grow_procs(FilterIndex *filter) {
+  int capacity = filter->proc_capacity * 2;
+  FilterProc *procs = calloc(capacity, sizeof(FilterProc));
+  if (!procs)
+    return 0;
+  for (int i = 0; i < filter->proc_capacity; ++i) {
+    if (filter->procs[i].pid != 0)
+      *find_proc(procs, capacity, filter->procs[i].pid) = filter->procs[i];
+  }
+  free(filter->procs);
+  filter->procs = procs;
+  filter->proc_capacity = capacity;
+  return 1;
+}
+
+// Backward-shift deletion, as in the process table.
+static void remove_proc(FilterIndex *filter, unsigned int hole) {
+  unsigned int mask = (unsigned int)filter->proc_capacity - 1;
+  filter->procs[hole].pid = 0;
+  filter->num_procs--;
+  unsigned int i = (hole + 1) & mask;
+  while (filter->procs[i].pid != 0) {
+    unsigned int home = hash_int((unsigned int)filter->procs[i].pid) & mask;
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      filter->procs[hole] = filter->procs[i];
+      filter->procs[i].pid = 0;
+      hole = i;
+    }
+    i = (i + 1) & mask;
+  }
+}
+
+static int proc_name(FilterIndex *filter, const pidStats *stats) {
+  FilterProc *proc =
+      find_proc(filter->procs, filter->proc_capacity, stats->pid);
+  if (proc->pid == 0) {
+    if ((filter->num_procs + 1) * 2 > filter->proc_capacity) {
+      if (!grow_procs(filter))
+        return -1;
+      proc = find_proc(filter->procs, filter->proc_capacity, stats->pid);
+    }
+    proc->pid = stats->pid;
+    proc->name = -1;
+    filter->num_procs++;
+  }
+  // A new process, a recycled PID or an exec that changed the name.
+  if (proc->name < 0 || proc->starttime != stats->starttime ||
+      !same_name(name_at(filter, proc->name), stats->comm)) {
+    proc->name = intern(filter, stats->comm);
+    proc->starttime = stats->starttime;
+  }
+  proc->seen = filter->generation;
+  return proc->name;
+}
+
+// Maps each row of a new snapshot to its name and PID, kept apart from the
+// rows so matching doesn't have to page through them. Thread rows have
+// neither: they are shown whenever their process is.
+void filter_sync(FilterIndex *filter, const ProcessInfo *rows, int num_rows,
+                 unsigned long generation) {
+  if (generation == filter->generation && filter->row_names)
+    return;
+  filter->num_rows = 0;
+  if (num_rows > filter->row_capacity) {
+    int *row_names = realloc(filter->row_names, sizeof(int) * num_rows);
+    int *row_pids = realloc(filter->row_pids, sizeof(int) * num_rows);
+    unsigned char *row_digits = realloc(filter->row_digits, num_rows);
+    int *matches = realloc(filter->matches, sizeof(int) * num_rows);
+    int *scratch = realloc(filter->scratch, sizeof(int) * num_rows);
+    if (row_names)
+      filter->row_names = row_names;
+    if (row_pids)
+      filter->row_pids = row_pids;
+    if (row_digits)
+      filter->row_digits = row_digits;
+    if (matches)
+      filter->matches = matches;
+    if (scratch)
+      filter->scratch = scratch;
+    if (!row_names || !row_pids || !row_digits || !matches || !scratch)
+      return;
+    filter->row_capacity = num_rows;
+  }
+  filter->generation = generation;
+  filter->num_rows = num_rows;
+  for (int i = 0; i < num_rows; ++i) {
+    int thread = rows[i].thread_of != 0;
+    filter->row_names[i] = thread ? -1 : proc_name(filter, &rows[i].stats);
+    filter->row_pids[i] = thread ? 0 : rows[i].stats.pid;
+    int digits = 1;
+    for (int pid = rows[i].stats.pid; pid >= 10; pid /= 10)
+      digits++;
+    filter->row_digits[i] = (unsigned char)digits;
+  }
+  unsigned int i = 0;
+  while (i < (unsigned int)filter->proc_capacity) {
+    if (filter->procs[i].pid != 0 &&
+        filter->procs[i].seen != filter->generation) {
+      remove_proc(filter, i);
+      continue;
+    }
+    ++i;
+  }
+  // Row numbers changed, so nothing can be narrowed from the last result.
+  filter->num_matches = -1;
+}
+
+// Forgets the last query, so the next one starts from every row.
+void filter_reset(FilterIndex *filter) {
+  filter->query[0] = '\0';
+  filter->num_matches = -1;
+}
+
+static int fuzzy_match(const char *name, const char *query) {
+  for (; *query; ++query) {
+    name = strchr(name, *query);
+    if (!name)
+      return 0;
+    name++;
+  }
+  return 1;
+}
+
+// The PIDs starting with the digits of `query` form one range per length:
+// "12" is 12, then 120-129, then 1200-1299 and so on. Ranges are indexed by
+// the PID's length in digits. Returns the query's length, or zero when it
+// is not a PID prefix.
+static int pid_ranges(const char *query, long long *low, long long *high) {
+  long long prefix = 0;
+  int digits = 0;
+  for (const char *p = query; *p; ++p, ++digits) {
+    if (!isdigit((unsigned char)*p) || digits == FILTER_PID_DIGITS)
+      return 0;
+    prefix = prefix * 10 + (*p - '0');
+  }
+  // PIDs never start with a zero.
+  if (digits == 0 || query[0] == '0')
+    return 0;
+  long long scale = 1;
+  for (int length = 0; length <= FILTER_PID_DIGITS; ++length) {
+    low[length] = high[length] = 0;
+    if (length >= digits) {
+      low[length] = prefix * scale;
+      high[length] = (prefix + 1) * scale;
+      scale *= 10;
+    }
+  }
+  return digits;
+}
+
+// Name ids worth testing: the last result when narrowing, otherwise the
+// shortest posting list among the query's trigrams, or every name for
+// queries too short to have one.
+static const int *name_candidates(FilterIndex *filter, const char *query,
+                                  int fuzzy, int narrowing, int *count) {
+  if (narrowing) {
+    *count = filter->num_matched_names;
+    return filter->matched_names;
+  }
+  size_t len = strlen(query);
+  if (fuzzy || len < 3) {
+    *count = -1;
+    return NULL;
+  }
+  const FilterPosting *best = NULL;
+  for (size_t i = 0; i + 3 <= len; ++i) {
+    const FilterPosting *posting = find_posting(
+        filter->postings, filter->posting_capacity, trigram_at(query + i));
+    if (posting->trigram == 0) {
+      *count = 0;
+      return NULL;
+    }
+    if (!best || posting->count < best->count)
+      best = posting;
+  }
+  *count = best->count;
+  return best->names;
+}
+
+static void match_names(FilterIndex *filter, const char *query, int fuzzy,
+                        int narrowing) {
+  for (int i = 0; i < filter->num_matched_names; ++i)
+    filter->name_matches[filter->matched_names[i]] = 0;
+  int count;
+  const int *candidates =
+      name_candidates(filter, query, fuzzy, narrowing, &count);
+  int total = count < 0 ? filter->num_names : count;
+  unsigned long long chars = char_mask(query);
+  int exact = exact_in_mask(query);
+  // Written in place over the candidates when narrowing, which is safe as
+  // the output never gets ahead of the input.
+  int matched = 0;
+  for (int i = 0; i < total; ++i) {
+    int id = candidates ? candidates[i] : i;
+    if ((filter->name_chars[id] & chars) != chars)
+      continue;
+    const char *name = name_at(filter, id);
+    if (exact ||
+        (fuzzy ? fuzzy_match(name, query) : strstr(name, query) != NULL)) {
+      filter->matched_names[matched++] = id;
+      filter->name_matches[id] = 1;
+    }
+  }
+  filter->num_matched_names = matched;
+  filter->matched_upto = filter->num_names;
+}
+
+// Leaves the indices of the rows last passed to filter_sync() that match
+// `query` in filter->matches and returns how many there are.
+int filter_apply(FilterIndex *filter, const char *query) {
+  char lower[FILTER_QUERY_MAX];
+  int fuzzy = query[0] == '~';
+  lowercase(lower, query + fuzzy, sizeof(lower));
+  // Names interned since the last match were never tested against it.
+  int narrowing = filter->query[0] != '\0' &&
+                  (filter->query[0] == '~') == fuzzy &&
+                  filter->matched_upto == filter->num_names &&
+                  strstr(lower, filter->query + fuzzy) != NULL;
+
+  match_names(filter, lower, fuzzy, narrowing);
+  long long low[FILTER_PID_DIGITS + 1], high[FILTER_PID_DIGITS + 1];
+  int pid_digits = fuzzy ? 0 : pid_ranges(lower, low, high);
+
+  // Narrowing only rescans the rows that matched last time. A PID prefix
+  // only narrows when the digits were appended.
+  int from_matches =
+      narrowing && filter->num_matches >= 0 &&
+      (pid_digits == 0 ||
+       strncmp(lower, filter->query, strlen(filter->query)) == 0);
+  int total = from_matches ? filter->num_matches : filter->num_rows;
+  int count = 0, process_matched = 0;
+  for (int k = 0; k < total; ++k) {
+    int i = from_matches ? filter->matches[k] : k;
+    int name = filter->row_names[i];
+    int pid = filter->row_pids[i];
+    if (pid != 0) {
+      int length = filter->row_digits[i];
+      process_matched = (name >= 0 && filter->name_matches[name]) ||
+                        (pid_digits > 0 && pid >= low[length] &&
+                         pid < high[length]);
+    }
+    if (process_matched)
+      filter->scratch[count++] = i;
+  }
+  int *previous = filter->matches;
+  filter->matches = filter->scratch;
+  filter->scratch = previous;
+  filter->num_matches = count;
+  snprintf(filter->query, sizeof(filter->query), "%s%s", fuzzy ? "~" : "",
+           lower);
+  return count;
+}
@@ -0,0 +1,171 @@
+#include "../include/history.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Samples of the finer tier folded into one sample of each tier, and how
+// many samples each ring holds: 10 minutes, 1 hour and 1 day.
+static const int tier_factor[HISTORY_TIERS] = {1, 10, 6};
+static const int tier_capacity[HISTORY_TIERS] = {600, 360, 1440};
+
+const char *const history_tier_names[HISTORY_TIERS] = {"1s", "10s", "60s"};
+
+static unsigned short quantize(double percent) {
+  if (!(percent > 0.0))
+    return 0;
+  if (percent >= 100.0)
+    return 65535;
+  return (unsigned short)(percent * 655.35 + 0.5);
+}
+
+static double used_percent(unsigned long total, unsigned long available) {
+  if (total == 0 || available > total)
+    return 0.0;
+  return 100.0 * (double)(total - available) / (double)total;
+}
+
+// `interval_ms` is how far apart samples are expected, which stands in for
+// the span of the first one; 0 if unknown.
+int history_init(History *history, int num_cpu_entries, int interval_ms) {
+  memset(history, 0, sizeof(*history));
+  history->num_cpu_entries = num_cpu_entries > 0 ? num_cpu_entries : 0;
+  history->num_series = history->num_cpu_entries + 2;
+  history->interval_ms = interval_ms > 0 ? interval_ms : 1000;
+  for (int tier = 0; tier < HISTORY_TIERS; ++tier) {
+    history->capacity[tier] = tier_capacity[tier];
+    history->samples[tier] =
+        calloc((size_t)history->num_series * tier_capacity[tier],
+               sizeof(unsigned short));
+    history->sums[tier] = calloc(history->num_series, sizeof(unsigned int));
+    if (!history->samples[tier] || !history->sums[tier]) {
+      history_destroy(history);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void history_destroy(History *history) {
+  for (int tier = 0; tier < HISTORY_TIERS; ++tier) {
+    free(history->samples[tier]);
+    free(history->sums[tier]);
+  }
+  memset(history, 0, sizeof(*history));
+}
+
+static unsigned short *ring(const History *history, int tier, int series) {
+  return history->samples[tier] + (size_t)series * history->capacity[tier];
+}
+
+// Appends the average of the samples pending for the first tier and folds
+// it into the coarser ones.
+static void push_second(History *history) {
+  unsigned int *pending_sums = history->sums[0];
+  unsigned int pending = (unsigned int)history->pending[0];
+  int slot = history->head[0];
+  for (int s = 0; s < history->num_series; ++s)
+    ring(history, 0, s)[slot] =
+        (unsigned short)((pending_sums[s] + pending / 2) / pending);
+
+  // Each new sample is added to the next tier's running sum, which is only
+  // averaged out once enough have arrived.
+  for (int tier = 0;; ++tier) {
+    slot = history->head[tier];
+    history->head[tier] = (slot + 1) % history->capacity[tier];
+    if (history->count[tier] < history->capacity[tier])
+      history->count[tier]++;
+    int next = tier + 1;
+    if (next == HISTORY_TIERS)
+      break;
+
+    unsigned int *sums = history->sums[next];
+    for (int s = 0; s < history->num_series; ++s)
+      sums[s] += ring(history, tier, s)[slot];
+    if (++history->pending[next] < tier_factor[next])
+      break;
+
+    unsigned int n = (unsigned int)history->pending[next];
+    for (int s = 0; s < history->num_series; ++s) {
+      ring(history, next, s)[history->head[next]] =
+          (unsigned short)((sums[s] + n / 2) / n);
+      sums[s] = 0;
+    }
+    history->pending[next] = 0;
+  }
+}
+
+// Each sample covers the time since the one before. Samples are summed
+// until they cover about a second, which is then appended once per second
+// covered, so ticks shorter than a second are averaged and longer ones
+// repeated.
+void history_record(History *history, unsigned long long timestamp_ms,
+                    const double *cpu_usage, int num_cpu_entries,
+                    const memStats *mem_info) {
+  // CPU hotplug changes what each series means; start over.
+  if (num_cpu_entries != history->num_cpu_entries || !history->num_series) {
+    int interval_ms = history->interval_ms;
+    history_destroy(history);
+    if (!history_init(history, num_cpu_entries, interval_ms))
+      return;
+  }
+
+  unsigned int span_ms = (unsigned int)history->interval_ms;
+  if (history->last_ms > 0 && timestamp_ms > history->last_ms) {
+    unsigned long long gap = timestamp_ms - history->last_ms;
+    span_ms = gap < 86400000ULL ? (unsigned int)gap : 86400000u;
+  }
+  history->last_ms = timestamp_ms;
+
+  unsigned int *sums = history->sums[0];
+  for (int i = 0; i < history->num_cpu_entries; ++i)
+    sums[i] += quantize(cpu_usage[i]);
+  sums[history_mem_series(history)] +=
+      quantize(used_percent(mem_info->memTotal, mem_info->memAvailable));
+  sums[history_swap_series(history)] +=
+      quantize(used_percent(mem_info->swapTotal, mem_info->swapFree));
+  history->pending[0]++;
+
+  // A second short by up to a quarter of a tick (at most 250 ms) is taken as
+  // covered, so jitter in the timestamps doesn't hold it back a whole tick.
+  history->span_ms += span_ms;
+  unsigned int slack = span_ms / 4 < 250 ? span_ms / 4 : 250;
+  unsigned int covered = (history->span_ms + slack) / 1000;
+  if (covered == 0)
+    return;
+  history->span_ms =
+      history->span_ms > covered * 1000 ? history->span_ms - covered * 1000 : 0;
+  if (covered > (unsigned int)history->capacity[0])
+    covered = (unsigned int)history->capacity[0];
+  for (unsigned int i = 0; i < covered; ++i)
+    push_second(history);
+  memset(sums, 0, sizeof(unsigned int) * history->num_series);
+  history->pending[0] = 0;
+}
+
+int history_cpu_series(const History *history, int cpu_index) {
+  return cpu_index >= 0 && cpu_index < history->num_cpu_entries ? cpu_index
+                                                                 : -1;
+}
+
+int history_mem_series(const History *history) {
+  return history->num_cpu_entries;
+}
+
+int history_swap_series(const History *history) {
+  return history->num_cpu_entries + 1;
+}
+
+// Copies the newest `max` samples of a series, oldest first, and returns
+// how many there were.
+int history_read(const History *history, int series, int tier,
+                 unsigned short *out, int max) {
+  if (series < 0 || series >= history->num_series || tier < 0 ||
+      tier >= HISTORY_TIERS)
+    return 0;
+  int capacity = history->capacity[tier];
+  int n = history->count[tier] < max ? history->count[tier] : max;
+  int start = (history->head[tier] - n + capacity) % capacity;
+  const unsigned short *samples = ring(history, tier, series);
+  for (int i = 0; i < n; ++i)
+    out[i] = samples[(start + i) % capacity];
+  return n;
+}
@@ -0,0 +1,56 @@
+#include "../include/latency.h"
+
+static int bucket_of(unsigned long long us) {
+  if (us < 8)
+    return (int)us;
+  int exponent = 63 - __builtin_clzll(us);
+  int bucket = 8 + (exponent - 3) * 4 + (int)((us >> (exponent - 2)) & 3);
+  return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+// The middle of a bucket, in microseconds.
+static double bucket_value(int bucket) {
+  if (bucket < 8)
+    return bucket;
+  int exponent = (bucket - 8) / 4 + 3;
+  double width = (double)(1ULL << (exponent - 2));
+  double low = (double)(1ULL << exponent) + ((bucket - 8) % 4) * width;
+  return low + width / 2;
+}
+
+void latency_record(LatencyHistogram *histogram, unsigned long long ns) {
+  unsigned long long us = ns / 1000;
+  histogram->counts[bucket_of(us)]++;
+  histogram->total++;
+  if (us > histogram->max_us)
+    histogram->max_us = us;
+}
+
+// The value below which `fraction` of the samples fall, in milliseconds;
+// zero before anything was recorded.
+double latency_percentile(const LatencyHistogram *histogram, double fraction) {
+  if (histogram->total == 0)
+    return 0.0;
+  unsigned long long rank =
+      (unsigned long long)(fraction * histogram->total + 0.5);
+  if (rank < 1)
+    rank = 1;
+  unsigned long long seen = 0;
+  for (int b = 0; b < LATENCY_BUCKETS; ++b) {
+    seen += histogram->counts[b];
+    if (seen >= rank) {
+      double us = bucket_value(b);
+      if (us > (double)histogram->max_us)
+        us = (double)histogram->max_us;
+      return us / 1000.0;
+    }
+  }
+  return histogram->max_us / 1000.0;
+}
+
+void latency_print(FILE *out, const char *name,
+                   const LatencyHistogram *histogram) {
+  fprintf(out, "%-10s %8u %10.3f %10.3f %10.3f\n", name, histogram->total,
+          latency_percentile(histogram, 0.5),
+          latency_percentile(histogram, 0.99), histogram->max_us / 1000.0);
+}
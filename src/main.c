@@ -1,265 +1,475 @@
-#include <ctype.h>
-#include <dirent.h>
-#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
 #include <pthread.h>
-#include <search.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-#include "../include/calculate.h"
-#include "../include/parser.h"
+#include "../include/agent.h"
+#include "../include/batch.h"
+#include "../include/collector.h"
+#include "../include/config.h"
+#include "../include/exporter.h"
+#include "../include/player.h"
+#include "../include/recording.h"
+#include "../include/scheduler.h"
+#include "../include/snapshot.h"
 #include "../include/ui.h"
+#include "../include/viewer.h"
 
-#define INITIAL_BUFFER_SIZE 4096
-#define MAX_CPU_ENTRIES 33
-#define MAX_PROCESSES 4096
-
-typedef struct {
-  pidStats *items;
-  int count;
-} ProcessList;
-
-typedef struct {
-  double cpu_usage[MAX_CPU_ENTRIES];
-  memStats mem_info;
-  ProcessInfo processed_list[MAX_PROCESSES];
-  int num_total_cpu_entries;
-  int num_processes;
-} SharedData;
-
-static SharedData shared_data;
-static pthread_mutex_t data_mutex;
+static SnapshotExchange exchange;
+static Scheduler scheduler;
 static volatile int running = 1;
-static volatile int sort_by_cpu = 1;
-
-int compare_cpu_usage(const void *a, const void *b) {
-  const ProcessInfo *p1 = (const ProcessInfo *)a;
-  const ProcessInfo *p2 = (const ProcessInfo *)b;
-  if (p2->cpu_percent > p1->cpu_percent)
-    return 1;
-  if (p2->cpu_percent < p1->cpu_percent)
-    return -1;
-  return 0;
-}
+static volatile SortColumn sort_column = SORT_CPU;
+static volatile int show_io = 0;
+static volatile int sort_depth = 0;
+static volatile int show_threads = 0;
+static volatile int selected_pid = 0;
+static volatile int show_cgroups = 0;
+static volatile int show_tree = 0;
+static volatile int show_memory = 0;
+static volatile int memory_rows = 0;
+// The process rows on screen, for which PSS, USS and swap are read; the UI
+// thread writes them and the data thread copies them under the lock.
+static pthread_mutex_t memory_lock = PTHREAD_MUTEX_INITIALIZER;
+static int memory_pids[UI_MAX_VISIBLE_PIDS];
+static int num_memory_pids = 0;
+static volatile int timed = 0;
+static Exporter exporter;
+static int exporting = 0;
+static Agent agent;
+static int serving_agent = 0;
+static Viewer viewer;
+static int viewing = 0;
+static int num_hosts = 0;
+static int selected_host = 0;
+static Recorder recorder;
+static int recording = 0;
+static Player player;
+static int replaying = 0;
+static int dumping_timings = 0;
+static int headless = 0;
+// Set by the data thread when it cannot collect; main reports it once the
+// UI is gone.
+static const char *collector_failure = NULL;
+static int collector_errno = 0;
 
-char *read_file_dynamically(const char *path);
-int get_all_processes(pidStats *buffer, int capacity);
 void *data_collector_thread(void *arg);
-int compare_pids(const void *a, const void *b);
-
-int main() {
+static int run_ui(int interval_ms);
+static int run_viewer(const PulseConfig *config);
+static int run_replay(const PulseConfig *config);
+static void destroy_outputs(BatchWriter *writer, const PulseConfig *config);
+static int run_headless(const sigset_t *signals);
+static int run_batch(BatchWriter *writer, const PulseConfig *config);
+static void dump_timings(const SelfStats *self,
+                         const LatencyHistogram *frames);
+
+int main(int argc, char **argv) {
   pthread_t data_thread_id;
+  PulseConfig config;
 
-  if (pthread_mutex_init(&data_mutex, NULL) != 0) {
+  config_defaults(&config);
+  if (!config_load_file(&config, NULL))
     return 1;
+  int parsed = config_parse_args(&config, argc, argv);
+  if (parsed != 0)
+    return parsed < 0 ? 1 : 0;
+  if (config.num_connect > 0)
+    return run_viewer(&config);
+  if (config.replay_path)
+    return run_replay(&config);
+
+  // Reject a bad field list before any collection starts.
+  BatchWriter writer;
+  if (config.batch) {
+    if (!batch_init(&writer, &config)) {
+      batch_destroy(&writer);
+      return 1;
+    }
+    sort_depth = config.top_n;
+    show_io = batch_wants_io(&writer);
+    show_memory = batch_wants_memory(&writer);
+    memory_rows = config.top_n > 0 ? config.top_n : INT_MAX;
   }
-  if (pthread_create(&data_thread_id, NULL, data_collector_thread, NULL) != 0) {
-    return 1;
+  if (config.serve_address) {
+    if (!exporter_init(&exporter, config.serve_address, config.top_n)) {
+      destroy_outputs(&writer, &config);
+      return 1;
+    }
+    exporting = 1;
   }
-
-  ui_init();
-
-  while (running) {
-    int ch = getch();
-    if (ch == 'q' || ch == 'Q') {
-      running = 0;
-      continue;
-    } else if (ch == KEY_RESIZE) {
-      ui_resize();
-    } else if (ch == 'c' || ch == 'C') {
-      sort_by_cpu = 1;
-    } else if (ch != ERR) {
-      ui_handle_input(ch, shared_data.num_processes);
+  if (config.agent_address) {
+    if (!agent_init(&agent, config.agent_address)) {
+      destroy_outputs(&writer, &config);
+      return 1;
     }
-    SharedData local_data_copy;
-    pthread_mutex_lock(&data_mutex);
-    local_data_copy = shared_data;
-    pthread_mutex_unlock(&data_mutex);
-
-    ui_draw(local_data_copy.cpu_usage, &local_data_copy.mem_info,
-            local_data_copy.num_total_cpu_entries,
-            local_data_copy.processed_list, local_data_copy.num_processes);
+    serving_agent = 1;
+    // Viewers sort for themselves and can show I/O, so collect it and
+    // leave the order alone.
+    if (!config.batch) {
+      sort_column = SORT_NONE;
+      show_io = 1;
+    }
+  }
+  if (config.record_path) {
+    if (!recorder_init(&recorder, config.record_path)) {
+      destroy_outputs(&writer, &config);
+      return 1;
+    }
+    recording = 1;
+  }
 
-    usleep(33000); // ~30 FPS
+  // An agent, or a scrape-only or recording instance (e.g. under a service
+  // manager) without a terminal to draw on, waits for SIGINT/SIGTERM
+  // instead. Block them before any thread starts so only sigwait() sees
+  // them.
+  headless =
+      !config.batch &&
+      (serving_agent ||
+       ((exporting || recording) && !isatty(STDOUT_FILENO)));
+  sigset_t stop_signals;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  if (headless)
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+  if ((exporting && !exporter_start(&exporter)) ||
+      (serving_agent && !agent_start(&agent)) ||
+      (recording && !recorder_start(&recorder))) {
+    destroy_outputs(&writer, &config);
+    return 1;
+  }
+  if (!scheduler_init(&scheduler, config_tick_ms(&config))) {
+    perror("pulse: timerfd");
+    destroy_outputs(&writer, &config);
+    return 1;
+  }
+  dumping_timings = timed = config.timings;
+  snapshot_init(&exchange);
+  int err = pthread_create(&data_thread_id, NULL, data_collector_thread,
+                           &config);
+  if (err != 0) {
+    fprintf(stderr, "pulse: cannot start collector: %s\n", strerror(err));
+    scheduler_destroy(&scheduler);
+    snapshot_destroy(&exchange);
+    destroy_outputs(&writer, &config);
+    return 1;
   }
 
+  int status;
+  if (config.batch)
+    status = run_batch(&writer, &config);
+  else if (headless)
+    status = run_headless(&stop_signals);
+  else
+    status = run_ui(config.cpu_interval_ms > 0 ? config.cpu_interval_ms
+                                               : config.interval_ms);
+
+  running = 0;
+  scheduler_stop(&scheduler);
   pthread_join(data_thread_id, NULL);
-  pthread_mutex_destroy(&data_mutex);
-  ui_cleanup();
-  return 0;
+  scheduler_destroy(&scheduler);
+  if (collector_failure) {
+    fprintf(stderr, "pulse: %s: %s\n", collector_failure,
+            strerror(collector_errno));
+    status = 1;
+  }
+  // The UI is gone by now, so the numbers land on a plain terminal.
+  if (dumping_timings)
+    dump_timings(&snapshot_acquire(&exchange, NULL)->self,
+                 config.batch || headless ? NULL : ui_frame_latency());
+  snapshot_destroy(&exchange);
+  destroy_outputs(&writer, &config);
+  return status;
 }
 
-void *data_collector_thread(void *arg) {
-  (void)arg;
-
-  cpuStat prevCpuStats[MAX_CPU_ENTRIES] = {0},
-          currCpuStats[MAX_CPU_ENTRIES] = {0};
-  pidStats prev_procs_buffer[MAX_PROCESSES];
-  ProcessList prev_procs = {.items = prev_procs_buffer};
-  int num_cpu_entries = 0;
+static void destroy_outputs(BatchWriter *writer, const PulseConfig *config) {
+  if (exporting)
+    exporter_destroy(&exporter);
+  if (serving_agent)
+    agent_destroy(&agent);
+  if (recording)
+    recorder_destroy(&recorder);
+  if (config->batch)
+    batch_destroy(writer);
+}
 
-  char *initial_cpu_data = read_file_dynamically("/proc/stat");
-  if (initial_cpu_data) {
-    num_cpu_entries =
-        cpuParser(initial_cpu_data, prevCpuStats, MAX_CPU_ENTRIES);
-    free(initial_cpu_data);
+// The UI over agents' samples: the viewer thread stands in for the
+// collector and publishes into the same exchange.
+static int run_viewer(const PulseConfig *config) {
+  snapshot_init(&exchange);
+  if (!viewer_init(&viewer, config->connect_addresses, config->num_connect,
+                   &exchange) ||
+      !viewer_start(&viewer)) {
+    viewer_destroy(&viewer);
+    snapshot_destroy(&exchange);
+    return 1;
   }
-  prev_procs.count = get_all_processes(prev_procs.items, MAX_PROCESSES);
-
-  while (running) {
-    SharedData current_data;
-    pidStats curr_procs_buffer[MAX_PROCESSES];
-    ProcessList curr_procs = {.items = curr_procs_buffer};
+  viewing = 1;
+  num_hosts = config->num_connect;
+  int status = run_ui(0);
+  running = 0;
+  viewer_destroy(&viewer);
+  snapshot_destroy(&exchange);
+  return status;
+}
 
-    current_data.num_total_cpu_entries = num_cpu_entries;
+// A recording played back the same way, with the player thread in place
+// of the collector.
+static int run_replay(const PulseConfig *config) {
+  snapshot_init(&exchange);
+  if (!player_init(&player, config->replay_path, &exchange) ||
+      !player_start(&player)) {
+    player_destroy(&player);
+    snapshot_destroy(&exchange);
+    return 1;
+  }
+  replaying = 1;
+  ui_set_replaying(1);
+  int status = run_ui(0);
+  running = 0;
+  player_destroy(&player);
+  snapshot_destroy(&exchange);
+  return status;
+}
 
-    char *cpu_data = read_file_dynamically("/proc/stat");
-    char *mem_data = read_file_dynamically("/proc/meminfo");
-    curr_procs.count = get_all_processes(curr_procs.items, MAX_PROCESSES);
+// `interval_ms` is how often this machine's CPU is sampled, or 0 when the
+// samples come from elsewhere.
+static int run_ui(int interval_ms) {
+  History history;
+  if (!history_init(&history, 0, interval_ms))
+    return 1;
+  ui_init();
 
-    if (cpu_data) {
-      cpuParser(cpu_data, currCpuStats, MAX_CPU_ENTRIES);
-      cpuUsage(prevCpuStats, currCpuStats, current_data.cpu_usage,
-               num_cpu_entries);
+  // Sleep until a key arrives or the collector publishes. SIGWINCH also
+  // interrupts poll(), after which getch() reports KEY_RESIZE.
+  struct pollfd fds[2] = {
+      {.fd = STDIN_FILENO, .events = POLLIN},
+      {.fd = exchange.notify_fd, .events = POLLIN},
+  };
+  int changed;
+  const Snapshot *snapshot = snapshot_acquire(&exchange, &changed);
+  int needs_draw = 1;
+  int history_source = 0;
+  unsigned long long history_time = 0;
+  while (running) {
+    // Every new CPU or memory sample goes into the history; ticks that only
+    // rescanned processes are not, nor are redraws for input or a viewer's
+    // republishes of the same sample in a new order.
+    // Switching to another agent, or seeking in a recording, starts the
+    // history over.
+    if (changed && snapshot->source != history_source) {
+      history_destroy(&history);
+      history_init(&history, 0, interval_ms);
+      history_source = snapshot->source;
     }
-    if (mem_data) {
-      memParser(mem_data, &current_data.mem_info);
-      free(mem_data);
+    if (changed && snapshot->timestamp_ms != history_time &&
+        (snapshot->sampled &
+         (1u << SUBSYSTEM_CPU | 1u << SUBSYSTEM_MEMORY))) {
+      history_record(&history, snapshot->timestamp_ms, snapshot->cpu.usage,
+                     snapshot->num_total_cpu_entries, &snapshot->mem_info);
+      history_time = snapshot->timestamp_ms;
     }
-
-    long long total_cpu_time_delta = 0;
-    if (cpu_data) {
-      unsigned long long prev_total =
-          prevCpuStats[0].user + prevCpuStats[0].nice + prevCpuStats[0].system +
-          prevCpuStats[0].idle + prevCpuStats[0].iowait + prevCpuStats[0].irq +
-          prevCpuStats[0].softirq;
-      unsigned long long curr_total =
-          currCpuStats[0].user + currCpuStats[0].nice + currCpuStats[0].system +
-          currCpuStats[0].idle + currCpuStats[0].iowait + currCpuStats[0].irq +
-          currCpuStats[0].softirq;
-      total_cpu_time_delta = curr_total - prev_total;
+    changed = 0;
+    if (needs_draw) {
+      ui_set_host(snapshot->source_name);
+      ui_draw(&snapshot->cpu, &snapshot->mem_info,
+              snapshot->num_total_cpu_entries, &history, snapshot->disks,
+              snapshot->num_disks, snapshot->nets, snapshot->num_nets,
+              snapshot->tcp_retrans_rate, snapshot->cgroups,
+              snapshot->num_cgroups, snapshot->processed_list,
+              snapshot->num_processes, &snapshot->self,
+              snapshot->generation);
+      needs_draw = 0;
     }
-
-    qsort(prev_procs.items, prev_procs.count, sizeof(pidStats), compare_pids);
-
-    for (int i = 0; i < curr_procs.count; ++i) {
-      current_data.processed_list[i].stats = curr_procs.items[i];
-      current_data.processed_list[i].cpu_percent = 0.0;
-
-      pidStats *prev_stat =
-          bsearch(&curr_procs.items[i], prev_procs.items, prev_procs.count,
-                  sizeof(pidStats), compare_pids);
-
-      if (prev_stat) {
-        unsigned long long proc_time_delta =
-            (curr_procs.items[i].utime + curr_procs.items[i].stime) -
-            (prev_stat->utime + prev_stat->stime);
-        if (total_cpu_time_delta > 0) {
-          current_data.processed_list[i].cpu_percent =
-              100.0 * (double)proc_time_delta / (double)total_cpu_time_delta;
-        }
-      }
-
-      if (current_data.mem_info.memTotal > 0) {
-        current_data.processed_list[i].mem_percent =
-            100.0 * (double)(current_data.processed_list[i].stats.rss * 4) /
-            (double)current_data.mem_info.memTotal;
+    // Without an eventfd, fall back to checking at the old 30 FPS.
+    int timeout = exchange.notify_fd >= 0 ? -1 : 33;
+    if (poll(fds, 2, timeout) < 0 && errno != EINTR)
+      break;
+    if (fds[1].revents & POLLIN)
+      snapshot_drain_notify(&exchange);
+
+    int ch;
+    while (running && (ch = getch()) != ERR) {
+      if (ch == KEY_RESIZE) {
+        ui_resize();
+        needs_draw = 1;
+      } else if (ui_filter_editing()) {
+        // While a search is typed every other key belongs to it.
+        if (ui_handle_input(ch, snapshot->num_processes))
+          needs_draw = 1;
+      } else if (ch == 'q' || ch == 'Q') {
+        running = 0;
+      } else if (viewing && ch == '\t') {
+        selected_host = (selected_host + 1) % num_hosts;
+      } else if ((viewing || replaying) && ch > 0 && ch < 128 &&
+                 strchr("tTfFgGmM", ch)) {
+        // Agents send neither threads, the tree, cgroups nor PSS, and
+        // recordings keep what agents send.
+      } else if (replaying && (ch == 'p' || ch == 'P')) {
+        player_toggle_pause(&player);
+      } else if (replaying && (ch == KEY_LEFT || ch == KEY_RIGHT)) {
+        player_seek(&player, ch == KEY_LEFT ? -10000 : 10000);
+      } else if (replaying && (ch == '[' || ch == ']')) {
+        player_seek(&player, ch == '[' ? -300000 : 300000);
+      } else if (replaying && (ch == KEY_HOME || ch == KEY_END)) {
+        player_seek(&player,
+                    ch == KEY_HOME ? -PLAYER_SEEK_ALL : PLAYER_SEEK_ALL);
+      } else if (replaying && (ch == '-' || ch == '+' || ch == '=')) {
+        player_change_speed(&player, ch == '-' ? -1 : 1);
+      } else if (ch == 'c' || ch == 'C') {
+        sort_column = SORT_CPU;
+      } else if (ch == 'i' || ch == 'I') {
+        sort_column = SORT_IO;
+        ui_set_io_visible(1);
+        needs_draw = 1;
+      } else if (ui_handle_input(ch, snapshot->num_processes)) {
+        needs_draw = 1;
       }
     }
-    current_data.num_processes = curr_procs.count;
-    if (sort_by_cpu) {
-      qsort(current_data.processed_list, current_data.num_processes,
-            sizeof(ProcessInfo), compare_cpu_usage);
-    }
-    pthread_mutex_lock(&data_mutex);
-    shared_data = current_data;
-    pthread_mutex_unlock(&data_mutex);
-
-    if (cpu_data) {
-      updateCpuState(prevCpuStats, currCpuStats, num_cpu_entries);
-      free(cpu_data);
-    }
-
-    prev_procs.count = curr_procs.count;
-    memcpy(prev_procs.items, curr_procs.items,
-           curr_procs.count * sizeof(pidStats));
-
-    sleep(1);
+    sort_depth = ui_sort_depth();
+    show_io = ui_io_visible();
+    show_threads = ui_threads_visible();
+    selected_pid = ui_selected_pid();
+    show_cgroups = ui_cgroups_visible();
+    show_tree = ui_tree_visible();
+    show_memory = ui_memory_visible();
+    pthread_mutex_lock(&memory_lock);
+    num_memory_pids = ui_visible_pids(memory_pids, UI_MAX_VISIBLE_PIDS);
+    pthread_mutex_unlock(&memory_lock);
+    timed = dumping_timings || ui_stats_visible();
+    if (viewing)
+      viewer_set_view(&viewer, selected_host, sort_column, sort_depth);
+    if (replaying)
+      player_set_view(&player, sort_column, sort_depth);
+    snapshot = snapshot_acquire(&exchange, &changed);
+    if (changed)
+      needs_draw = 1;
   }
 
-  return NULL;
+  ui_cleanup();
+  history_destroy(&history);
+  return 0;
 }
 
-int compare_pids(const void *a, const void *b) {
-  const pidStats *p1 = (const pidStats *)a;
-  const pidStats *p2 = (const pidStats *)b;
-  return (p1->pid - p2->pid);
+static int run_headless(const sigset_t *signals) {
+  int sig;
+  sigwait(signals, &sig);
+  return 0;
 }
 
-int get_all_processes(pidStats *buffer, int capacity) {
-  DIR *proc_dir = opendir("/proc");
-  if (!proc_dir)
-    return 0;
+// Batch mode: wait for each publish and stream it to stdout, formatted
+// into one reused buffer and written with a single write() per tick.
+static int run_batch(BatchWriter *writer, const PulseConfig *config) {
+  struct pollfd notify = {.fd = exchange.notify_fd, .events = POLLIN};
+  int timeout = exchange.notify_fd >= 0 ? -1 : 33;
+  int emitted = 0;
+  int status = 0;
+  while (running) {
+    if (poll(&notify, 1, timeout) < 0 && errno != EINTR)
+      break;
+    if (notify.revents & POLLIN)
+      snapshot_drain_notify(&exchange);
 
-  int count = 0;
-  struct dirent *entry;
-  while ((entry = readdir(proc_dir)) != NULL && count < capacity) {
-    if (!isdigit(entry->d_name[0]))
+    int changed;
+    const Snapshot *snapshot = snapshot_acquire(&exchange, &changed);
+    if (!changed)
       continue;
-
-    char path[512];
-    snprintf(path, sizeof(path), "/proc/%s/stat", entry->d_name);
-    char *file_contents = read_file_dynamically(path);
-    if (file_contents) {
-      if (pidParser(file_contents, &buffer[count]))
-        count++;
-      free(file_contents);
+    if (!batch_emit(writer, snapshot, STDOUT_FILENO)) {
+      status = 1;
+      break;
     }
+    if (config->iterations > 0 && ++emitted >= config->iterations)
+      break;
   }
-  closedir(proc_dir);
-  return count;
+
+  return status;
 }
 
-char *read_file_dynamically(const char *path) {
-  int fd = open(path, O_RDONLY);
-  if (fd < 0)
-    return NULL;
+static void dump_timings(const SelfStats *self,
+                         const LatencyHistogram *frames) {
+  fprintf(stderr, "%-10s %8s %10s %10s %10s\n", "stage", "count", "p50 ms",
+          "p99 ms", "max ms");
+  for (int s = 0; s < self->num_stages; ++s)
+    latency_print(stderr, self->stage_names[s], &self->stages[s]);
+  latency_print(stderr, "tick", &self->tick);
+  latency_print(stderr, "drift", &self->drift);
+  if (frames)
+    latency_print(stderr, "frame", frames);
+  fprintf(stderr, "%llu ticks dropped after overruns\n", self->overruns);
+  fprintf(stderr, "cpu %.1f%%, rss %ld kB\n", self->cpu_percent,
+          self->rss_kb);
+}
+
+// Stops the program from the data thread: whichever loop main is in wakes
+// up, finds `running` clear and returns.
+static void collector_failed(const char *what) {
+  collector_failure = what;
+  collector_errno = errno;
+  running = 0;
+  snapshot_wake(&exchange);
+  if (headless)
+    kill(getpid(), SIGTERM);
+}
+
+void *data_collector_thread(void *arg) {
+  const PulseConfig *config = arg;
+  Collector collector;
+  int visible_pids[UI_MAX_VISIBLE_PIDS];
 
-  size_t buffer_size = INITIAL_BUFFER_SIZE;
-  char *buffer = malloc(buffer_size);
-  if (!buffer) {
-    close(fd);
+  if (!collector_init(&collector, config)) {
+    collector_failed("cannot start collector");
+    return NULL;
+  }
+  // Without deadlines the first wait would never end.
+  if (!scheduler_start(&scheduler)) {
+    collector_failed("timerfd");
+    collector_destroy(&collector);
     return NULL;
   }
 
-  size_t total_read = 0;
-  while (1) {
-    ssize_t bytes_read =
-        read(fd, buffer + total_read, buffer_size - total_read - 1);
-    if (bytes_read > 0) {
-      total_read += bytes_read;
-    } else if (bytes_read == 0) {
-      break;
-    } else {
-      free(buffer);
-      close(fd);
-      return NULL;
+  while (running) {
+    pthread_mutex_lock(&memory_lock);
+    int num_visible_pids = num_memory_pids;
+    memcpy(visible_pids, memory_pids, sizeof(int) * num_visible_pids);
+    pthread_mutex_unlock(&memory_lock);
+    CollectorView view = {.sort_column = sort_column,
+                          .sort_depth = sort_depth,
+                          .show_io = show_io,
+                          .show_threads = show_threads,
+                          .selected_pid = selected_pid,
+                          .show_cgroups = show_cgroups,
+                          .show_tree = show_tree,
+                          .show_memory = show_memory,
+                          .memory_rows = memory_rows,
+                          .memory_pids = visible_pids,
+                          .num_memory_pids = num_visible_pids,
+                          .timed = timed};
+    Snapshot *snapshot = snapshot_back(&exchange);
+    if (collector_tick(&collector, snapshot, &view)) {
+      // The back buffer is still ours until publish, so render from it here.
+      if (exporting)
+        exporter_update(&exporter, snapshot);
+      if (serving_agent)
+        agent_update(&agent, snapshot);
+      if (recording)
+        recorder_update(&recorder, snapshot);
+      collector_publish(&collector, &exchange);
     }
-
-    if (total_read >= buffer_size - 1) {
-      buffer_size *= 2;
-      char *new_buffer = realloc(buffer, buffer_size);
-      if (!new_buffer) {
-        free(buffer);
-        close(fd);
-        return NULL;
-      }
-      buffer = new_buffer;
+    // An overrun drops the ticks it ran into instead of running them late.
+    int missed = scheduler_wait(&scheduler);
+    if (missed < 0) {
+      if (running)
+        collector_failed("timerfd");
+      break;
     }
+    collector_skip(&collector, missed);
   }
-  buffer[total_read] = '\0';
-  close(fd);
-  return buffer;
+
+  collector_destroy(&collector);
+  return NULL;
 }
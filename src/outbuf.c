@@ -0,0 +1,151 @@
+#include "../include/outbuf.h"
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define OUTBUF_INITIAL_CAPACITY 4096
+
+void outbuf_init(OutBuf *buf) { memset(buf, 0, sizeof(*buf)); }
+
+void outbuf_free(OutBuf *buf) {
+  free(buf->data);
+  memset(buf, 0, sizeof(*buf));
+}
+
+void outbuf_reset(OutBuf *buf) {
+  buf->len = 0;
+  buf->failed = 0;
+}
+
+int outbuf_reserve(OutBuf *buf, size_t extra) {
+  if (buf->failed)
+    return 0;
+  if (buf->len + extra <= buf->capacity)
+    return 1;
+  size_t capacity = buf->capacity ? buf->capacity : OUTBUF_INITIAL_CAPACITY;
+  while (capacity < buf->len + extra)
+    capacity *= 2;
+  char *data = realloc(buf->data, capacity);
+  if (!data) {
+    buf->failed = 1;
+    return 0;
+  }
+  buf->data = data;
+  buf->capacity = capacity;
+  return 1;
+}
+
+void outbuf_char(OutBuf *buf, char c) {
+  if (outbuf_reserve(buf, 1))
+    buf->data[buf->len++] = c;
+}
+
+void outbuf_mem(OutBuf *buf, const char *data, size_t len) {
+  if (outbuf_reserve(buf, len)) {
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+  }
+}
+
+void outbuf_str(OutBuf *buf, const char *text) {
+  outbuf_mem(buf, text, strlen(text));
+}
+
+void outbuf_u64(OutBuf *buf, unsigned long long value) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value);
+  if (!outbuf_reserve(buf, n))
+    return;
+  while (n > 0)
+    buf->data[buf->len++] = digits[--n];
+}
+
+void outbuf_i64(OutBuf *buf, long long value) {
+  if (value < 0) {
+    outbuf_char(buf, '-');
+    outbuf_u64(buf, 0ULL - (unsigned long long)value);
+  } else {
+    outbuf_u64(buf, (unsigned long long)value);
+  }
+}
+
+void outbuf_fixed(OutBuf *buf, double value, int decimals) {
+  static const double scales[] = {1, 10, 100, 1000, 10000};
+  if (decimals < 0)
+    decimals = 0;
+  if (decimals > 4)
+    decimals = 4;
+  if (!isfinite(value)) {
+    outbuf_char(buf, '0');
+    return;
+  }
+  if (value < 0) {
+    outbuf_char(buf, '-');
+    value = -value;
+  }
+  unsigned long long scaled =
+      (unsigned long long)llround(value * scales[decimals]);
+  unsigned long long scale = (unsigned long long)scales[decimals];
+  outbuf_u64(buf, scaled / scale);
+  if (decimals == 0)
+    return;
+  char frac[4];
+  unsigned long long rest = scaled % scale;
+  for (int i = decimals - 1; i >= 0; --i) {
+    frac[i] = (char)('0' + rest % 10);
+    rest /= 10;
+  }
+  outbuf_char(buf, '.');
+  outbuf_mem(buf, frac, decimals);
+}
+
+void outbuf_json_string(OutBuf *buf, const char *text) {
+  static const char hex[] = "0123456789abcdef";
+  outbuf_char(buf, '"');
+  for (const unsigned char *p = (const unsigned char *)text; *p; ++p) {
+    if (*p == '"' || *p == '\\') {
+      char escaped[2] = {'\\', (char)*p};
+      outbuf_mem(buf, escaped, 2);
+    } else if (*p < 0x20) {
+      char escaped[6] = {'\\', 'u', '0', '0', hex[*p >> 4], hex[*p & 15]};
+      outbuf_mem(buf, escaped, 6);
+    } else {
+      outbuf_char(buf, (char)*p);
+    }
+  }
+  outbuf_char(buf, '"');
+}
+
+void outbuf_csv_string(OutBuf *buf, const char *text) {
+  if (!strpbrk(text, ",\"\r\n")) {
+    outbuf_str(buf, text);
+    return;
+  }
+  outbuf_char(buf, '"');
+  for (const char *p = text; *p; ++p) {
+    if (*p == '"')
+      outbuf_char(buf, '"');
+    outbuf_char(buf, *p);
+  }
+  outbuf_char(buf, '"');
+}
+
+int outbuf_write_all(const OutBuf *buf, int fd) {
+  size_t written = 0;
+  while (written < buf->len) {
+    ssize_t n = write(fd, buf->data + written, buf->len - written);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return 0;
+    }
+    written += (size_t)n;
+  }
+  return 1;
+}
@@ -1,7 +1,11 @@
+#define _GNU_SOURCE
 #include "../include/parser.h"
 #include <malloc.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 void memParser(char *input, memStats *stats) {
   char *token;
@@ -21,51 +25,420 @@ void memParser(char *input, memStats *stats) {
   }
 }
 
-int cpuParser(char *input, cpuStat *cpuStatsPointer, int max_entries) {
-  char *line = input;
-  char *next_line = NULL;
+int cpuEntryCount(const char *input) {
+  int count = 0;
+  const char *line = input;
+  while (line && *line != '\0') {
+    if (strncmp(line, "cpu", 3) == 0)
+      count++;
+    line = strchr(line, '\n');
+    if (line)
+      line++;
+  }
+  return count;
+}
+
+static inline const char *skip_blanks(const char *p) {
+  while (*p == ' ' || *p == '\t')
+    p++;
+  return p;
+}
+
+static inline unsigned long long next_number(const char **cursor) {
+  const char *p = skip_blanks(*cursor);
+  unsigned long long value = 0;
+  while ((unsigned char)(*p - '0') < 10)
+    value = value * 10 + (unsigned long long)(*p++ - '0');
+  *cursor = p;
+  return value;
+}
+
+int cpuStatsReserve(cpuStats *stats, int entries) {
+  if (entries <= stats->capacity)
+    return 1;
+  entries = cpu_lanes_round(entries);
+  unsigned long long *block =
+      calloc((size_t)entries * CPU_FIELDS, sizeof(unsigned long long));
+  if (!block)
+    return 0;
+  for (int f = 0; f < CPU_FIELDS; ++f) {
+    if (stats->capacity > 0)
+      memcpy(block + (size_t)f * entries, stats->field[f],
+             sizeof(unsigned long long) * stats->capacity);
+  }
+  free(stats->field[0]);
+  for (int f = 0; f < CPU_FIELDS; ++f)
+    stats->field[f] = block + (size_t)f * entries;
+  stats->capacity = entries;
+  return 1;
+}
+
+void cpuStatsFree(cpuStats *stats) {
+  free(stats->field[0]);
+  memset(stats, 0, sizeof(*stats));
+}
+
+// Columns a kernel does not report (steal and guest only appeared in 2.6)
+// read as zero.
+int cpuParser(const char *input, cpuStats *stats, int max_entries) {
+  const char *line = input;
   int count = 0;
 
   while (line && *line != '\0' && count < max_entries) {
-    next_line = strchr(line, '\n');
-    if (next_line) {
-      *next_line = '\0';
+    if (strncmp(line, "cpu", 3) == 0) {
+      const char *p = line + 3;
+      while ((unsigned char)(*p - '0') < 10)
+        p++;
+      int columns = 0;
+      for (int f = 0; f < CPU_FIELDS; ++f) {
+        p = skip_blanks(p);
+        if ((unsigned char)(*p - '0') < 10) {
+          stats->field[f][count] = next_number(&p);
+          columns++;
+        } else {
+          stats->field[f][count] = 0;
+        }
+      }
+      if (columns >= CPU_IOWAIT)
+        count++;
     }
+    line = strchr(line, '\n');
+    if (line)
+      line++;
+  }
+  return count;
+}
 
-    if (strncmp(line, "cpu", 3) == 0) {
-      cpuStat *stats = &cpuStatsPointer[count];
-      int core_id;
+static inline unsigned long long parse_field(const char **cursor,
+                                             const char *end) {
+  const char *p = *cursor;
+  unsigned long long value = 0;
+  while (p < end && (unsigned char)(*p - '0') < 10)
+    value = value * 10 + (unsigned long long)(*p++ - '0');
+  *cursor = (p < end) ? p + 1 : end;
+  return value;
+}
 
-      if (sscanf(line, " cpu %lu %lu %lu %lu %lu %lu %lu", &stats->user,
-                 &stats->nice, &stats->system, &stats->idle, &stats->iowait,
-                 &stats->irq, &stats->softirq) == 7) {
-        count++;
-      } else if (sscanf(line, " cpu%d %lu %lu %lu %lu %lu %lu %lu", &core_id,
-                        &stats->user, &stats->nice, &stats->system,
-                        &stats->idle, &stats->iowait, &stats->irq,
-                        &stats->softirq) == 8) {
-        count++;
+#define SWAR_ONES 0x0101010101010101ULL
+#define SWAR_LOW7 0x7f7f7f7f7f7f7f7fULL
+
+// Marks (0x80) exactly the bytes of `word` that are equal to ' '.
+static inline unsigned long long space_mask(unsigned long long word) {
+  unsigned long long x = word ^ (SWAR_ONES * ' ');
+  return ~(((x & SWAR_LOW7) + SWAR_LOW7) | x | SWAR_LOW7);
+}
+
+// Skips `count` space-separated fields eight bytes at a time.
+static inline void skip_fields(const char **cursor, const char *end,
+                               int count) {
+  const char *p = *cursor;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  while (count > 0 && end - p >= 8) {
+    unsigned long long word;
+    memcpy(&word, p, sizeof(word));
+    unsigned long long spaces = space_mask(word);
+    int found = __builtin_popcountll(spaces);
+    if (found < count) {
+      count -= found;
+      p += 8;
+      continue;
+    }
+    while (--count > 0)
+      spaces &= spaces - 1;
+    p += (__builtin_ctzll(spaces) >> 3) + 1;
+  }
+#endif
+  while (count > 0 && p < end) {
+    if (*p++ == ' ')
+      count--;
+  }
+  *cursor = p;
+}
+
+// Kilobytes per page, looked up on first use; scan workers may race to
+// store the same value.
+static long page_kb(void) {
+  static atomic_long cached;
+  long kb = atomic_load_explicit(&cached, memory_order_relaxed);
+  if (kb == 0) {
+    kb = sysconf(_SC_PAGESIZE) / 1024;
+    atomic_store_explicit(&cached, kb, memory_order_relaxed);
+  }
+  return kb;
+}
+
+// /proc/<pid>/stat: "pid (comm) state ppid ...". comm may itself contain
+// spaces and ')', so it ends at the last ')' in the record.
+int pidParser(const char *input, size_t len, pidStats *stats) {
+  const char *end = input + len;
+  const char *open = memchr(input, '(', len);
+  const char *close = memrchr(input, ')', len);
+  if (!open || !close || close < open || end - close < 4)
+    return 0;
+
+  const char *p = input;
+  stats->pid = (int)parse_field(&p, open);
+  if (stats->pid <= 0)
+    return 0;
+
+  size_t comm_len = close - open - 1;
+  if (comm_len >= sizeof(stats->comm))
+    comm_len = sizeof(stats->comm) - 1;
+  memcpy(stats->comm, open + 1, comm_len);
+  stats->comm[comm_len] = '\0';
+
+  p = close + 2;
+  stats->state = *p;
+  p += 2;
+  stats->ppid = (int)parse_field(&p, end);         // 4
+  skip_fields(&p, end, 5);                         // 5-9
+  stats->minflt = parse_field(&p, end);            // 10
+  skip_fields(&p, end, 1);                         // 11
+  stats->majflt = parse_field(&p, end);            // 12
+  skip_fields(&p, end, 1);                         // 13
+  stats->utime = parse_field(&p, end);             // 14
+  stats->stime = parse_field(&p, end);             // 15
+  skip_fields(&p, end, 4);                         // 16-19
+  stats->num_threads = (long)parse_field(&p, end); // 20
+  skip_fields(&p, end, 1);                         // 21
+  stats->starttime = parse_field(&p, end);         // 22
+  stats->vsize = (long)parse_field(&p, end);       // 23
+  if (p >= end)
+    return 0;
+  long rss_pages = (long)parse_field(&p, end);     // 24
+  stats->rss_kb = rss_pages * page_kb();
+  skip_fields(&p, end, 14);                        // 25-38
+  stats->processor = (int)parse_field(&p, end);    // 39
+  return 1;
+}
+
+// /proc/<pid>/io: "key: value" lines. read_bytes/write_bytes count what
+// actually reached the block layer, unlike rchar/wchar.
+int ioParser(const char *input, size_t len, pidStats *stats) {
+  const char *end = input + len;
+  const char *line = input;
+  int found = 0;
+  while (line < end) {
+    const char *next = memchr(line, '\n', end - line);
+    if (!next)
+      next = end;
+    if (next - line > 12 && memcmp(line, "read_bytes: ", 12) == 0) {
+      const char *p = line + 12;
+      stats->read_bytes = parse_field(&p, next);
+      found |= 1;
+    } else if (next - line > 13 && memcmp(line, "write_bytes: ", 13) == 0) {
+      const char *p = line + 13;
+      stats->write_bytes = parse_field(&p, next);
+      found |= 2;
+    }
+    line = next + 1;
+  }
+  stats->has_io = found == 3;
+  return stats->has_io;
+}
+
+// /proc/<pid>/smaps_rollup: a header line, then "Key:   value kB" lines
+// summed over every mapping.
+int smapsParser(const char *input, size_t len, smapsStat *stats) {
+  const char *end = input + len;
+  const char *line = input;
+  int found = 0;
+  stats->pss = stats->uss = stats->swap = 0;
+  while (line < end) {
+    const char *next = memchr(line, '\n', end - line);
+    if (!next)
+      next = end;
+    const char *colon = memchr(line, ':', next - line);
+    if (colon) {
+      size_t key = colon - line;
+      const char *p = skip_blanks(colon + 1);
+      unsigned long value = parse_field(&p, next);
+      if (key == 3 && memcmp(line, "Pss", 3) == 0) {
+        stats->pss = value;
+        found = 1;
+      } else if ((key == 13 && (memcmp(line, "Private_Clean", 13) == 0 ||
+                                memcmp(line, "Private_Dirty", 13) == 0)) ||
+                 (key == 15 && memcmp(line, "Private_Hugetlb", 15) == 0)) {
+        stats->uss += value;
+      } else if (key == 4 && memcmp(line, "Swap", 4) == 0) {
+        stats->swap = value;
       }
     }
+    line = next + 1;
+  }
+  return found;
+}
 
-    if (next_line) {
-      line = next_line + 1;
-    } else {
-      break;
+int diskEntryCount(const char *input) {
+  int count = 0;
+  for (const char *line = input; line && *line != '\0'; ++count) {
+    line = strchr(line, '\n');
+    if (line)
+      line++;
+  }
+  return count;
+}
+
+// /proc/diskstats: "major minor name reads merged sectors ms writes merged
+// sectors ms in_flight io_ms ...".
+int diskParser(char *input, diskStat *diskStatsPointer, int max_entries) {
+  char *line = input;
+  int count = 0;
+
+  while (line && *line != '\0' && count < max_entries) {
+    char *next_line = strchr(line, '\n');
+    if (next_line)
+      *next_line = '\0';
+
+    diskStat *stats = &diskStatsPointer[count];
+    if (sscanf(line,
+               " %*u %*u %31s %llu %*u %llu %*u %llu %*u %llu %*u %*u %llu",
+               stats->name, &stats->reads, &stats->sectors_read,
+               &stats->writes, &stats->sectors_written,
+               &stats->io_ticks) == 6)
+      count++;
+
+    line = next_line ? next_line + 1 : NULL;
+  }
+  return count;
+}
+
+int netEntryCount(const char *input) {
+  int count = 0;
+  for (const char *p = strchr(input, ':'); p; p = strchr(p + 1, ':'))
+    count++;
+  return count;
+}
+
+// /proc/net/dev: two header lines, then "name: rx_bytes rx_packets errs drop
+// fifo frame compressed multicast tx_bytes tx_packets errs drop ...". Hosts
+// running containers list hundreds of veths, so this is a single pass over
+// the text that neither copies nor allocates.
+int netParser(const char *input, netStat *netStatsPointer, int max_entries) {
+  const char *line = input;
+  int count = 0;
+
+  while (line && *line != '\0' && count < max_entries) {
+    const char *next_line = strchr(line, '\n');
+    const char *colon = memchr(line, ':', next_line ? (size_t)(next_line - line)
+                                                    : strlen(line));
+    if (colon) {
+      netStat *stats = &netStatsPointer[count];
+      const char *name = skip_blanks(line);
+      size_t name_len = colon - name;
+      if (name_len >= sizeof(stats->name))
+        name_len = sizeof(stats->name) - 1;
+      memcpy(stats->name, name, name_len);
+      stats->name[name_len] = '\0';
+
+      const char *p = colon + 1;
+      stats->rx_bytes = next_number(&p);
+      stats->rx_packets = next_number(&p);
+      next_number(&p);
+      stats->rx_drops = next_number(&p);
+      for (int i = 0; i < 4; ++i)
+        next_number(&p);
+      stats->tx_bytes = next_number(&p);
+      stats->tx_packets = next_number(&p);
+      next_number(&p);
+      stats->tx_drops = next_number(&p);
+      count++;
     }
+    line = next_line ? next_line + 1 : NULL;
   }
   return count;
 }
 
-int pidParser(char *input, pidStats *stats) {
-  int readCount = sscanf(input,
-                         "%d (%255[^)]) %c %*s %*s %*s %*s %*s %*s %*s %*s %*s "
-                         "%lu %lu %*s %*s %*s %*s %*s %*s %*s %lu %ld",
-                         &stats->pid, stats->comm, &stats->state, &stats->utime,
-                         &stats->stime, &stats->vsize, &stats->rss);
+// /proc/net/snmp pairs a "Tcp:" header line naming the columns with a "Tcp:"
+// line of values; RetransSegs is looked up by name rather than position.
+int tcpRetransParser(const char *input, unsigned long long *retrans_segs) {
+  const char *header = strstr(input, "Tcp:");
+  if (!header)
+    return 0;
+  const char *values = strstr(header + 4, "\nTcp:");
+  if (!values)
+    return 0;
+  values += 5;
+
+  int column = 0, found = 0;
+  const char *p = header + 4;
+  while (!found && *p != '\n' && *p != '\0') {
+    p = skip_blanks(p);
+    const char *word = p;
+    while (*p != ' ' && *p != '\n' && *p != '\0')
+      p++;
+    if (p - word == 11 && memcmp(word, "RetransSegs", 11) == 0)
+      found = 1;
+    else
+      column++;
+  }
+  if (!found)
+    return 0;
 
-  if (readCount < 7) {
+  p = values;
+  for (int i = 0; i < column; ++i) {
+    p = skip_blanks(p);
+    while (*p != ' ' && *p != '\n' && *p != '\0')
+      p++;
+  }
+  p = skip_blanks(p);
+  if ((unsigned char)(*p - '0') >= 10)
     return 0;
+  *retrans_segs = next_number(&p);
+  return 1;
+}
+
+// /proc/<pid>/cgroup: the v2 hierarchy is the "0::" line. A hybrid host
+// also lists v1 controllers, which are ignored.
+int cgroupPathParser(const char *input, char *path, size_t size) {
+  const char *line = input;
+  while (line && *line != '\0') {
+    if (strncmp(line, "0::", 3) == 0) {
+      const char *start = line + 3;
+      size_t len = strcspn(start, "\n");
+      if (len == 0 || len >= size)
+        return 0;
+      memcpy(path, start, len);
+      path[len] = '\0';
+      return 1;
+    }
+    line = strchr(line, '\n');
+    if (line)
+      line++;
+  }
+  return 0;
+}
+
+int cgroupCpuParser(const char *input, cgroupCpuStat *stats) {
+  const char *line = input;
+  int found = 0;
+  while (line && *line != '\0') {
+    const char *p = strchr(line, ' ');
+    if (!p)
+      break;
+    size_t key = p - line;
+    if (key == 10 && memcmp(line, "usage_usec", 10) == 0) {
+      stats->usage_usec = next_number(&p);
+      found = 1;
+    } else if (key == 9 && memcmp(line, "user_usec", 9) == 0) {
+      stats->user_usec = next_number(&p);
+    } else if (key == 11 && memcmp(line, "system_usec", 11) == 0) {
+      stats->system_usec = next_number(&p);
+    }
+    line = strchr(p, '\n');
+    if (line)
+      line++;
   }
+  return found;
+}
+
+// "some avg10=0.12 avg60=... total=..." then the same for "full".
+int pressureParser(const char *input, pressureStat *stats) {
+  const char *some = strstr(input, "some avg10=");
+  if (!some)
+    return 0;
+  stats->some_avg10 = strtod(some + 11, NULL);
+  const char *full = strstr(input, "full avg10=");
+  stats->full_avg10 = full ? strtod(full + 11, NULL) : 0.0;
   return 1;
 }
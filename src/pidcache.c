@@ -0,0 +1,205 @@
+#include "../include/pidcache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define PIDCACHE_INITIAL_CAPACITY 1024
+#define PIDCACHE_INITIAL_BUFFER 1024
+#define PIDCACHE_RESERVED_FDS 64
+#define PIDCACHE_MAX_OPEN_LIMIT (1 << 20)
+
+static unsigned int hash_pid(int pid) {
+  return (unsigned int)pid * 2654435761u;
+}
+
+static int raise_fd_limit(void) {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+    return 1024 - PIDCACHE_RESERVED_FDS;
+  if (limit.rlim_cur < limit.rlim_max) {
+    rlim_t wanted = limit.rlim_max;
+    if (wanted == RLIM_INFINITY || wanted > PIDCACHE_MAX_OPEN_LIMIT)
+      wanted = PIDCACHE_MAX_OPEN_LIMIT;
+    if (wanted > limit.rlim_cur) {
+      limit.rlim_cur = wanted;
+      if (setrlimit(RLIMIT_NOFILE, &limit) != 0)
+        getrlimit(RLIMIT_NOFILE, &limit);
+    }
+  }
+  rlim_t usable = limit.rlim_cur;
+  if (usable == RLIM_INFINITY || usable > PIDCACHE_MAX_OPEN_LIMIT)
+    usable = PIDCACHE_MAX_OPEN_LIMIT;
+  if (usable <= PIDCACHE_RESERVED_FDS * 2)
+    return (int)usable / 2;
+  return (int)usable - PIDCACHE_RESERVED_FDS;
+}
+
+static PidFdEntry *find_slot(PidFdEntry *slots, int capacity, int pid) {
+  unsigned int mask = (unsigned int)capacity - 1;
+  unsigned int i = hash_pid(pid) & mask;
+  while (slots[i].pid != 0 && slots[i].pid != pid)
+    i = (i + 1) & mask;
+  return &slots[i];
+}
+
+static int grow_table(PidFdCache *cache) {
+  int new_capacity = cache->capacity * 2;
+  PidFdEntry *new_slots = calloc(new_capacity, sizeof(PidFdEntry));
+  if (!new_slots)
+    return 0;
+  for (int i = 0; i < cache->capacity; ++i) {
+    if (cache->slots[i].pid != 0)
+      *find_slot(new_slots, new_capacity, cache->slots[i].pid) =
+          cache->slots[i];
+  }
+  free(cache->slots);
+  cache->slots = new_slots;
+  cache->capacity = new_capacity;
+  return 1;
+}
+
+// Backward-shift deletion keeps probe chains intact without tombstones.
+static void remove_slot(PidFdCache *cache, unsigned int hole) {
+  unsigned int mask = (unsigned int)cache->capacity - 1;
+  close(cache->slots[hole].fd);
+  cache->slots[hole].pid = 0;
+  cache->count--;
+
+  unsigned int i = (hole + 1) & mask;
+  while (cache->slots[i].pid != 0) {
+    unsigned int home = hash_pid(cache->slots[i].pid) & mask;
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      cache->slots[hole] = cache->slots[i];
+      cache->slots[i].pid = 0;
+      hole = i;
+    }
+    i = (i + 1) & mask;
+  }
+}
+
+static int open_file(PidFdCache *cache, int pid) {
+  char path[64];
+  snprintf(path, sizeof(path), "%d/%s", pid, cache->file);
+  return openat(cache->dir_fd, path, O_RDONLY | O_CLOEXEC);
+}
+
+static ssize_t pread_whole(PidFdCache *cache, int fd) {
+  while (1) {
+    ssize_t bytes_read = pread(fd, cache->buffer, cache->buffer_size - 1, 0);
+    if (bytes_read <= 0)
+      return -1;
+    if ((size_t)bytes_read < cache->buffer_size - 1) {
+      cache->buffer[bytes_read] = '\0';
+      return bytes_read;
+    }
+    char *new_buffer = realloc(cache->buffer, cache->buffer_size * 2);
+    if (!new_buffer)
+      return -1;
+    cache->buffer = new_buffer;
+    cache->buffer_size *= 2;
+  }
+}
+
+int pidcache_init(PidFdCache *cache, const char *proc_root, const char *file) {
+  memset(cache, 0, sizeof(*cache));
+  cache->file = file;
+  cache->dir_fd = open(proc_root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (cache->dir_fd < 0)
+    return 0;
+  cache->capacity = PIDCACHE_INITIAL_CAPACITY;
+  cache->slots = calloc(cache->capacity, sizeof(PidFdEntry));
+  cache->buffer_size = PIDCACHE_INITIAL_BUFFER;
+  cache->buffer = malloc(cache->buffer_size);
+  if (!cache->slots || !cache->buffer) {
+    pidcache_destroy(cache);
+    return 0;
+  }
+  cache->max_open = raise_fd_limit();
+  return 1;
+}
+
+void pidcache_destroy(PidFdCache *cache) {
+  if (cache->slots) {
+    for (int i = 0; i < cache->capacity; ++i) {
+      if (cache->slots[i].pid != 0)
+        close(cache->slots[i].fd);
+    }
+  }
+  if (cache->dir_fd >= 0)
+    close(cache->dir_fd);
+  free(cache->slots);
+  free(cache->buffer);
+  memset(cache, 0, sizeof(*cache));
+  cache->dir_fd = -1;
+}
+
+void pidcache_begin_tick(PidFdCache *cache) { cache->generation++; }
+
+char *pidcache_read(PidFdCache *cache, int pid, size_t *len) {
+  PidFdEntry *entry = find_slot(cache->slots, cache->capacity, pid);
+  int fd;
+
+  if (entry->pid == pid) {
+    entry->seen = cache->generation;
+    ssize_t bytes_read = pread_whole(cache, entry->fd);
+    if (bytes_read >= 0) {
+      *len = bytes_read;
+      return cache->buffer;
+    }
+    // ESRCH: the process behind the cached fd exited. The pid may already
+    // belong to a new one, so open it afresh.
+    remove_slot(cache, entry - cache->slots);
+    entry = find_slot(cache->slots, cache->capacity, pid);
+  }
+
+  fd = open_file(cache, pid);
+  if (fd < 0)
+    return NULL;
+  ssize_t bytes_read = pread_whole(cache, fd);
+  if (bytes_read < 0) {
+    close(fd);
+    return NULL;
+  }
+
+  if (cache->count < cache->max_open) {
+    if ((cache->count + 1) * 2 > cache->capacity) {
+      if (!grow_table(cache)) {
+        close(fd);
+        *len = bytes_read;
+        return cache->buffer;
+      }
+      entry = find_slot(cache->slots, cache->capacity, pid);
+    }
+    entry->pid = pid;
+    entry->fd = fd;
+    entry->seen = cache->generation;
+    cache->count++;
+  } else {
+    close(fd);
+  }
+  *len = bytes_read;
+  return cache->buffer;
+}
+
+// Keeps a pid's fd open across a tick in which it is not read.
+void pidcache_touch(PidFdCache *cache, int pid) {
+  PidFdEntry *entry = find_slot(cache->slots, cache->capacity, pid);
+  if (entry->pid == pid)
+    entry->seen = cache->generation;
+}
+
+void pidcache_sweep(PidFdCache *cache) {
+  int i = 0;
+  while (i < cache->capacity) {
+    if (cache->slots[i].pid != 0 &&
+        cache->slots[i].seen != cache->generation) {
+      remove_slot(cache, i);
+      continue;
+    }
+    ++i;
+  }
+}
@@ -0,0 +1,260 @@
+#include "../include/player.h"
+#include "../include/timing.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+// A longer gap between samples (the recorder was stopped for a while) is
+// played as this long.
+#define PLAYER_MAX_GAP_MS 2000
+
+static unsigned long long now_ms(void) { return now_ns() / 1000000; }
+
+static void wake(Player *player) {
+  uint64_t one = 1;
+  ssize_t written = write(player->wake_fd, &one, sizeof(one));
+  (void)written;
+}
+
+int player_init(Player *player, const char *path,
+                SnapshotExchange *exchange) {
+  memset(player, 0, sizeof(*player));
+  player->exchange = exchange;
+  player->stop_fd = player->wake_fd = -1;
+  wire_state_init(&player->state);
+  wire_state_init(&player->scratch);
+  atomic_init(&player->sort_column, SORT_CPU);
+  atomic_init(&player->sort_depth, 0);
+  atomic_init(&player->paused, 0);
+  atomic_init(&player->speed, 0);
+  atomic_init(&player->seek_ms, 0);
+  if (!recording_open(&player->recording, path)) {
+    player_destroy(player);
+    return 0;
+  }
+  if (player->recording.num_marks == 0) {
+    fprintf(stderr, "pulse: %s holds no samples\n", path);
+    player_destroy(player);
+    return 0;
+  }
+  player->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  player->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (player->stop_fd < 0 || player->wake_fd < 0) {
+    player_destroy(player);
+    return 0;
+  }
+  return 1;
+}
+
+// Applies frames up to and including the next sample. A damaged frame
+// skips ahead to the next keyframe. Returns 0 at the end of the recording.
+static int step(Player *player) {
+  int type;
+  const unsigned char *payload;
+  size_t len;
+  while (recording_frame(&player->recording, player->next, &type, &payload,
+                         &len)) {
+    player->next += WIRE_HEADER_SIZE + len;
+    if (type == WIRE_HELLO) {
+      char name[sizeof(player->host)];
+      if (wire_decode_hello(payload, len, name, sizeof(name)) && name[0])
+        memcpy(player->host, name, sizeof(name));
+      continue;
+    }
+    if (type == WIRE_DELTA && !player->synced)
+      continue;
+    player->synced =
+        wire_decode(&player->state, &player->scratch, type, payload, len);
+    if (player->synced)
+      return 1;
+  }
+  return 0;
+}
+
+// When the next sample was taken, without applying it.
+static int next_time(const Player *player, unsigned long long *time_ms) {
+  size_t offset = player->next;
+  int type;
+  const unsigned char *payload;
+  size_t len;
+  while (recording_frame(&player->recording, offset, &type, &payload,
+                         &len)) {
+    offset += WIRE_HEADER_SIZE + len;
+    if (type == WIRE_HELLO || (type == WIRE_DELTA && !player->synced))
+      continue;
+    return wire_frame_timestamp(&player->state, type, payload, len,
+                                time_ms);
+  }
+  return 0;
+}
+
+// From the keyframe before `target` forward through the deltas up to it.
+static void seek(Player *player, unsigned long long target) {
+  int mark = recording_find(&player->recording, target);
+  if (mark < 0)
+    return;
+  player->next = recording_mark_offset(&player->recording, mark);
+  player->synced = 0;
+  if (!step(player))
+    return;
+  unsigned long long time_ms;
+  while (next_time(player, &time_ms) && time_ms <= target && step(player))
+    ;
+  player->source++;
+}
+
+static void publish(Player *player) {
+  int sorted = wire_order(&player->order, &player->state,
+                          atomic_load(&player->sort_column),
+                          atomic_load(&player->sort_depth));
+  if (sorted < 0)
+    return;
+  Snapshot *snapshot = snapshot_back(player->exchange);
+  if (!wire_to_snapshot(&player->state, player->order.indices, snapshot))
+    return;
+  snapshot->sorted_count = sorted;
+  snapshot->source = player->source;
+
+  char when[20] = "";
+  time_t seconds = (time_t)(player->state.timestamp_ms / 1000);
+  struct tm tm;
+  if (localtime_r(&seconds, &tm))
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+  int speed = atomic_load(&player->speed);
+  char rate[8];
+  if (speed >= 0)
+    snprintf(rate, sizeof(rate), "x%d", 1 << speed);
+  else
+    snprintf(rate, sizeof(rate), "x1/%d", 1 << -speed);
+  unsigned long long next_ms;
+  const char *status = atomic_load(&player->paused) ? " [paused]"
+                       : !next_time(player, &next_ms) ? " [end]"
+                                                      : "";
+  snprintf(snapshot->source_name, sizeof(snapshot->source_name),
+           "%.40s %s %s%s", player->host, when, rate, status);
+  snapshot_publish(player->exchange);
+}
+
+static void *player_thread(void *arg) {
+  Player *player = arg;
+  struct pollfd fds[2] = {
+      {.fd = player->stop_fd, .events = POLLIN},
+      {.fd = player->wake_fd, .events = POLLIN},
+  };
+  seek(player, 0);
+  unsigned long long shown_at = now_ms();
+  int dirty = 1;
+  while (1) {
+    if (dirty) {
+      publish(player);
+      dirty = 0;
+    }
+    // The next sample is due when the recording says, from when the one on
+    // screen went up.
+    unsigned long long now = now_ms(), due = 0, next_ms;
+    int paused = atomic_load(&player->paused);
+    int has_next = next_time(player, &next_ms);
+    int timeout = -1;
+    if (!paused && has_next) {
+      unsigned long long gap = next_ms > player->state.timestamp_ms
+                                   ? next_ms - player->state.timestamp_ms
+                                   : 0;
+      if (gap > PLAYER_MAX_GAP_MS)
+        gap = PLAYER_MAX_GAP_MS;
+      int speed = atomic_load(&player->speed);
+      due = shown_at + (speed >= 0 ? gap >> speed : gap << -speed);
+      timeout = due > now ? (int)(due - now) : 0;
+    }
+
+    if (poll(fds, 2, timeout) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (fds[0].revents & POLLIN)
+      break;
+    now = now_ms();
+    if (fds[1].revents & POLLIN) {
+      uint64_t pending;
+      ssize_t drained = read(player->wake_fd, &pending, sizeof(pending));
+      (void)drained;
+      long long delta = atomic_exchange(&player->seek_ms, 0);
+      if (delta) {
+        long long target = (long long)player->state.timestamp_ms + delta;
+        seek(player, target > 0 ? (unsigned long long)target : 0);
+      }
+      // A seek, or coming out of a pause, starts the clock again.
+      if (delta || paused)
+        shown_at = now;
+      dirty = 1;
+    } else if (!paused && has_next && now >= due && step(player)) {
+      // Keep to the recording's pace unless decoding has fallen behind.
+      shown_at = now - due > PLAYER_MAX_GAP_MS ? now : due;
+      dirty = 1;
+    }
+  }
+  return NULL;
+}
+
+int player_start(Player *player) {
+  if (pthread_create(&player->thread, NULL, player_thread, player) != 0)
+    return 0;
+  player->thread_started = 1;
+  return 1;
+}
+
+// The player_* controls are called from the UI thread; each wakes the
+// player thread to act on it and publish again.
+void player_set_view(Player *player, SortColumn sort_column,
+                     int sort_depth) {
+  int changed = atomic_exchange(&player->sort_column, (int)sort_column) !=
+                (int)sort_column;
+  changed |= atomic_exchange(&player->sort_depth, sort_depth) != sort_depth;
+  if (changed)
+    wake(player);
+}
+
+void player_toggle_pause(Player *player) {
+  atomic_fetch_xor(&player->paused, 1);
+  wake(player);
+}
+
+void player_change_speed(Player *player, int step) {
+  int speed = atomic_load(&player->speed) + step;
+  if (speed < PLAYER_MIN_SPEED)
+    speed = PLAYER_MIN_SPEED;
+  if (speed > PLAYER_MAX_SPEED)
+    speed = PLAYER_MAX_SPEED;
+  atomic_store(&player->speed, speed);
+  wake(player);
+}
+
+void player_seek(Player *player, long long delta_ms) {
+  atomic_fetch_add(&player->seek_ms, delta_ms);
+  wake(player);
+}
+
+void player_destroy(Player *player) {
+  if (player->thread_started) {
+    uint64_t one = 1;
+    if (write(player->stop_fd, &one, sizeof(one)) < 0)
+      perror("pulse: player stop");
+    pthread_join(player->thread, NULL);
+  }
+  if (player->stop_fd >= 0)
+    close(player->stop_fd);
+  if (player->wake_fd >= 0)
+    close(player->wake_fd);
+  recording_close(&player->recording);
+  wire_state_destroy(&player->state);
+  wire_state_destroy(&player->scratch);
+  wire_order_destroy(&player->order);
+  memset(player, 0, sizeof(*player));
+  player->stop_fd = player->wake_fd = -1;
+}
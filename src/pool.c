@@ -0,0 +1,107 @@
+#include "../include/pool.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+struct WorkerSlot {
+  WorkerPool *pool;
+  pthread_t thread;
+  int index;
+};
+
+int pool_default_workers(void) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int workers = cpus > 0 ? (int)(cpus / 4) : 1;
+  return workers > 0 ? workers : 1;
+}
+
+static void *worker_main(void *arg) {
+  WorkerSlot *slot = arg;
+  WorkerPool *pool = slot->pool;
+  unsigned long seen = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  while (1) {
+    while (!pool->stopping && pool->generation == seen)
+      pthread_cond_wait(&pool->start_cond, &pool->lock);
+    if (pool->stopping)
+      break;
+    seen = pool->generation;
+    pool_task_fn task = pool->task;
+    void *ctx = pool->ctx;
+    pthread_mutex_unlock(&pool->lock);
+
+    task(ctx, slot->index);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->pending == 0)
+      pthread_cond_signal(&pool->done_cond);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+int pool_init(WorkerPool *pool, int num_workers) {
+  if (num_workers < 1)
+    num_workers = 1;
+  pool->num_workers = num_workers;
+  pool->generation = 0;
+  pool->pending = 0;
+  pool->stopping = 0;
+  pool->task = NULL;
+  pool->ctx = NULL;
+  pool->slots = calloc(num_workers, sizeof(WorkerSlot));
+  if (!pool->slots)
+    return 0;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start_cond, NULL);
+  pthread_cond_init(&pool->done_cond, NULL);
+
+  // Worker 0 is the calling thread, so only num_workers - 1 are spawned.
+  for (int i = 1; i < num_workers; ++i) {
+    pool->slots[i].pool = pool;
+    pool->slots[i].index = i;
+    if (pthread_create(&pool->slots[i].thread, NULL, worker_main,
+                       &pool->slots[i]) != 0) {
+      pool->num_workers = i;
+      break;
+    }
+  }
+  return 1;
+}
+
+void pool_run(WorkerPool *pool, pool_task_fn task, void *ctx) {
+  if (pool->num_workers > 1) {
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->ctx = ctx;
+    pool->pending = pool->num_workers - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->lock);
+  }
+
+  task(ctx, 0);
+
+  if (pool->num_workers > 1) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0)
+      pthread_cond_wait(&pool->done_cond, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+void pool_destroy(WorkerPool *pool) {
+  if (!pool->slots)
+    return;
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = 1;
+  pthread_cond_broadcast(&pool->start_cond);
+  pthread_mutex_unlock(&pool->lock);
+  for (int i = 1; i < pool->num_workers; ++i)
+    pthread_join(pool->slots[i].thread, NULL);
+  pthread_cond_destroy(&pool->done_cond);
+  pthread_cond_destroy(&pool->start_cond);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->slots);
+  pool->slots = NULL;
+}
@@ -0,0 +1,115 @@
+#include "../include/proctable.h"
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned int hash_pid(int pid) {
+  return (unsigned int)pid * 2654435761u;
+}
+
+static int round_up_pow2(int value) {
+  int capacity = 16;
+  while (capacity < value)
+    capacity <<= 1;
+  return capacity;
+}
+
+static ProcEntry *find_slot(ProcEntry *slots, int capacity, int pid) {
+  unsigned int mask = (unsigned int)capacity - 1;
+  unsigned int i = hash_pid(pid) & mask;
+  while (slots[i].pid != 0 && slots[i].pid != pid)
+    i = (i + 1) & mask;
+  return &slots[i];
+}
+
+static int grow_table(ProcTable *table) {
+  int new_capacity = table->capacity * 2;
+  ProcEntry *new_slots = calloc(new_capacity, sizeof(ProcEntry));
+  if (!new_slots)
+    return 0;
+  for (int i = 0; i < table->capacity; ++i) {
+    if (table->slots[i].pid != 0)
+      *find_slot(new_slots, new_capacity, table->slots[i].pid) =
+          table->slots[i];
+  }
+  free(table->slots);
+  table->slots = new_slots;
+  table->capacity = new_capacity;
+  return 1;
+}
+
+// Backward-shift deletion keeps probe chains intact without tombstones.
+static void remove_slot(ProcTable *table, unsigned int hole) {
+  unsigned int mask = (unsigned int)table->capacity - 1;
+  table->slots[hole].pid = 0;
+  table->count--;
+
+  unsigned int i = (hole + 1) & mask;
+  while (table->slots[i].pid != 0) {
+    unsigned int home = hash_pid(table->slots[i].pid) & mask;
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      table->slots[hole] = table->slots[i];
+      table->slots[i].pid = 0;
+      hole = i;
+    }
+    i = (i + 1) & mask;
+  }
+}
+
+int proctable_init(ProcTable *table, int capacity) {
+  memset(table, 0, sizeof(*table));
+  table->capacity = round_up_pow2(capacity * 2);
+  table->slots = calloc(table->capacity, sizeof(ProcEntry));
+  return table->slots != NULL;
+}
+
+void proctable_destroy(ProcTable *table) {
+  free(table->slots);
+  memset(table, 0, sizeof(*table));
+}
+
+void proctable_begin_tick(ProcTable *table) { table->generation++; }
+
+const ProcEntry *proctable_find(const ProcTable *table, int pid) {
+  const ProcEntry *entry = find_slot(table->slots, table->capacity, pid);
+  return entry->pid == pid ? entry : NULL;
+}
+
+ProcEntry *proctable_get(ProcTable *table, int pid) {
+  ProcEntry *entry = find_slot(table->slots, table->capacity, pid);
+  return entry->pid == pid ? entry : NULL;
+}
+
+ProcEntry *proctable_upsert(ProcTable *table, int pid,
+                            unsigned long long starttime, int *is_new) {
+  ProcEntry *entry = find_slot(table->slots, table->capacity, pid);
+  if (entry->pid == pid) {
+    *is_new = entry->starttime != starttime;
+  } else {
+    if ((table->count + 1) * 2 > table->capacity) {
+      if (!grow_table(table))
+        return NULL;
+      entry = find_slot(table->slots, table->capacity, pid);
+    }
+    table->count++;
+    *is_new = 1;
+  }
+  if (*is_new) {
+    memset(entry, 0, sizeof(*entry));
+    entry->pid = pid;
+    entry->starttime = starttime;
+  }
+  entry->seen = table->generation;
+  return entry;
+}
+
+void proctable_sweep(ProcTable *table) {
+  int i = 0;
+  while (i < table->capacity) {
+    if (table->slots[i].pid != 0 &&
+        table->slots[i].seen != table->generation) {
+      remove_slot(table, i);
+      continue;
+    }
+    ++i;
+  }
+}
@@ -0,0 +1,271 @@
+#include "../include/proctree.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PROCTREE_INITIAL_PENDING 64
+
+typedef struct {
+  int parent;
+  int pid;
+  double key;
+  int position;
+} TreeKey;
+
+int proctree_init(ProcTree *tree, int capacity) {
+  memset(tree, 0, sizeof(*tree));
+  tree->capacity = capacity > 16 ? capacity : 16;
+  tree->nodes = malloc(sizeof(TreeNode) * tree->capacity);
+  tree->pending_capacity = PROCTREE_INITIAL_PENDING;
+  tree->pending = malloc(sizeof(int) * tree->pending_capacity);
+  tree->free_list = tree->first_root = -1;
+  if (!tree->nodes || !tree->pending) {
+    proctree_destroy(tree);
+    return 0;
+  }
+  return 1;
+}
+
+void proctree_destroy(ProcTree *tree) {
+  free(tree->nodes);
+  free(tree->pending);
+  memset(tree, 0, sizeof(*tree));
+  tree->free_list = tree->first_root = -1;
+}
+
+void proctree_begin_tick(ProcTree *tree) { tree->generation++; }
+
+// Every live node is linked somewhere: under its parent or among the roots.
+static void unlink_node(ProcTree *tree, int i) {
+  TreeNode *node = &tree->nodes[i];
+  if (node->prev_sibling >= 0)
+    tree->nodes[node->prev_sibling].next_sibling = node->next_sibling;
+  else if (node->parent >= 0)
+    tree->nodes[node->parent].first_child = node->next_sibling;
+  else
+    tree->first_root = node->next_sibling;
+  if (node->next_sibling >= 0)
+    tree->nodes[node->next_sibling].prev_sibling = node->prev_sibling;
+  node->parent = node->prev_sibling = node->next_sibling = -1;
+}
+
+static void link_node(ProcTree *tree, int i, int parent) {
+  TreeNode *node = &tree->nodes[i];
+  int *head =
+      parent >= 0 ? &tree->nodes[parent].first_child : &tree->first_root;
+  node->parent = parent;
+  node->prev_sibling = -1;
+  node->next_sibling = *head;
+  if (*head >= 0)
+    tree->nodes[*head].prev_sibling = i;
+  *head = i;
+}
+
+static void mark_pending(ProcTree *tree, int i) {
+  if (tree->nodes[i].pending)
+    return;
+  if (tree->num_pending == tree->pending_capacity) {
+    int capacity = tree->pending_capacity * 2;
+    int *pending = realloc(tree->pending, sizeof(int) * capacity);
+    // Left among the roots until its next change of parent.
+    if (!pending)
+      return;
+    tree->pending = pending;
+    tree->pending_capacity = capacity;
+  }
+  tree->pending[tree->num_pending++] = i;
+  tree->nodes[i].pending = 1;
+}
+
+static int alloc_node(ProcTree *tree) {
+  if (tree->free_list >= 0) {
+    int i = tree->free_list;
+    tree->free_list = tree->nodes[i].next_sibling;
+    return i;
+  }
+  if (tree->num_nodes == tree->capacity) {
+    int capacity = tree->capacity * 2;
+    TreeNode *nodes = realloc(tree->nodes, sizeof(TreeNode) * capacity);
+    if (!nodes)
+      return -1;
+    tree->nodes = nodes;
+    tree->capacity = capacity;
+  }
+  return tree->num_nodes++;
+}
+
+// Marks the process in `row` of this tick's scan as alive. A process seen
+// for the first time gets a node, and one whose ppid changed is queued to
+// be moved; everything else is left where it is. Returns 0 if a node could
+// not be allocated.
+int proctree_update(ProcTree *tree, ProcEntry *entry, const pidStats *stats,
+                    int row) {
+  int i = entry->tree_node - 1;
+  if (i < 0 || i >= tree->num_nodes || tree->nodes[i].pid != stats->pid) {
+    i = alloc_node(tree);
+    if (i < 0)
+      return 0;
+    TreeNode *node = &tree->nodes[i];
+    memset(node, 0, sizeof(*node));
+    node->pid = stats->pid;
+    node->ppid = stats->ppid;
+    node->first_child = -1;
+    link_node(tree, i, -1);
+    mark_pending(tree, i);
+    entry->tree_node = i + 1;
+  } else if (tree->nodes[i].ppid != stats->ppid) {
+    tree->nodes[i].ppid = stats->ppid;
+    mark_pending(tree, i);
+  }
+  tree->nodes[i].seen = tree->generation;
+  tree->nodes[i].row = row;
+  return 1;
+}
+
+static int is_ancestor(const ProcTree *tree, int node, int of) {
+  for (int i = of; i >= 0; i = tree->nodes[i].parent) {
+    if (i == node)
+      return 1;
+  }
+  return 0;
+}
+
+// Links each pending node under the live process its ppid names. Nodes
+// whose parent can't be seen (ppid 0, or hidden by hidepid) stay roots and
+// are tried again next tick.
+static void resolve_pending(ProcTree *tree, const ProcTable *procs) {
+  int kept = 0;
+  for (int k = 0; k < tree->num_pending; ++k) {
+    int i = tree->pending[k];
+    TreeNode *node = &tree->nodes[i];
+    if (node->pid == 0 || !node->pending)
+      continue;
+    int parent = -1;
+    const ProcEntry *entry =
+        node->ppid > 0 ? proctable_find(procs, node->ppid) : NULL;
+    if (entry && entry->tree_node > 0 &&
+        entry->tree_node <= tree->num_nodes) {
+      int candidate = entry->tree_node - 1;
+      // A ppid read before a PID was recycled could point into the node's
+      // own subtree; only a node with children can close such a loop.
+      if (tree->nodes[candidate].pid == node->ppid &&
+          tree->nodes[candidate].seen == tree->generation &&
+          (node->first_child < 0 || !is_ancestor(tree, i, candidate)))
+        parent = candidate;
+    }
+    if (parent != node->parent) {
+      unlink_node(tree, i);
+      link_node(tree, i, parent);
+    }
+    if (parent >= 0 || node->ppid <= 0)
+      node->pending = 0;
+    else
+      tree->pending[kept++] = i;
+  }
+  tree->num_pending = kept;
+}
+
+// Drops the nodes of processes not seen this tick and settles the pending
+// ones. The children of an exited process wait among the roots until their
+// ppid names the process the kernel moved them to.
+void proctree_sweep(ProcTree *tree, const ProcTable *procs) {
+  for (int i = 0; i < tree->num_nodes; ++i) {
+    TreeNode *node = &tree->nodes[i];
+    if (node->pid == 0 || node->seen == tree->generation)
+      continue;
+    while (node->first_child >= 0) {
+      int child = node->first_child;
+      unlink_node(tree, child);
+      link_node(tree, child, -1);
+      mark_pending(tree, child);
+    }
+    unlink_node(tree, i);
+    node->pid = 0;
+    node->pending = 0;
+    node->next_sibling = tree->free_list;
+    tree->free_list = i;
+  }
+  resolve_pending(tree, procs);
+}
+
+static int compare_tree_keys(const void *a, const void *b) {
+  const TreeKey *x = a, *y = b;
+  if (x->parent != y->parent)
+    return x->parent < y->parent ? -1 : 1;
+  if (x->key != y->key)
+    return x->key < y->key ? 1 : -1;
+  return (x->pid > y->pid) - (x->pid < y->pid);
+}
+
+// Flattens the tree into `out` in display order. The links are walked once
+// in pre-order into an array, where every child comes after its parent, so
+// a single pass backwards (children before parents, as in post-order) adds
+// each subtree into its root. Siblings are then ordered by their summed
+// key. Returns the number of rows written.
+int proctree_layout(const ProcTree *tree, Arena *arena,
+                    const TreeSample *samples, TreeRow *out, int max) {
+  int n = tree->num_nodes;
+  int *position = arena_alloc(arena, sizeof(int) * (n + 1));
+  int *parents = arena_alloc(arena, sizeof(int) * (n + 1));
+  TreeRow *rows = arena_alloc(arena, sizeof(TreeRow) * (n + 1));
+  TreeKey *keys = arena_alloc(arena, sizeof(TreeKey) * (n + 1));
+  int *first_child = arena_alloc(arena, sizeof(int) * (n + 1));
+  int *num_children = arena_alloc(arena, sizeof(int) * (n + 1));
+  int *stack = arena_alloc(arena, sizeof(int) * (n + 1));
+  if (!position || !parents || !rows || !keys || !first_child ||
+      !num_children || !stack)
+    return 0;
+
+  int count = 0, depth = 0;
+  for (int i = tree->first_root; i >= 0 && count < n;) {
+    const TreeNode *node = &tree->nodes[i];
+    const TreeSample *sample = &samples[node->row];
+    position[i] = count;
+    parents[count] = node->parent >= 0 ? position[node->parent] : -1;
+    rows[count] = (TreeRow){node->row, depth, 0, sample->cpu, sample->rss};
+    keys[count] = (TreeKey){0, node->pid, sample->key, count};
+    num_children[count] = 0;
+    count++;
+    if (node->first_child >= 0) {
+      i = node->first_child;
+      depth++;
+      continue;
+    }
+    while (i >= 0 && tree->nodes[i].next_sibling < 0) {
+      i = tree->nodes[i].parent;
+      depth--;
+    }
+    if (i >= 0)
+      i = tree->nodes[i].next_sibling;
+  }
+
+  for (int k = count - 1; k >= 0; --k) {
+    int parent = parents[k];
+    keys[k].parent = parent;
+    if (parent < 0)
+      continue;
+    rows[parent].cpu += rows[k].cpu;
+    rows[parent].rss += rows[k].rss;
+    rows[parent].descendants += rows[k].descendants + 1;
+    keys[parent].key += keys[k].key;
+  }
+
+  qsort(keys, count, sizeof(TreeKey), compare_tree_keys);
+  int roots = 0;
+  for (int k = 0; k < count; ++k) {
+    int parent = keys[k].parent;
+    if (parent < 0)
+      roots++;
+    else if (num_children[parent]++ == 0)
+      first_child[parent] = k;
+  }
+  int written = 0, top = 0;
+  for (int k = roots - 1; k >= 0; --k)
+    stack[top++] = keys[k].position;
+  while (top > 0 && written < max) {
+    int k = stack[--top];
+    out[written++] = rows[k];
+    for (int c = num_children[k] - 1; c >= 0; --c)
+      stack[top++] = keys[first_child[k] + c].position;
+  }
+  return written;
+}
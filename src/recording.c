@@ -0,0 +1,426 @@
+#include "../include/recording.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// How far the file is extended, and mapped, at a time.
+#define RECORDING_CHUNK (4u << 20)
+
+static void put_u64(unsigned char *out, unsigned long long value) {
+  for (int i = 0; i < 8; ++i)
+    out[i] = (unsigned char)(value >> (8 * i));
+}
+
+static unsigned long long get_u64(const unsigned char *in) {
+  unsigned long long value = 0;
+  for (int i = 0; i < 8; ++i)
+    value |= (unsigned long long)in[i] << (8 * i);
+  return value;
+}
+
+static size_t get_u32(const unsigned char *in) {
+  return in[0] | (size_t)in[1] << 8 | (size_t)in[2] << 16 |
+         (size_t)in[3] << 24;
+}
+
+// Moves the mapping to the chunk holding `end`. The blocks are allocated
+// up front: a full disk then fails here rather than as SIGBUS on a store.
+static int map_window(Recorder *recorder) {
+  if (recorder->map)
+    munmap(recorder->map, recorder->map_size);
+  recorder->map = NULL;
+  long page = sysconf(_SC_PAGESIZE);
+  recorder->map_offset = recorder->end - recorder->end % page;
+  recorder->map_size = RECORDING_CHUNK;
+  int error = posix_fallocate(recorder->fd, recorder->map_offset,
+                              recorder->map_size);
+  if (error) {
+    errno = error;
+    return 0;
+  }
+  void *map = mmap(NULL, recorder->map_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, recorder->fd, recorder->map_offset);
+  if (map == MAP_FAILED)
+    return 0;
+  recorder->map = map;
+  return 1;
+}
+
+static int append(Recorder *recorder, const void *data, size_t len) {
+  const unsigned char *bytes = data;
+  while (len > 0) {
+    off_t map_end = recorder->map_offset + (off_t)recorder->map_size;
+    if (!recorder->map || recorder->end >= map_end) {
+      if (!map_window(recorder))
+        return 0;
+      map_end = recorder->map_offset + (off_t)recorder->map_size;
+    }
+    size_t room = (size_t)(map_end - recorder->end);
+    size_t n = len < room ? len : room;
+    memcpy(recorder->map + (recorder->end - recorder->map_offset), bytes, n);
+    recorder->end += n;
+    bytes += n;
+    len -= n;
+  }
+  return 1;
+}
+
+// Starts `path` or, if it already holds a recording, carries on after its
+// last whole frame, so a restarted recorder keeps one file and one index.
+int recorder_init(Recorder *recorder, const char *path) {
+  memset(recorder, 0, sizeof(*recorder));
+  wire_state_init(&recorder->captured);
+  wire_state_init(&recorder->pending);
+  wire_state_init(&recorder->written);
+  wire_state_init(&recorder->encoding);
+  pthread_mutex_init(&recorder->lock, NULL);
+  pthread_cond_init(&recorder->ready, NULL);
+  atomic_init(&recorder->error, 0);
+  outbuf_init(&recorder->frame);
+  outbuf_init(&recorder->index);
+  if (gethostname(recorder->host, sizeof(recorder->host) - 1) != 0)
+    strcpy(recorder->host, "unknown");
+  recorder->path = strdup(path);
+  recorder->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (!recorder->path || recorder->fd < 0) {
+    fprintf(stderr, "pulse: cannot record to %s: %s\n", path,
+            strerror(errno));
+    recorder_destroy(recorder);
+    return 0;
+  }
+  if (flock(recorder->fd, LOCK_EX | LOCK_NB) != 0) {
+    fprintf(stderr, "pulse: %s is being recorded by another pulse\n", path);
+    recorder_destroy(recorder);
+    return 0;
+  }
+
+  struct stat st;
+  if (fstat(recorder->fd, &st) == 0 && st.st_size > 0) {
+    Recording existing;
+    if (!recording_open(&existing, path)) {
+      recorder_destroy(recorder);
+      return 0;
+    }
+    recorder->end = (off_t)existing.frames_end;
+    outbuf_mem(&recorder->index, (const char *)existing.index,
+               (size_t)existing.num_marks * RECORDING_MARK_SIZE);
+    if (existing.num_marks > 0)
+      recorder->last_mark_ms =
+          recording_mark_time(&existing, existing.num_marks - 1);
+    recording_close(&existing);
+    // The old index and trailer are written again, longer, on close.
+    if (recorder->index.failed || ftruncate(recorder->fd, recorder->end)) {
+      fprintf(stderr, "pulse: cannot record to %s: %s\n", path,
+              strerror(errno));
+      recorder_destroy(recorder);
+      return 0;
+    }
+  } else {
+    unsigned char header[RECORDING_HEADER_SIZE] = {0};
+    memcpy(header, RECORDING_MAGIC, 8);
+    header[8] = RECORDING_VERSION;
+    if (!append(recorder, header, sizeof(header))) {
+      fprintf(stderr, "pulse: cannot record to %s: %s\n", path,
+              strerror(errno));
+      recorder_destroy(recorder);
+      return 0;
+    }
+  }
+  recorder->frames_end = recorder->end;
+  return 1;
+}
+
+// Called from the collector thread with the snapshot about to be published.
+void recorder_update(Recorder *recorder, const Snapshot *snapshot) {
+  if (atomic_load(&recorder->error) ||
+      !wire_capture(&recorder->captured, snapshot))
+    return;
+  pthread_mutex_lock(&recorder->lock);
+  WireState captured = recorder->captured;
+  recorder->captured = recorder->pending;
+  recorder->pending = captured;
+  recorder->has_pending = 1;
+  pthread_cond_signal(&recorder->ready);
+  pthread_mutex_unlock(&recorder->lock);
+}
+
+// Appends `encoding` as a delta from the last sample written, or as a hello
+// and keyframe every RECORDING_KEYFRAME_INTERVAL samples. Returns 0 once
+// the file cannot take any more.
+static int write_sample(Recorder *recorder) {
+  WireState *curr = &recorder->encoding;
+  int keyframe = !recorder->have_sample ||
+                 recorder->since_keyframe >= RECORDING_KEYFRAME_INTERVAL;
+  outbuf_reset(&recorder->frame);
+  if (keyframe)
+    wire_encode_hello(&recorder->frame, recorder->host);
+  wire_encode(&recorder->frame, keyframe ? NULL : &recorder->written, curr);
+  if (recorder->frame.failed)
+    return 1;
+  off_t offset = recorder->end;
+  if (!append(recorder, recorder->frame.data, recorder->frame.len)) {
+    atomic_store(&recorder->error, errno);
+    return 0;
+  }
+  recorder->frames_end = recorder->end;
+  if (keyframe) {
+    // The index has to stay in order for the binary search, whatever the
+    // wall clock does.
+    if (curr->timestamp_ms > recorder->last_mark_ms)
+      recorder->last_mark_ms = curr->timestamp_ms;
+    unsigned char mark[RECORDING_MARK_SIZE];
+    put_u64(mark, recorder->last_mark_ms);
+    put_u64(mark + 8, (unsigned long long)offset);
+    outbuf_mem(&recorder->index, (const char *)mark, sizeof(mark));
+    recorder->since_keyframe = 0;
+  }
+  recorder->since_keyframe++;
+  recorder->have_sample = 1;
+  WireState written = recorder->written;
+  recorder->written = recorder->encoding;
+  recorder->encoding = written;
+  return 1;
+}
+
+// Writes whatever was handed over last; on stop, drains it first.
+static void *recorder_thread(void *arg) {
+  Recorder *recorder = arg;
+  while (1) {
+    pthread_mutex_lock(&recorder->lock);
+    while (!recorder->has_pending && !recorder->stopping)
+      pthread_cond_wait(&recorder->ready, &recorder->lock);
+    if (!recorder->has_pending) {
+      pthread_mutex_unlock(&recorder->lock);
+      break;
+    }
+    WireState pending = recorder->pending;
+    recorder->pending = recorder->encoding;
+    recorder->encoding = pending;
+    recorder->has_pending = 0;
+    pthread_mutex_unlock(&recorder->lock);
+    if (!write_sample(recorder))
+      break;
+  }
+  return NULL;
+}
+
+int recorder_start(Recorder *recorder) {
+  if (pthread_create(&recorder->thread, NULL, recorder_thread, recorder) !=
+      0)
+    return 0;
+  recorder->thread_started = 1;
+  return 1;
+}
+
+// Writes the index and trailer after the last whole frame and trims the
+// file to its end. Without them the reader rebuilds the index itself.
+static void finish(Recorder *recorder) {
+  recorder->end = recorder->frames_end;
+  size_t len = recorder->index.len;
+  unsigned char header[WIRE_HEADER_SIZE] = {RECORDING_INDEX};
+  for (int i = 0; i < 4; ++i)
+    header[1 + i] = (unsigned char)(len >> (8 * i));
+  unsigned char trailer[RECORDING_TRAILER_SIZE];
+  put_u64(trailer, (unsigned long long)recorder->frames_end);
+  memcpy(trailer + 8, RECORDING_INDEX_MAGIC, 8);
+  if (atomic_load(&recorder->error) || recorder->index.failed ||
+      len > WIRE_FRAME_MAX ||
+      !append(recorder, header, sizeof(header)) ||
+      !append(recorder, recorder->index.data, len) ||
+      !append(recorder, trailer, sizeof(trailer)))
+    recorder->end = recorder->frames_end;
+  if (recorder->map)
+    munmap(recorder->map, recorder->map_size);
+  recorder->map = NULL;
+  if (ftruncate(recorder->fd, recorder->end) != 0)
+    perror("pulse: recording");
+}
+
+void recorder_destroy(Recorder *recorder) {
+  if (recorder->thread_started) {
+    pthread_mutex_lock(&recorder->lock);
+    recorder->stopping = 1;
+    pthread_cond_signal(&recorder->ready);
+    pthread_mutex_unlock(&recorder->lock);
+    pthread_join(recorder->thread, NULL);
+  }
+  if (recorder->frames_end > 0)
+    finish(recorder);
+  if (recorder->map)
+    munmap(recorder->map, recorder->map_size);
+  if (recorder->fd >= 0)
+    close(recorder->fd);
+  int error = atomic_load(&recorder->error);
+  if (error)
+    fprintf(stderr, "pulse: recording to %s stopped early: %s\n",
+            recorder->path, strerror(error));
+  free(recorder->path);
+  pthread_mutex_destroy(&recorder->lock);
+  pthread_cond_destroy(&recorder->ready);
+  wire_state_destroy(&recorder->captured);
+  wire_state_destroy(&recorder->pending);
+  wire_state_destroy(&recorder->written);
+  wire_state_destroy(&recorder->encoding);
+  outbuf_free(&recorder->frame);
+  outbuf_free(&recorder->index);
+  memset(recorder, 0, sizeof(*recorder));
+  recorder->fd = -1;
+}
+
+// The complete frame at `offset`, if there is one before the index.
+int recording_frame(const Recording *recording, size_t offset, int *type,
+                    const unsigned char **payload, size_t *len) {
+  if (offset > recording->frames_end ||
+      recording->frames_end - offset < WIRE_HEADER_SIZE)
+    return 0;
+  const unsigned char *frame = recording->data + offset;
+  size_t size = get_u32(frame + 1);
+  if (size > recording->frames_end - offset - WIRE_HEADER_SIZE)
+    return 0;
+  *type = frame[0];
+  *payload = frame + WIRE_HEADER_SIZE;
+  *len = size;
+  return 1;
+}
+
+static int load_index(Recording *recording) {
+  const unsigned char *data = recording->data;
+  size_t size = recording->size;
+  if (size < RECORDING_HEADER_SIZE + WIRE_HEADER_SIZE +
+                 RECORDING_TRAILER_SIZE ||
+      memcmp(data + size - 8, RECORDING_INDEX_MAGIC, 8) != 0)
+    return 0;
+  unsigned long long offset = get_u64(data + size - RECORDING_TRAILER_SIZE);
+  size_t index_end = size - RECORDING_TRAILER_SIZE;
+  if (offset < RECORDING_HEADER_SIZE ||
+      offset > index_end - WIRE_HEADER_SIZE ||
+      data[offset] != RECORDING_INDEX)
+    return 0;
+  size_t len = get_u32(data + offset + 1);
+  if (len != index_end - offset - WIRE_HEADER_SIZE ||
+      len % RECORDING_MARK_SIZE || len / RECORDING_MARK_SIZE > INT_MAX)
+    return 0;
+  recording->frames_end = (size_t)offset;
+  recording->index = data + offset + WIRE_HEADER_SIZE;
+  recording->num_marks = (int)(len / RECORDING_MARK_SIZE);
+  return 1;
+}
+
+// For a recording that was not closed cleanly: walks the frames to the
+// first that is cut short (or the zeroed tail of the last chunk) and
+// indexes the keyframes on the way.
+static int rebuild_index(Recording *recording) {
+  static const WireState empty;
+  OutBuf marks;
+  outbuf_init(&marks);
+  recording->frames_end = recording->size;
+  size_t offset = RECORDING_HEADER_SIZE, hello = SIZE_MAX;
+  unsigned long long last_ms = 0;
+  int type;
+  const unsigned char *payload;
+  size_t len;
+  while (recording_frame(recording, offset, &type, &payload, &len)) {
+    unsigned long long timestamp_ms;
+    if (type == WIRE_KEYFRAME &&
+        wire_frame_timestamp(&empty, type, payload, len, &timestamp_ms)) {
+      if (timestamp_ms > last_ms)
+        last_ms = timestamp_ms;
+      unsigned char mark[RECORDING_MARK_SIZE];
+      put_u64(mark, last_ms);
+      put_u64(mark + 8, hello != SIZE_MAX ? hello : offset);
+      outbuf_mem(&marks, (const char *)mark, sizeof(mark));
+    } else if (type != WIRE_HELLO && type != WIRE_DELTA) {
+      break;
+    }
+    hello = type == WIRE_HELLO ? offset : SIZE_MAX;
+    offset += WIRE_HEADER_SIZE + len;
+  }
+  recording->frames_end = offset;
+  if (marks.failed || marks.len / RECORDING_MARK_SIZE > INT_MAX) {
+    outbuf_free(&marks);
+    return 0;
+  }
+  recording->owned_index = (unsigned char *)marks.data;
+  recording->index = recording->owned_index;
+  recording->num_marks = (int)(marks.len / RECORDING_MARK_SIZE);
+  return 1;
+}
+
+int recording_open(Recording *recording, const char *path) {
+  memset(recording, 0, sizeof(*recording));
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "pulse: cannot open %s: %s\n", path, strerror(errno));
+    return 0;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < RECORDING_HEADER_SIZE) {
+    fprintf(stderr, "pulse: %s is not a Pulse recording\n", path);
+    close(fd);
+    return 0;
+  }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "pulse: cannot map %s: %s\n", path, strerror(errno));
+    return 0;
+  }
+  recording->data = map;
+  recording->size = st.st_size;
+  if (memcmp(recording->data, RECORDING_MAGIC, 8) != 0) {
+    fprintf(stderr, "pulse: %s is not a Pulse recording\n", path);
+    recording_close(recording);
+    return 0;
+  }
+  if (get_u32(recording->data + 8) != RECORDING_VERSION) {
+    fprintf(stderr, "pulse: %s is recording format %zu, not %d\n", path,
+            get_u32(recording->data + 8), RECORDING_VERSION);
+    recording_close(recording);
+    return 0;
+  }
+  if (!load_index(recording) && !rebuild_index(recording)) {
+    fprintf(stderr, "pulse: out of memory indexing %s\n", path);
+    recording_close(recording);
+    return 0;
+  }
+  return 1;
+}
+
+void recording_close(Recording *recording) {
+  if (recording->data)
+    munmap((void *)recording->data, recording->size);
+  free(recording->owned_index);
+  memset(recording, 0, sizeof(*recording));
+}
+
+unsigned long long recording_mark_time(const Recording *recording,
+                                       int mark) {
+  return get_u64(recording->index + (size_t)mark * RECORDING_MARK_SIZE);
+}
+
+size_t recording_mark_offset(const Recording *recording, int mark) {
+  return (size_t)get_u64(recording->index +
+                         (size_t)mark * RECORDING_MARK_SIZE + 8);
+}
+
+// The last keyframe at or before `time_ms`, or the first one if they are
+// all later; -1 for a recording without any.
+int recording_find(const Recording *recording, unsigned long long time_ms) {
+  int lo = 0, hi = recording->num_marks;
+  while (hi - lo > 1) {
+    int mid = lo + (hi - lo) / 2;
+    if (recording_mark_time(recording, mid) <= time_ms)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return recording->num_marks > 0 ? lo : -1;
+}
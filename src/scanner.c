@@ -0,0 +1,209 @@
+#include "../include/scanner.h"
+#include "../include/timing.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_PID_CAPACITY 1024
+
+static int parse_pid_name(const char *name) {
+  int pid = 0;
+  for (; *name; ++name) {
+    if (!isdigit((unsigned char)*name))
+      return 0;
+    pid = pid * 10 + (*name - '0');
+  }
+  return pid;
+}
+
+// PIDs are sharded by value rather than by position in the readdir list so
+// that each worker keeps seeing the same processes and its fd cache stays
+// warm from one tick to the next.
+static int shard_of(const ProcScanner *scanner, int pid) {
+  return (int)((unsigned int)pid % (unsigned int)scanner->num_shards);
+}
+
+static void read_io(ScanShard *shard, pidStats *stats) {
+  size_t len;
+  char *contents = pidcache_read(&shard->io_cache, stats->pid, &len);
+  if (contents)
+    ioParser(contents, len, stats);
+}
+
+static void scan_shard(void *ctx, int worker) {
+  ProcScanner *scanner = ctx;
+  ScanShard *shard = &scanner->shards[worker];
+  pidStats *out = scanner->output + shard->start;
+
+  unsigned long long started = now_ns();
+  pidcache_begin_tick(&shard->cache);
+  pidcache_begin_tick(&shard->io_cache);
+  shard->produced = 0;
+  shard->sampled = 0;
+  shard->parse_ns = 0;
+  for (int i = 0; i < shard->count; ++i) {
+    int pid = scanner->grouped_pids[shard->start + i];
+    const pidStats *reused =
+        scanner->reuse ? scanner->reuse(scanner->reuse_ctx, pid) : NULL;
+    if (reused) {
+      out[shard->produced++] = *reused;
+      pidcache_touch(&shard->cache, pid);
+      pidcache_touch(&shard->io_cache, pid);
+      continue;
+    }
+
+    size_t len;
+    char *contents = pidcache_read(&shard->cache, pid, &len);
+    if (!contents)
+      continue;
+    shard->sampled++;
+    pidStats *stats = &out[shard->produced];
+    int parsed;
+    if (scanner->timed) {
+      unsigned long long parse_started = now_ns();
+      parsed = pidParser(contents, len, stats);
+      shard->parse_ns += now_ns() - parse_started;
+    } else {
+      parsed = pidParser(contents, len, stats);
+    }
+    if (!parsed)
+      continue;
+    stats->has_io = 0;
+    if (scanner->read_io)
+      read_io(shard, stats);
+    shard->produced++;
+  }
+  // With read_io off nothing is marked seen, so this also closes every io fd.
+  pidcache_sweep(&shard->cache);
+  pidcache_sweep(&shard->io_cache);
+  shard->read_ns = now_ns() - started - shard->parse_ns;
+}
+
+static int read_pid_list(ProcScanner *scanner, Arena *arena, int **out) {
+  DIR *proc_dir = opendir(scanner->proc_root);
+  if (!proc_dir)
+    return 0;
+
+  int capacity = INITIAL_PID_CAPACITY;
+  int *pids = arena_alloc(arena, sizeof(int) * capacity);
+  int count = 0;
+  struct dirent *entry;
+  while (pids && (entry = readdir(proc_dir)) != NULL) {
+    int pid = parse_pid_name(entry->d_name);
+    if (pid <= 0)
+      continue;
+    if (count == capacity) {
+      pids = arena_grow(arena, pids, sizeof(int) * capacity,
+                        sizeof(int) * capacity * 2);
+      capacity *= 2;
+      if (!pids)
+        break;
+    }
+    pids[count++] = pid;
+  }
+  closedir(proc_dir);
+  *out = pids;
+  return pids ? count : 0;
+}
+
+int scanner_init(ProcScanner *scanner, const char *proc_root, int num_workers) {
+  memset(scanner, 0, sizeof(*scanner));
+  if (num_workers < 1)
+    num_workers = 1;
+  scanner->proc_root = strdup(proc_root);
+  scanner->shards = calloc(num_workers, sizeof(ScanShard));
+  if (!scanner->proc_root || !scanner->shards) {
+    scanner_destroy(scanner);
+    return 0;
+  }
+  for (int i = 0; i < num_workers; ++i) {
+    ScanShard *shard = &scanner->shards[i];
+    if (!pidcache_init(&shard->cache, proc_root, "stat")) {
+      scanner_destroy(scanner);
+      return 0;
+    }
+    if (!pidcache_init(&shard->io_cache, proc_root, "io")) {
+      pidcache_destroy(&shard->cache);
+      scanner_destroy(scanner);
+      return 0;
+    }
+    scanner->num_shards = i + 1;
+  }
+  if (!pool_init(&scanner->pool, num_workers)) {
+    scanner_destroy(scanner);
+    return 0;
+  }
+  // The pool may have started fewer threads than asked for.
+  for (int i = scanner->pool.num_workers; i < scanner->num_shards; ++i) {
+    pidcache_destroy(&scanner->shards[i].cache);
+    pidcache_destroy(&scanner->shards[i].io_cache);
+  }
+  scanner->num_shards = scanner->pool.num_workers;
+  // Every cache sizes itself to the whole fd limit; split it between them so
+  // together they cannot run the process out of descriptors.
+  for (int i = 0; i < scanner->num_shards; ++i) {
+    scanner->shards[i].cache.max_open /= 2 * scanner->num_shards;
+    scanner->shards[i].io_cache.max_open /= 2 * scanner->num_shards;
+  }
+  return 1;
+}
+
+int scanner_collect(ProcScanner *scanner, Arena *arena, pidStats **out) {
+  int *pids;
+  unsigned long long started = now_ns();
+  int total = read_pid_list(scanner, arena, &pids);
+  scanner->readdir_ns = now_ns() - started;
+  scanner->read_ns = 0;
+  scanner->parse_ns = 0;
+  scanner->sampled = 0;
+  pidStats *buffer = arena_alloc(arena, sizeof(pidStats) * (total + 1));
+  scanner->grouped_pids = arena_alloc(arena, sizeof(int) * (total + 1));
+  *out = buffer;
+  if (!buffer || !scanner->grouped_pids)
+    return 0;
+
+  for (int s = 0; s < scanner->num_shards; ++s)
+    scanner->shards[s].count = 0;
+  for (int i = 0; i < total; ++i)
+    scanner->shards[shard_of(scanner, pids[i])].count++;
+  int offset = 0;
+  for (int s = 0; s < scanner->num_shards; ++s) {
+    scanner->shards[s].start = offset;
+    offset += scanner->shards[s].count;
+    scanner->shards[s].count = 0;
+  }
+  for (int i = 0; i < total; ++i) {
+    ScanShard *shard = &scanner->shards[shard_of(scanner, pids[i])];
+    scanner->grouped_pids[shard->start + shard->count++] = pids[i];
+  }
+
+  scanner->output = buffer;
+  pool_run(&scanner->pool, scan_shard, scanner);
+
+  // Close the gaps left by processes that vanished between readdir and read.
+  int count = 0;
+  for (int s = 0; s < scanner->num_shards; ++s) {
+    ScanShard *shard = &scanner->shards[s];
+    scanner->read_ns += shard->read_ns;
+    scanner->parse_ns += shard->parse_ns;
+    scanner->sampled += shard->sampled;
+    if (shard->start != count && shard->produced > 0)
+      memmove(&buffer[count], &buffer[shard->start],
+              sizeof(pidStats) * shard->produced);
+    count += shard->produced;
+  }
+  return count;
+}
+
+void scanner_destroy(ProcScanner *scanner) {
+  if (scanner->pool.slots)
+    pool_destroy(&scanner->pool);
+  for (int i = 0; i < scanner->num_shards; ++i) {
+    pidcache_destroy(&scanner->shards[i].cache);
+    pidcache_destroy(&scanner->shards[i].io_cache);
+  }
+  free(scanner->shards);
+  free(scanner->proc_root);
+  memset(scanner, 0, sizeof(*scanner));
+}
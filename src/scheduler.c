@@ -0,0 +1,90 @@
+#include "../include/scheduler.h"
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+int scheduler_init(Scheduler *scheduler, int interval_ms) {
+  scheduler->interval_ms = interval_ms;
+  scheduler->timer_fd =
+      timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  scheduler->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (scheduler->timer_fd < 0 || scheduler->stop_fd < 0) {
+    scheduler_destroy(scheduler);
+    return 0;
+  }
+  return 1;
+}
+
+// Lays the grid of deadlines from now: the first is one interval away.
+int scheduler_start(Scheduler *scheduler) {
+  int interval_ms = scheduler->interval_ms;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = interval_ms / 1000;
+  spec.it_interval.tv_nsec = (long)(interval_ms % 1000) * 1000000L;
+  spec.it_value.tv_sec = now.tv_sec + spec.it_interval.tv_sec;
+  spec.it_value.tv_nsec = now.tv_nsec + spec.it_interval.tv_nsec;
+  if (spec.it_value.tv_nsec >= 1000000000L) {
+    spec.it_value.tv_sec++;
+    spec.it_value.tv_nsec -= 1000000000L;
+  }
+  return timerfd_settime(scheduler->timer_fd, TFD_TIMER_ABSTIME, &spec,
+                         NULL) == 0;
+}
+
+// Expirations since the last read, 0 if none.
+static int take_expirations(Scheduler *scheduler) {
+  uint64_t expirations;
+  if (read(scheduler->timer_fd, &expirations, sizeof(expirations)) !=
+      (ssize_t)sizeof(expirations))
+    return 0;
+  return expirations > (uint64_t)INT_MAX ? INT_MAX : (int)expirations;
+}
+
+// Blocks until the next deadline. Deadlines that passed while the last tick
+// ran are dropped, not run late. Returns how many were dropped, or -1 once
+// stopped.
+int scheduler_wait(Scheduler *scheduler) {
+  struct pollfd fds[2] = {
+      {.fd = scheduler->timer_fd, .events = POLLIN},
+      {.fd = scheduler->stop_fd, .events = POLLIN},
+  };
+  int missed = take_expirations(scheduler);
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    if (fds[1].revents & POLLIN)
+      return -1;
+    int expirations = take_expirations(scheduler);
+    if (expirations > 0) {
+      missed += expirations - 1;
+      break;
+    }
+  }
+  return missed;
+}
+
+void scheduler_stop(Scheduler *scheduler) {
+  uint64_t one = 1;
+  if (scheduler->stop_fd >= 0 &&
+      write(scheduler->stop_fd, &one, sizeof(one)) < 0)
+    perror("pulse: scheduler stop");
+}
+
+void scheduler_destroy(Scheduler *scheduler) {
+  if (scheduler->timer_fd >= 0)
+    close(scheduler->timer_fd);
+  if (scheduler->stop_fd >= 0)
+    close(scheduler->stop_fd);
+  scheduler->timer_fd = scheduler->stop_fd = -1;
+}
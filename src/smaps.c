@@ -0,0 +1,143 @@
+#include "../include/smaps.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SMAPS_INITIAL_CAPACITY 64
+
+static int grow(void **items, int *capacity, int needed, size_t size) {
+  if (needed <= *capacity)
+    return 1;
+  int grown = *capacity > 0 ? *capacity * 2 : SMAPS_INITIAL_CAPACITY;
+  while (grown < needed)
+    grown *= 2;
+  void *moved = realloc(*items, size * grown);
+  if (!moved)
+    return 0;
+  *items = moved;
+  *capacity = grown;
+  return 1;
+}
+
+static void read_rollup(SmapsReader *reader, const SmapsRequest *request,
+                        SmapsResult *result) {
+  result->pid = request->pid;
+  result->starttime = request->starttime;
+  result->ok = 0;
+  char path[32];
+  snprintf(path, sizeof(path), "%d/smaps_rollup", request->pid);
+  int fd = openat(reader->dir_fd, path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+  ssize_t len = read(fd, reader->buffer, sizeof(reader->buffer) - 1);
+  close(fd);
+  if (len <= 0)
+    return;
+  reader->buffer[len] = '\0';
+  result->ok = smapsParser(reader->buffer, (size_t)len, &result->stats);
+}
+
+// Takes everything queued and reads it in order, handing each result back
+// as soon as it is read.
+static void *smaps_thread(void *arg) {
+  SmapsReader *reader = arg;
+  pthread_mutex_lock(&reader->lock);
+  while (1) {
+    while (!reader->stopping && reader->num_queued == 0)
+      pthread_cond_wait(&reader->ready, &reader->lock);
+    if (reader->stopping)
+      break;
+    SmapsRequest *queue = reader->queue;
+    int queue_capacity = reader->queue_capacity;
+    int count = reader->num_queued;
+    reader->queue = reader->work;
+    reader->queue_capacity = reader->work_capacity;
+    reader->num_queued = 0;
+    reader->work = queue;
+    reader->work_capacity = queue_capacity;
+    pthread_mutex_unlock(&reader->lock);
+
+    for (int i = 0; i < count; ++i) {
+      SmapsResult result;
+      read_rollup(reader, &reader->work[i], &result);
+      pthread_mutex_lock(&reader->lock);
+      if (grow((void **)&reader->results, &reader->result_capacity,
+               reader->num_results + 1, sizeof(SmapsResult)))
+        reader->results[reader->num_results++] = result;
+      int stopping = reader->stopping;
+      pthread_mutex_unlock(&reader->lock);
+      if (stopping)
+        return NULL;
+    }
+    pthread_mutex_lock(&reader->lock);
+  }
+  pthread_mutex_unlock(&reader->lock);
+  return NULL;
+}
+
+int smaps_init(SmapsReader *reader, const char *proc_root) {
+  memset(reader, 0, sizeof(*reader));
+  pthread_mutex_init(&reader->lock, NULL);
+  pthread_cond_init(&reader->ready, NULL);
+  reader->dir_fd = open(proc_root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (reader->dir_fd < 0)
+    return 0;
+  if (pthread_create(&reader->thread, NULL, smaps_thread, reader) != 0)
+    return 0;
+  reader->thread_started = 1;
+  return 1;
+}
+
+// Queues a read of `pid`. Returns 0 if it was refused, in which case no
+// result will come back for it.
+int smaps_request(SmapsReader *reader, int pid, unsigned long long starttime) {
+  pthread_mutex_lock(&reader->lock);
+  int queued = reader->num_queued < SMAPS_MAX_QUEUED &&
+               grow((void **)&reader->queue, &reader->queue_capacity,
+                    reader->num_queued + 1, sizeof(SmapsRequest));
+  if (queued) {
+    reader->queue[reader->num_queued++] = (SmapsRequest){pid, starttime};
+    pthread_cond_signal(&reader->ready);
+  }
+  pthread_mutex_unlock(&reader->lock);
+  return queued;
+}
+
+// Everything read since the last call; the array stays valid until the
+// next one.
+int smaps_take(SmapsReader *reader, const SmapsResult **results) {
+  pthread_mutex_lock(&reader->lock);
+  SmapsResult *done = reader->results;
+  int done_capacity = reader->result_capacity;
+  int count = reader->num_results;
+  reader->results = reader->taken;
+  reader->result_capacity = reader->taken_capacity;
+  reader->num_results = 0;
+  pthread_mutex_unlock(&reader->lock);
+  reader->taken = done;
+  reader->taken_capacity = done_capacity;
+  *results = done;
+  return count;
+}
+
+void smaps_destroy(SmapsReader *reader) {
+  if (reader->thread_started) {
+    pthread_mutex_lock(&reader->lock);
+    reader->stopping = 1;
+    pthread_cond_signal(&reader->ready);
+    pthread_mutex_unlock(&reader->lock);
+    pthread_join(reader->thread, NULL);
+  }
+  if (reader->dir_fd >= 0)
+    close(reader->dir_fd);
+  pthread_cond_destroy(&reader->ready);
+  pthread_mutex_destroy(&reader->lock);
+  free(reader->queue);
+  free(reader->results);
+  free(reader->work);
+  free(reader->taken);
+  memset(reader, 0, sizeof(*reader));
+  reader->dir_fd = -1;
+}
@@ -0,0 +1,141 @@
+#include "../include/snapshot.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define SNAPSHOT_INDEX_MASK 3u
+#define SNAPSHOT_FRESH 4u
+
+void snapshot_init(SnapshotExchange *exchange) {
+  memset(exchange->buffers, 0, sizeof(exchange->buffers));
+  exchange->back = 0;
+  exchange->front = 1;
+  exchange->generation = 0;
+  atomic_init(&exchange->middle, 2);
+  exchange->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+void snapshot_destroy(SnapshotExchange *exchange) {
+  for (int i = 0; i < 3; ++i) {
+    free(exchange->buffers[i].cpu.usage);
+    free(exchange->buffers[i].processed_list);
+    free(exchange->buffers[i].disks);
+    free(exchange->buffers[i].nets);
+    free(exchange->buffers[i].cgroups);
+  }
+  memset(exchange->buffers, 0, sizeof(exchange->buffers));
+  if (exchange->notify_fd >= 0)
+    close(exchange->notify_fd);
+  exchange->notify_fd = -1;
+}
+
+static int grow_capacity(int capacity, int needed) {
+  int grown = capacity + capacity / 2;
+  return grown > needed ? grown : needed;
+}
+
+// Buffers only ever grow, so once the largest tick has been seen publishing
+// no longer allocates.
+int snapshot_reserve(Snapshot *snapshot, int num_cpu_entries,
+                     int num_processes, int num_disks, int num_nets) {
+  if (num_cpu_entries > snapshot->cpu_capacity) {
+    // Whole CPU_LANES blocks, which cpuUsage() writes past the last entry.
+    int capacity = cpu_lanes_round(num_cpu_entries);
+    double *block = calloc((size_t)capacity * 5, sizeof(double));
+    if (!block)
+      return 0;
+    free(snapshot->cpu.usage);
+    snapshot->cpu.usage = block;
+    snapshot->cpu.user = block + capacity;
+    snapshot->cpu.system = block + 2 * (size_t)capacity;
+    snapshot->cpu.iowait = block + 3 * (size_t)capacity;
+    snapshot->cpu.steal = block + 4 * (size_t)capacity;
+    snapshot->cpu_capacity = capacity;
+  }
+  if (num_processes > snapshot->process_capacity) {
+    int capacity = grow_capacity(snapshot->process_capacity, num_processes);
+    ProcessInfo *list =
+        realloc(snapshot->processed_list, sizeof(ProcessInfo) * capacity);
+    if (!list)
+      return 0;
+    snapshot->processed_list = list;
+    snapshot->process_capacity = capacity;
+  }
+  if (num_disks > snapshot->disk_capacity) {
+    int capacity = grow_capacity(snapshot->disk_capacity, num_disks);
+    DiskInfo *disks = realloc(snapshot->disks, sizeof(DiskInfo) * capacity);
+    if (!disks)
+      return 0;
+    snapshot->disks = disks;
+    snapshot->disk_capacity = capacity;
+  }
+  if (num_nets > snapshot->net_capacity) {
+    int capacity = grow_capacity(snapshot->net_capacity, num_nets);
+    NetInfo *nets = realloc(snapshot->nets, sizeof(NetInfo) * capacity);
+    if (!nets)
+      return 0;
+    snapshot->nets = nets;
+    snapshot->net_capacity = capacity;
+  }
+  return 1;
+}
+
+int snapshot_reserve_cgroups(Snapshot *snapshot, int num_cgroups) {
+  if (num_cgroups <= snapshot->cgroup_capacity)
+    return 1;
+  int capacity = grow_capacity(snapshot->cgroup_capacity, num_cgroups);
+  CgroupInfo *cgroups =
+      realloc(snapshot->cgroups, sizeof(CgroupInfo) * capacity);
+  if (!cgroups)
+    return 0;
+  snapshot->cgroups = cgroups;
+  snapshot->cgroup_capacity = capacity;
+  return 1;
+}
+
+Snapshot *snapshot_back(SnapshotExchange *exchange) {
+  return &exchange->buffers[exchange->back];
+}
+
+void snapshot_publish(SnapshotExchange *exchange) {
+  exchange->buffers[exchange->back].generation = ++exchange->generation;
+  unsigned int previous =
+      atomic_exchange_explicit(&exchange->middle,
+                               (unsigned int)exchange->back | SNAPSHOT_FRESH,
+                               memory_order_acq_rel);
+  exchange->back = (int)(previous & SNAPSHOT_INDEX_MASK);
+  snapshot_wake(exchange);
+}
+
+// Signals notify_fd without publishing, so a reader in poll() wakes up and
+// rechecks whatever it is waiting on.
+void snapshot_wake(SnapshotExchange *exchange) {
+  if (exchange->notify_fd >= 0) {
+    uint64_t one = 1;
+    ssize_t written = write(exchange->notify_fd, &one, sizeof(one));
+    (void)written;
+  }
+}
+
+void snapshot_drain_notify(SnapshotExchange *exchange) {
+  uint64_t pending;
+  if (exchange->notify_fd >= 0) {
+    ssize_t drained = read(exchange->notify_fd, &pending, sizeof(pending));
+    (void)drained;
+  }
+}
+
+const Snapshot *snapshot_acquire(SnapshotExchange *exchange, int *changed) {
+  int fresh = (atomic_load_explicit(&exchange->middle, memory_order_relaxed) &
+               SNAPSHOT_FRESH) != 0;
+  if (fresh) {
+    unsigned int previous = atomic_exchange_explicit(
+        &exchange->middle, (unsigned int)exchange->front, memory_order_acq_rel);
+    exchange->front = (int)(previous & SNAPSHOT_INDEX_MASK);
+  }
+  if (changed)
+    *changed = fresh;
+  return &exchange->buffers[exchange->front];
+}
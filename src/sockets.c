@@ -0,0 +1,169 @@
+#include "../include/sockets.h"
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SOCKET_BACKLOG 16
+
+static const char *unix_socket_path(const char *address) {
+  if (strncmp(address, "unix:", 5) == 0)
+    return address + 5;
+  return strchr(address, '/') ? address : NULL;
+}
+
+static int unix_address(const char *path, struct sockaddr_un *addr) {
+  if (strlen(path) >= sizeof(addr->sun_path))
+    return 0;
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  strcpy(addr->sun_path, path);
+  return 1;
+}
+
+// Splits "host:port" into `host` (brackets of a v6 address removed) and a
+// pointer to the port. Returns 0 if there is no port.
+static int split_address(const char *address, char *host, size_t size,
+                         const char **port) {
+  const char *colon = strrchr(address, ':');
+  if (!colon || colon[1] == '\0')
+    return 0;
+  size_t host_len = colon - address;
+  if (host_len >= size)
+    return 0;
+  if (host_len >= 2 && address[0] == '[' && address[host_len - 1] == ']') {
+    memcpy(host, address + 1, host_len - 2);
+    host[host_len - 2] = '\0';
+  } else {
+    memcpy(host, address, host_len);
+    host[host_len] = '\0';
+  }
+  *port = colon + 1;
+  return 1;
+}
+
+static int listen_unix(const char *path, char **unix_path) {
+  struct sockaddr_un addr;
+  if (!unix_address(path, &addr)) {
+    fprintf(stderr, "pulse: socket path too long: %s\n", path);
+    return -1;
+  }
+
+  // Replace a socket left behind by an earlier run, but nothing else.
+  struct stat st;
+  if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(fd, SOCKET_BACKLOG) != 0) {
+    fprintf(stderr, "pulse: cannot listen on %s: %s\n", path,
+            strerror(errno));
+    close(fd);
+    return -1;
+  }
+  *unix_path = strdup(path);
+  return fd;
+}
+
+static int listen_tcp(const char *address) {
+  char host[256];
+  const char *port;
+  if (!split_address(address, host, sizeof(host), &port)) {
+    fprintf(stderr, "pulse: address needs a port: %s\n", address);
+    return -1;
+  }
+
+  struct addrinfo hints, *results;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  int rc = getaddrinfo(*host ? host : NULL, port, &hints, &results);
+  if (rc != 0) {
+    fprintf(stderr, "pulse: cannot resolve %s: %s\n", address,
+            gai_strerror(rc));
+    return -1;
+  }
+
+  int fd = -1;
+  int saved_errno = 0;
+  for (struct addrinfo *ai = results; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+    if (fd < 0)
+      continue;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+        listen(fd, SOCKET_BACKLOG) == 0)
+      break;
+    saved_errno = errno;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(results);
+  if (fd < 0)
+    fprintf(stderr, "pulse: cannot listen on %s: %s\n", address,
+            strerror(saved_errno));
+  return fd;
+}
+
+int socket_listen(const char *address, char **unix_path) {
+  const char *path = unix_socket_path(address);
+  *unix_path = NULL;
+  return path ? listen_unix(path, unix_path) : listen_tcp(address);
+}
+
+// Quiet on failure: the viewer retries while the UI owns the terminal.
+// Name lookup still blocks, but only the first address is tried.
+int socket_connect(const char *address) {
+  const char *path = unix_socket_path(address);
+  if (path) {
+    struct sockaddr_un addr;
+    if (!unix_address(path, &addr))
+      return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 &&
+        errno != EINPROGRESS) {
+      close(fd);
+      fd = -1;
+    }
+    return fd;
+  }
+
+  char host[256];
+  const char *port;
+  if (!split_address(address, host, sizeof(host), &port))
+    return -1;
+  struct addrinfo hints, *results;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(*host ? host : NULL, port, &hints, &results) != 0)
+    return -1;
+  int fd = socket(results->ai_family,
+                  results->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                  results->ai_protocol);
+  if (fd >= 0 && connect(fd, results->ai_addr, results->ai_addrlen) != 0 &&
+      errno != EINPROGRESS) {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(results);
+  return fd;
+}
+
+int socket_error(int fd) {
+  int error = 0;
+  socklen_t len = sizeof(error);
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) != 0)
+    return errno;
+  return error;
+}
@@ -0,0 +1,69 @@
+#include "../include/taskscan.h"
+#include "../include/timing.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// How many threads are read between checks of the deadline.
+#define TASKSCAN_CLOCK_STRIDE 64
+
+int taskscan_init(TaskScanner *scanner, const char *proc_root) {
+  scanner->dir_fd = open(proc_root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  return scanner->dir_fd >= 0;
+}
+
+static int read_task(TaskScanner *scanner, int task_fd, const char *tid,
+                     pidStats *stats) {
+  char path[32];
+  snprintf(path, sizeof(path), "%.16s/stat", tid);
+  int fd = openat(task_fd, path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return 0;
+  ssize_t len = read(fd, scanner->buffer, sizeof(scanner->buffer) - 1);
+  close(fd);
+  if (len <= 0)
+    return 0;
+  scanner->buffer[len] = '\0';
+  if (!pidParser(scanner->buffer, (size_t)len, stats))
+    return 0;
+  stats->has_io = 0;
+  return 1;
+}
+
+// Fills `out` with up to `max` threads of `pid`, each under its own tid, and
+// returns how many were read. Stops early once `deadline_ns` has passed, so
+// a process with a huge thread count cannot hold up the tick.
+int taskscan_collect(TaskScanner *scanner, int pid, pidStats *out, int max,
+                     unsigned long long deadline_ns) {
+  char path[32];
+  snprintf(path, sizeof(path), "%d/task", pid);
+  int task_fd =
+      openat(scanner->dir_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (task_fd < 0)
+    return 0;
+  DIR *dir = fdopendir(task_fd);
+  if (!dir) {
+    close(task_fd);
+    return 0;
+  }
+
+  int count = 0, attempts = 0;
+  struct dirent *entry;
+  while (count < max && (entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+      continue;
+    if (++attempts % TASKSCAN_CLOCK_STRIDE == 0 && now_ns() > deadline_ns)
+      break;
+    if (read_task(scanner, task_fd, entry->d_name, &out[count]))
+      count++;
+  }
+  closedir(dir);
+  return count;
+}
+
+void taskscan_destroy(TaskScanner *scanner) {
+  if (scanner->dir_fd >= 0)
+    close(scanner->dir_fd);
+  scanner->dir_fd = -1;
+}
@@ -0,0 +1,60 @@
+#include "../include/topk.h"
+#include <stdlib.h>
+
+// Descending by value, ties broken by ascending pid so idle rows keep a
+// stable order from one tick to the next.
+static inline int ranks_before(const SortKey *a, const SortKey *b) {
+  if (a->value != b->value)
+    return a->value > b->value;
+  return a->pid < b->pid;
+}
+
+static int compare_keys(const void *a, const void *b) {
+  const SortKey *k1 = a;
+  const SortKey *k2 = b;
+  if (ranks_before(k1, k2))
+    return -1;
+  if (ranks_before(k2, k1))
+    return 1;
+  return 0;
+}
+
+static void sift_down(SortKey *heap, int size, int i) {
+  SortKey item = heap[i];
+  while (1) {
+    int child = 2 * i + 1;
+    if (child >= size)
+      break;
+    if (child + 1 < size && ranks_before(&heap[child], &heap[child + 1]))
+      child++;
+    if (!ranks_before(&item, &heap[child]))
+      break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = item;
+}
+
+// Moves the k best keys to the front of the array in sorted order and returns
+// how many are sorted. The remaining keys stay behind them in no particular
+// order. A bounded heap whose root is the worst retained key makes this
+// O(n log k); when k covers a large part of the input a full sort is cheaper.
+int topk_select(SortKey *keys, int count, int k) {
+  if (k <= 0 || k * 4 >= count) {
+    qsort(keys, count, sizeof(SortKey), compare_keys);
+    return count;
+  }
+
+  for (int i = k / 2 - 1; i >= 0; --i)
+    sift_down(keys, k, i);
+  for (int i = k; i < count; ++i) {
+    if (ranks_before(&keys[i], &keys[0])) {
+      SortKey evicted = keys[0];
+      keys[0] = keys[i];
+      keys[i] = evicted;
+      sift_down(keys, k, 0);
+    }
+  }
+  qsort(keys, k, sizeof(SortKey), compare_keys);
+  return k;
+}
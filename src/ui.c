@@ -1,27 +1,159 @@
 #include "../include/ui.h"
+#include "../include/filter.h"
+#include "../include/timing.h"
+#include <langinfo.h>
+#include <locale.h>
 #include <ncurses.h>
+#include <stdlib.h>
 #include <string.h>
 
-static WINDOW *header_win, *cpu_win, *mem_win, *proc_win;
+// Last text written to each row of a panel. Rows are only repainted when
+// their formatted content differs, so an unchanged tick costs no curses
+// output at all.
+typedef struct {
+  char *lines;
+  int rows;
+  int stride;
+} LineCache;
+
+static WINDOW *header_win, *cpu_win, *mem_win, *disk_win, *net_win, *proc_win;
+// Pulse's own timings, drawn over the top right of the process panel.
+static WINDOW *stats_win;
+static int stats_visible = 0;
+static LatencyHistogram frame_latency;
 static int scroll_offset = 0;
+static int layout_cpu_entries = 0;
+static int layout_disk_entries = 0;
+static int layout_net_rows = 0;
+static int layout_stat_rows = 0;
+static int io_visible = 0;
+// The PSS, USS and SWAP columns, and the pids of the process rows last
+// drawn (sorted), which are the ones the collector reads them for.
+static int memory_visible = 0;
+static int drawn_pids[UI_MAX_VISIBLE_PIDS];
+static int num_drawn_pids = 0;
+static int threads_visible = 0;
+// The selected row, remembered by pid (and owning pid, for thread rows) so
+// it stays put while the table is re-sorted. A zero pid adopts whatever row
+// is at selected_index on the next draw.
+static int selected_index = 0;
+static int selected_pid = 0, selected_thread_of = 0;
+static int drawn_selected_row = -1;
+// With a query set the process table only shows matching rows, and row
+// numbers (selection, scrolling) count those rows. filter_editing is set
+// while the query is being typed after '/'.
+static FilterIndex name_filter;
+static int filter_ready = 0, filter_editing = 0;
+static char filter_query[FILTER_QUERY_MAX];
+static char applied_query[FILTER_QUERY_MAX];
+static unsigned long applied_generation;
+static int num_visible_rows = 0;
+static char drawn_proc_title[FILTER_QUERY_MAX + 32];
+// The tree view lists processes under their parents. Collapsed subtrees
+// are remembered by the pid at their root, kept sorted; tree_rows maps rows
+// of the table to snapshot rows once collapsed subtrees are left out.
+static int tree_visible = 0;
+static int *collapsed_pids;
+static int num_collapsed_pids, collapsed_pid_capacity;
+static int *tree_rows;
+static int num_tree_rows, tree_row_capacity;
+static int tree_layout_valid = 0;
+static unsigned long tree_layout_generation;
+static int selected_has_children = 0;
+static const int *row_map;
+// The cgroup table replaces the process table while cgroups_visible is set.
+// Collapsed groups are remembered by path; visible_cgroups maps rows of the
+// table to snapshot entries once collapsed subtrees are left out.
+static int cgroups_visible = 0;
+static int cgroup_scroll = 0, cgroup_selected = 0;
+static char selected_cgroup[256];
+static char **collapsed_cgroups;
+static int num_collapsed_cgroups;
+static int *visible_cgroups;
+static int num_visible_cgroups, visible_cgroup_capacity;
+static int history_tier = 0;
+// The agent being viewed, or the recording's host and time when replaying;
+// empty when watching this machine.
+static char host_label[80];
+static int replaying = 0;
+static int utf8_glyphs = 0;
+static int full_redraw = 1;
+static int header_dirty = 0;
+static int drawn_scroll_offset = -1, drawn_num_processes = -1;
+static LineCache cpu_cells, mem_lines, disk_lines, net_lines, proc_rows;
 
 #define HEADER_HEIGHT 1
 #define MEM_PANEL_HEIGHT 3
-#define CPU_ITEM_FIXED_WIDTH 18
+#define CPU_LABEL_WIDTH 14
+#define CPU_ITEM_FIXED_WIDTH 32
+#define CPU_BAR_MAX_WIDTH 20
+#define CPU_BAR_SEGMENTS 4
+#define MEM_LABEL_WIDTH 20
+#define SPARK_MIN_WIDTH 4
+#define SPARK_MAX_WIDTH 256
+// Sparkline glyphs take up to three bytes each in UTF-8.
+#define SPARK_BYTES 3
+#define NET_PANEL_MAX_IFACES 4
+#define STATS_WIN_WIDTH 32
 #define HEADER_PAIR 1
 #define PANEL_BORDER_PAIR 2
 #define PROC_HEADER_PAIR 3
 #define SCROLL_THUMB_PAIR 4
+// User, system, iowait and steal, in bar order.
+#define CPU_USER_PAIR 5
 
 void draw_header(void);
 void draw_panel_border(WINDOW *win, const char *title);
-void draw_cpu_panel(const double *cpu_usage, int num_total_cpu_entries);
-void draw_mem_panel(const memStats *mem_info);
-void draw_process_panel(const ProcessInfo *processes, int num_processes);
+void draw_cpu_panel(const CpuUsage *cpu, int num_total_cpu_entries,
+                    const History *history);
+void draw_mem_panel(const memStats *mem_info, const History *history);
+void draw_disk_panel(const DiskInfo *disks, int num_disks);
+void draw_net_panel(const NetInfo *nets, int num_nets,
+                    double tcp_retrans_rate);
+void draw_process_panel(const ProcessInfo *processes, int num_processes,
+                        unsigned long generation);
+void draw_cgroup_panel(const CgroupInfo *cgroups, int num_cgroups);
+void draw_stats_panel(const SelfStats *self);
 static void format_memory_unit(char *buf, size_t buf_size, long kb);
 
+static void line_cache_reset(LineCache *cache, int rows, int width) {
+  free(cache->lines);
+  cache->rows = rows > 0 ? rows : 0;
+  cache->stride = (width > 0 ? width : 0) + 1;
+  cache->lines = malloc((size_t)cache->rows * cache->stride + 1);
+  if (!cache->lines) {
+    cache->rows = 0;
+    return;
+  }
+  // A byte no formatted row can start with, so every row misses once.
+  for (int i = 0; i < cache->rows; ++i)
+    cache->lines[i * cache->stride] = '\1';
+}
+
+static int line_cache_update(LineCache *cache, int row, const char *text) {
+  if (row < 0 || row >= cache->rows)
+    return 1;
+  char *line = cache->lines + (size_t)row * cache->stride;
+  if (strncmp(line, text, cache->stride - 1) == 0)
+    return 0;
+  strncpy(line, text, cache->stride - 1);
+  line[cache->stride - 1] = '\0';
+  return 1;
+}
+
+static void line_cache_invalidate(LineCache *cache, int row) {
+  if (row >= 0 && row < cache->rows)
+    cache->lines[(size_t)row * cache->stride] = '\1';
+}
+
 void ui_init(void) {
+  // Block-element sparklines need a UTF-8 locale; otherwise use ASCII.
+  setlocale(LC_ALL, "");
+  utf8_glyphs = strcmp(nl_langinfo(CODESET), "UTF-8") == 0;
+  filter_ready = filter_init(&name_filter);
   initscr();
+  // Escape cancels a search; don't wait a second to tell it from a key.
+  set_escdelay(25);
   cbreak();
   noecho();
   curs_set(0);
@@ -36,6 +168,10 @@ void ui_init(void) {
     init_pair(PANEL_BORDER_PAIR, COLOR_WHITE, -1);
     init_pair(PROC_HEADER_PAIR, COLOR_BLACK, COLOR_CYAN);
     init_pair(SCROLL_THUMB_PAIR, COLOR_CYAN, COLOR_CYAN);
+    init_pair(CPU_USER_PAIR, COLOR_GREEN, -1);
+    init_pair(CPU_USER_PAIR + 1, COLOR_RED, -1);
+    init_pair(CPU_USER_PAIR + 2, COLOR_BLUE, -1);
+    init_pair(CPU_USER_PAIR + 3, COLOR_MAGENTA, -1);
   }
   ui_resize();
 }
@@ -50,20 +186,73 @@ void ui_resize(void) {
     delwin(cpu_win);
   if (mem_win)
     delwin(mem_win);
+  if (disk_win)
+    delwin(disk_win);
+  disk_win = NULL;
+  if (net_win)
+    delwin(net_win);
+  net_win = NULL;
   if (proc_win)
     delwin(proc_win);
+  if (stats_win)
+    delwin(stats_win);
+  stats_win = NULL;
   int screen_width, screen_height;
   getmaxyx(stdscr, screen_height, screen_width);
-  int dummy_cpu_rows = 4;
-  int cpu_win_height = dummy_cpu_rows + 2;
-  int proc_win_height =
-      screen_height - HEADER_HEIGHT - cpu_win_height - MEM_PANEL_HEIGHT;
+  int num_cols = (screen_width > 2) ? (screen_width - 2) / CPU_ITEM_FIXED_WIDTH
+                                    : 1;
+  if (num_cols == 0)
+    num_cols = 1;
+  int cpu_rows = (layout_cpu_entries + num_cols - 1) / num_cols;
+  int max_cpu_rows = screen_height / 3;
+  if (cpu_rows > max_cpu_rows)
+    cpu_rows = max_cpu_rows;
+  if (cpu_rows < 1)
+    cpu_rows = 1;
+  int cpu_win_height = cpu_rows + 2;
+  // The disk panel only exists while there are devices to show.
+  int disk_rows = layout_disk_entries;
+  if (disk_rows > screen_height / 4)
+    disk_rows = screen_height / 4;
+  int disk_win_height = disk_rows > 0 ? disk_rows + 2 : 0;
+  int net_rows = layout_net_rows;
+  if (net_rows > screen_height / 4)
+    net_rows = screen_height / 4;
+  int net_win_height = net_rows > 0 ? net_rows + 2 : 0;
+  int proc_win_height = screen_height - HEADER_HEIGHT - cpu_win_height -
+                        MEM_PANEL_HEIGHT - disk_win_height - net_win_height;
   header_win = newwin(HEADER_HEIGHT, screen_width, 0, 0);
   cpu_win = newwin(cpu_win_height, screen_width, HEADER_HEIGHT, 0);
   mem_win =
       newwin(MEM_PANEL_HEIGHT, screen_width, HEADER_HEIGHT + cpu_win_height, 0);
+  if (disk_win_height > 0)
+    disk_win = newwin(disk_win_height, screen_width,
+                      HEADER_HEIGHT + cpu_win_height + MEM_PANEL_HEIGHT, 0);
+  if (net_win_height > 0)
+    net_win = newwin(net_win_height, screen_width,
+                     HEADER_HEIGHT + cpu_win_height + MEM_PANEL_HEIGHT +
+                         disk_win_height,
+                     0);
   proc_win = newwin(proc_win_height, screen_width,
-                    HEADER_HEIGHT + cpu_win_height + MEM_PANEL_HEIGHT, 0);
+                    HEADER_HEIGHT + cpu_win_height + MEM_PANEL_HEIGHT +
+                        disk_win_height + net_win_height,
+                    0);
+  // A header, the stages, tick, drift, frame, dropped ticks and Pulse's own
+  // usage.
+  int stats_win_height = layout_stat_rows + 8;
+  if (stats_visible && proc_win_height > stats_win_height &&
+      screen_width > STATS_WIN_WIDTH + 2)
+    stats_win = newwin(stats_win_height, STATS_WIN_WIDTH,
+                       getbegy(proc_win) + 1,
+                       screen_width - STATS_WIN_WIDTH - 2);
+
+  line_cache_reset(&cpu_cells, layout_cpu_entries,
+                   screen_width * SPARK_BYTES);
+  line_cache_reset(&mem_lines, 1, screen_width * SPARK_BYTES);
+  line_cache_reset(&disk_lines, disk_rows, screen_width);
+  line_cache_reset(&net_lines, net_rows, screen_width);
+  line_cache_reset(&proc_rows, proc_win_height, screen_width);
+  full_redraw = 1;
 }
 
 void ui_cleanup(void) {
@@ -75,14 +264,171 @@ void ui_cleanup(void) {
     delwin(cpu_win);
   if (mem_win)
     delwin(mem_win);
+  if (disk_win)
+    delwin(disk_win);
+  if (net_win)
+    delwin(net_win);
   if (proc_win)
     delwin(proc_win);
+  if (stats_win)
+    delwin(stats_win);
+  free(cpu_cells.lines);
+  free(mem_lines.lines);
+  free(disk_lines.lines);
+  free(net_lines.lines);
+  free(proc_rows.lines);
+  for (int i = 0; i < num_collapsed_cgroups; ++i)
+    free(collapsed_cgroups[i]);
+  free(collapsed_cgroups);
+  free(visible_cgroups);
+  free(collapsed_pids);
+  free(tree_rows);
+  if (filter_ready)
+    filter_destroy(&name_filter);
   endwin();
 }
 
-void ui_handle_input(int ch, int num_processes) {
-  if (!proc_win)
+static int find_collapsed(const char *path) {
+  for (int i = 0; i < num_collapsed_cgroups; ++i) {
+    if (strcmp(collapsed_cgroups[i], path) == 0)
+      return i;
+  }
+  return -1;
+}
+
+static void toggle_collapsed(const char *path) {
+  int i = find_collapsed(path);
+  if (i >= 0) {
+    free(collapsed_cgroups[i]);
+    collapsed_cgroups[i] = collapsed_cgroups[--num_collapsed_cgroups];
+    return;
+  }
+  char **grown = realloc(collapsed_cgroups, sizeof(char *) *
+                                                (num_collapsed_cgroups + 1));
+  if (!grown)
     return;
+  collapsed_cgroups = grown;
+  if ((collapsed_cgroups[num_collapsed_cgroups] = strdup(path)))
+    num_collapsed_cgroups++;
+}
+
+static int handle_cgroup_input(int ch, int drawable_height) {
+  int previous_scroll = cgroup_scroll, previous_selected = cgroup_selected;
+  int max_scroll = num_visible_cgroups - drawable_height;
+  if (max_scroll < 0)
+    max_scroll = 0;
+  if (ch == KEY_MOUSE) {
+    MEVENT event;
+    if (getmouse(&event) == OK) {
+      if ((event.bstate & BUTTON4_PRESSED) && cgroup_scroll > 0)
+        cgroup_scroll--;
+      else if ((event.bstate & BUTTON5_PRESSED) && cgroup_scroll < max_scroll)
+        cgroup_scroll++;
+    }
+    if (cgroup_selected < cgroup_scroll)
+      cgroup_selected = cgroup_scroll;
+    else if (cgroup_selected >= cgroup_scroll + drawable_height)
+      cgroup_selected = cgroup_scroll + drawable_height - 1;
+  }
+  switch (ch) {
+  case KEY_UP:
+    if (cgroup_selected > 0)
+      cgroup_selected--;
+    break;
+  case KEY_DOWN:
+    if (cgroup_selected < num_visible_cgroups - 1)
+      cgroup_selected++;
+    break;
+  case ' ':
+  case '\n':
+  case KEY_ENTER:
+    if (selected_cgroup[0] == '\0')
+      return 0;
+    toggle_collapsed(selected_cgroup);
+    return 1;
+  }
+  if (cgroup_selected < cgroup_scroll)
+    cgroup_scroll = cgroup_selected;
+  else if (cgroup_selected >= cgroup_scroll + drawable_height)
+    cgroup_scroll = cgroup_selected - drawable_height + 1;
+  // The path is picked up again from the row on the next draw.
+  if (cgroup_selected != previous_selected)
+    selected_cgroup[0] = '\0';
+  return cgroup_scroll != previous_scroll ||
+         cgroup_selected != previous_selected;
+}
+
+// Index of `pid` in collapsed_pids, or where it would go.
+static int collapsed_pid_slot(int pid) {
+  int low = 0, high = num_collapsed_pids;
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (collapsed_pids[mid] < pid)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+static int pid_collapsed(int pid) {
+  int i = collapsed_pid_slot(pid);
+  return i < num_collapsed_pids && collapsed_pids[i] == pid;
+}
+
+static void toggle_collapsed_pid(int pid) {
+  int i = collapsed_pid_slot(pid);
+  if (i < num_collapsed_pids && collapsed_pids[i] == pid) {
+    memmove(&collapsed_pids[i], &collapsed_pids[i + 1],
+            sizeof(int) * (num_collapsed_pids - i - 1));
+    num_collapsed_pids--;
+  } else {
+    if (num_collapsed_pids == collapsed_pid_capacity) {
+      int capacity = collapsed_pid_capacity ? collapsed_pid_capacity * 2 : 16;
+      int *grown = realloc(collapsed_pids, sizeof(int) * capacity);
+      if (!grown)
+        return;
+      collapsed_pids = grown;
+      collapsed_pid_capacity = capacity;
+    }
+    memmove(&collapsed_pids[i + 1], &collapsed_pids[i],
+            sizeof(int) * (num_collapsed_pids - i));
+    collapsed_pids[i] = pid;
+    num_collapsed_pids++;
+  }
+  tree_layout_valid = 0;
+}
+
+// Keys typed after '/': printable ones extend the query, Backspace shortens
+// it, Enter keeps it and Escape drops it.
+static int handle_filter_input(int ch) {
+  size_t len = strlen(filter_query);
+  if (ch == 27) {
+    filter_query[0] = '\0';
+    filter_editing = 0;
+  } else if (ch == '\n' || ch == KEY_ENTER) {
+    filter_editing = 0;
+  } else if (ch == KEY_BACKSPACE || ch == 127 || ch == 8) {
+    if (len > 0)
+      filter_query[len - 1] = '\0';
+  } else if (ch >= 32 && ch < 127 && len + 1 < sizeof(filter_query)) {
+    filter_query[len] = (char)ch;
+    filter_query[len + 1] = '\0';
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+int ui_filter_editing(void) { return filter_editing; }
+
+int ui_handle_input(int ch, int num_processes) {
+  if (!proc_win)
+    return 0;
+  if (filter_editing)
+    return handle_filter_input(ch);
+  if (filter_query[0] || tree_visible)
+    num_processes = num_visible_rows;
   int proc_win_height = getmaxy(proc_win);
   int drawable_height = proc_win_height - 3;
   if (drawable_height < 1)
@@ -90,6 +436,16 @@ void ui_handle_input(int ch, int num_processes) {
   int max_scroll = num_processes - drawable_height;
   if (max_scroll < 0)
     max_scroll = 0;
+  if (ch == 'g' || ch == 'G') {
+    ui_set_cgroups_visible(!cgroups_visible);
+    return 1;
+  }
+  // Navigation goes to whichever table is showing; the rest is shared.
+  if (cgroups_visible && (ch == KEY_MOUSE || ch == KEY_UP || ch == KEY_DOWN ||
+                          ch == ' ' || ch == '\n' || ch == KEY_ENTER))
+    return handle_cgroup_input(ch, drawable_height);
+  int previous_offset = scroll_offset;
+  int previous_index = selected_index;
 
   if (ch == KEY_MOUSE) {
     MEVENT event;
@@ -102,32 +458,239 @@ void ui_handle_input(int ch, int num_processes) {
           scroll_offset++;
       }
     }
+    // The wheel moves the window; the selection stays inside it.
+    if (selected_index < scroll_offset)
+      selected_index = scroll_offset;
+    else if (selected_index >= scroll_offset + drawable_height)
+      selected_index = scroll_offset + drawable_height - 1;
   }
   switch (ch) {
+  case 'o':
+  case 'O':
+    ui_set_io_visible(!io_visible);
+    return 1;
+  case 'm':
+  case 'M':
+    ui_set_memory_visible(!memory_visible);
+    return 1;
+  case 't':
+  case 'T':
+    ui_set_threads_visible(!threads_visible);
+    return 1;
+  case 'f':
+  case 'F':
+    ui_set_tree_visible(!tree_visible);
+    return 1;
+  case ' ':
+  case '\n':
+  case KEY_ENTER:
+    if (!tree_visible || filter_query[0] || selected_pid <= 0 ||
+        (!selected_has_children && !pid_collapsed(selected_pid)))
+      return 0;
+    toggle_collapsed_pid(selected_pid);
+    return 1;
+  case '/':
+    if (!filter_ready || cgroups_visible)
+      return 0;
+    filter_editing = 1;
+    return 1;
+  case 27:
+    if (!filter_query[0])
+      return 0;
+    filter_query[0] = '\0';
+    return 1;
+  case 's':
+  case 'S':
+    stats_visible = !stats_visible;
+    ui_resize();
+    return 1;
+  case 'h':
+  case 'H':
+    history_tier = (history_tier + 1) % HISTORY_TIERS;
+    ui_resize();
+    return 1;
   case KEY_UP:
-    if (scroll_offset > 0)
-      scroll_offset--;
+    if (selected_index > 0)
+      selected_index--;
+    if (selected_index < scroll_offset)
+      scroll_offset = selected_index;
     break;
   case KEY_DOWN:
-    if (scroll_offset < max_scroll)
-      scroll_offset++;
+    if (selected_index < num_processes - 1)
+      selected_index++;
+    if (selected_index >= scroll_offset + drawable_height)
+      scroll_offset = selected_index - drawable_height + 1;
     break;
   }
+  if (selected_index != previous_index)
+    selected_pid = selected_thread_of = 0;
+  return scroll_offset != previous_offset || selected_index != previous_index;
+}
+
+// Rows the collector must keep sorted: everything up to the bottom of the
+// visible window plus one more screen, so scrolling stays ahead of the sort.
+// Filtered rows can come from anywhere in the list, so a filter needs it
+// all sorted.
+int ui_sort_depth(void) {
+  if (!proc_win || filter_query[0])
+    return 0;
+  int drawable_height = getmaxy(proc_win) - 3;
+  if (drawable_height < 1)
+    drawable_height = 1;
+  return scroll_offset + 2 * drawable_height;
+}
+
+int ui_io_visible(void) { return io_visible; }
+
+void ui_set_io_visible(int visible) {
+  if (visible == io_visible)
+    return;
+  io_visible = visible;
+  // The process header changes, so every row has to be laid out again.
+  if (proc_win)
+    ui_resize();
+}
+
+int ui_memory_visible(void) { return memory_visible; }
+
+void ui_set_memory_visible(int visible) {
+  if (visible == memory_visible)
+    return;
+  memory_visible = visible;
+  num_drawn_pids = 0;
+  if (proc_win)
+    ui_resize();
 }
 
-void ui_draw(const double *cpu_usage, const memStats *mem_info,
-             int num_total_cpu_entries, const ProcessInfo *processes,
-             int num_processes) {
-  draw_header();
-  draw_cpu_panel(cpu_usage, num_total_cpu_entries);
-  draw_mem_panel(mem_info);
-  draw_process_panel(processes, num_processes);
-  wnoutrefresh(stdscr);
-  wnoutrefresh(header_win);
+int ui_visible_pids(int *pids, int max) {
+  int count = num_drawn_pids < max ? num_drawn_pids : max;
+  memcpy(pids, drawn_pids, sizeof(int) * count);
+  return count;
+}
+
+int ui_cgroups_visible(void) { return cgroups_visible; }
+
+void ui_set_cgroups_visible(int visible) {
+  if (visible == cgroups_visible)
+    return;
+  cgroups_visible = visible;
+  if (proc_win)
+    ui_resize();
+}
+
+int ui_threads_visible(void) { return threads_visible; }
+
+void ui_set_threads_visible(int visible) {
+  if (visible == threads_visible)
+    return;
+  threads_visible = visible;
+  if (visible)
+    tree_visible = 0;
+  if (proc_win)
+    ui_resize();
+}
+
+int ui_tree_visible(void) { return tree_visible; }
+
+int ui_stats_visible(void) { return stats_visible; }
+
+const LatencyHistogram *ui_frame_latency(void) { return &frame_latency; }
+
+// The tree has no thread rows, so the two views replace each other.
+void ui_set_tree_visible(int visible) {
+  if (visible == tree_visible)
+    return;
+  tree_visible = visible;
+  tree_layout_valid = 0;
+  if (visible)
+    threads_visible = 0;
+  if (proc_win)
+    ui_resize();
+}
+
+// The process the selection belongs to, which for a thread row is the one
+// that owns it.
+int ui_selected_pid(void) {
+  return selected_thread_of ? selected_thread_of : selected_pid;
+}
+
+void ui_draw(const CpuUsage *cpu, const memStats *mem_info,
+             int num_total_cpu_entries, const History *history,
+             const DiskInfo *disks, int num_disks,
+             const NetInfo *nets, int num_nets, double tcp_retrans_rate,
+             const CgroupInfo *cgroups, int num_cgroups,
+             const ProcessInfo *processes, int num_processes,
+             const SelfStats *self, unsigned long generation) {
+  unsigned long long started = now_ns();
+  // A summary line plus the busiest few interfaces; veths coming and going
+  // on a container host only change the layout around that size.
+  int net_rows = num_nets > 0 ? 1 + (num_nets < NET_PANEL_MAX_IFACES
+                                         ? num_nets
+                                         : NET_PANEL_MAX_IFACES)
+                              : 0;
+  if (num_total_cpu_entries != layout_cpu_entries ||
+      num_disks != layout_disk_entries || net_rows != layout_net_rows ||
+      self->num_stages != layout_stat_rows) {
+    layout_cpu_entries = num_total_cpu_entries;
+    layout_disk_entries = num_disks;
+    layout_net_rows = net_rows;
+    layout_stat_rows = self->num_stages;
+    ui_resize();
+  }
+  if (full_redraw) {
+    wnoutrefresh(stdscr);
+    draw_header();
+    char cpu_title[32];
+    snprintf(cpu_title, sizeof(cpu_title), "CPU [%s]",
+             history_tier_names[history_tier]);
+    werase(cpu_win);
+    draw_panel_border(cpu_win, cpu_title);
+    werase(mem_win);
+    draw_panel_border(mem_win, "Memory");
+    if (disk_win) {
+      werase(disk_win);
+      draw_panel_border(disk_win, "Disks");
+    }
+    if (net_win) {
+      werase(net_win);
+      draw_panel_border(net_win, "Network");
+    }
+    werase(proc_win);
+    if (cgroups_visible)
+      draw_panel_border(proc_win, "Cgroups");
+    // The process panel's title changes with the filter; it is drawn along
+    // with the rows.
+    drawn_proc_title[0] = '\0';
+    drawn_scroll_offset = -1;
+    wnoutrefresh(header_win);
+  } else if (header_dirty) {
+    draw_header();
+    wnoutrefresh(header_win);
+  }
+  header_dirty = 0;
+  draw_cpu_panel(cpu, num_total_cpu_entries, history);
+  draw_mem_panel(mem_info, history);
+  draw_disk_panel(disks, num_disks);
+  draw_net_panel(nets, num_nets, tcp_retrans_rate);
+  if (cgroups_visible)
+    draw_cgroup_panel(cgroups, num_cgroups);
+  else
+    draw_process_panel(processes, num_processes, generation);
   wnoutrefresh(cpu_win);
   wnoutrefresh(mem_win);
+  if (disk_win)
+    wnoutrefresh(disk_win);
+  if (net_win)
+    wnoutrefresh(net_win);
   wnoutrefresh(proc_win);
+  // Drawn whole every frame so it stays on top of repainted process rows.
+  if (stats_win) {
+    draw_stats_panel(self);
+    wnoutrefresh(stats_win);
+  }
   doupdate();
+  full_redraw = 0;
+  latency_record(&frame_latency, now_ns() - started);
 }
 
 static void format_memory_unit(char *buf, size_t buf_size, long kb) {
@@ -148,7 +711,34 @@ static void format_memory_unit(char *buf, size_t buf_size, long kb) {
 void draw_header(void) {
   werase(header_win);
   wbkgd(header_win, COLOR_PAIR(HEADER_PAIR));
-  mvwprintw(header_win, 0, 1, "Pulse - Sort: (c)pu/(p)id | (q)uit");
+  if (replaying)
+    mvwprintw(header_win, 0, 1,
+              "Pulse replay @ %s - (p)ause | (Left/Right) 10s | ([/]) 5m | "
+              "(-/+) speed | Sort: (c)pu/(i)o | (o) I/O | (/) filter | "
+              "(h)istory | (q)uit",
+              host_label);
+  else if (host_label[0])
+    mvwprintw(header_win, 0, 1,
+              "Pulse @ %s - Sort: (c)pu/(i)o | (o) I/O | (/) filter | "
+              "(h)istory | (Tab) host | (q)uit",
+              host_label);
+  else
+    mvwprintw(header_win, 0, 1,
+              "Pulse - Sort: (c)pu/(i)o | (o) I/O | (m)emory | "
+              "(t)hreads | (f) tree | (g)roups | (/) filter | (h)istory | "
+              "(s)tats | (q)uit");
+}
+
+void ui_set_host(const char *name) {
+  if (strcmp(name, host_label) == 0)
+    return;
+  snprintf(host_label, sizeof(host_label), "%s", name);
+  header_dirty = 1;
+}
+
+void ui_set_replaying(int on) {
+  replaying = on;
+  header_dirty = 1;
 }
 
 void draw_panel_border(WINDOW *win, const char *title) {
@@ -158,31 +748,123 @@ void draw_panel_border(WINDOW *win, const char *title) {
   wattroff(win, COLOR_PAIR(PANEL_BORDER_PAIR));
 }
 
-void draw_cpu_panel(const double *cpu_usage, int num_total_cpu_entries) {
-  werase(cpu_win);
-  draw_panel_border(cpu_win, "CPU");
+static const char *const spark_blocks[8] = {
+    "\xe2\x96\x81", "\xe2\x96\x82", "\xe2\x96\x83", "\xe2\x96\x84",
+    "\xe2\x96\x85", "\xe2\x96\x86", "\xe2\x96\x87", "\xe2\x96\x88"};
+static const char spark_ascii[] = "_.-:=+*#";
+
+// Appends `width` columns of one history series at the selected tier,
+// newest on the right and blank where there is no history yet. `out` needs
+// room for width * SPARK_BYTES more bytes.
+static int append_sparkline(char *out, int pos, const History *history,
+                            int series, int width) {
+  unsigned short samples[SPARK_MAX_WIDTH];
+  int n = history_read(history, series, history_tier, samples, width);
+  for (int i = n; i < width; ++i)
+    out[pos++] = ' ';
+  for (int i = 0; i < n; ++i) {
+    int level = samples[i] >> 13;
+    if (utf8_glyphs) {
+      memcpy(out + pos, spark_blocks[level], SPARK_BYTES);
+      pos += SPARK_BYTES;
+    } else {
+      out[pos++] = spark_ascii[level];
+    }
+  }
+  out[pos] = '\0';
+  return pos;
+}
+
+// Splits `width` columns between user, system, iowait and steal, rounding
+// the running total so the segments never add up to more than the bar.
+static void breakdown_ends(const CpuUsage *cpu, int i, int width,
+                           int ends[CPU_BAR_SEGMENTS]) {
+  const double shares[CPU_BAR_SEGMENTS] = {cpu->user[i], cpu->system[i],
+                                           cpu->iowait[i], cpu->steal[i]};
+  double sum = 0.0;
+  for (int s = 0; s < CPU_BAR_SEGMENTS; ++s) {
+    sum += shares[s];
+    int end = (int)(sum * width / 100.0 + 0.5);
+    ends[s] = end < width ? end : width;
+  }
+}
+
+static void draw_cpu_cell(int y, int x, const char *cell, int bar_start,
+                          const int ends[CPU_BAR_SEGMENTS]) {
+  if (!has_colors()) {
+    mvwaddstr(cpu_win, y, x, cell);
+    return;
+  }
+  mvwaddnstr(cpu_win, y, x, cell, bar_start);
+  int drawn = 0;
+  for (int s = 0; s < CPU_BAR_SEGMENTS; ++s) {
+    wattron(cpu_win, COLOR_PAIR(CPU_USER_PAIR + s));
+    for (; drawn < ends[s]; ++drawn)
+      waddch(cpu_win, '|');
+    wattroff(cpu_win, COLOR_PAIR(CPU_USER_PAIR + s));
+  }
+  waddstr(cpu_win, cell + bar_start + drawn);
+}
+
+void draw_cpu_panel(const CpuUsage *cpu, int num_total_cpu_entries,
+                    const History *history) {
   int panel_width = getmaxx(cpu_win);
   int num_cols =
       (panel_width > 2) ? (panel_width - 2) / CPU_ITEM_FIXED_WIDTH : 1;
   if (num_cols == 0)
     num_cols = 1;
   int col_width = (panel_width - 2) / num_cols;
+  // Each cell is the label, a user/system/iowait/steal bar and a sparkline.
+  int label_width = CPU_LABEL_WIDTH;
+  int graphs_width = col_width - 3 - CPU_LABEL_WIDTH;
+  int bar_width = graphs_width / 2;
+  if (bar_width > CPU_BAR_MAX_WIDTH)
+    bar_width = CPU_BAR_MAX_WIDTH;
+  int spark_width = graphs_width - bar_width;
+  if (spark_width > SPARK_MAX_WIDTH)
+    spark_width = SPARK_MAX_WIDTH;
+  if (spark_width < SPARK_MIN_WIDTH) {
+    bar_width = spark_width = 0;
+    label_width = col_width > 1 ? col_width - 1 : 0;
+  }
 
+  // Bars are cached as distinct per-mode glyphs so that a shift between
+  // modes repaints the cell even when the total is unchanged.
+  static const char bar_glyphs[CPU_BAR_SEGMENTS] = {'|', '+', 'w', '!'};
+  char cell[CPU_ITEM_FIXED_WIDTH + CPU_BAR_MAX_WIDTH +
+            SPARK_MAX_WIDTH * SPARK_BYTES];
   for (int i = 0; i < num_total_cpu_entries; ++i) {
     int row = i / num_cols;
     int col = i % num_cols;
-    char buffer[32];
-    (i == 0) ? snprintf(buffer, sizeof(buffer), "Aggr: %.1f%%", cpu_usage[i])
-             : snprintf(buffer, sizeof(buffer), "CPU%d: %.1f%%", i - 1,
-                        cpu_usage[i]);
-    mvwprintw(cpu_win, row + 1, col * col_width + 2, "%-*s", col_width, buffer);
+    if (row + 1 >= getmaxy(cpu_win) - 1)
+      break;
+    char label[32];
+    (i == 0) ? snprintf(label, sizeof(label), "Aggr: %.1f%%", cpu->usage[i])
+             : snprintf(label, sizeof(label), "CPU%d: %.1f%%", i - 1,
+                        cpu->usage[i]);
+    int len = snprintf(cell, sizeof(cell), "%-*.*s", label_width,
+                       label_width, label);
+    int bar_start = len;
+    int ends[CPU_BAR_SEGMENTS] = {0};
+    if (spark_width > 0) {
+      cell[len++] = ' ';
+      bar_start = len;
+      breakdown_ends(cpu, i, bar_width, ends);
+      for (int s = 0, x = 0; s < CPU_BAR_SEGMENTS; ++s)
+        for (; x < ends[s]; ++x)
+          cell[len++] = bar_glyphs[s];
+      while (len < bar_start + bar_width)
+        cell[len++] = ' ';
+      cell[len++] = ' ';
+      append_sparkline(cell, len, history, history_cpu_series(history, i),
+                       spark_width);
+    }
+    if (line_cache_update(&cpu_cells, i, cell))
+      draw_cpu_cell(row + 1, col * col_width + 2, cell, bar_start, ends);
   }
 }
 
-void draw_mem_panel(const memStats *mem_info) {
-  werase(mem_win);
-  draw_panel_border(mem_win, "Memory");
-
+void draw_mem_panel(const memStats *mem_info, const History *history) {
   unsigned long mem_used =
       mem_info->memTotal > 0 ? mem_info->memTotal - mem_info->memAvailable : 0;
   unsigned long swap_used =
@@ -202,42 +884,332 @@ void draw_mem_panel(const memStats *mem_info) {
   snprintf(swap_display_str, sizeof(swap_display_str), "Swap: %s/%s",
            swap_used_str, swap_total_str);
 
-  mvwprintw(mem_win, 1, 2, mem_display_str);
-  mvwprintw(mem_win, 1, 4 + strlen(mem_display_str), swap_display_str);
+  // Memory and swap each get half the line: the totals, then a sparkline of
+  // the used percentage when there is room for one.
+  int width = getmaxx(mem_win) - 4;
+  int spark_width = (width - 2) / 2 - MEM_LABEL_WIDTH - 1;
+  if (spark_width > SPARK_MAX_WIDTH)
+    spark_width = SPARK_MAX_WIDTH;
+  char line[2 * (MEM_LABEL_WIDTH + SPARK_MAX_WIDTH * SPARK_BYTES) + 160];
+  if (spark_width < SPARK_MIN_WIDTH) {
+    snprintf(line, sizeof(line), "%s  %s", mem_display_str, swap_display_str);
+    if (line_cache_update(&mem_lines, 0, line))
+      mvwprintw(mem_win, 1, 2, "%-*.*s", width, width, line);
+    return;
+  }
+
+  int pos = snprintf(line, sizeof(line), "%-*.*s ", MEM_LABEL_WIDTH,
+                     MEM_LABEL_WIDTH, mem_display_str);
+  pos = append_sparkline(line, pos, history, history_mem_series(history),
+                         spark_width);
+  pos += snprintf(line + pos, sizeof(line) - pos, "  %-*.*s ",
+                  MEM_LABEL_WIDTH, MEM_LABEL_WIDTH, swap_display_str);
+  append_sparkline(line, pos, history, history_swap_series(history),
+                   spark_width);
+  if (line_cache_update(&mem_lines, 0, line))
+    mvwaddstr(mem_win, 1, 2, line);
+}
+
+void draw_disk_panel(const DiskInfo *disks, int num_disks) {
+  if (!disk_win)
+    return;
+  int rows = getmaxy(disk_win) - 2;
+  int width = getmaxx(disk_win) - 4;
+  for (int i = 0; i < num_disks && i < rows; ++i) {
+    const DiskInfo *d = &disks[i];
+    char read_str[16], write_str[16], line[160];
+    format_memory_unit(read_str, sizeof(read_str), (long)(d->read_rate / 1024));
+    format_memory_unit(write_str, sizeof(write_str),
+                       (long)(d->write_rate / 1024));
+    snprintf(line, sizeof(line),
+             "%-10.10s Read: %7s/s  Write: %7s/s  IOPS: %6.0f/%-6.0f "
+             "Util: %5.1f%%",
+             d->name, read_str, write_str, d->read_iops, d->write_iops,
+             d->utilization);
+    if (line_cache_update(&disk_lines, i, line))
+      mvwprintw(disk_win, i + 1, 2, "%-*.*s", width, width, line);
+  }
+}
+
+void draw_net_panel(const NetInfo *nets, int num_nets,
+                    double tcp_retrans_rate) {
+  if (!net_win)
+    return;
+  int rows = getmaxy(net_win) - 2;
+  int width = getmaxx(net_win) - 4;
+  if (rows < 1)
+    return;
+
+  double rx_total = 0.0, tx_total = 0.0;
+  for (int i = 0; i < num_nets; ++i) {
+    rx_total += nets[i].rx_rate;
+    tx_total += nets[i].tx_rate;
+  }
+  char rx_str[16], tx_str[16], retrans_str[32], line[160];
+  format_memory_unit(rx_str, sizeof(rx_str), (long)(rx_total / 1024));
+  format_memory_unit(tx_str, sizeof(tx_str), (long)(tx_total / 1024));
+  if (tcp_retrans_rate >= 0.0)
+    snprintf(retrans_str, sizeof(retrans_str), "%.1f/s", tcp_retrans_rate);
+  else
+    snprintf(retrans_str, sizeof(retrans_str), "n/a");
+  snprintf(line, sizeof(line),
+           "Total RX: %s/s  TX: %s/s  Interfaces: %d  TCP retrans: %s",
+           rx_str, tx_str, num_nets, retrans_str);
+  if (line_cache_update(&net_lines, 0, line))
+    mvwprintw(net_win, 1, 2, "%-*.*s", width, width, line);
+
+  for (int i = 0; i < num_nets && i + 1 < rows; ++i) {
+    const NetInfo *n = &nets[i];
+    format_memory_unit(rx_str, sizeof(rx_str), (long)(n->rx_rate / 1024));
+    format_memory_unit(tx_str, sizeof(tx_str), (long)(n->tx_rate / 1024));
+    snprintf(line, sizeof(line),
+             "%-15.15s RX: %7s/s %7.0f pkt/s  TX: %7s/s %7.0f pkt/s  "
+             "Drops: %.0f/%.0f",
+             n->name, rx_str, n->rx_packets, tx_str, n->tx_packets,
+             n->rx_drops, n->tx_drops);
+    if (line_cache_update(&net_lines, i + 1, line))
+      mvwprintw(net_win, i + 2, 2, "%-*.*s", width, width, line);
+  }
+}
+
+// Row `i` of the table, which skips whatever the filter or collapsed
+// subtrees hide.
+static const ProcessInfo *table_row(const ProcessInfo *processes, int i) {
+  return row_map ? &processes[row_map[i]] : &processes[i];
+}
+
+// A subtree's rows follow its root and the root knows how many there are,
+// so a collapsed one is skipped in a single step however big it is.
+static int layout_tree(const ProcessInfo *processes, int num_processes,
+                       unsigned long generation) {
+  if (tree_layout_valid && generation == tree_layout_generation)
+    return num_tree_rows;
+  if (num_processes > tree_row_capacity) {
+    int *grown = realloc(tree_rows, sizeof(int) * num_processes);
+    if (!grown)
+      return num_tree_rows = 0;
+    tree_rows = grown;
+    tree_row_capacity = num_processes;
+  }
+  num_tree_rows = 0;
+  for (int i = 0; i < num_processes; ++i) {
+    tree_rows[num_tree_rows++] = i;
+    if (num_collapsed_pids > 0 && processes[i].descendants > 0 &&
+        pid_collapsed(processes[i].stats.pid))
+      i += processes[i].descendants;
+  }
+  tree_layout_valid = 1;
+  tree_layout_generation = generation;
+  return num_tree_rows;
+}
+
+// Narrows the table to the rows matching the query. The index only has to
+// catch up with a new snapshot, and only re-matches when the query or the
+// rows changed. It starts catching up as soon as '/' is pressed, so the
+// first character typed doesn't wait for a full sync.
+static int apply_filter(const ProcessInfo *processes, int num_processes,
+                        unsigned long generation) {
+  if (filter_ready && (filter_editing || filter_query[0]))
+    filter_sync(&name_filter, processes, num_processes, generation);
+  if (!filter_query[0] || !filter_ready) {
+    filter_query[0] = '\0';
+    if (applied_query[0])
+      filter_reset(&name_filter);
+    applied_query[0] = '\0';
+    return num_processes;
+  }
+  if (generation == applied_generation &&
+      strcmp(filter_query, applied_query) == 0)
+    return name_filter.num_matches;
+  applied_generation = generation;
+  snprintf(applied_query, sizeof(applied_query), "%s", filter_query);
+  return filter_apply(&name_filter, filter_query);
+}
+
+// Finds the selected row again after a new snapshot moved it and keeps it
+// inside the window; if it is gone, whatever took its place is selected.
+static void follow_selection(const ProcessInfo *processes, int num_rows,
+                             int drawable_height) {
+  for (int i = 0; i < num_rows && selected_pid > 0; ++i) {
+    const ProcessInfo *p = table_row(processes, i);
+    if (p->stats.pid == selected_pid && p->thread_of == selected_thread_of) {
+      selected_index = i;
+      break;
+    }
+  }
+  if (selected_index >= num_rows)
+    selected_index = num_rows - 1;
+  if (selected_index < 0)
+    selected_index = 0;
+  selected_pid = selected_thread_of = 0;
+  if (num_rows == 0)
+    return;
+  const ProcessInfo *selected = table_row(processes, selected_index);
+  selected_pid = selected->stats.pid;
+  selected_thread_of = selected->thread_of;
+  selected_has_children = selected->descendants > 0;
+  if (selected_index < scroll_offset)
+    scroll_offset = selected_index;
+  else if (selected_index >= scroll_offset + drawable_height)
+    scroll_offset = selected_index - drawable_height + 1;
+}
+
+// Keeps drawn_pids sorted; a screen holds few enough rows to insert.
+static void remember_drawn_pid(int pid) {
+  if (num_drawn_pids == UI_MAX_VISIBLE_PIDS)
+    return;
+  int i = num_drawn_pids++;
+  for (; i > 0 && drawn_pids[i - 1] > pid; --i)
+    drawn_pids[i] = drawn_pids[i - 1];
+  drawn_pids[i] = pid;
 }
 
-void draw_process_panel(const ProcessInfo *processes, int num_processes) {
-  werase(proc_win);
-  draw_panel_border(proc_win, "Processes");
+void draw_process_panel(const ProcessInfo *processes, int num_processes,
+                        unsigned long generation) {
   int width = getmaxx(proc_win);
   int height = getmaxy(proc_win);
   int drawable_height = height - 3;
   if (drawable_height < 1)
     return;
+  int filtered = apply_filter(processes, num_processes, generation);
+  row_map = NULL;
+  if (filter_query[0]) {
+    row_map = name_filter.matches;
+    num_processes = filtered;
+  } else if (tree_visible) {
+    num_processes = layout_tree(processes, num_processes, generation);
+    row_map = tree_rows;
+  }
+  num_visible_rows = num_processes;
+  follow_selection(processes, num_processes, drawable_height);
 
-  wattron(proc_win, COLOR_PAIR(PROC_HEADER_PAIR));
-  mvwprintw(proc_win, 1, 1, "%-6s %-20s %-5s %-6s %-8s %-8s", "PID", "COMMAND",
-            "S", "CPU%", "VIRT", "RES");
-  for (int x = 62; x < width - 1; ++x)
-    mvwaddch(proc_win, 1, x, ' ');
-  wattroff(proc_win, COLOR_PAIR(PROC_HEADER_PAIR));
+  char title[sizeof(drawn_proc_title)];
+  int len = snprintf(title, sizeof(title), "%s",
+                     tree_visible      ? "Process tree"
+                     : threads_visible ? "Processes and threads"
+                                       : "Processes");
+  if (filter_editing || filter_query[0])
+    snprintf(title + len, sizeof(title) - len, " [/%s%s]", filter_query,
+             filter_editing ? "_" : "");
+  if (strcmp(title, drawn_proc_title) != 0) {
+    draw_panel_border(proc_win, title);
+    snprintf(drawn_proc_title, sizeof(drawn_proc_title), "%s", title);
+  }
+
+  if (full_redraw) {
+    char header[160];
+    int len = 0;
+    if (tree_visible)
+      len = snprintf(header, sizeof(header),
+                     "%-6s %-30s %-5s %-6s %-8s %-6s %-8s", "PID", "COMMAND",
+                     "S", "CPU%", "RES", "TREE%", "TREE RES");
+    else
+      len = snprintf(header, sizeof(header), "%-6s %-20s %-5s %-6s %-8s %-8s",
+                     "PID", "COMMAND", "S", "CPU%", "VIRT", "RES");
+    if (threads_visible)
+      len += snprintf(header + len, sizeof(header) - len, " %-4s", "CPU#");
+    if (io_visible)
+      len += snprintf(header + len, sizeof(header) - len, " %-9s %-9s",
+                      "READ/s", "WRITE/s");
+    if (memory_visible)
+      snprintf(header + len, sizeof(header) - len, " %-8s %-8s %-8s", "PSS",
+               "USS", "SWAP");
+    wattron(proc_win, COLOR_PAIR(PROC_HEADER_PAIR));
+    mvwprintw(proc_win, 1, 1, "%-*.*s", width - 2, width - 2, header);
+    wattroff(proc_win, COLOR_PAIR(PROC_HEADER_PAIR));
+  }
 
+  // Leave the rightmost interior column to the scrollbar.
+  int row_width = width - 3;
+  if (row_width < 1)
+    return;
+  char row[512];
+  if (row_width >= (int)sizeof(row))
+    row_width = sizeof(row) - 1;
+  int selected_row = num_processes > 0 ? selected_index - scroll_offset : -1;
+  if (selected_row != drawn_selected_row) {
+    line_cache_invalidate(&proc_rows, drawn_selected_row);
+    line_cache_invalidate(&proc_rows, selected_row);
+    drawn_selected_row = selected_row;
+  }
+  num_drawn_pids = 0;
   for (int i = 0; i < drawable_height; ++i) {
     int proc_index = scroll_offset + i;
-    if (proc_index >= num_processes)
-      break;
-
-    const ProcessInfo *p = &processes[proc_index];
-    char cmd[21], virt_str[16], res_str[16];
-    snprintf(cmd, sizeof(cmd), "%.20s", p->stats.comm);
-    format_memory_unit(virt_str, sizeof(virt_str), p->stats.vsize / 1024);
-    format_memory_unit(res_str, sizeof(res_str), p->stats.rss * 4);
-
-    mvwprintw(proc_win, i + 2, 1, "%-6d %-20s %-5c %-6.1f %-8s %-8s",
-              p->stats.pid, cmd, p->stats.state, p->cpu_percent, virt_str,
-              res_str);
+    char line[160] = "";
+    if (proc_index < num_processes) {
+      const ProcessInfo *p = table_row(processes, proc_index);
+      char cmd[64], virt_str[16], res_str[16];
+      format_memory_unit(virt_str, sizeof(virt_str), p->stats.vsize / 1024);
+      format_memory_unit(res_str, sizeof(res_str), p->stats.rss_kb);
+      int len = 0;
+      if (tree_visible) {
+        // "+" marks a collapsed subtree, "-" an expanded one.
+        char marker = ' ';
+        if (p->descendants > 0)
+          marker = pid_collapsed(p->stats.pid) ? '+' : '-';
+        int indent = p->depth * 2 < 20 ? p->depth * 2 : 20;
+        char tree_res[16];
+        format_memory_unit(tree_res, sizeof(tree_res), p->tree_rss);
+        snprintf(cmd, sizeof(cmd), "%*s%c %.28s", indent, "", marker,
+                 p->stats.comm);
+        len = snprintf(line, sizeof(line),
+                       "%-6d %-30.30s %-5c %-6.1f %-8s %-6.1f %-8s",
+                       p->stats.pid, cmd, p->stats.state, p->cpu_percent,
+                       res_str, p->tree_cpu, tree_res);
+      } else {
+        // Threads are indented under the process they belong to.
+        if (p->thread_of)
+          snprintf(cmd, sizeof(cmd), "  %.18s", p->stats.comm);
+        else
+          snprintf(cmd, sizeof(cmd), "%.20s", p->stats.comm);
+        len = snprintf(line, sizeof(line), "%-6d %-20s %-5c %-6.1f %-8s %-8s",
+                       p->stats.pid, cmd, p->stats.state, p->cpu_percent,
+                       virt_str, res_str);
+      }
+      if (threads_visible)
+        len += snprintf(line + len, sizeof(line) - len, " %-4d",
+                        p->stats.processor);
+      if (io_visible) {
+        char read_str[16] = "-", write_str[16] = "-";
+        if (p->stats.has_io) {
+          format_memory_unit(read_str, sizeof(read_str),
+                             (long)(p->read_rate / 1024));
+          format_memory_unit(write_str, sizeof(write_str),
+                             (long)(p->write_rate / 1024));
+        }
+        len += snprintf(line + len, sizeof(line) - len, " %-9s %-9s",
+                        read_str, write_str);
+      }
+      if (memory_visible) {
+        char pss_str[16] = "-", uss_str[16] = "-", swap_str[16] = "-";
+        if (p->has_smaps) {
+          format_memory_unit(pss_str, sizeof(pss_str), (long)p->smaps.pss);
+          format_memory_unit(uss_str, sizeof(uss_str), (long)p->smaps.uss);
+          format_memory_unit(swap_str, sizeof(swap_str),
+                             (long)p->smaps.swap);
+        }
+        snprintf(line + len, sizeof(line) - len, " %-8s %-8s %-8s", pss_str,
+                 uss_str, swap_str);
+      }
+      if (memory_visible && !p->thread_of)
+        remember_drawn_pid(p->stats.pid);
+    }
+    snprintf(row, row_width + 1, "%-*s", row_width, line);
+    if (!line_cache_update(&proc_rows, i, row))
+      continue;
+    if (i == selected_row)
+      wattron(proc_win, A_REVERSE);
+    mvwaddnstr(proc_win, i + 2, 1, row, row_width);
+    if (i == selected_row)
+      wattroff(proc_win, A_REVERSE);
   }
 
+  if (scroll_offset == drawn_scroll_offset &&
+      num_processes == drawn_num_processes)
+    return;
+  drawn_scroll_offset = scroll_offset;
+  drawn_num_processes = num_processes;
+  mvwvline(proc_win, 2, width - 2, ' ', drawable_height);
   int max_scroll = num_processes - drawable_height;
   if (max_scroll > 0) {
     double scroll_percent = (double)scroll_offset / max_scroll;
@@ -250,3 +1222,146 @@ void draw_process_panel(const ProcessInfo *processes, int num_processes) {
     wattroff(proc_win, COLOR_PAIR(SCROLL_THUMB_PAIR));
   }
 }
+
+// Rows of the cgroup table: every group not inside a collapsed one.
+static void layout_cgroups(const CgroupInfo *cgroups, int num_cgroups) {
+  if (num_cgroups > visible_cgroup_capacity) {
+    int *grown = realloc(visible_cgroups, sizeof(int) * num_cgroups);
+    if (!grown) {
+      num_visible_cgroups = 0;
+      return;
+    }
+    visible_cgroups = grown;
+    visible_cgroup_capacity = num_cgroups;
+  }
+  num_visible_cgroups = 0;
+  int hide_below = -1;
+  for (int i = 0; i < num_cgroups; ++i) {
+    if (hide_below >= 0 && cgroups[i].depth > hide_below)
+      continue;
+    hide_below = -1;
+    visible_cgroups[num_visible_cgroups++] = i;
+    if (num_collapsed_cgroups > 0 && find_collapsed(cgroups[i].path) >= 0)
+      hide_below = cgroups[i].depth;
+  }
+}
+
+// Follows the selected group by path, as the process table follows a pid.
+static void follow_cgroup_selection(const CgroupInfo *cgroups,
+                                    int drawable_height) {
+  for (int row = 0; row < num_visible_cgroups && selected_cgroup[0]; ++row) {
+    if (strcmp(cgroups[visible_cgroups[row]].path, selected_cgroup) == 0) {
+      cgroup_selected = row;
+      break;
+    }
+  }
+  if (cgroup_selected >= num_visible_cgroups)
+    cgroup_selected = num_visible_cgroups - 1;
+  if (cgroup_selected < 0)
+    cgroup_selected = 0;
+  selected_cgroup[0] = '\0';
+  if (num_visible_cgroups == 0)
+    return;
+  snprintf(selected_cgroup, sizeof(selected_cgroup), "%s",
+           cgroups[visible_cgroups[cgroup_selected]].path);
+  if (cgroup_selected < cgroup_scroll)
+    cgroup_scroll = cgroup_selected;
+  else if (cgroup_selected >= cgroup_scroll + drawable_height)
+    cgroup_scroll = cgroup_selected - drawable_height + 1;
+}
+
+void draw_cgroup_panel(const CgroupInfo *cgroups, int num_cgroups) {
+  int width = getmaxx(proc_win);
+  int drawable_height = getmaxy(proc_win) - 3;
+  if (drawable_height < 1)
+    return;
+  layout_cgroups(cgroups, num_cgroups);
+  follow_cgroup_selection(cgroups, drawable_height);
+
+  if (full_redraw) {
+    char header[128];
+    snprintf(header, sizeof(header), "%-40s %6s %-6s %-8s %s", "CGROUP",
+             "PROCS", "CPU%", "MEM", "MEM PSI some/full");
+    wattron(proc_win, COLOR_PAIR(PROC_HEADER_PAIR));
+    mvwprintw(proc_win, 1, 1, "%-*.*s", width - 2, width - 2, header);
+    wattroff(proc_win, COLOR_PAIR(PROC_HEADER_PAIR));
+  }
+
+  int row_width = width - 3;
+  if (row_width < 1)
+    return;
+  char row[512];
+  if (row_width >= (int)sizeof(row))
+    row_width = sizeof(row) - 1;
+  int selected_row =
+      num_visible_cgroups > 0 ? cgroup_selected - cgroup_scroll : -1;
+  if (selected_row != drawn_selected_row) {
+    line_cache_invalidate(&proc_rows, drawn_selected_row);
+    line_cache_invalidate(&proc_rows, selected_row);
+    drawn_selected_row = selected_row;
+  }
+  for (int i = 0; i < drawable_height; ++i) {
+    int index = cgroup_scroll + i;
+    char line[256] = "";
+    if (num_cgroups == 0 && i == 0) {
+      snprintf(line, sizeof(line), "No cgroup v2 hierarchy found");
+    } else if (index < num_visible_cgroups) {
+      int c = visible_cgroups[index];
+      const CgroupInfo *g = &cgroups[c];
+      // "+" marks a collapsed group, "-" an expanded one with children.
+      int has_children = c + 1 < num_cgroups && cgroups[c + 1].depth > g->depth;
+      char marker = ' ';
+      if (has_children)
+        marker = find_collapsed(g->path) >= 0 ? '+' : '-';
+      const char *name = strrchr(g->path, '/');
+      name = name && name[1] ? name + 1 : g->path;
+      char label[64], mem_str[16] = "-", psi_str[32] = "-";
+      int indent = g->depth * 2 < 20 ? g->depth * 2 : 20;
+      snprintf(label, sizeof(label), "%*s%c %.40s", indent, "", marker, name);
+      if (g->has_memory)
+        format_memory_unit(mem_str, sizeof(mem_str),
+                           (long)(g->memory_bytes / 1024));
+      if (g->has_pressure)
+        snprintf(psi_str, sizeof(psi_str), "%.2f/%.2f", g->pressure_some,
+                 g->pressure_full);
+      snprintf(line, sizeof(line), "%-40.40s %6d %-6.1f %-8s %s", label,
+               g->num_procs, g->cpu_percent, mem_str, psi_str);
+    }
+    snprintf(row, row_width + 1, "%-*s", row_width, line);
+    if (!line_cache_update(&proc_rows, i, row))
+      continue;
+    if (i == selected_row)
+      wattron(proc_win, A_REVERSE);
+    mvwaddnstr(proc_win, i + 2, 1, row, row_width);
+    if (i == selected_row)
+      wattroff(proc_win, A_REVERSE);
+  }
+}
+
+static void draw_stat_row(int row, const char *name,
+                          const LatencyHistogram *latency) {
+  if (latency->total == 0)
+    mvwprintw(stats_win, row, 2, "%-8s %9s %9s", name, "-", "-");
+  else
+    mvwprintw(stats_win, row, 2, "%-8s %9.3f %9.3f", name,
+              latency_percentile(latency, 0.5),
+              latency_percentile(latency, 0.99));
+}
+
+void draw_stats_panel(const SelfStats *self) {
+  werase(stats_win);
+  draw_panel_border(stats_win, "Pulse");
+  wattron(stats_win, A_BOLD);
+  mvwprintw(stats_win, 1, 2, "%-8s %9s %9s", "ms", "p50", "p99");
+  wattroff(stats_win, A_BOLD);
+  int row = 2;
+  for (int s = 0; s < self->num_stages; ++s)
+    draw_stat_row(row++, self->stage_names[s], &self->stages[s]);
+  draw_stat_row(row++, "tick", &self->tick);
+  draw_stat_row(row++, "drift", &self->drift);
+  draw_stat_row(row++, "frame", &frame_latency);
+  mvwprintw(stats_win, row++, 2, "%-8s %9llu", "dropped", self->overruns);
+  char rss[16];
+  format_memory_unit(rss, sizeof(rss), self->rss_kb);
+  mvwprintw(stats_win, row, 2, "cpu %.1f%%  rss %s", self->cpu_percent, rss);
+}
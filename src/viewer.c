@@ -0,0 +1,282 @@
+#include "../include/viewer.h"
+#include "../include/sockets.h"
+#include "../include/timing.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define VIEWER_RETRY_MS 2000
+#define VIEWER_READ_CHUNK 65536
+
+int viewer_init(Viewer *viewer, const char *const *addresses,
+                int num_addresses, SnapshotExchange *exchange) {
+  memset(viewer, 0, sizeof(*viewer));
+  viewer->exchange = exchange;
+  viewer->stop_fd = viewer->wake_fd = -1;
+  wire_state_init(&viewer->scratch);
+  atomic_init(&viewer->selected, 0);
+  atomic_init(&viewer->sort_column, SORT_CPU);
+  atomic_init(&viewer->sort_depth, 0);
+  viewer->hosts = calloc(num_addresses, sizeof(ViewerHost));
+  if (!viewer->hosts) {
+    viewer_destroy(viewer);
+    return 0;
+  }
+  viewer->num_hosts = num_addresses;
+  for (int i = 0; i < num_addresses; ++i) {
+    ViewerHost *host = &viewer->hosts[i];
+    host->address = addresses[i];
+    host->fd = -1;
+    snprintf(host->name, sizeof(host->name), "%s", addresses[i]);
+    wire_state_init(&host->state);
+  }
+  viewer->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  viewer->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (viewer->stop_fd < 0 || viewer->wake_fd < 0) {
+    viewer_destroy(viewer);
+    return 0;
+  }
+  return 1;
+}
+
+// The last sample stays on screen, marked offline, until the host is back
+// and has sent a keyframe.
+static void disconnect(ViewerHost *host, unsigned long long now_ms) {
+  if (host->fd >= 0)
+    close(host->fd);
+  host->fd = -1;
+  host->connecting = 0;
+  host->synced = 0;
+  host->in_len = 0;
+  host->retry_at_ms = now_ms + VIEWER_RETRY_MS;
+}
+
+static int handle_frame(ViewerHost *host, WireState *scratch, int type,
+                        const unsigned char *payload, size_t len) {
+  if (type == WIRE_HELLO) {
+    char name[sizeof(host->name)];
+    if (!wire_decode_hello(payload, len, name, sizeof(name)))
+      return 0;
+    if (name[0])
+      memcpy(host->name, name, sizeof(name));
+    return 1;
+  }
+  if (type == WIRE_DELTA && !host->synced)
+    return 0;
+  if (!wire_decode(&host->state, scratch, type, payload, len)) {
+    wire_state_clear(&host->state);
+    return 0;
+  }
+  host->synced = 1;
+  return 1;
+}
+
+// Reads what has arrived and applies every complete frame. Returns how
+// many samples came in, or -1 if the connection has to be dropped.
+static int read_host(ViewerHost *host, WireState *scratch) {
+  while (1) {
+    if (host->in_capacity - host->in_len < VIEWER_READ_CHUNK) {
+      size_t capacity = host->in_capacity * 2;
+      if (capacity < host->in_len + VIEWER_READ_CHUNK)
+        capacity = host->in_len + VIEWER_READ_CHUNK;
+      unsigned char *in = realloc(host->in, capacity);
+      if (!in)
+        return -1;
+      host->in = in;
+      host->in_capacity = capacity;
+    }
+    ssize_t n = recv(host->fd, host->in + host->in_len,
+                     host->in_capacity - host->in_len, 0);
+    if (n == 0)
+      return -1;
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      return -1;
+    }
+    host->in_len += n;
+  }
+
+  int samples = 0;
+  size_t pos = 0;
+  while (host->in_len - pos >= WIRE_HEADER_SIZE) {
+    const unsigned char *frame = host->in + pos;
+    size_t len = frame[1] | (size_t)frame[2] << 8 | (size_t)frame[3] << 16 |
+                 (size_t)frame[4] << 24;
+    if (len > WIRE_FRAME_MAX)
+      return -1;
+    if (host->in_len - pos - WIRE_HEADER_SIZE < len)
+      break;
+    if (!handle_frame(host, scratch, frame[0], frame + WIRE_HEADER_SIZE,
+                      len))
+      return -1;
+    if (frame[0] != WIRE_HELLO)
+      samples++;
+    pos += WIRE_HEADER_SIZE + len;
+  }
+  memmove(host->in, host->in + pos, host->in_len - pos);
+  host->in_len -= pos;
+  return samples;
+}
+
+// Agents send processes by pid; the order the UI asked for is made here.
+static void publish(Viewer *viewer) {
+  int selected = atomic_load(&viewer->selected);
+  const ViewerHost *host = &viewer->hosts[selected];
+  const WireState *state = &host->state;
+  int sorted = wire_order(&viewer->order, state,
+                          atomic_load(&viewer->sort_column),
+                          atomic_load(&viewer->sort_depth));
+  if (sorted < 0)
+    return;
+
+  Snapshot *snapshot = snapshot_back(viewer->exchange);
+  if (!wire_to_snapshot(state, viewer->order.indices, snapshot))
+    return;
+  snapshot->sorted_count = sorted;
+  snapshot->source = selected;
+  // Agents on one machine share a host name; their addresses tell them
+  // apart.
+  const char *status = host->fd < 0      ? " [offline]"
+                       : !host->synced ? " [connecting]"
+                                       : "";
+  if (strcmp(host->name, host->address) == 0)
+    snprintf(snapshot->source_name, sizeof(snapshot->source_name), "%s%s",
+             host->name, status);
+  else
+    snprintf(snapshot->source_name, sizeof(snapshot->source_name),
+             "%s (%s)%s", host->name, host->address, status);
+  snapshot_publish(viewer->exchange);
+}
+
+static void *viewer_thread(void *arg) {
+  Viewer *viewer = arg;
+  struct pollfd *fds = calloc(viewer->num_hosts + 2, sizeof(struct pollfd));
+  if (!fds)
+    return NULL;
+  int dirty = 1;
+  while (1) {
+    unsigned long long now = now_ns() / 1000000;
+    int timeout = -1;
+    fds[0] = (struct pollfd){.fd = viewer->stop_fd, .events = POLLIN};
+    fds[1] = (struct pollfd){.fd = viewer->wake_fd, .events = POLLIN};
+    for (int i = 0; i < viewer->num_hosts; ++i) {
+      ViewerHost *host = &viewer->hosts[i];
+      if (host->fd < 0 && now >= host->retry_at_ms) {
+        host->fd = socket_connect(host->address);
+        host->connecting = host->fd >= 0;
+        if (host->fd < 0)
+          host->retry_at_ms = now + VIEWER_RETRY_MS;
+      }
+      if (host->fd < 0) {
+        int wait = (int)(host->retry_at_ms - now);
+        if (timeout < 0 || wait < timeout)
+          timeout = wait;
+      }
+      // poll() skips negative descriptors.
+      fds[2 + i] = (struct pollfd){
+          .fd = host->fd, .events = host->connecting ? POLLOUT : POLLIN};
+    }
+    if (dirty) {
+      publish(viewer);
+      dirty = 0;
+    }
+
+    if (poll(fds, viewer->num_hosts + 2, timeout) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (fds[0].revents & POLLIN)
+      break;
+    if (fds[1].revents & POLLIN) {
+      uint64_t pending;
+      ssize_t drained = read(viewer->wake_fd, &pending, sizeof(pending));
+      (void)drained;
+      dirty = 1;
+    }
+
+    now = now_ns() / 1000000;
+    int selected = atomic_load(&viewer->selected);
+    for (int i = 0; i < viewer->num_hosts; ++i) {
+      ViewerHost *host = &viewer->hosts[i];
+      short revents = fds[2 + i].revents;
+      if (!revents)
+        continue;
+      int alive = 1;
+      if (host->connecting) {
+        alive = socket_error(host->fd) == 0;
+        host->connecting = 0;
+      } else {
+        int samples = read_host(host, &viewer->scratch);
+        alive = samples >= 0;
+        if (samples > 0 && i == selected)
+          dirty = 1;
+      }
+      if (!alive) {
+        disconnect(host, now);
+        if (i == selected)
+          dirty = 1;
+      }
+    }
+  }
+  free(fds);
+  return NULL;
+}
+
+int viewer_start(Viewer *viewer) {
+  if (pthread_create(&viewer->thread, NULL, viewer_thread, viewer) != 0)
+    return 0;
+  viewer->thread_started = 1;
+  return 1;
+}
+
+// Called from the UI thread on every pass; only a change wakes the viewer
+// thread to publish again.
+void viewer_set_view(Viewer *viewer, int selected, SortColumn sort_column,
+                     int sort_depth) {
+  if (selected < 0 || selected >= viewer->num_hosts)
+    selected = 0;
+  int changed = atomic_exchange(&viewer->selected, selected) != selected;
+  changed |= atomic_exchange(&viewer->sort_column, (int)sort_column) !=
+             (int)sort_column;
+  changed |= atomic_exchange(&viewer->sort_depth, sort_depth) != sort_depth;
+  if (changed) {
+    uint64_t one = 1;
+    ssize_t written = write(viewer->wake_fd, &one, sizeof(one));
+    (void)written;
+  }
+}
+
+void viewer_destroy(Viewer *viewer) {
+  if (viewer->thread_started) {
+    uint64_t one = 1;
+    if (write(viewer->stop_fd, &one, sizeof(one)) < 0)
+      perror("pulse: viewer stop");
+    pthread_join(viewer->thread, NULL);
+  }
+  for (int i = 0; i < viewer->num_hosts; ++i) {
+    ViewerHost *host = &viewer->hosts[i];
+    if (host->fd >= 0)
+      close(host->fd);
+    free(host->in);
+    wire_state_destroy(&host->state);
+  }
+  free(viewer->hosts);
+  if (viewer->stop_fd >= 0)
+    close(viewer->stop_fd);
+  if (viewer->wake_fd >= 0)
+    close(viewer->wake_fd);
+  wire_state_destroy(&viewer->scratch);
+  wire_order_destroy(&viewer->order);
+  memset(viewer, 0, sizeof(*viewer));
+  viewer->stop_fd = viewer->wake_fd = -1;
+}
@@ -0,0 +1,743 @@
+#include "../include/wire.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A changed process record starts with a mask: WIRE_NEW for a process the
+// other side has not seen (or whose pid was reused, or which exec'd), then
+// one bit per field that follows.
+#define WIRE_NEW 1u
+#define FIELD_BIT(f) (2u << (f))
+#define WIRE_MAX_CPU_ENTRIES 65536
+#define WIRE_MAX_DEVICES 65536
+
+typedef struct {
+  const unsigned char *p;
+  const unsigned char *end;
+  int failed;
+} WireReader;
+
+void wire_state_init(WireState *state) { memset(state, 0, sizeof(*state)); }
+
+void wire_state_destroy(WireState *state) {
+  free(state->cpu);
+  free(state->disks);
+  free(state->nets);
+  free(state->procs);
+  free(state->keys);
+  memset(state, 0, sizeof(*state));
+}
+
+// Back to an empty sample, keeping the allocations.
+void wire_state_clear(WireState *state) {
+  state->timestamp_ms = 0;
+  state->sampled = 0;
+  state->num_cpu_entries = 0;
+  memset(state->mem, 0, sizeof(state->mem));
+  state->tcp_retrans = 0;
+  state->num_disks = 0;
+  state->num_nets = 0;
+  state->num_procs = 0;
+}
+
+static int grow_capacity(int capacity, int needed) {
+  int grown = capacity + capacity / 2;
+  return grown > needed ? grown : needed;
+}
+
+static int reserve_cpu(WireState *state, int entries) {
+  if (entries <= state->cpu_capacity)
+    return 1;
+  int capacity = grow_capacity(state->cpu_capacity, entries);
+  long long *cpu =
+      realloc(state->cpu, sizeof(long long) * WIRE_CPU_MODES * capacity);
+  if (!cpu)
+    return 0;
+  state->cpu = cpu;
+  state->cpu_capacity = capacity;
+  return 1;
+}
+
+static int reserve_devices(WireDevice **devices, int *capacity, int needed) {
+  if (needed <= *capacity)
+    return 1;
+  int grown = grow_capacity(*capacity, needed);
+  WireDevice *items = realloc(*devices, sizeof(WireDevice) * grown);
+  if (!items)
+    return 0;
+  *devices = items;
+  *capacity = grown;
+  return 1;
+}
+
+static int reserve_procs(WireState *state, int needed) {
+  if (needed <= state->proc_capacity)
+    return 1;
+  int capacity = grow_capacity(state->proc_capacity, needed);
+  WireProcess *procs = realloc(state->procs, sizeof(WireProcess) * capacity);
+  if (!procs)
+    return 0;
+  state->procs = procs;
+  state->proc_capacity = capacity;
+  return 1;
+}
+
+// Two halves: the keys and room for one radix pass.
+static int reserve_keys(WireState *state, int needed) {
+  if (needed <= state->key_capacity)
+    return 1;
+  int capacity = grow_capacity(state->key_capacity, needed);
+  unsigned long long *keys =
+      realloc(state->keys, sizeof(unsigned long long) * 2 * capacity);
+  if (!keys)
+    return 0;
+  state->keys = keys;
+  state->key_capacity = capacity;
+  return 1;
+}
+
+// Half away from zero, as llround() but inline: it runs for every field of
+// every process on every tick. NaN and values out of range become 0.
+static long long rounded(double value) {
+  if (!(value > -9e18 && value < 9e18))
+    return 0;
+  return (long long)(value < 0 ? value - 0.5 : value + 0.5);
+}
+
+static long long hundredths(double value) { return rounded(value * 100.0); }
+
+#define RADIX_BITS 11
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+// Sorts pid << 32 | index keys by pid, least significant digit first. Pids
+// are at most 22 bits in practice, so the top pass is usually skipped.
+// Returns whichever half ended up holding the result.
+static unsigned long long *radix_sort_pids(unsigned long long *keys,
+                                           unsigned long long *tmp,
+                                           int count) {
+  for (int shift = 32; shift < 64; shift += RADIX_BITS) {
+    int counts[RADIX_SIZE] = {0};
+    for (int i = 0; i < count; ++i)
+      counts[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+    if (counts[(keys[0] >> shift) & (RADIX_SIZE - 1)] == count)
+      continue;
+    int offset = 0;
+    for (int d = 0; d < RADIX_SIZE; ++d) {
+      int n = counts[d];
+      counts[d] = offset;
+      offset += n;
+    }
+    for (int i = 0; i < count; ++i)
+      tmp[counts[(keys[i] >> shift) & (RADIX_SIZE - 1)]++] = keys[i];
+    unsigned long long *swap = keys;
+    keys = tmp;
+    tmp = swap;
+  }
+  return keys;
+}
+
+static void capture_process(WireProcess *w, const ProcessInfo *p) {
+  const pidStats *stats = &p->stats;
+  w->pid = stats->pid;
+  w->starttime = stats->starttime;
+  size_t len = strnlen(stats->comm, sizeof(w->comm) - 1);
+  memcpy(w->comm, stats->comm, len);
+  w->comm[len] = '\0';
+  w->fields[WIRE_PPID] = stats->ppid;
+  w->fields[WIRE_STATE] = (unsigned char)stats->state;
+  w->fields[WIRE_PROCESSOR] = stats->processor;
+  w->fields[WIRE_VSIZE_KB] = stats->vsize / 1024;
+  w->fields[WIRE_RSS_KB] = stats->rss_kb;
+  w->fields[WIRE_CPU] = hundredths(p->cpu_percent);
+  w->fields[WIRE_MEM] = hundredths(p->mem_percent);
+  w->fields[WIRE_READ_RATE] = rounded(p->read_rate);
+  w->fields[WIRE_WRITE_RATE] = rounded(p->write_rate);
+  w->fields[WIRE_HAS_IO] = stats->has_io;
+}
+
+// Reduces a published snapshot to its wire form. Returns 0 if out of
+// memory, leaving `state` unusable until the next successful capture.
+int wire_capture(WireState *state, const Snapshot *snapshot) {
+  int entries = snapshot->num_total_cpu_entries;
+  if (!reserve_cpu(state, entries) ||
+      !reserve_devices(&state->disks, &state->disk_capacity,
+                       snapshot->num_disks) ||
+      !reserve_devices(&state->nets, &state->net_capacity,
+                       snapshot->num_nets) ||
+      !reserve_procs(state, snapshot->num_processes) ||
+      !reserve_keys(state, snapshot->num_processes))
+    return 0;
+
+  state->timestamp_ms = snapshot->timestamp_ms;
+  state->sampled = snapshot->sampled;
+  state->num_cpu_entries = entries;
+  const double *modes[WIRE_CPU_MODES] = {
+      snapshot->cpu.usage, snapshot->cpu.user, snapshot->cpu.system,
+      snapshot->cpu.iowait, snapshot->cpu.steal};
+  for (int m = 0; m < WIRE_CPU_MODES; ++m) {
+    for (int i = 0; i < entries; ++i)
+      state->cpu[m * entries + i] = hundredths(modes[m][i]);
+  }
+  const memStats *mem = &snapshot->mem_info;
+  state->mem[0] = mem->memTotal;
+  state->mem[1] = mem->memAvailable;
+  state->mem[2] = mem->swapTotal;
+  state->mem[3] = mem->swapFree;
+  state->tcp_retrans = hundredths(snapshot->tcp_retrans_rate);
+
+  state->num_disks = snapshot->num_disks;
+  for (int i = 0; i < snapshot->num_disks; ++i) {
+    const DiskInfo *d = &snapshot->disks[i];
+    WireDevice *w = &state->disks[i];
+    memcpy(w->name, d->name, sizeof(w->name));
+    w->name[sizeof(w->name) - 1] = '\0';
+    w->fields[0] = rounded(d->read_rate);
+    w->fields[1] = rounded(d->write_rate);
+    w->fields[2] = hundredths(d->read_iops);
+    w->fields[3] = hundredths(d->write_iops);
+    w->fields[4] = hundredths(d->utilization);
+    w->fields[5] = 0;
+  }
+  state->num_nets = snapshot->num_nets;
+  for (int i = 0; i < snapshot->num_nets; ++i) {
+    const NetInfo *n = &snapshot->nets[i];
+    WireDevice *w = &state->nets[i];
+    memcpy(w->name, n->name, sizeof(w->name));
+    w->name[sizeof(w->name) - 1] = '\0';
+    w->fields[0] = rounded(n->rx_rate);
+    w->fields[1] = rounded(n->tx_rate);
+    w->fields[2] = hundredths(n->rx_packets);
+    w->fields[3] = hundredths(n->tx_packets);
+    w->fields[4] = hundredths(n->rx_drops);
+    w->fields[5] = hundredths(n->tx_drops);
+  }
+
+  // The collector lists processes in scan or sort order; the wire wants
+  // them by pid, which a scan of the real /proc already is. Otherwise only
+  // the keys are sorted, and each record is then written straight to its
+  // place while the snapshot is read front to back.
+  unsigned long long *keys = state->keys;
+  int count = 0, sorted = 1;
+  int last_pid = 0;
+  for (int i = 0; i < snapshot->num_processes; ++i) {
+    const ProcessInfo *p = &snapshot->processed_list[i];
+    if (p->thread_of || p->stats.pid <= 0)
+      continue;
+    if (p->stats.pid <= last_pid)
+      sorted = 0;
+    last_pid = p->stats.pid;
+    keys[count++] = (unsigned long long)p->stats.pid << 32 | (unsigned)i;
+  }
+  if (sorted) {
+    for (int i = 0; i < count; ++i)
+      capture_process(&state->procs[i],
+                      &snapshot->processed_list[keys[i] & 0xffffffffu]);
+    state->num_procs = count;
+    return 1;
+  }
+
+  unsigned long long *spare = state->keys + state->key_capacity;
+  keys = radix_sort_pids(keys, spare, count);
+  unsigned long long *places = keys == spare ? state->keys : spare;
+  for (int i = 0; i < snapshot->num_processes; ++i)
+    places[i] = ULLONG_MAX;
+  int kept = 0;
+  for (int i = 0; i < count; ++i) {
+    if (i > 0 && keys[i] >> 32 == keys[i - 1] >> 32)
+      continue;
+    places[keys[i] & 0xffffffffu] = kept++;
+  }
+  for (int i = 0; i < snapshot->num_processes; ++i) {
+    if (places[i] != ULLONG_MAX)
+      capture_process(&state->procs[places[i]],
+                      &snapshot->processed_list[i]);
+  }
+  count = kept;
+  state->num_procs = count;
+  return 1;
+}
+
+static void put_varint(OutBuf *out, unsigned long long value) {
+  char bytes[10];
+  int n = 0;
+  while (value >= 0x80) {
+    bytes[n++] = (char)(value | 0x80);
+    value >>= 7;
+  }
+  bytes[n++] = (char)value;
+  outbuf_mem(out, bytes, n);
+}
+
+// Zigzag: small values of either sign stay short.
+static void put_signed(OutBuf *out, long long value) {
+  put_varint(out, ((unsigned long long)value << 1) ^
+                      (unsigned long long)(value >> 63));
+}
+
+static void put_string(OutBuf *out, const char *text) {
+  size_t len = strlen(text);
+  put_varint(out, len);
+  outbuf_mem(out, text, len);
+}
+
+static size_t begin_frame(OutBuf *out, WireFrameType type) {
+  size_t start = out->len;
+  char header[WIRE_HEADER_SIZE] = {(char)type};
+  outbuf_mem(out, header, sizeof(header));
+  return start;
+}
+
+static void end_frame(OutBuf *out, size_t start) {
+  if (out->failed)
+    return;
+  size_t len = out->len - start - WIRE_HEADER_SIZE;
+  for (int i = 0; i < 4; ++i)
+    out->data[start + 1 + i] = (char)(len >> (8 * i));
+}
+
+void wire_encode_hello(OutBuf *out, const char *host) {
+  size_t start = begin_frame(out, WIRE_HELLO);
+  put_varint(out, WIRE_VERSION);
+  put_string(out, host);
+  end_frame(out, start);
+}
+
+// Devices come and go rarely, so their names are only sent when the list
+// changed, and then against all-zero values. After that come the devices
+// whose values changed, by index gap as for processes, each with a mask of
+// the fields that follow.
+static void encode_devices(OutBuf *out, const WireDevice *prev, int num_prev,
+                           const WireDevice *curr, int num_curr) {
+  int renamed = num_prev != num_curr;
+  for (int i = 0; !renamed && i < num_curr; ++i)
+    renamed = strcmp(prev[i].name, curr[i].name) != 0;
+  put_varint(out, num_curr);
+  put_varint(out, renamed);
+  for (int i = 0; renamed && i < num_curr; ++i)
+    put_string(out, curr[i].name);
+  int last = -1;
+  for (int i = 0; i < num_curr; ++i) {
+    const long long *base = renamed ? NULL : prev[i].fields;
+    unsigned int mask = 0;
+    for (int f = 0; f < WIRE_DEVICE_FIELDS; ++f) {
+      if (curr[i].fields[f] != (base ? base[f] : 0))
+        mask |= 1u << f;
+    }
+    if (!mask)
+      continue;
+    put_varint(out, i - last);
+    last = i;
+    put_varint(out, mask);
+    for (int f = 0; f < WIRE_DEVICE_FIELDS; ++f) {
+      if (mask & (1u << f))
+        put_signed(out, curr[i].fields[f] - (base ? base[f] : 0));
+    }
+  }
+  put_varint(out, 0);
+}
+
+static unsigned int changed_fields(const WireProcess *prev,
+                                   const WireProcess *curr) {
+  unsigned int mask = 0;
+  for (int f = 0; f < WIRE_PROCESS_FIELDS; ++f) {
+    if (curr->fields[f] != (prev ? prev->fields[f] : 0))
+      mask |= FIELD_BIT(f);
+  }
+  return mask;
+}
+
+// Two lists, each ascending by pid with every pid sent as the gap from the
+// one before and a zero gap ending the list: the pids that exited, then
+// the processes that are new or changed. Unchanged processes cost nothing.
+static void encode_processes(OutBuf *out, const WireState *prev,
+                             const WireState *curr) {
+  int j = 0, last = 0;
+  for (int i = 0; i < prev->num_procs; ++i) {
+    int pid = prev->procs[i].pid;
+    while (j < curr->num_procs && curr->procs[j].pid < pid)
+      j++;
+    if (j == curr->num_procs || curr->procs[j].pid != pid) {
+      put_varint(out, pid - last);
+      last = pid;
+    }
+  }
+  put_varint(out, 0);
+
+  int i = 0;
+  last = 0;
+  for (j = 0; j < curr->num_procs; ++j) {
+    const WireProcess *p = &curr->procs[j];
+    while (i < prev->num_procs && prev->procs[i].pid < p->pid)
+      i++;
+    const WireProcess *old = NULL;
+    if (i < prev->num_procs && prev->procs[i].pid == p->pid &&
+        prev->procs[i].starttime == p->starttime &&
+        strcmp(prev->procs[i].comm, p->comm) == 0)
+      old = &prev->procs[i];
+    unsigned int mask = changed_fields(old, p) | (old ? 0 : WIRE_NEW);
+    if (!mask)
+      continue;
+    put_varint(out, p->pid - last);
+    last = p->pid;
+    put_varint(out, mask);
+    if (!old) {
+      put_varint(out, p->starttime);
+      put_string(out, p->comm);
+    }
+    for (int f = 0; f < WIRE_PROCESS_FIELDS; ++f) {
+      if (mask & FIELD_BIT(f))
+        put_signed(out, p->fields[f] - (old ? old->fields[f] : 0));
+    }
+  }
+  put_varint(out, 0);
+}
+
+// Appends one frame taking `prev` to `curr`; with no `prev` it is a
+// keyframe, which is the same encoding against an empty sample.
+void wire_encode(OutBuf *out, const WireState *prev, const WireState *curr) {
+  static const WireState empty;
+  size_t start = begin_frame(out, prev ? WIRE_DELTA : WIRE_KEYFRAME);
+  if (!prev)
+    prev = &empty;
+
+  put_signed(out, (long long)(curr->timestamp_ms - prev->timestamp_ms));
+  put_varint(out, curr->sampled);
+  int entries = curr->num_cpu_entries;
+  int same_cpus = entries == prev->num_cpu_entries;
+  put_varint(out, entries);
+  for (int k = 0; k < WIRE_CPU_MODES * entries; ++k)
+    put_signed(out, curr->cpu[k] - (same_cpus ? prev->cpu[k] : 0));
+  for (int k = 0; k < WIRE_MEM_FIELDS; ++k)
+    put_signed(out, curr->mem[k] - prev->mem[k]);
+  put_signed(out, curr->tcp_retrans - prev->tcp_retrans);
+  encode_devices(out, prev->disks, prev->num_disks, curr->disks,
+                 curr->num_disks);
+  encode_devices(out, prev->nets, prev->num_nets, curr->nets, curr->num_nets);
+  encode_processes(out, prev, curr);
+  end_frame(out, start);
+}
+
+static unsigned long long get_varint(WireReader *in) {
+  unsigned long long value = 0;
+  for (int shift = 0; shift < 64 && in->p < in->end; shift += 7) {
+    unsigned char byte = *in->p++;
+    value |= (unsigned long long)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return value;
+  }
+  in->failed = 1;
+  return 0;
+}
+
+static long long get_signed(WireReader *in) {
+  unsigned long long value = get_varint(in);
+  return (long long)((value >> 1) ^ (0 - (value & 1)));
+}
+
+static void get_string(WireReader *in, char *out, size_t size) {
+  unsigned long long len = get_varint(in);
+  out[0] = '\0';
+  if (in->failed || len > (unsigned long long)(in->end - in->p)) {
+    in->failed = 1;
+    return;
+  }
+  size_t kept = len < size ? len : size - 1;
+  memcpy(out, in->p, kept);
+  out[kept] = '\0';
+  in->p += len;
+}
+
+// Deltas come off the network; wrap rather than overflow on nonsense.
+static long long add_delta(long long value, long long delta) {
+  return (long long)((unsigned long long)value + (unsigned long long)delta);
+}
+
+int wire_decode_hello(const unsigned char *payload, size_t len, char *host,
+                      size_t host_size) {
+  WireReader in = {payload, payload + len, 0};
+  if (get_varint(&in) != WIRE_VERSION)
+    return 0;
+  get_string(&in, host, host_size);
+  return !in.failed;
+}
+
+static int decode_devices(WireReader *in, WireDevice **devices, int *count,
+                          int *capacity) {
+  unsigned long long n = get_varint(in);
+  unsigned long long renamed = get_varint(in);
+  if (in->failed || n > WIRE_MAX_DEVICES || renamed > 1 ||
+      (!renamed && n != (unsigned long long)*count) ||
+      !reserve_devices(devices, capacity, (int)n))
+    return 0;
+  for (int i = 0; renamed && i < (int)n; ++i) {
+    WireDevice *d = &(*devices)[i];
+    get_string(in, d->name, sizeof(d->name));
+    memset(d->fields, 0, sizeof(d->fields));
+  }
+  *count = (int)n;
+  long long index = -1;
+  while (1) {
+    unsigned long long gap = get_varint(in);
+    if (in->failed || gap > (unsigned long long)(n - 1 - index))
+      return 0;
+    if (!gap)
+      return 1;
+    index += gap;
+    unsigned long long mask = get_varint(in);
+    if (in->failed || mask >> WIRE_DEVICE_FIELDS)
+      return 0;
+    WireDevice *d = &(*devices)[index];
+    for (int f = 0; f < WIRE_DEVICE_FIELDS; ++f) {
+      if (mask & (1u << f))
+        d->fields[f] = add_delta(d->fields[f], get_signed(in));
+    }
+  }
+}
+
+static WireProcess *append_process(WireState *state) {
+  if (!reserve_procs(state, state->num_procs + 1))
+    return NULL;
+  return &state->procs[state->num_procs++];
+}
+
+// Exited processes are marked with pid 0 in place, then the old list and
+// the changes are merged into `scratch`, which becomes the new list.
+static int decode_processes(WireReader *in, WireState *state,
+                            WireState *scratch) {
+  unsigned long long pid = 0;
+  int i = 0;
+  while (1) {
+    unsigned long long gap = get_varint(in);
+    if (in->failed || gap > INT_MAX - pid)
+      return 0;
+    if (!gap)
+      break;
+    pid += gap;
+    while (i < state->num_procs && state->procs[i].pid < (int)pid)
+      i++;
+    if (i < state->num_procs && state->procs[i].pid == (int)pid)
+      state->procs[i++].pid = 0;
+  }
+
+  scratch->num_procs = 0;
+  pid = 0;
+  i = 0;
+  while (1) {
+    unsigned long long gap = get_varint(in);
+    if (in->failed || gap > INT_MAX - pid)
+      return 0;
+    pid += gap;
+    while (i < state->num_procs && (!gap || state->procs[i].pid < (int)pid)) {
+      if (state->procs[i].pid) {
+        WireProcess *kept = append_process(scratch);
+        if (!kept)
+          return 0;
+        *kept = state->procs[i];
+      }
+      i++;
+    }
+    if (!gap)
+      break;
+
+    const WireProcess *old = NULL;
+    if (i < state->num_procs && state->procs[i].pid == (int)pid)
+      old = &state->procs[i++];
+    unsigned long long mask = get_varint(in);
+    WireProcess *p = append_process(scratch);
+    if (in->failed || mask >> (WIRE_PROCESS_FIELDS + 1) || !p)
+      return 0;
+    if (mask & WIRE_NEW) {
+      memset(p, 0, sizeof(*p));
+      p->pid = (int)pid;
+      p->starttime = get_varint(in);
+      get_string(in, p->comm, sizeof(p->comm));
+    } else if (old) {
+      *p = *old;
+    } else {
+      return 0;
+    }
+    for (int f = 0; f < WIRE_PROCESS_FIELDS; ++f) {
+      if (mask & FIELD_BIT(f))
+        p->fields[f] = add_delta(p->fields[f], get_signed(in));
+    }
+  }
+
+  WireProcess *procs = state->procs;
+  int capacity = state->proc_capacity;
+  state->procs = scratch->procs;
+  state->num_procs = scratch->num_procs;
+  state->proc_capacity = scratch->proc_capacity;
+  scratch->procs = procs;
+  scratch->proc_capacity = capacity;
+  scratch->num_procs = 0;
+  return !in->failed;
+}
+
+// Applies a keyframe or delta payload. Returns 0 on a malformed payload,
+// after which `state` is only good for the next keyframe.
+int wire_decode(WireState *state, WireState *scratch, int type,
+                const unsigned char *payload, size_t len) {
+  if (type == WIRE_KEYFRAME)
+    wire_state_clear(state);
+  else if (type != WIRE_DELTA)
+    return 0;
+  WireReader in = {payload, payload + len, 0};
+
+  state->timestamp_ms += (unsigned long long)get_signed(&in);
+  state->sampled = (unsigned int)get_varint(&in);
+  unsigned long long entries = get_varint(&in);
+  if (in.failed || entries > WIRE_MAX_CPU_ENTRIES)
+    return 0;
+  if ((int)entries != state->num_cpu_entries) {
+    if (!reserve_cpu(state, (int)entries))
+      return 0;
+    memset(state->cpu, 0, sizeof(long long) * WIRE_CPU_MODES * entries);
+    state->num_cpu_entries = (int)entries;
+  }
+  for (int k = 0; k < WIRE_CPU_MODES * (int)entries; ++k)
+    state->cpu[k] = add_delta(state->cpu[k], get_signed(&in));
+  for (int k = 0; k < WIRE_MEM_FIELDS; ++k)
+    state->mem[k] = add_delta(state->mem[k], get_signed(&in));
+  state->tcp_retrans = add_delta(state->tcp_retrans, get_signed(&in));
+  if (in.failed ||
+      !decode_devices(&in, &state->disks, &state->num_disks,
+                      &state->disk_capacity) ||
+      !decode_devices(&in, &state->nets, &state->num_nets,
+                      &state->net_capacity) ||
+      !decode_processes(&in, state, scratch))
+    return 0;
+  return in.p == in.end;
+}
+
+// The timestamp a keyframe or delta would give `state`, without applying
+// it. Returns 0 if the payload does not start with one.
+int wire_frame_timestamp(const WireState *state, int type,
+                         const unsigned char *payload, size_t len,
+                         unsigned long long *timestamp_ms) {
+  if (type != WIRE_KEYFRAME && type != WIRE_DELTA)
+    return 0;
+  WireReader in = {payload, payload + len, 0};
+  long long delta = get_signed(&in);
+  if (in.failed)
+    return 0;
+  *timestamp_ms = (type == WIRE_KEYFRAME ? 0 : state->timestamp_ms) +
+                  (unsigned long long)delta;
+  return 1;
+}
+
+// Orders the processes by `column`, exactly for the first `depth` (all of
+// them for 0), leaving order->indices for wire_to_snapshot. SORT_NONE
+// keeps them by pid. Returns how many lead in sorted order, or -1 if out of
+// memory.
+int wire_order(WireOrder *order, const WireState *state, SortColumn column,
+               int depth) {
+  int n = state->num_procs;
+  if (n > order->capacity) {
+    SortKey *keys = realloc(order->keys, sizeof(SortKey) * n);
+    if (keys)
+      order->keys = keys;
+    int *indices = realloc(order->indices, sizeof(int) * n);
+    if (indices)
+      order->indices = indices;
+    if (!keys || !indices)
+      return -1;
+    order->capacity = n;
+  }
+  if (column == SORT_NONE || n == 0) {
+    for (int i = 0; i < n; ++i)
+      order->indices[i] = i;
+    return n;
+  }
+  for (int i = 0; i < n; ++i) {
+    const long long *fields = state->procs[i].fields;
+    order->keys[i].value =
+        column == SORT_IO
+            ? (double)(fields[WIRE_READ_RATE] + fields[WIRE_WRITE_RATE])
+            : (double)fields[WIRE_CPU];
+    order->keys[i].pid = state->procs[i].pid;
+    order->keys[i].index = i;
+  }
+  int sorted = topk_select(order->keys, n, depth);
+  for (int i = 0; i < n; ++i)
+    order->indices[i] = order->keys[i].index;
+  return sorted;
+}
+
+void wire_order_destroy(WireOrder *order) {
+  free(order->keys);
+  free(order->indices);
+  memset(order, 0, sizeof(*order));
+}
+
+// Fills a snapshot for the UI, processes in `order` (indices into
+// state->procs) or, without one, by pid. Returns 0 if out of memory.
+int wire_to_snapshot(const WireState *state, const int *order,
+                     Snapshot *snapshot) {
+  int entries = state->num_cpu_entries;
+  if (!snapshot_reserve(snapshot, entries, state->num_procs,
+                        state->num_disks, state->num_nets))
+    return 0;
+
+  double *modes[WIRE_CPU_MODES] = {snapshot->cpu.usage, snapshot->cpu.user,
+                                   snapshot->cpu.system, snapshot->cpu.iowait,
+                                   snapshot->cpu.steal};
+  for (int m = 0; m < WIRE_CPU_MODES; ++m) {
+    for (int i = 0; i < entries; ++i)
+      modes[m][i] = state->cpu[m * entries + i] / 100.0;
+  }
+  snapshot->num_total_cpu_entries = entries;
+  snapshot->mem_info.memTotal = (unsigned long)state->mem[0];
+  snapshot->mem_info.memAvailable = (unsigned long)state->mem[1];
+  snapshot->mem_info.swapTotal = (unsigned long)state->mem[2];
+  snapshot->mem_info.swapFree = (unsigned long)state->mem[3];
+  snapshot->tcp_retrans_rate = state->tcp_retrans / 100.0;
+
+  for (int i = 0; i < state->num_disks; ++i) {
+    const WireDevice *w = &state->disks[i];
+    DiskInfo *d = &snapshot->disks[i];
+    memcpy(d->name, w->name, sizeof(d->name));
+    d->read_rate = (double)w->fields[0];
+    d->write_rate = (double)w->fields[1];
+    d->read_iops = w->fields[2] / 100.0;
+    d->write_iops = w->fields[3] / 100.0;
+    d->utilization = w->fields[4] / 100.0;
+  }
+  snapshot->num_disks = state->num_disks;
+  for (int i = 0; i < state->num_nets; ++i) {
+    const WireDevice *w = &state->nets[i];
+    NetInfo *n = &snapshot->nets[i];
+    memcpy(n->name, w->name, sizeof(n->name));
+    n->rx_rate = (double)w->fields[0];
+    n->tx_rate = (double)w->fields[1];
+    n->rx_packets = w->fields[2] / 100.0;
+    n->tx_packets = w->fields[3] / 100.0;
+    n->rx_drops = w->fields[4] / 100.0;
+    n->tx_drops = w->fields[5] / 100.0;
+  }
+  snapshot->num_nets = state->num_nets;
+
+  for (int k = 0; k < state->num_procs; ++k) {
+    const WireProcess *w = &state->procs[order ? order[k] : k];
+    ProcessInfo *p = &snapshot->processed_list[k];
+    memset(p, 0, sizeof(*p));
+    p->stats.pid = w->pid;
+    p->stats.starttime = w->starttime;
+    memcpy(p->stats.comm, w->comm, sizeof(w->comm));
+    p->stats.ppid = (int)w->fields[WIRE_PPID];
+    p->stats.state = (char)w->fields[WIRE_STATE];
+    p->stats.processor = (int)w->fields[WIRE_PROCESSOR];
+    p->stats.vsize = (long)w->fields[WIRE_VSIZE_KB] * 1024;
+    p->stats.rss_kb = (long)w->fields[WIRE_RSS_KB];
+    p->stats.has_io = (int)w->fields[WIRE_HAS_IO];
+    p->cpu_percent = w->fields[WIRE_CPU] / 100.0;
+    p->mem_percent = w->fields[WIRE_MEM] / 100.0;
+    p->read_rate = (double)w->fields[WIRE_READ_RATE];
+    p->write_rate = (double)w->fields[WIRE_WRITE_RATE];
+  }
+  snapshot->num_processes = state->num_procs;
+  snapshot->sorted_count = state->num_procs;
+  snapshot->num_cgroups = 0;
+  snapshot->timestamp_ms = state->timestamp_ms;
+  snapshot->sampled = state->sampled;
+  return 1;
+}